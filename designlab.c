@@ -1,23 +1,48 @@
-#include "pico/stdlib.h"
-#include "hardware/spi.h"
 #include <stdio.h>
 #include <stdbool.h>
-#include "hardware/watchdog.h"
-
-// pin definitions-adjust to wiring
-#define SPI_PORT spi0
-#define PIN_SPI_SCK 18  // SPI clock (SCK)
-#define PIN_SPI_MOSI 19 // SPI MOSI(controller->GPX2)
-#define PIN_SPI_MISO 16 // SPI MISO(GPX2->controller)
-#define PIN_SPI_CS 17   // chip select (SSN)
-#define PIN_GPX_INT 20  // GPX2 interrupt output
-
-// spi opcodes for tdc-gpx2
-#define OPC_POWER_RESET 0x30  // power-on reset
-#define OPC_INIT 0x18         // initialize chip and start measurement
-#define OPC_WRITE_CONFIG 0x80 // write configuration
-#define OPC_READ_CONFIG 0x40  // read configuration
-#define OPC_READ_RESULTS 0x60 // read measurement results
+#include <stdint.h>
+#include "gpx2_hal.h"
+#include "gpx2_results.h"
+#include "gpx2_ring.h"
+#include "gpx2_stream.h"
+#include "gpx2_hist.h"
+#include "gpx2_perf.h"
+#include "gpx2_time.h"
+#include "gpx2_coinc.h"
+#include "gpx2_profile.h"
+#include "gpx2_dev.h"
+#include "gpx2_text.h"
+#include "gpx2_gate.h"
+#include "gpx2_dnl.h"
+#include "gpx2_pack.h"
+#include "gpx2_stats.h"
+#include "gpx2_capture.h"
+#include "gpx2_crc.h"
+#include <string.h>
+
+// pin definitions-adjust to wiring, one row per GPX2. Chips on the same bus
+// share SCK/MOSI/MISO and need their own CS and INT, the first gpx2_ndev rows
+// are used
+typedef struct
+{
+    uint8_t bus;  // 0/1 -> spi0/spi1
+    uint8_t sck;  // SPI clock (SCK)
+    uint8_t mosi; // SPI MOSI(controller->GPX2)
+    uint8_t miso; // SPI MISO(GPX2->controller)
+    uint8_t cs;   // chip select (SSN)
+    uint8_t intr; // GPX2 interrupt output
+} gpx2_wiring_t;
+static const gpx2_wiring_t gpx2_wiring[GPX2_MAX_DEVICES] = {
+    {0, 18, 19, 16, 17, 20},
+    {1, 10, 11, 12, 13, 21},
+    {0, 18, 19, 16, 22, 26},
+    {1, 10, 11, 12, 9, 27}};
+
+// interrupt mode: max result transactions per INT edge before handing back to the main loop
+#define GPX2_IRQ_MAX_READS 16
+
+// binary output: a partly filled frame is sent after this long
+#define GPX2_STREAM_FLUSH_US 5000
 
 //spi speed in Hz
 // #define GPX2_SPI_SPEED_HZ (4*1000*1000)
@@ -31,13 +56,147 @@ static uint8_t gpx2_config[17] = {
     0x04};
 
 static uint8_t pins[4] = {0};
-bool measure = true;
+
+// chips in use, all run the same gpx2_config
+static gpx2_dev_t gpx2_dev[GPX2_MAX_DEVICES];
+static uint8_t gpx2_ndev = 1;
+static gpx2_sched_t gpx2_sched;
+static gpx2_sched_mode_t gpx2_sched_mode = GPX2_SCHED_ROUND_ROBIN;
 bool clk_reset = false;
+
+// acquisition state machine, stepped by whichever core owns the SPI bus so
+// every wait is bounded and commands stay responsive
+typedef enum
+{
+    GPX2_ACQ_IDLE = 0,        // not configured yet
+    GPX2_ACQ_CONFIGURING = 1, // power reset, config write + verify, OPC_INIT on the next step
+    GPX2_ACQ_ARMED = 2,       // measuring, INT high
+    GPX2_ACQ_READING = 3,     // INT low, bursts are read
+    GPX2_ACQ_PAUSED = 4,      // STOP inputs disabled (P)
+    GPX2_ACQ_ERROR = 5        // config did not verify, retried every GPX2_ACQ_RETRY_US
+} gpx2_acq_state_t;
+static const char *const gpx2_acq_names[] = {"idle", "configuring", "armed", "reading", "paused", "error"};
+static volatile gpx2_acq_state_t gpx2_acq_state = GPX2_ACQ_IDLE;
+static uint64_t gpx2_acq_since_us = 0;         // state entered
+static volatile uint32_t gpx2_acq_epoch = 0;   // OPC_INIT count, core0 resets the time bases on change
+static uint32_t gpx2_time_epoch = 0;           // epoch the time bases run in, core0 only
+static uint32_t gpx2_ring_stale = 0;           // ring frames of an earlier epoch, dropped by core0
+static volatile uint32_t gpx2_acq_reinits = 0; // stalled readouts restarted with OPC_INIT
+static volatile uint32_t gpx2_acq_reconfigs = 0; // chips found with a lost config
+static volatile uint32_t gpx2_acq_errors = 0;  // config writes that did not verify
+static volatile uint32_t gpx2_core1_beat = 0;  // core1 loop passes, the watchdog is only fed while it moves
+static bool gpx2_watchdog_boot = false;
+#define GPX2_INT_WAIT_US 1000        // longest INT wait per step
+#define GPX2_STALL_US 100000         // INT low this long without new hits counts as a stall
+#define GPX2_QUIET_CHECK_US 1000000  // this long without hits, the config is read back
+#define GPX2_ACQ_RETRY_US 1000000
+#define GPX2_WATCHDOG_MS 2000
 int gpx2_spi_speed_hz = (4*1000*1000);
 
+typedef enum
+{
+    GPX2_READOUT_POLL = 0, // main loop spins on the INT pins
+    GPX2_READOUT_IRQ = 1,  // falling edge irq reads into gpx2_ring
+    GPX2_READOUT_CORE1 = 2 // core1 owns the SPI bus and fills gpx2_ring, core0 does USB
+} gpx2_readout_mode_t;
+static gpx2_readout_mode_t gpx2_readout_mode = GPX2_READOUT_POLL;
+static bool gpx2_irq_armed = false;
+static gpx2_ring_t gpx2_ring;
+static gpx2_raw_ring_t gpx2_raw_ring; // record output mode, every frame as read
+static uint32_t gpx2_record_epoch = 0; // init count of the last SETUP frame
+
+// burst readout, 0 = pick from the FIFO mode when measurement starts
+static uint8_t gpx2_burst_limit = 0;
+static uint8_t gpx2_burst_frames = 1; // effective frames per transaction
+// one burst per bus per scheduler pass
+static gpx2_result_t gpx2_burst[GPX2_SPI_BUSES * GPX2_BURST_MAX];
+
+typedef enum
+{
+    GPX2_OUTPUT_TEXT = 0,  // one printf line per channel
+    GPX2_OUTPUT_BINARY = 1, // crc protected frames of 7 byte records, see gpx2_stream.h
+    GPX2_OUTPUT_NONE = 2,   // nothing per event, e.g. histogram only
+    GPX2_OUTPUT_CSV = 3,    // one csv line per frame, written in chunks, see gpx2_text.h
+    GPX2_OUTPUT_PACKED = 4, // binary frames of delta + varint coded raw events, see gpx2_pack.h
+    GPX2_OUTPUT_RECORD = 5  // raw result frames + setup for replay on the host, see gpx2_stream.h
+} gpx2_output_mode_t;
+static gpx2_output_mode_t gpx2_output_mode = GPX2_OUTPUT_TEXT;
+static gpx2_stream_t gpx2_stream;
+static uint64_t gpx2_stream_open_us = 0;
+static gpx2_pack_t gpx2_pack;
+static gpx2_text_t gpx2_text;
+static uint64_t gpx2_text_open_us = 0;
+
+// event data channel (menu R, U toggles): binary frames and csv go to the usb
+// console or the bulk endpoint (hal_bulk_*); menus, reports and text mode
+// lines always stay on the console
+#define GPX2_BULK_WAIT_US 20000 // longest wait for a free buffer before dropping
+static bool gpx2_bulk_enabled = false;
+static uint32_t gpx2_bulk_sent = 0;    // bytes
+static uint32_t gpx2_bulk_dropped = 0; // bytes, no host or host too slow
+
+// timestamp format of the text and binary outputs
+typedef enum
+{
+    GPX2_TIME_RAW = 0, // REF index and STOP fraction as read
+    GPX2_TIME_PS = 1   // absolute ps since OPC_INIT, REF rollover unwrapped
+} gpx2_time_format_t;
+static gpx2_time_format_t gpx2_time_format = GPX2_TIME_RAW;
+static uint32_t gpx2_refclk_period_ps = 200000; // matches the default REFCLK_DIVISIONS
+static gpx2_time_t gpx2_time[GPX2_MAX_DEVICES]; // every chip counts its own REF index
+
+// config profiles in flash, the default one is applied at boot without the menu
+#define GPX2_BOOT_TAG_MENU 0x4D454E55u // "MENU", M asks the next boot for the menu
+static gpx2_profile_store_t gpx2_profiles;
+// STOP nonlinearity correction tables (menu N), kept in their own flash sector
+static gpx2_dnl_store_t gpx2_dnl_store;
+static gpx2_dnl_t gpx2_dnl;            // tables of the running HIRES setting
+static gpx2_dnl_cal_t gpx2_dnl_cal;    // code density histograms of a calibration run
+static bool gpx2_dnl_active = false;
+#define GPX2_DNL_CAL_HITS 65536   // default calibration hits per channel, ~3% per bin
+#define GPX2_DNL_CAL_US 60000000  // calibration gives up after this long
+static const char *const gpx2_hires_names[GPX2_DNL_HIRES] = {"off", "2x", "4x"};
+// startup timing, hal_time_us() counts from reset
+static uint64_t gpx2_boot_config_us = 0; // measurement started
+static uint64_t gpx2_boot_first_us = 0;  // first event consumed
+
+// on-device STOP histograms, one per channel, dumped on request. Channels of
+// all chips are numbered dev * 4 + ch
+#define GPX2_ALL_CHANNELS (GPX2_MAX_DEVICES * GPX2_CHANNELS)
+static gpx2_hist_t gpx2_hist[GPX2_ALL_CHANNELS];
+static bool gpx2_hist_enabled = false;
+
+// coincidence stage, when enabled only dT results are output
+static gpx2_coinc_t gpx2_coinc;
+static bool gpx2_coinc_enabled = false;
+static gpx2_hist_t gpx2_dt_hist[GPX2_COINC_MAX_PAIRS];
+
+// event gate in front of histograms, coincidences and output
+static gpx2_gate_t gpx2_gate;
+static bool gpx2_gate_enabled = false;
+
+// live mean/sigma/min/max per channel and coincidence pair, reported every window
+#define GPX2_STATS_WINDOW_MS 1000
+static gpx2_stats_t gpx2_stats;
+static bool gpx2_stats_enabled = false;
+static int gpx2_stats_line = -1; // next report line to print, -1 when done
+
+// burst capture into flash: B records, D reads back; output pauses meanwhile
+#define GPX2_CAPTURE_DUMP_PAGES 4 // read back per loop pass
+static gpx2_capture_t gpx2_capture;
+static bool gpx2_capture_enabled = false;
+static uint32_t gpx2_capture_max_events = 0; // 0 = region full
+static uint32_t gpx2_capture_max_ms = 0;     // 0 = no limit
+static gpx2_capture_header_t gpx2_capture_dump; // header of the capture being read back
+static uint32_t gpx2_capture_dump_next = 0;     // next record to send
+static bool gpx2_capture_dumping = false;
+static uint16_t gpx2_capture_dump_crc;
+static uint32_t gpx2_capture_dump_dropped;      // hits that came in during the read back
+static const char *const gpx2_capture_names[] = {"idle", "erasing", "ready", "running", "spilling", "done", "failed"};
+
 static void restart()
 {
-    watchdog_reboot(0, 0, 0); // reboots the chip
+    hal_reboot(); // reboots the chip
 }
 
 /**
@@ -171,6 +330,276 @@ static void gpx2_set_cmos_input(uint8_t mode)
     gpx2_config[16]&=~(1<<2); //clear bit before setting
     gpx2_config[16] |= (mode << 2);
 }
+// bring up the buses and pins of the first gpx2_ndev rows of gpx2_wiring
+static void gpx2_devices_init(void)
+{
+    bool bus_up[GPX2_SPI_BUSES] = {false};
+    for (int i = 0; i < gpx2_ndev; i++)
+    {
+        const gpx2_wiring_t *w = &gpx2_wiring[i];
+        if (!bus_up[w->bus])
+        {
+            hal_spi_init(w->bus, gpx2_spi_speed_hz, w->sck, w->mosi, w->miso);
+            bus_up[w->bus] = true;
+        }
+        gpx2_dev_init(&gpx2_dev[i], (uint8_t)i, w->bus, w->cs, w->intr);
+    }
+    gpx2_sched_init(&gpx2_sched, gpx2_dev, gpx2_ndev, gpx2_sched_mode);
+}
+
+// copy a profile into the live config
+static void gpx2_profile_apply(const gpx2_profile_t *p)
+{
+    memcpy(gpx2_config, p->config, sizeof(gpx2_config));
+    memcpy(pins, p->pins, sizeof(pins));
+    gpx2_spi_speed_hz = (int)p->spi_speed_hz;
+    gpx2_ndev = (p->devices >= 1 && p->devices <= GPX2_MAX_DEVICES) ? p->devices : 1;
+    gpx2_sched_mode = p->sched ? GPX2_SCHED_PRIORITY : GPX2_SCHED_ROUND_ROBIN;
+    // menu 8 sets REFCLK_DIVISIONS to the period in ps
+    gpx2_refclk_period_ps = gpx2_config[3] | (gpx2_config[4] << 8) | ((gpx2_config[5] & 0x0F) << 16);
+}
+
+static void gpx2_profile_list(void)
+{
+    for (int i = 0; i < GPX2_PROFILE_SLOTS; i++)
+    {
+        const gpx2_profile_t *p = &gpx2_profiles.slot[i];
+        if (!gpx2_profile_valid(p))
+        {
+            printf("%d: <empty>\n", i + 1);
+            continue;
+        }
+        printf("%d: %-15s spi=%lu Hz chips=%u%s\n", i + 1, p->name, (unsigned long)p->spi_speed_hz,
+               p->devices ? p->devices : 1,
+               gpx2_profiles.default_slot == i ? " (boot default)" : "");
+    }
+}
+
+// profile sub menu, every change is written to flash right away
+static void gpx2_profile_menu(void)
+{
+    int action = 0, slot = 0;
+    char name[GPX2_PROFILE_NAME] = {0};
+    printf("\nProfiles: 0=list 1=save current 2=load 3=set boot default 4=delete: ");
+    scanf("%d", &action);
+    if (action == 0)
+    {
+        gpx2_profile_list();
+        return;
+    }
+    printf("Slot (1-%d%s): ", GPX2_PROFILE_SLOTS, action == 3 ? ", 0=no default" : "");
+    scanf("%d", &slot);
+    slot--;
+    if (slot < (action == 3 ? -1 : 0) || slot >= GPX2_PROFILE_SLOTS)
+    {
+        printf("Invalid slot\n");
+        return;
+    }
+    gpx2_profile_t *p = &gpx2_profiles.slot[slot < 0 ? 0 : slot];
+    switch (action)
+    {
+    case 1:
+        printf("Name (max %d chars): ", GPX2_PROFILE_NAME - 1);
+        scanf("%15s", name);
+        gpx2_profile_set(p, name, gpx2_config, pins, (uint32_t)gpx2_spi_speed_hz, gpx2_ndev,
+                         (uint8_t)gpx2_sched_mode);
+        break;
+    case 2:
+        if (!gpx2_profile_valid(p))
+        {
+            printf("Slot %d is empty\n", slot + 1);
+            return;
+        }
+        gpx2_profile_apply(p);
+        gpx2_devices_init();
+        printf("Profile '%s' loaded\n", p->name);
+        return;
+    case 3:
+        if (slot >= 0 && !gpx2_profile_valid(p))
+        {
+            printf("Slot %d is empty\n", slot + 1);
+            return;
+        }
+        gpx2_profiles.default_slot = slot < 0 ? GPX2_PROFILE_NONE : (uint8_t)slot;
+        break;
+    case 4:
+        memset(p, 0, sizeof(*p));
+        if (gpx2_profiles.default_slot == slot)
+            gpx2_profiles.default_slot = GPX2_PROFILE_NONE;
+        break;
+    default:
+        printf("Invalid action\n");
+        return;
+    }
+    printf(gpx2_profile_save(&gpx2_profiles) ? "Saved to flash\n" : "ERROR: flash write failed\n");
+}
+
+// event gate rules, channel by channel, applied to everything after readout
+static void gpx2_gate_menu(void)
+{
+    int input = 0, ref = 0;
+    unsigned long lo = 0, hi = 0;
+    long long wlo = 0, whi = 0;
+    printf("\nEnable event gate? (0/1): ");
+    scanf("%d", &input);
+    gpx2_gate_enabled = (input != 0);
+    if (!gpx2_gate_enabled)
+        return;
+    printf("Clear all rules? (0/1): ");
+    scanf("%d", &input);
+    if (input)
+        gpx2_gate_init(&gpx2_gate);
+    while (true)
+    {
+        printf("Channel to configure (1-%d, 0=done): ", gpx2_ndev * GPX2_CHANNELS);
+        scanf("%d", &input);
+        if (input <= 0 || input > gpx2_ndev * GPX2_CHANNELS)
+            return;
+        uint8_t ch = (uint8_t)(input - 1);
+        printf("STOP range lo hi (lo > hi = off): ");
+        scanf("%lu %lu", &lo, &hi);
+        gpx2_gate_set_stop(&gpx2_gate, ch, lo, hi);
+        printf("REF index range lo hi (lo > hi = off): ");
+        scanf("%lu %lu", &lo, &hi);
+        gpx2_gate_set_ref(&gpx2_gate, ch, lo, hi);
+        printf("Window reference channel (0=off): ");
+        scanf("%d", &ref);
+        if (ref > 0)
+        {
+            printf("Window lo hi, ps after the reference hit: ");
+            scanf("%lld %lld", &wlo, &whi);
+            if (!gpx2_gate_set_window(&gpx2_gate, ch, (uint8_t)(ref - 1), wlo, whi))
+                printf("Invalid reference channel, window off\n");
+        }
+        else
+        {
+            gpx2_gate_set_window(&gpx2_gate, ch, 0, 1, 0);
+        }
+        printf("Prescale, keep 1 in N (1=all): ");
+        scanf("%d", &input);
+        gpx2_gate_set_prescale(&gpx2_gate, ch, input > 1 ? (uint16_t)input : 1);
+    }
+}
+
+static void gpx2_stats_menu(void)
+{
+    int input = 0;
+    unsigned long window_ms = 0;
+    printf("\nEnable live statistics? (0/1): ");
+    scanf("%d", &input);
+    gpx2_stats_enabled = (input != 0);
+    if (!gpx2_stats_enabled)
+        return;
+    printf("Window in ms (default %d): ", GPX2_STATS_WINDOW_MS);
+    scanf("%lu", &window_ms);
+    if (window_ms == 0 || window_ms > 3600000)
+        window_ms = GPX2_STATS_WINDOW_MS;
+    printf("Channel value (0=interval between hits in ps, 1=STOP): ");
+    scanf("%d", &input);
+    gpx2_stats_setup(&gpx2_stats, (uint32_t)window_ms * 1000,
+                     input == 1 ? GPX2_STATS_STOP : GPX2_STATS_INTERVAL);
+    printf("Pairs are the coincidence pairs of menu I (dT in ps)\n");
+}
+
+static void gpx2_capture_menu(void)
+{
+    int input = 0;
+    unsigned long events = 0, ms = 0;
+    printf("\nEnable burst capture to flash? (0/1): ");
+    scanf("%d", &input);
+    gpx2_capture_enabled = (input != 0);
+    if (!gpx2_capture_enabled)
+        return;
+    printf("Stop after events (0=region full, max %lu): ", (unsigned long)GPX2_CAPTURE_MAX_RECORDS);
+    scanf("%lu", &events);
+    printf("Stop after ms (0=no limit): ");
+    scanf("%lu", &ms);
+    gpx2_capture_max_events = events > GPX2_CAPTURE_MAX_RECORDS ? GPX2_CAPTURE_MAX_RECORDS : (uint32_t)events;
+    gpx2_capture_max_ms = ms > 3600000 ? 3600000 : (uint32_t)ms;
+    // erased while measuring, every block stalls the readout ~45 ms and the
+    // chip FIFO overflows meanwhile; done here it costs no hits
+    printf("Erase the capture region now, so B starts without stalling the readout (drops a capture in flash)? (0/1): ");
+    scanf("%d", &input);
+    if (input == 0)
+        return;
+    if (!hal_capture_available())
+    {
+        printf("ERROR: firmware image reaches into the capture region\n");
+        return;
+    }
+    printf("Erasing %d blocks...\n", HAL_CAPTURE_SIZE / HAL_CAPTURE_BLOCK);
+    uint64_t t0 = hal_time_us();
+    bool ok = gpx2_capture_erase_region();
+    printf(ok ? "Erased in %lu ms\n" : "ERROR: capture flash did not verify after %lu ms\n",
+           (unsigned long)((hal_time_us() - t0) / 1000));
+}
+
+// DNL tables of every HIRES setting
+static void gpx2_dnl_list(void)
+{
+    int n = 0;
+    for (int h = 0; h < GPX2_DNL_HIRES; h++)
+    {
+        for (int ch = 0; ch < GPX2_DNL_CHANNELS; ch++)
+        {
+            const gpx2_dnl_table_t *t = &gpx2_dnl_store.table[h][ch];
+            if (t->hits == 0)
+                continue;
+            uint32_t lo, hi;
+            gpx2_dnl_range(t, &lo, &hi);
+            printf("HIRES %s CH%d: hits=%lu bin width %lu..%lu%% of nominal\n", gpx2_hires_names[h],
+                   ch + 1, (unsigned long)t->hits, (unsigned long)lo, (unsigned long)hi);
+            n++;
+        }
+    }
+    printf("%d tables, correction %s\n", n, gpx2_dnl_store.enabled ? "enabled" : "disabled");
+}
+
+// defined with the SPI routines below
+static void gpx2_spi_calibrate(bool check_frames);
+static uint16_t gpx2_dnl_calibrate(uint32_t target);
+
+// DNL sub menu, every change is written to flash right away
+static void gpx2_dnl_menu(void)
+{
+    int action = 0;
+    unsigned long target = 0;
+    uint8_t hires = (gpx2_config[1] >> 6) & 0x03;
+    if (hires >= GPX2_DNL_HIRES)
+        hires = 0;
+    printf("\nDNL correction (HIRES %s): 0=list 1=calibrate 2=enable 3=disable 4=clear this HIRES: ",
+           gpx2_hires_names[hires]);
+    scanf("%d", &action);
+    switch (action)
+    {
+    case 0:
+        gpx2_dnl_list();
+        return;
+    case 1:
+    {
+        printf("Hits per channel (0=%d), uncorrelated to REFCLK: ", GPX2_DNL_CAL_HITS);
+        scanf("%lu", &target);
+        uint16_t built = gpx2_dnl_calibrate(target ? (uint32_t)target : GPX2_DNL_CAL_HITS);
+        if (built == 0)
+            return;
+        printf("Tables built for %d channels\n", __builtin_popcount(built));
+        gpx2_dnl_store.enabled = 1;
+        break;
+    }
+    case 2:
+    case 3:
+        gpx2_dnl_store.enabled = (action == 2);
+        break;
+    case 4:
+        memset(gpx2_dnl_store.table[hires], 0, sizeof(gpx2_dnl_store.table[hires]));
+        break;
+    default:
+        printf("Invalid action\n");
+        return;
+    }
+    printf(gpx2_dnl_save(&gpx2_dnl_store) ? "Saved to flash\n" : "ERROR: flash write failed\n");
+}
+
 static void gpx2_input_config()
 {
     int input = 0;
@@ -192,6 +621,20 @@ static void gpx2_input_config()
         printf("A. Set CMOS input mode (0/1)\n");
         printf("B. Show current config bytes\n");
         printf("C. Set SPI speed\n");
+        printf("D. Set readout mode (0=polling, 1=interrupt, 2=dual core)\n");
+        printf("E. Set output mode (0=text, 1=binary, 2=none, 3=csv, 4=packed binary, 5=record raw frames)\n");
+        printf("F. Configure STOP histograms\n");
+        printf("G. Set burst readout limit (0=auto from FIFO mode, 1=single frame, max %d)\n", GPX2_BURST_MAX);
+        printf("H. Set timestamp format (0=raw REF/STOP, 1=picoseconds)\n");
+        printf("I. Configure coincidence pairs (dT output)\n");
+        printf("J. Config profiles (list/save/load/boot default)\n");
+        printf("K. Calibrate SPI speed (sweep, sets the fastest error free rate)\n");
+        printf("L. Set number of GPX2 chips and readout scheduling\n");
+        printf("M. Configure event gate (STOP/REF ranges, window, prescale)\n");
+        printf("N. DNL calibration (code density correction tables per channel and HIRES)\n");
+        printf("O. Live statistics (mean, sigma, min, max and rate per channel and pair)\n");
+        printf("P. Burst capture to flash (event and time limits)\n");
+        printf("R. Set event data channel (0=usb console, 1=usb bulk endpoint)\n");
         printf("Q. Apply & Exit\n");
         printf("Select option: ");
 
@@ -249,7 +692,8 @@ static void gpx2_input_config()
             case '8':
                 printf("\nEnter REFCLK frequency in Hz (e.g., 5000000 for 5MHz): ");
                 scanf("%d", &bigInput);
-                gpx2_set_refclk_divisions(gpx2_compute_divisions_from_freq(bigInput));
+                gpx2_refclk_period_ps = gpx2_compute_divisions_from_freq(bigInput);
+                gpx2_set_refclk_divisions(gpx2_refclk_period_ps);
                 break;
             case '9':
                 printf("\nUse internal XOSC? (0=extrenal REFCLK, 1=internal crystal): ");
@@ -274,6 +718,170 @@ static void gpx2_input_config()
                 scanf("%d", &bigInput);
                 gpx2_spi_speed_hz = bigInput;
                 break;
+            case 'D':
+            case 'd':
+                printf("\nReadout mode (0=polling, 1=interrupt, 2=dual core): ");
+                scanf("%d", &input);
+                if (input == 1)
+                    gpx2_readout_mode = GPX2_READOUT_IRQ;
+                else if (input == 2)
+                    gpx2_readout_mode = GPX2_READOUT_CORE1;
+                else
+                    gpx2_readout_mode = GPX2_READOUT_POLL;
+                break;
+            case 'E':
+            case 'e':
+                printf("\nOutput mode (0=text, 1=binary, 2=none, 3=csv, 4=packed binary, 5=record raw frames): ");
+                scanf("%d", &input);
+                if (input == 1)
+                    gpx2_output_mode = GPX2_OUTPUT_BINARY;
+                else if (input == 4)
+                    gpx2_output_mode = GPX2_OUTPUT_PACKED;
+                else if (input == 5)
+                    gpx2_output_mode = GPX2_OUTPUT_RECORD;
+                else if (input == 2)
+                    gpx2_output_mode = GPX2_OUTPUT_NONE;
+                else if (input == 3)
+                    gpx2_output_mode = GPX2_OUTPUT_CSV;
+                else
+                    gpx2_output_mode = GPX2_OUTPUT_TEXT;
+                break;
+            case 'F':
+            case 'f':
+            {
+                int offset = 0;
+                unsigned long width = 0;
+                printf("\nEnable STOP histograms? (0/1): ");
+                scanf("%d", &input);
+                gpx2_hist_enabled = (input != 0);
+                if (!gpx2_hist_enabled)
+                    break;
+                printf("Lowest STOP value (offset): ");
+                scanf("%d", &offset);
+                printf("Bin width: ");
+                scanf("%lu", &width);
+                printf("Number of bins (1-%d): ", GPX2_HIST_MAX_BINS);
+                scanf("%d", &input);
+                for (int i = 0; i < GPX2_ALL_CHANNELS; i++)
+                {
+                    if (!gpx2_hist_setup(&gpx2_hist[i], offset, width, (uint16_t)input))
+                    {
+                        printf("Invalid histogram range, histograms disabled\n");
+                        gpx2_hist_enabled = false;
+                        break;
+                    }
+                }
+                break;
+            }
+            case 'G':
+            case 'g':
+                printf("\nFrames per readout transaction (0=auto, 1-%d): ", GPX2_BURST_MAX);
+                scanf("%d", &input);
+                gpx2_burst_limit = (input < 0 || input > GPX2_BURST_MAX) ? 0 : (uint8_t)input;
+                break;
+            case 'H':
+            case 'h':
+                printf("\nTimestamp format (0=raw REF/STOP, 1=picoseconds): ");
+                scanf("%d", &input);
+                gpx2_time_format = (input == 1) ? GPX2_TIME_PS : GPX2_TIME_RAW;
+                break;
+            case 'I':
+            case 'i':
+            {
+                unsigned long window = 0, delay = 0, width = 0;
+                int offset = 0, a = 0, b = 0;
+                printf("\nEnable coincidences? (0/1): ");
+                scanf("%d", &input);
+                gpx2_coinc_enabled = (input != 0);
+                if (!gpx2_coinc_enabled)
+                    break;
+                printf("Coincidence window +/- (ps, 1-%ld): ", (long)GPX2_COINC_MAX_WINDOW_PS);
+                scanf("%lu", &window);
+                printf("Accidental window delay (ps, 0=off): ");
+                scanf("%lu", &delay);
+                // checked before the narrowing, a larger value would wrap into range
+                if (window > GPX2_COINC_MAX_WINDOW_PS || !gpx2_coinc_setup(&gpx2_coinc, (uint32_t)window, delay))
+                {
+                    printf("Invalid window, coincidences disabled\n");
+                    gpx2_coinc_enabled = false;
+                    break;
+                }
+                printf("Number of pairs (1-%d): ", GPX2_COINC_MAX_PAIRS);
+                scanf("%d", &input);
+                for (int i = 0; i < input && i < GPX2_COINC_MAX_PAIRS; i++)
+                {
+                    printf("Pair %d channels a b, dT = b - a (1-%d 1-%d): ", i + 1,
+                           gpx2_ndev * GPX2_CHANNELS, gpx2_ndev * GPX2_CHANNELS);
+                    scanf("%d %d", &a, &b);
+                    if (!gpx2_coinc_add_pair(&gpx2_coinc, (uint8_t)(a - 1), (uint8_t)(b - 1)))
+                        printf("Invalid pair, skipped\n");
+                }
+                if (gpx2_coinc.npairs == 0)
+                {
+                    printf("No pairs, coincidences disabled\n");
+                    gpx2_coinc_enabled = false;
+                    break;
+                }
+                printf("dT histogram lowest value (ps): ");
+                scanf("%d", &offset);
+                printf("dT histogram bin width (ps): ");
+                scanf("%lu", &width);
+                printf("dT histogram bins (1-%d): ", GPX2_HIST_MAX_BINS);
+                scanf("%d", &input);
+                for (int i = 0; i < GPX2_COINC_MAX_PAIRS; i++)
+                {
+                    if (!gpx2_hist_setup(&gpx2_dt_hist[i], offset, width, (uint16_t)input))
+                    {
+                        printf("Invalid histogram range, using default\n");
+                        for (int j = 0; j < GPX2_COINC_MAX_PAIRS; j++)
+                            gpx2_hist_setup(&gpx2_dt_hist[j], -8192, 16, GPX2_HIST_MAX_BINS);
+                        break;
+                    }
+                }
+                break;
+            }
+            case 'J':
+            case 'j':
+                gpx2_profile_menu();
+                break;
+            case 'K':
+            case 'k':
+                printf("\nAlso check result frames (needs STOP signals)? (0/1): ");
+                scanf("%d", &input);
+                gpx2_spi_calibrate(input != 0);
+                break;
+            case 'L':
+            case 'l':
+                printf("\nNumber of GPX2 chips (1-%d, wiring table in designlab.c): ", GPX2_MAX_DEVICES);
+                scanf("%d", &input);
+                gpx2_ndev = (input >= 1 && input <= GPX2_MAX_DEVICES) ? (uint8_t)input : 1;
+                printf("Scheduling (0=round robin, 1=priority by chip number): ");
+                scanf("%d", &input);
+                gpx2_sched_mode = (input == 1) ? GPX2_SCHED_PRIORITY : GPX2_SCHED_ROUND_ROBIN;
+                gpx2_devices_init();
+                break;
+            case 'M':
+            case 'm':
+                gpx2_gate_menu();
+                break;
+            case 'N':
+            case 'n':
+                gpx2_dnl_menu();
+                break;
+            case 'O':
+            case 'o':
+                gpx2_stats_menu();
+                break;
+            case 'P':
+            case 'p':
+                gpx2_capture_menu();
+                break;
+            case 'R':
+            case 'r':
+                printf("\nEvent data channel (0=usb console, 1=usb bulk endpoint): ");
+                scanf("%d", &input);
+                gpx2_bulk_enabled = (input == 1);
+                break;
             case 'Q':
             case 'q':
                 printf("\nExiting input config menu.\n");
@@ -310,158 +918,580 @@ static void gpx2_refclk_reset_unpulse()
  * Communication with TDC
  */
 
-// helper:control chip select (SSN)
-static inline void gpx2_cs_low(void)
+// keep the INT irqs away from the bus while the main loop talks to the chips
+static inline void gpx2_irq_pause(void)
 {
-    gpio_put(PIN_SPI_CS, 0); // drive CS low->select GPX2
+    for (int i = 0; i < gpx2_ndev && gpx2_irq_armed; i++)
+        hal_gpio_irq_enable(gpx2_dev[i].pin_int, false);
 }
-static inline void gpx2_cs_high(void)
+static inline void gpx2_irq_resume(void)
 {
-    gpio_put(PIN_SPI_CS, 1); // drive CS high->deselect GPX2
+    for (int i = 0; i < gpx2_ndev && gpx2_irq_armed; i++)
+        hal_gpio_irq_enable(gpx2_dev[i].pin_int, true);
 }
 
-// send one byte over spi(blocking)
-static void gpx2_spi_send_byte(uint8_t value)
+// single byte command to every chip
+static void gpx2_send_opcode(uint8_t opcode)
 {
-    spi_write_blocking(SPI_PORT, &value, 1);
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev_opcode(&gpx2_dev[i], opcode);
 }
-// read one byte over spi (blocking)
-static uint8_t gpx2_spi_read_byte(void)
+
+// same clock on every bus in use, returns the rate actually set
+static uint32_t gpx2_spi_set_speed(uint32_t hz)
 {
-    uint8_t rx = 0;
-    spi_read_blocking(SPI_PORT, 0x00, &rx, 1);
-    return rx;
+    uint32_t actual = 0;
+    for (int i = 0; i < gpx2_ndev; i++)
+        actual = hal_spi_set_baudrate(gpx2_dev[i].bus, hz);
+    return actual;
 }
 
-// write configuration registers to GPX2
-static bool gpx2_write_config(const uint8_t *cfg)
+// false when the readback differs, the shadow is then dropped so the next
+// write sends everything
+static bool gpx2_write_and_verify_range(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n)
 {
-    gpx2_cs_low();
+    GPX2_PERF_BEGIN(t0);
+    gpx2_irq_pause();
+    gpx2_dev_write_config(d, cfg, addr, n);
+    bool ok = gpx2_dev_verify_config(d, cfg, addr, n);
+    if (ok)
+        gpx2_dev_config_commit(d, cfg, addr, n);
+    else
+        d->config_valid = false;
+    gpx2_irq_resume();
+    GPX2_PERF_END(GPX2_STAGE_CONFIG, t0);
+    if (!ok)
+        gpx2_acq_errors++;
+    return ok;
+}
 
-    // opcode for write config+start address
-    gpx2_spi_send_byte(OPC_WRITE_CONFIG | 0x00);
+// write and verify all 17 registers of every chip
+static bool gpx2_write_and_verify_config(const uint8_t *cfg)
+{
+    bool ok = true;
+    for (int i = 0; i < gpx2_ndev; i++)
+        ok &= gpx2_write_and_verify_range(&gpx2_dev[i], cfg, 0, GPX2_CONFIG_BYTES);
+    return ok;
+}
 
-    // send all 17 config bytes
-    for (int i = 0; i < 17; i++)
+// write and verify only the registers of gpx2_config that differ from each
+// chip, as one address range (runtime P/R/C only touch config[0])
+static bool gpx2_update_config(void)
+{
+    uint8_t addr, n;
+    bool ok = true;
+    for (int i = 0; i < gpx2_ndev; i++)
     {
-        gpx2_spi_send_byte(cfg[i]);
+        if (gpx2_dev_config_dirty(&gpx2_dev[i], gpx2_config, &addr, &n))
+            ok &= gpx2_write_and_verify_range(&gpx2_dev[i], gpx2_config, addr, n);
     }
-    gpx2_cs_high();
-    return true;
+    return ok;
 }
 
-// read back and verify config. registers
-static bool gpx2_verify_config(const uint8_t *cfg)
+// send initialize and start measurement
+static void gpx2_start_measurement(void)
 {
-    gpx2_cs_low();
+    gpx2_irq_pause();
+    gpx2_send_opcode(OPC_INIT);
+    hal_busy_wait_us(100);
+    // before the irq can read again, so every frame after the init carries the new epoch
+    gpx2_acq_epoch++;
+    gpx2_irq_resume();
+}
+
+/**
+ * SPI speed calibration
+ */
+#define GPX2_CAL_ITERATIONS 100  // config write/readback rounds per rate
+#define GPX2_CAL_FRAME_US 50000  // result frame check time per rate
+#define GPX2_CAL_MARGIN_PCT 20   // chosen rate stays this far below the fastest clean one
 
-    // opcode for read config. +start address (0x00)
-    gpx2_spi_send_byte(OPC_READ_CONFIG + 0x00);
-    // read 17 bytes and compare to local config.
-    uint8_t rx;
-    for (int i = 0; i < 17; i++)
+static const uint32_t gpx2_cal_rates[] = {
+    1000000, 2000000, 4000000, 5000000, 8000000, 10000000, 12500000,
+    16000000, 20000000, 25000000, 31250000, 40000000, 50000000};
+
+// config write/readback with random patterns on every chip, returns bad rounds
+static uint32_t gpx2_cal_config_errors(uint32_t *seed)
+{
+    uint8_t pattern[GPX2_CONFIG_BYTES];
+    uint32_t errors = 0;
+    for (int n = 0; n < GPX2_CAL_ITERATIONS; n++)
     {
-        rx = gpx2_spi_read_byte();
-        // printf("received %x\n",rx);
-        if (rx != cfg[i])
+        // every other round the real config, random bytes otherwise
+        for (int i = 0; i < GPX2_CONFIG_BYTES; i++)
+        {
+            *seed = *seed * 1664525u + 1013904223u;
+            pattern[i] = (n & 1) ? gpx2_config[i] : (uint8_t)(*seed >> 24);
+        }
+        for (int i = 0; i < gpx2_ndev; i++)
         {
-            gpx2_cs_high();
-            return false;
+            gpx2_dev_write_config(&gpx2_dev[i], pattern, 0, GPX2_CONFIG_BYTES);
+            if (!gpx2_dev_verify_config(&gpx2_dev[i], pattern, 0, GPX2_CONFIG_BYTES))
+                errors++;
         }
     }
-    gpx2_cs_high();
-    return true;
+    return errors;
 }
-static void gpx2_write_and_verify_config(const uint8_t *cfg)
+
+// read result frames for a while with the real config running, a frame is
+// bad when STOP is not below REFCLK_DIVISIONS or REF runs backwards
+static uint32_t gpx2_cal_frame_errors(uint32_t *frames)
 {
-    char input;
-    gpx2_write_config(cfg);
-    if (!gpx2_verify_config(cfg))
+    uint32_t divisions = gpx2_config[3] | (gpx2_config[4] << 8) | ((gpx2_config[5] & 0x0F) << 16);
+    uint32_t last_ref[GPX2_ALL_CHANNELS] = {0};
+    bool have_ref[GPX2_ALL_CHANNELS] = {false};
+    uint32_t errors = 0;
+    gpx2_result_t res;
+
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev_write_config(&gpx2_dev[i], gpx2_config, 0, GPX2_CONFIG_BYTES);
+    gpx2_start_measurement();
+    *frames = 0;
+    uint64_t end = hal_time_us() + GPX2_CAL_FRAME_US;
+    while (hal_time_us() < end)
     {
-        printf("Config write error, press Q to reset pico\n");
-        while (1)
+        for (int i = 0; i < gpx2_ndev; i++)
         {
-            input = getchar();
-            if (input == 'q' || input == 'Q')
+            if (!gpx2_dev_int(&gpx2_dev[i]))
+                continue;
+            gpx2_dev_read_frame(&gpx2_dev[i], &res);
+            (*frames)++;
+            bool bad = false;
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
             {
-                restart();
+                int g = i * GPX2_CHANNELS + ch;
+                if (res.ref[ch] == 0 && res.stop[ch] == 0)
+                    continue; // empty slot
+                if (res.stop[ch] >= divisions)
+                    bad = true;
+                // forward distance in the 24 bit REF ring must stay below half a wrap
+                if (have_ref[g] && ((res.ref[ch] - last_ref[g]) & GPX2_REF_MASK) >= (GPX2_REF_MASK >> 1))
+                    bad = true;
+                last_ref[g] = res.ref[ch];
+                have_ref[g] = true;
             }
+            if (bad)
+                errors++;
         }
     }
+    return errors;
 }
 
-// send initialize and start measurement
-static void gpx2_start_measurement(void)
+// sweep gpx2_cal_rates, keep the fastest rate below which everything passed,
+// minus GPX2_CAL_MARGIN_PCT, as gpx2_spi_speed_hz
+static void gpx2_spi_calibrate(bool check_frames)
 {
-    gpx2_cs_low();
-    gpx2_spi_send_byte(OPC_INIT);
-    gpx2_cs_high();
-    busy_wait_us(100);
+    uint32_t seed = 0x2545F491u;
+    uint32_t best = 0;
+    uint32_t clean[sizeof(gpx2_cal_rates) / sizeof(gpx2_cal_rates[0])];
+    int nclean = 0;
+    uint32_t last_actual = 0;
+    uint32_t unverified = 0; // rate that read no frames to check
+
+    printf("\nSPI calibration, %d config rounds%s per rate and chip\n", GPX2_CAL_ITERATIONS,
+           check_frames ? " + result frames" : "");
+    gpx2_irq_pause();
+    for (size_t i = 0; i < sizeof(gpx2_cal_rates) / sizeof(gpx2_cal_rates[0]); i++)
+    {
+        uint32_t actual = gpx2_spi_set_speed(gpx2_cal_rates[i]);
+        if (actual == last_actual)
+            continue; // divider rounds to the same clock
+        last_actual = actual;
+
+        uint32_t cfg_err = gpx2_cal_config_errors(&seed);
+        uint32_t frames = 0, frame_err = 0;
+        if (check_frames && cfg_err == 0)
+            frame_err = gpx2_cal_frame_errors(&frames);
+        printf("SPI %8lu Hz: config %lu/%d bad", (unsigned long)actual,
+               (unsigned long)cfg_err, GPX2_CAL_ITERATIONS * gpx2_ndev);
+        if (check_frames)
+            printf(", frames %lu/%lu bad", (unsigned long)frame_err, (unsigned long)frames);
+        // no hits, no frame check: the rate is not accepted on config alone
+        if (check_frames && cfg_err == 0 && frames == 0)
+        {
+            printf(", unverified\n");
+            unverified = actual;
+            break;
+        }
+        printf("\n");
+        if (cfg_err != 0 || frame_err != 0)
+            break;
+        clean[nclean++] = actual;
+    }
+
+    // highest clean rate at or below the margin
+    if (nclean > 0)
+    {
+        uint32_t limit = (uint32_t)((uint64_t)clean[nclean - 1] * (100 - GPX2_CAL_MARGIN_PCT) / 100);
+        best = clean[0];
+        for (int i = 0; i < nclean; i++)
+        {
+            if (clean[i] <= limit)
+                best = clean[i];
+        }
+    }
+
+    // chips are left with test patterns, main does a power reset before the real config
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev[i].config_valid = false;
+    if (unverified != 0)
+        printf("WARNING: no result frames at %lu Hz, STOP inputs need hits for the frame check\n",
+               (unsigned long)unverified);
+    if (best == 0 && unverified != 0)
+    {
+        printf("ERROR: no rate verified. SPI speed unchanged (%d Hz)\n", gpx2_spi_speed_hz);
+        gpx2_spi_set_speed(gpx2_spi_speed_hz);
+    }
+    else if (best == 0)
+    {
+        printf("ERROR: errors at the lowest rate, check wiring. SPI speed unchanged (%d Hz)\n",
+               gpx2_spi_speed_hz);
+        gpx2_spi_set_speed(gpx2_spi_speed_hz);
+    }
+    else
+    {
+        gpx2_spi_speed_hz = (int)gpx2_spi_set_speed(best);
+        printf("SPI speed set to %d Hz (fastest clean %lu Hz, %d%% margin)\n", gpx2_spi_speed_hz,
+               (unsigned long)clean[nclean - 1], GPX2_CAL_MARGIN_PCT);
+    }
+    gpx2_irq_resume();
 }
 
-// read 24bit value from SPI, GPX2 send values as 3-byte big-endian
-static uint32_t gpx2_read_24bit(void)
+/**
+ * DNL calibration
+ */
+// code density run: hits of the real config, uncorrelated to REFCLK, are
+// histogrammed per channel until every enabled channel has target hits.
+// Returns the channels that got a new table for the current HIRES setting
+static uint16_t gpx2_dnl_calibrate(uint32_t target)
 {
-    uint32_t value = 0;
+    uint8_t hires = (gpx2_config[1] >> 6) & 0x03;
+    uint32_t divisions = gpx2_config[3] | (gpx2_config[4] << 8) | ((gpx2_config[5] & 0x0F) << 16);
+    gpx2_result_t res;
+    gpx2_result_t last[GPX2_MAX_DEVICES];
+    memset(last, 0, sizeof(last));
+
+    gpx2_dnl_cal_init(&gpx2_dnl_cal, divisions);
+    if (hires >= GPX2_DNL_HIRES || gpx2_dnl_cal.divisions == 0)
+    {
+        printf("ERROR: needs REFCLK_DIVISIONS >= %d and a valid HIRES setting\n", GPX2_DNL_BINS);
+        return 0;
+    }
+    gpx2_spi_set_speed(gpx2_spi_speed_hz);
+    gpx2_send_opcode(OPC_POWER_RESET);
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev[i].config_valid = false;
+    hal_busy_wait_us(100);
+    if (!gpx2_write_and_verify_config(gpx2_config))
+    {
+        printf("ERROR: config write did not verify\n");
+        return 0;
+    }
+    uint16_t want = 0, done = 0;
+    for (int i = 0; i < gpx2_ndev; i++)
+    {
+        gpx2_dev_readout_setup(&gpx2_dev[i], gpx2_config, 1, (uint32_t)gpx2_spi_speed_hz);
+        want |= gpx2_dev[i].active_mask << (i * GPX2_CHANNELS);
+    }
+    if (want == 0)
+    {
+        printf("ERROR: no channel enabled\n");
+        return 0;
+    }
+    printf("DNL calibration, HIRES %s, %lu hits per channel\n", gpx2_hires_names[hires],
+           (unsigned long)target);
+    gpx2_start_measurement();
 
-    value |= ((uint32_t)gpx2_spi_read_byte()) << 16;
-    value |= ((uint32_t)gpx2_spi_read_byte()) << 8;
-    value |= ((uint32_t)gpx2_spi_read_byte());
+    uint64_t start = hal_time_us(), report = start, now = start;
+    while (done != want && now - start < GPX2_DNL_CAL_US)
+    {
+        for (int i = 0; i < gpx2_ndev; i++)
+        {
+            gpx2_dev_t *d = &gpx2_dev[i];
+            if (!gpx2_dev_int(d))
+                continue;
+            gpx2_dev_read_frame(d, &res);
+            uint8_t m = gpx2_results_new_hits(&res, &last[i], d->active_mask);
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                int g = i * GPX2_CHANNELS + ch;
+                if (!(m & (1 << ch)))
+                    continue;
+                gpx2_dnl_cal_add(&gpx2_dnl_cal, g, res.stop[ch]);
+                if (gpx2_dnl_cal.hits[g] >= target)
+                    done |= 1u << g;
+            }
+        }
+        now = hal_time_us();
+        if (now - report >= 1000000)
+        {
+            uint32_t least = UINT32_MAX;
+            for (int g = 0; g < GPX2_DNL_CHANNELS; g++)
+            {
+                if ((want & (1u << g)) && gpx2_dnl_cal.hits[g] < least)
+                    least = gpx2_dnl_cal.hits[g];
+            }
+            printf("%lu s: %lu/%lu hits on the slowest channel\n", (unsigned long)((now - start) / 1000000),
+                   (unsigned long)least, (unsigned long)target);
+            report = now;
+        }
+    }
 
-    return value;
+    // main does a power reset before the real config
+    gpx2_send_opcode(OPC_POWER_RESET);
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev[i].config_valid = false;
+    if (done != want)
+        printf("WARNING: timeout, channels below %lu hits keep their old table\n", (unsigned long)target);
+    uint16_t built = gpx2_dnl_build(&gpx2_dnl_store, hires, &gpx2_dnl_cal, target);
+    for (int g = 0; g < GPX2_DNL_CHANNELS; g++)
+    {
+        if (!(built & (1u << g)))
+            continue;
+        uint32_t lo, hi;
+        gpx2_dnl_range(&gpx2_dnl_store.table[hires][g], &lo, &hi);
+        printf("CH%d: bin width %lu..%lu%% of nominal\n", g + 1, (unsigned long)lo, (unsigned long)hi);
+    }
+    return built;
 }
 
-// read measurement results for 4 channels
-static void gpx2_read_results(uint32_t reference_index[4],
-                              uint32_t stop_results[4])
+static void gpx2_record_raw(uint8_t dev, const uint8_t *frame);
+
+// frames per transaction from menu G, auto drains up to GPX2_BURST_MAX when
+// COMMON/BLOCKWISE FIFO is set and reads one frame per INT otherwise
+static void gpx2_burst_apply(void)
 {
-    // wait until gpx2 puls interrupt pin low
-    while (gpio_get(PIN_GPX_INT) != 0)
+    uint8_t fifo_modes = gpx2_config[2] & 0xC0;
+    if (gpx2_burst_limit != 0)
+        gpx2_burst_frames = gpx2_burst_limit;
+    else
+        gpx2_burst_frames = fifo_modes ? GPX2_BURST_MAX : 1;
+    bool record = gpx2_output_mode == GPX2_OUTPUT_RECORD;
+    for (int i = 0; i < gpx2_ndev; i++)
     {
-        tight_loop_contents(); // small idle loop
+        gpx2_dev_readout_setup(&gpx2_dev[i], gpx2_config, gpx2_burst_frames, (uint32_t)gpx2_spi_speed_hz);
+        // a recording holds whole frames, whatever slots the plan would skip
+        if (record)
+            gpx2_dev_readout_range(&gpx2_dev[i], 0, GPX2_CHANNELS);
+        gpx2_dev[i].raw = record ? gpx2_record_raw : NULL;
     }
-    gpx2_cs_low();
-    gpx2_spi_send_byte(OPC_READ_RESULTS + 8);
+}
 
-    for (int ch = 0; ch < 4; ch++)
+// read bursts into the ring while an INT stays low, bounded so the caller gets control back
+static void gpx2_drain_to_ring(void)
+{
+    for (int n = 0; n < GPX2_IRQ_MAX_READS && gpx2_sched_pending(&gpx2_sched); n++)
     {
-        // 3 bytes reference index
-        reference_index[ch] = gpx2_read_24bit();
-        // 3 bytes stop results
-        stop_results[ch] = gpx2_read_24bit();
+        int got = gpx2_sched_service(&gpx2_sched, gpx2_burst);
+        for (int i = 0; i < got; i++)
+        {
+            gpx2_ring_push(&gpx2_ring, &gpx2_burst[i], gpx2_acq_epoch);
+        }
     }
-    gpx2_cs_high();
 }
-bool gpx2_validate_input(void)
+
+// INT falling edge handler, shared by all chips, the scheduler picks who is read
+static void gpx2_int_callback(uint8_t pin)
 {
-    bool ok=true;
-    
-    uint8_t pin_ena=gpx2_config[0]& 0x0F; //PIN_ENA1..4
-    uint8_t refclk_ena=(gpx2_config[0]>>4)&0x01;
-    uint8_t hit_ena=gpx2_config[1]&0x0F; //HIT_ENA1..4
-    uint8_t channel_combine=(gpx2_config[1]>>4)&0x03;
-    uint8_t hires=(gpx2_config[1]>>6)&0x03;
-    uint8_t common_fifo=(gpx2_config[2]>>6)&0x01;
-    uint8_t blockwise_fifo=(gpx2_config[2]>>7)&0x01;
+    (void)pin;
+    gpx2_drain_to_ring();
+}
 
-    uint32_t refclk_div=
-        gpx2_config[3]|
-        (gpx2_config[4]<<8)|
-        ((gpx2_config[5]&0x0F)<<16);
-    
-    uint8_t cmos_input=(gpx2_config[16]>>2)&0x01;
+static void gpx2_irq_arm(void)
+{
+    gpx2_ring_init(&gpx2_ring);
+    for (int i = 0; i < gpx2_ndev; i++)
+        hal_gpio_irq_falling(gpx2_dev[i].pin_int, &gpx2_int_callback);
+    gpx2_irq_armed = true;
+}
 
-    printf("\n CONFIG VALIDATION \n");
+// an edge is only seen once, so INT still low after a capped drain (or low
+// before arming) would stall, pick it up from the main loop
+static void gpx2_irq_kick(void)
+{
+    if (gpx2_sched_pending(&gpx2_sched))
+    {
+        gpx2_irq_pause();
+        gpx2_drain_to_ring();
+        gpx2_irq_resume();
+    }
+}
 
-    //1. PIN_ENA vs HIT_ENA mismatch
-    for (int i=0; i<4; i++){
-        if ((pin_ena & (1<<i))&&!(hit_ena&(1<<i))){
-            printf("ERROR: STOP%d enabled but HIT_ENA%d disabled\n", i + 1, i + 1);
-            ok=false;
+/**
+ * Acquisition state machine
+ */
+static void gpx2_acq_enter(gpx2_acq_state_t state)
+{
+    gpx2_acq_state = state;
+    gpx2_acq_since_us = hal_time_us();
+}
+
+// power reset, full config on every chip and OPC_INIT; ends paused when the
+// STOP inputs are disabled (P) and in error when a chip does not verify
+static void gpx2_acq_configure(void)
+{
+    gpx2_send_opcode(OPC_POWER_RESET);
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_dev[i].config_valid = false;
+    hal_busy_wait_us(100);
+    if (!gpx2_write_and_verify_config(gpx2_config))
+    {
+        gpx2_acq_enter(GPX2_ACQ_ERROR);
+        return;
+    }
+    gpx2_burst_apply();
+    gpx2_start_measurement();
+    if (gpx2_boot_config_us == 0)
+        gpx2_boot_config_us = hal_time_us();
+    gpx2_acq_enter((gpx2_config[0] & (1 << 6)) ? GPX2_ACQ_PAUSED : GPX2_ACQ_ARMED);
+}
+
+// a chip without new hits for GPX2_QUIET_CHECK_US gets its config read back,
+// one that lost it (brown-out, reset glitch) has the whole chain configured
+// again. Per chip, so a dead chip is found while the others keep counting
+static void gpx2_acq_check_config(uint64_t now)
+{
+    static uint64_t since[GPX2_MAX_DEVICES];
+    static uint32_t frames[GPX2_MAX_DEVICES];
+    for (int i = 0; i < gpx2_ndev; i++)
+    {
+        gpx2_dev_t *d = &gpx2_dev[i];
+        if (d->frames != frames[i] || since[i] < gpx2_acq_since_us)
+        {
+            frames[i] = d->frames;
+            since[i] = now;
+            continue;
+        }
+        if (now - since[i] < GPX2_QUIET_CHECK_US)
+            continue;
+        since[i] = now;
+        gpx2_irq_pause();
+        bool ok = gpx2_dev_verify_config(d, d->config_chip, 0, GPX2_CONFIG_BYTES);
+        gpx2_irq_resume();
+        if (!ok)
+        {
+            gpx2_acq_reconfigs++;
+            gpx2_acq_enter(GPX2_ACQ_CONFIGURING);
+            return;
         }
     }
-    //2. REFCLK enabled?
-    if (!refclk_ena){
+}
+
+// a chip whose INT stays low while its bursts bring only repeated slots for
+// GPX2_STALL_US has a hung readout; a chip that is simply not served (priority
+// scheduling at saturation) reads no empty bursts and does not count
+static bool gpx2_acq_stalled(uint64_t now)
+{
+    static uint64_t since[GPX2_MAX_DEVICES];
+    static uint32_t frames[GPX2_MAX_DEVICES];
+    static uint32_t empty[GPX2_MAX_DEVICES];
+    bool stalled = false;
+    for (int i = 0; i < gpx2_ndev; i++)
+    {
+        const gpx2_dev_t *d = &gpx2_dev[i];
+        if (!gpx2_dev_int(d) || d->frames != frames[i])
+        {
+            since[i] = now;
+            frames[i] = d->frames;
+            empty[i] = d->batch_count[0];
+        }
+        else if (now - since[i] >= GPX2_STALL_US && d->batch_count[0] != empty[i])
+        {
+            stalled = true;
+            since[i] = now;
+        }
+    }
+    return stalled;
+}
+
+// one readout step: bounded INT wait, one scheduler pass (the irq does the
+// reading in irq mode), stall and quiet checks. Returns frames in gpx2_burst
+static int gpx2_acq_read(void)
+{
+    bool irq = gpx2_readout_mode == GPX2_READOUT_IRQ;
+    uint64_t now = hal_time_us();
+    if (!gpx2_sched_pending(&gpx2_sched) && !irq)
+    {
+        GPX2_PERF_BEGIN(t0);
+        while (!gpx2_sched_pending(&gpx2_sched) && hal_time_us() - now < GPX2_INT_WAIT_US)
+        {
+            hal_tight_loop(); // small idle loop
+        }
+        GPX2_PERF_END(GPX2_STAGE_WAIT_INT, t0);
+        now = hal_time_us();
+    }
+    if (!gpx2_sched_pending(&gpx2_sched))
+    {
+        gpx2_acq_state = GPX2_ACQ_ARMED;
+        gpx2_acq_check_config(now);
+        return 0;
+    }
+    gpx2_acq_state = GPX2_ACQ_READING;
+
+    int got = 0;
+    if (irq)
+        gpx2_irq_kick();
+    else
+        got = gpx2_sched_service(&gpx2_sched, gpx2_burst);
+    gpx2_acq_check_config(now);
+    if (gpx2_acq_state == GPX2_ACQ_READING && gpx2_acq_stalled(now))
+    {
+        // OPC_INIT clears the FIFOs and restarts the REF index
+        gpx2_acq_reinits++;
+        gpx2_start_measurement();
+        gpx2_acq_enter(GPX2_ACQ_ARMED);
+    }
+    return got;
+}
+
+static int gpx2_acq_step(void)
+{
+    switch (gpx2_acq_state)
+    {
+    case GPX2_ACQ_CONFIGURING:
+        gpx2_acq_configure();
+        return 0;
+    case GPX2_ACQ_ERROR:
+        if (hal_time_us() - gpx2_acq_since_us >= GPX2_ACQ_RETRY_US)
+            gpx2_acq_enter(GPX2_ACQ_CONFIGURING);
+        return 0;
+    case GPX2_ACQ_ARMED:
+    case GPX2_ACQ_READING:
+        return gpx2_acq_read();
+    default: // idle, paused
+        return 0;
+    }
+}
+bool gpx2_validate_input(void)
+{
+    bool ok=true;
+    
+    uint8_t pin_ena=gpx2_config[0]& 0x0F; //PIN_ENA1..4
+    uint8_t refclk_ena=(gpx2_config[0]>>4)&0x01;
+    uint8_t hit_ena=gpx2_config[1]&0x0F; //HIT_ENA1..4
+    uint8_t channel_combine=(gpx2_config[1]>>4)&0x03;
+    uint8_t hires=(gpx2_config[1]>>6)&0x03;
+    uint8_t common_fifo=(gpx2_config[2]>>6)&0x01;
+    uint8_t blockwise_fifo=(gpx2_config[2]>>7)&0x01;
+
+    uint32_t refclk_div=
+        gpx2_config[3]|
+        (gpx2_config[4]<<8)|
+        ((gpx2_config[5]&0x0F)<<16);
+    
+    uint8_t cmos_input=(gpx2_config[16]>>2)&0x01;
+
+    printf("\n CONFIG VALIDATION \n");
+
+    //1. PIN_ENA vs HIT_ENA mismatch
+    for (int i=0; i<4; i++){
+        if ((pin_ena & (1<<i))&&!(hit_ena&(1<<i))){
+            printf("ERROR: STOP%d enabled but HIT_ENA%d disabled\n", i + 1, i + 1);
+            ok=false;
+        }
+    }
+    //2. REFCLK enabled?
+    if (!refclk_ena){
         printf("ERROR: REFCLK input not enabled\n");
         ok=false;
     }
@@ -598,112 +1628,1206 @@ bool gpx2_validate_input(void)
     return ok;
 }
 
-// main
-int main()
+// runtime actions that talk to the chip, run by whichever core owns the SPI bus
+// while configuring or in error only gpx2_config changes, the next
+// configuration picks it up
+static void gpx2_runtime_command(char cmd)
+{
+    bool running = gpx2_acq_state == GPX2_ACQ_ARMED || gpx2_acq_state == GPX2_ACQ_READING ||
+                   gpx2_acq_state == GPX2_ACQ_PAUSED;
+    if (cmd == 'p' || cmd == 'P') // p pauses measurements
+    {
+        gpx2_pins_disable();
+        if (running)
+            gpx2_acq_enter(gpx2_update_config() ? GPX2_ACQ_PAUSED : GPX2_ACQ_ERROR);
+    }
+    else if (cmd == 'r' || cmd == 'R') // r restarts measurements
+    {
+        gpx2_pins_enable();
+        if (running && gpx2_update_config())
+        {
+            gpx2_start_measurement();
+            gpx2_acq_enter(GPX2_ACQ_ARMED);
+        }
+        else if (running)
+        {
+            gpx2_acq_enter(GPX2_ACQ_ERROR);
+        }
+    }
+    else if ((cmd == 'c' || cmd == 'C') && running)
+    {
+        gpx2_refclk_reset_pulse();
+        gpx2_update_config();
+        clk_reset = true;
+    }
+}
+// second half of the REFCLK reset, one loop pass after the pulse
+static void gpx2_runtime_service(void)
 {
-    stdio_init_all(); // enable usb serial output
-    char userinput = getchar();
+    if (clk_reset)
+    {
+        gpx2_refclk_reset_unpulse();
+        clk_reset = false;
+        if (!gpx2_update_config())
+        {
+            gpx2_acq_enter(GPX2_ACQ_ERROR);
+            return;
+        }
+        gpx2_start_measurement();
+    }
+}
 
-    //cli
-    do
+// core1 acquisition loop, commands from core0 arrive in the RAM mailbox
+// (hal_core1_pop), the inter-core fifo belongs to the flash lockout
+static void gpx2_core1_main(void)
+{
+    while (true)
+    {
+        gpx2_core1_beat++;
+        gpx2_runtime_service();
+        uint32_t cmd;
+        if (hal_core1_pop(&cmd))
+        {
+            gpx2_runtime_command((char)cmd);
+        }
+        int got = gpx2_acq_step();
+        for (int i = 0; i < got; i++)
+        {
+            gpx2_ring_push(&gpx2_ring, &gpx2_burst[i], gpx2_acq_epoch);
+        }
+    }
+}
+
+// acquisition counters, head/tail of the ring double as frames queued/printed
+// in irq and core1 mode; polling consumes frames as read, without the ring
+static void gpx2_print_acq_stats(void)
+{
+    static uint64_t last_us = 0;
+    static uint32_t last_read = 0;
+
+    uint64_t now = hal_time_us();
+    uint64_t dt = now - last_us;
+    uint32_t read = 0;
+    if (gpx2_readout_mode == GPX2_READOUT_POLL)
+    {
+        for (int i = 0; i < gpx2_ndev; i++)
+            read += gpx2_dev[i].frames;
+        printf("ACQ: read=%lu ring=n/a (polling) rate=%lu fr/s\n", (unsigned long)read,
+               (unsigned long)(dt ? (uint64_t)(read - last_read) * 1000000u / dt : 0));
+    }
+    else
+    {
+        uint32_t queued = atomic_load_explicit(&gpx2_ring.head, memory_order_acquire);
+        uint32_t printed = atomic_load_explicit(&gpx2_ring.tail, memory_order_acquire);
+        uint32_t drops = atomic_load_explicit(&gpx2_ring.dropped, memory_order_relaxed);
+        read = queued + drops;
+        printf("ACQ: read=%lu printed=%lu depth=%lu high=%lu/%d drops=%lu stale=%lu rate=%lu fr/s\n",
+               (unsigned long)read,
+               (unsigned long)printed,
+               (unsigned long)(queued - printed),
+               (unsigned long)atomic_load_explicit(&gpx2_ring.high_water, memory_order_relaxed),
+               GPX2_RING_SIZE,
+               (unsigned long)drops,
+               (unsigned long)gpx2_ring_stale,
+               (unsigned long)(dt ? (uint64_t)(read - last_read) * 1000000u / dt : 0));
+    }
+    last_us = now;
+    last_read = read;
+
+    printf("BOOT: measurement started %lu us, first event %lu us after reset%s\n",
+           (unsigned long)gpx2_boot_config_us, (unsigned long)gpx2_boot_first_us,
+           gpx2_watchdog_boot ? ", watchdog reset" : "");
+    printf("STATE: %s reinits=%lu reconfigs=%lu config_errors=%lu\n", gpx2_acq_names[gpx2_acq_state],
+           (unsigned long)gpx2_acq_reinits, (unsigned long)gpx2_acq_reconfigs,
+           (unsigned long)gpx2_acq_errors);
+
+    // burst readout: transactions by number of frames carrying new hits
+    uint32_t batch[GPX2_BURST_MAX + 1] = {0};
+    uint32_t bursts = 0, frames = 0, events = 0;
+    for (int i = 0; i < gpx2_ndev; i++)
+    {
+        for (int n = 0; n <= GPX2_BURST_MAX; n++)
+            batch[n] += gpx2_dev[i].batch_count[n];
+        events += gpx2_dev[i].events;
+    }
+    for (int n = 0; n <= GPX2_BURST_MAX; n++)
+    {
+        bursts += batch[n];
+        frames += batch[n] * n;
+    }
+    printf("BATCH: limit=%u bursts=%lu frames=%lu events=%lu mean=%lu.%02lu empty=%lu",
+           gpx2_burst_frames, (unsigned long)bursts, (unsigned long)frames,
+           (unsigned long)events,
+           (unsigned long)(bursts ? frames / bursts : 0),
+           (unsigned long)(bursts ? (uint64_t)(frames % bursts) * 100 / bursts : 0),
+           (unsigned long)batch[0]);
+    for (int n = 1; n <= GPX2_BURST_MAX; n++)
     {
-        gpx2_input_config();
-    } while (!gpx2_validate_input());
+        if (batch[n] != 0)
+            printf(" %d:%lu", n, (unsigned long)batch[n]);
+    }
+    printf("\n");
+    // slots read per frame, the same on every chip
+    const gpx2_dev_t *d0 = &gpx2_dev[0];
+    printf("READOUT: CH%u-CH%u, %u bytes per frame, %s\n", d0->read_first + 1,
+           d0->read_first + d0->read_bytes / GPX2_SLOT_BYTES, d0->read_bytes,
+           d0->read_burst ? "bursts in one transaction" : "one transaction per frame");
 
-    // initialize SPI hardware
-    spi_init(SPI_PORT, gpx2_spi_speed_hz); // SPI_PORT at 4MHz
-    spi_set_format(SPI_PORT, 8, SPI_CPOL_0, SPI_CPHA_1, SPI_MSB_FIRST);
-    gpio_set_function(PIN_SPI_SCK, GPIO_FUNC_SPI);
-    gpio_set_function(PIN_SPI_MOSI, GPIO_FUNC_SPI);
-    gpio_set_function(PIN_SPI_MISO, GPIO_FUNC_SPI);
+    // per chip throughput since the last S
+    static uint32_t last_events[GPX2_MAX_DEVICES];
+    for (int i = 0; i < gpx2_ndev && gpx2_ndev > 1; i++)
+    {
+        const gpx2_dev_t *d = &gpx2_dev[i];
+        uint32_t e = d->events;
+        printf("DEV%d: spi%u frames=%lu events=%lu rate=%lu ev/s\n", i + 1, d->bus,
+               (unsigned long)d->frames, (unsigned long)e,
+               (unsigned long)(dt ? (uint64_t)(e - last_events[i]) * 1000000u / dt : 0));
+        last_events[i] = e;
+    }
+    if (gpx2_bulk_enabled || gpx2_bulk_sent != 0)
+        printf("BULK: %s, sent=%lu dropped=%lu bytes\n", hal_bulk_ready() ? "host connected" : "no host",
+               (unsigned long)gpx2_bulk_sent, (unsigned long)gpx2_bulk_dropped);
+    // hits coming in while flash is busy overflow the chip FIFO uncounted
+    if (gpx2_capture_enabled)
+        printf("CAPTURE: %s, readout held up %lu ms by flash erase and program\n",
+               gpx2_capture_names[gpx2_capture.state], (unsigned long)(gpx2_capture.held_us / 1000));
 
-    // initialie chip select pin
-    gpio_init(PIN_SPI_CS);
-    gpio_set_function(PIN_SPI_CS, GPIO_FUNC_SIO);
-    gpio_set_dir(PIN_SPI_CS, GPIO_OUT);
-    gpx2_cs_high();
+    for (int ch = 0; ch < GPX2_GATE_CHANNELS && gpx2_gate_enabled; ch++)
+    {
+        const uint32_t *rej = gpx2_gate.rejected[ch];
+        if (gpx2_gate.rule[ch].flags == 0 && gpx2_gate.accepted[ch] == 0)
+            continue;
+        printf("GATE CH%d: accepted=%lu rejected stop=%lu ref=%lu window=%lu prescale=%lu\n", ch + 1,
+               (unsigned long)gpx2_gate.accepted[ch], (unsigned long)rej[GPX2_GATE_REJ_STOP],
+               (unsigned long)rej[GPX2_GATE_REJ_REF], (unsigned long)rej[GPX2_GATE_REJ_WINDOW],
+               (unsigned long)rej[GPX2_GATE_REJ_PRESCALE]);
+    }
 
-    // initialize interrupt pin
-    gpio_init(PIN_GPX_INT);
-    gpio_set_function(PIN_GPX_INT, GPIO_FUNC_SIO);
-    gpio_set_dir(PIN_GPX_INT, GPIO_IN);
+    for (int p = 0; p < gpx2_coinc.npairs && gpx2_coinc_enabled; p++)
+    {
+        const gpx2_coinc_pair_t *c = &gpx2_coinc.pair[p];
+        printf("COINC P%d CH%d-CH%d: matched=%lu accidental=%lu unmatched=%lu/%lu\n",
+               p + 1, c->b + 1, c->a + 1,
+               (unsigned long)c->matched, (unsigned long)c->accidental,
+               (unsigned long)c->unmatched_a, (unsigned long)c->unmatched_b);
+    }
+}
 
-    // power-on reset command
-    gpx2_cs_low();
-    gpx2_spi_send_byte(OPC_POWER_RESET);
-    gpx2_cs_high();
-    busy_wait_us(100);
+// print results for channels with a new hit, t_ps is NULL in raw format.
+// With several chips lines carry the chip and the global channel dev * 4 + ch
+static void gpx2_print_results(const gpx2_result_t *res, const uint64_t *t_ps)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        if (!(res->mask & (1 << ch)))
+            continue;
+        if (gpx2_ndev > 1)
+            printf("D%d ", res->dev + 1);
+        int g = res->dev * GPX2_CHANNELS + ch;
+        if (t_ps != NULL)
+        {
+            printf("CH%d: T=%llu ps\n", g + 1, (unsigned long long)t_ps[ch]);
+        }
+        else
+        {
+            printf("CH%d: REF=%lu   STOP=%lu\n",
+                   g + 1,
+                   (unsigned long)res->ref[ch],
+                   (unsigned long)res->stop[ch]);
+            // printf("%d\n",res->stop[ch]); //debug
+        }
+    }
+}
 
+// event data out on the selected channel. The bulk endpoint takes it a
+// buffer at a time; with both buffers on the wire this waits up to
+// GPX2_BULK_WAIT_US, then the rest is dropped (decoders resync on the next
+// frame), as it is right away while no host has the device open
+static void gpx2_data_write(const uint8_t *data, size_t len)
+{
+    if (!gpx2_bulk_enabled)
+    {
+        hal_write_raw(data, len);
+        return;
+    }
+    uint64_t start = 0;
+    while (len > 0)
+    {
+        size_t n = hal_bulk_write(data, len);
+        data += n;
+        len -= n;
+        gpx2_bulk_sent += n;
+        if (len == 0 || !hal_bulk_ready())
+            break;
+        if (n == 0)
+        {
+            if (start == 0)
+                start = hal_time_us();
+            else if (hal_time_us() - start > GPX2_BULK_WAIT_US)
+                break;
+        }
+    }
+    gpx2_bulk_dropped += len;
+}
 
+// send the open binary frame, raw so stdio does no CR/LF translation
+static void gpx2_stream_flush(void)
+{
+    size_t size = gpx2_stream_finish(&gpx2_stream);
+    if (size > 0)
+    {
+        gpx2_data_write(gpx2_stream.buf, size);
+    }
+}
 
+// append one record to the open frame, sending it when full. The channel
+// byte is the global channel dev * 4 + ch
+static bool gpx2_stream_add(const gpx2_result_t *res, const uint64_t *t_ps, int ch)
+{
+    uint8_t g = (uint8_t)(res->dev * GPX2_CHANNELS + ch);
+    if (t_ps != NULL)
+        return gpx2_stream_add_time(&gpx2_stream, g, t_ps[ch]);
+    return gpx2_stream_add_event(&gpx2_stream, g, res->ref[ch], res->stop[ch]);
+}
 
-    // write config to GPX2
-    gpx2_write_and_verify_config(gpx2_config);
+// append new hits to the open frame, t_ps is NULL in raw format
+static void gpx2_stream_results(const gpx2_result_t *res, const uint64_t *t_ps)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        if (!(res->mask & (1 << ch)))
+            continue;
+        if (gpx2_stream.type == 0)
+        {
+            gpx2_stream_open_us = hal_time_us();
+        }
+        if (!gpx2_stream_add(res, t_ps, ch))
+        {
+            gpx2_stream_flush();
+            gpx2_stream_open_us = hal_time_us();
+            gpx2_stream_add(res, t_ps, ch);
+        }
+    }
+}
+
+// append one result frame as a packed record, raw format only
+static void gpx2_stream_packed(const gpx2_result_t *res)
+{
+    if (gpx2_stream.type == 0)
+    {
+        gpx2_stream_open_us = hal_time_us();
+    }
+    if (!gpx2_pack_add(&gpx2_pack, &gpx2_stream, res))
+    {
+        gpx2_stream_flush();
+        gpx2_stream_open_us = hal_time_us();
+        gpx2_pack_add(&gpx2_pack, &gpx2_stream, res);
+    }
+}
 
-    printf("Config written, starting measurement...\n");
-    printf("Press P to pause mearurements, R to resume, C to reset REFNUM, Q to restart the pico\n");
+// record output mode: chip count, init count, REFCLK period and config in a
+// frame of its own, ahead of the raw frames and after every OPC_INIT
+static void gpx2_record_setup(uint32_t epoch)
+{
+    gpx2_stream_flush();
+    uint8_t *p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_SETUP, GPX2_SETUP_PAYLOAD);
+    p[0] = gpx2_ndev;
+    gpx2_put_le32(p + 1, epoch);
+    gpx2_put_le32(p + 5, gpx2_refclk_period_ps);
+    memcpy(p + 9, gpx2_config, GPX2_CONFIG_BYTES);
+    gpx2_stream_flush();
+    gpx2_record_epoch = epoch;
+}
 
-    // start measurement
-    gpx2_start_measurement();
+// gpx2_dev raw hook, in the reading context (main loop, INT irq or core1):
+// the 24 bytes clocked out after OPC_READ_RESULTS, empty and stale slots
+// included, stamped with the time of the read
+static void gpx2_record_raw(uint8_t dev, const uint8_t *frame)
+{
+    gpx2_raw_frame_t f;
+    f.dev = dev;
+    f.epoch = gpx2_acq_epoch;
+    f.t_us = (uint32_t)hal_time_us();
+    memcpy(f.frame, frame, GPX2_FRAME_BYTES);
+    gpx2_raw_ring_push(&gpx2_raw_ring, &f);
+}
+
+// recorded frames into the stream, a SETUP frame ahead of the first one read
+// after an OPC_INIT; a running or dumping capture gets the bus to itself
+static void gpx2_record_drain(void)
+{
+    static uint32_t reported_drops = 0;
+    uint32_t drops = atomic_load_explicit(&gpx2_raw_ring.dropped, memory_order_relaxed);
+    if (drops != reported_drops)
+    {
+        printf("WARNING: %lu frames not recorded, raw ring full\n", (unsigned long)drops);
+        reported_drops = drops;
+    }
+    bool capturing = gpx2_capture_enabled && (gpx2_capture.state == GPX2_CAPTURE_RUNNING || gpx2_capture_dumping);
+    gpx2_raw_frame_t f;
+    for (int n = 0; n < GPX2_RAW_RING_SIZE && gpx2_raw_ring_pop(&gpx2_raw_ring, &f); n++)
+    {
+        if (capturing)
+            continue;
+        if (f.epoch != gpx2_record_epoch)
+            gpx2_record_setup(f.epoch);
+        if (gpx2_stream.type == 0)
+        {
+            gpx2_stream_open_us = hal_time_us();
+        }
+        if (!gpx2_stream_add_raw(&gpx2_stream, f.dev, f.t_us, f.frame))
+        {
+            gpx2_stream_flush();
+            gpx2_stream_open_us = hal_time_us();
+            gpx2_stream_add_raw(&gpx2_stream, f.dev, f.t_us, f.frame);
+        }
+    }
+}
+
+// write out the csv buffer in one go
+static void gpx2_text_flush(void)
+{
+    if (gpx2_text.len > 0)
+    {
+        gpx2_data_write((const uint8_t *)gpx2_text.buf, gpx2_text.len);
+        gpx2_text.len = 0;
+    }
+}
+
+// make room for one csv line, the first line of a chunk starts the flush timer
+static void gpx2_text_reserve(void)
+{
+    if (!gpx2_text_room(&gpx2_text))
+        gpx2_text_flush();
+    if (gpx2_text.len == 0)
+        gpx2_text_open_us = hal_time_us();
+}
+
+// csv header for the current columns, sent when measurement starts
+static void gpx2_text_start(void)
+{
+    char line[GPX2_TEXT_LINE_MAX];
+    int n = gpx2_coinc_enabled ? sprintf(line, "pair,dt_ps\n")
+                               : gpx2_text_header(line, gpx2_config[0] & gpx2_config[1] & 0x0F,
+                                                  gpx2_time_format == GPX2_TIME_PS);
+    gpx2_text_init(&gpx2_text);
+    gpx2_data_write((const uint8_t *)line, n);
+}
+
+// move event data between console and bulk endpoint (U). What is open goes
+// out on the old channel, the new one starts with what a decoder needs first
+static void gpx2_data_select(bool bulk)
+{
+    if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+        gpx2_record_drain();
+    gpx2_stream_flush();
+    gpx2_text_flush();
+    if (gpx2_bulk_enabled)
+        hal_bulk_flush();
+    gpx2_bulk_enabled = bulk;
+    printf("DATA on the %s\n", bulk ? "usb bulk endpoint" : "usb console");
+    if (gpx2_output_mode == GPX2_OUTPUT_CSV)
+        gpx2_text_start();
+    else if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+        gpx2_record_setup(gpx2_record_epoch);
+    else if (gpx2_output_mode == GPX2_OUTPUT_PACKED)
+        gpx2_pack_init(&gpx2_pack); // next packed frame is a keyframe
+}
+
+static void gpx2_output_results(const gpx2_result_t *res, const uint64_t *t_ps)
+{
+    if (gpx2_output_mode == GPX2_OUTPUT_BINARY)
+        gpx2_stream_results(res, t_ps);
+    else if (gpx2_output_mode == GPX2_OUTPUT_PACKED)
+    {
+        // picosecond timestamps keep their fixed size records
+        if (t_ps != NULL)
+            gpx2_stream_results(res, t_ps);
+        else
+            gpx2_stream_packed(res);
+    }
+    else if (gpx2_output_mode == GPX2_OUTPUT_TEXT)
+        gpx2_print_results(res, t_ps);
+    else if (gpx2_output_mode == GPX2_OUTPUT_CSV)
+    {
+        gpx2_text_reserve();
+        gpx2_text_add_frame(&gpx2_text, res, t_ps, gpx2_dev[res->dev].active_mask);
+    }
+}
+
+// send one coincidence result
+static void gpx2_output_dt(const gpx2_coinc_pair_t *p, int pair, int32_t dt_ps)
+{
+    if (gpx2_output_mode == GPX2_OUTPUT_BINARY || gpx2_output_mode == GPX2_OUTPUT_PACKED)
+    {
+        if (gpx2_stream.type == 0)
+        {
+            gpx2_stream_open_us = hal_time_us();
+        }
+        if (!gpx2_stream_add_dt(&gpx2_stream, p->a, p->b, dt_ps))
+        {
+            gpx2_stream_flush();
+            gpx2_stream_open_us = hal_time_us();
+            gpx2_stream_add_dt(&gpx2_stream, p->a, p->b, dt_ps);
+        }
+    }
+    else if (gpx2_output_mode == GPX2_OUTPUT_TEXT)
+    {
+        printf("P%d CH%d-CH%d: DT=%ld ps\n", pair + 1, p->b + 1, p->a + 1, (long)dt_ps);
+    }
+    else if (gpx2_output_mode == GPX2_OUTPUT_CSV)
+    {
+        gpx2_text_reserve();
+        gpx2_text_add_dt(&gpx2_text, pair, dt_ps);
+    }
+}
+
+// feed the new hits of one frame to the coincidence stage, dT histogram and output
+static void gpx2_coinc_results(const gpx2_result_t *res, const uint64_t *t_ps)
+{
+    gpx2_coinc_dt_t dt[GPX2_COINC_MAX_PAIRS];
+    for (int ch = 0; ch < 4; ch++)
+    {
+        if (!(res->mask & (1 << ch)))
+            continue;
+        int n = gpx2_coinc_add(&gpx2_coinc, res->dev * GPX2_CHANNELS + ch, t_ps[ch], dt);
+        for (int i = 0; i < n; i++)
+        {
+            gpx2_hist_add(&gpx2_dt_hist[dt[i].pair], dt[i].dt_ps);
+            if (gpx2_stats_enabled)
+                gpx2_stats_dt(&gpx2_stats, dt[i].pair, dt[i].dt_ps);
+            gpx2_output_dt(&gpx2_coinc.pair[dt[i].pair], dt[i].pair, dt[i].dt_ps);
+        }
+    }
+}
+
+// per event processing on the consumer side: histogram, then output
+static void gpx2_consume_results(const gpx2_result_t *res)
+{
+    GPX2_PERF_BEGIN(t0);
+    if (gpx2_boot_first_us == 0)
+    {
+        gpx2_boot_first_us = hal_time_us();
+        if (gpx2_output_mode == GPX2_OUTPUT_TEXT)
+            printf("First event %lu us after reset (measurement started at %lu us)\n",
+                   (unsigned long)gpx2_boot_first_us, (unsigned long)gpx2_boot_config_us);
+    }
+    if (gpx2_capture_enabled && (gpx2_capture.state == GPX2_CAPTURE_RUNNING || gpx2_capture_dumping))
+    {
+        // raw hits into the capture, nothing else while it runs or is read back
+        if (gpx2_capture_dumping)
+        {
+            gpx2_capture_dump_dropped += __builtin_popcount(res->mask);
+            GPX2_PERF_END(GPX2_STAGE_OUTPUT, t0);
+            return;
+        }
+        uint64_t now_us = hal_time_us();
+        for (int ch = 0; ch < 4; ch++)
+        {
+            if (res->mask & (1 << ch))
+                gpx2_capture_add(&gpx2_capture, res->dev * GPX2_CHANNELS + ch, res->ref[ch], res->stop[ch], now_us);
+        }
+        GPX2_PERF_END(GPX2_STAGE_OUTPUT, t0);
+        return;
+    }
+    gpx2_result_t corrected;
+    if (gpx2_dnl_active)
+    {
+        // STOP codes to their calibrated position, before anything looks at them
+        corrected = *res;
+        for (int ch = 0; ch < 4; ch++)
+        {
+            if (res->mask & (1 << ch))
+                corrected.stop[ch] = gpx2_dnl_correct(&gpx2_dnl, res->dev * GPX2_CHANNELS + ch, res->stop[ch]);
+        }
+        res = &corrected;
+    }
+    uint64_t t_ps[4];
+    bool ps = (gpx2_time_format == GPX2_TIME_PS) || gpx2_coinc_enabled ||
+              (gpx2_gate_enabled && gpx2_gate_needs_ps(&gpx2_gate)) ||
+              (gpx2_stats_enabled && gpx2_stats.value == GPX2_STATS_INTERVAL);
+    uint64_t now_us = ps ? hal_time_us() : 0;
+    for (int ch = 0; ch < 4; ch++)
+    {
+        if (!(res->mask & (1 << ch)))
+            continue;
+        GPX2_PERF_EVENT(res->dev * GPX2_CHANNELS + ch);
+        // every hit goes through the time base, gated or not, so REF wraps are seen
+        if (ps)
+            t_ps[ch] = gpx2_time_ps(&gpx2_time[res->dev], res->ref[ch], res->stop[ch], now_us);
+    }
+    gpx2_result_t gated;
+    if (gpx2_gate_enabled)
+    {
+        gated = *res;
+        gated.mask = gpx2_gate_apply(&gpx2_gate, res, t_ps);
+        res = &gated;
+    }
+    for (int ch = 0; ch < 4 && gpx2_hist_enabled; ch++)
+    {
+        if (res->mask & (1 << ch))
+            gpx2_hist_add(&gpx2_hist[res->dev * GPX2_CHANNELS + ch], (int32_t)res->stop[ch]);
+    }
+    for (int ch = 0; ch < 4 && gpx2_stats_enabled; ch++)
+    {
+        if (res->mask & (1 << ch))
+            gpx2_stats_hit(&gpx2_stats, res->dev * GPX2_CHANNELS + ch, res->stop[ch], ps ? t_ps[ch] : 0);
+    }
+    if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+    {
+        // the raw hook has the frame already, the host replays it through the
+        // rest; histograms and statistics windows are kept for comparison
+        GPX2_PERF_END(GPX2_STAGE_OUTPUT, t0);
+        return;
+    }
+    if (res->mask != 0) // else everything was gated out
+    {
+        if (gpx2_coinc_enabled)
+            gpx2_coinc_results(res, t_ps);
+        else
+            gpx2_output_results(res, gpx2_time_format == GPX2_TIME_PS ? t_ps : NULL);
+    }
+    GPX2_PERF_END(GPX2_STAGE_OUTPUT, t0);
+}
+
+// csv dump of the channel histograms of all chips, one column per channel
+static void gpx2_hist_dump_csv(void)
+{
+    const gpx2_hist_t *h = &gpx2_hist[0];
+    int nch = gpx2_ndev * GPX2_CHANNELS;
+    printf("# STOP histogram offset=%ld width=%lu bins=%u\n",
+           (long)h->offset, (unsigned long)h->bin_width, h->bins);
+    printf("bin,low");
+    for (int ch = 0; ch < nch; ch++)
+        printf(",ch%d", ch + 1);
+    printf("\n");
+    for (uint16_t i = 0; i < h->bins; i++)
+    {
+        printf("%u,%lld", i, (long long)gpx2_hist_bin_low(h, i));
+        for (int ch = 0; ch < nch; ch++)
+            printf(",%lu", (unsigned long)gpx2_hist[ch].count[i]);
+        printf("\n");
+    }
+    printf("underflow,");
+    for (int ch = 0; ch < nch; ch++)
+        printf(",%lu", (unsigned long)gpx2_hist[ch].underflow);
+    printf("\noverflow,");
+    for (int ch = 0; ch < nch; ch++)
+        printf(",%lu", (unsigned long)gpx2_hist[ch].overflow);
+    printf("\n");
+}
+
+// csv dump of the dT histogram of every coincidence pair
+static void gpx2_dt_hist_dump_csv(void)
+{
+    for (int p = 0; p < gpx2_coinc.npairs; p++)
+    {
+        const gpx2_hist_t *h = &gpx2_dt_hist[p];
+        printf("# dT histogram P%d CH%d-CH%d offset=%ld width=%lu bins=%u\n", p + 1,
+               gpx2_coinc.pair[p].b + 1, gpx2_coinc.pair[p].a + 1,
+               (long)h->offset, (unsigned long)h->bin_width, h->bins);
+        printf("bin,low,count\n");
+        for (uint16_t i = 0; i < h->bins; i++)
+        {
+            printf("%u,%lld,%lu\n", i, (long long)gpx2_hist_bin_low(h, i), (unsigned long)h->count[i]);
+        }
+        printf("underflow,,%lu\n", (unsigned long)h->underflow);
+        printf("overflow,,%lu\n", (unsigned long)h->overflow);
+    }
+}
+
+// one histogram split into GPX2_FRAME_HIST chunks
+static void gpx2_hist_send(uint8_t id, const gpx2_hist_t *h)
+{
+    for (uint16_t first = 0; first < h->bins; first += GPX2_HIST_CHUNK_BINS)
+    {
+        uint16_t n = h->bins - first;
+        if (n > GPX2_HIST_CHUNK_BINS)
+            n = GPX2_HIST_CHUNK_BINS;
+        uint8_t *p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_HIST, GPX2_HIST_CHUNK_HEADER + 4 * n);
+        p[0] = id;
+        gpx2_put_le16(p + 1, first);
+        gpx2_put_le16(p + 3, h->bins);
+        gpx2_put_le32(p + 5, (uint32_t)h->offset);
+        gpx2_put_le32(p + 9, h->bin_width);
+        gpx2_put_le32(p + 13, h->underflow);
+        gpx2_put_le32(p + 17, h->overflow);
+        for (uint16_t i = 0; i < n; i++)
+        {
+            gpx2_put_le32(p + GPX2_HIST_CHUNK_HEADER + 4 * i, h->count[first + i]);
+        }
+        gpx2_stream_flush();
+    }
+}
+
+// binary dump of the enabled STOP and dT histograms
+static void gpx2_hist_dump_binary(void)
+{
+    gpx2_stream_flush(); // close a pending events frame
+    for (uint8_t ch = 0; ch < gpx2_ndev * GPX2_CHANNELS && gpx2_hist_enabled; ch++)
+    {
+        gpx2_hist_send(ch, &gpx2_hist[ch]);
+    }
+    for (uint8_t p = 0; p < gpx2_coinc.npairs && gpx2_coinc_enabled; p++)
+    {
+        gpx2_hist_send(GPX2_HIST_ID_PAIR + p, &gpx2_dt_hist[p]);
+    }
+}
+
+static void gpx2_hist_clear_all(void)
+{
+    for (int ch = 0; ch < GPX2_ALL_CHANNELS; ch++)
+        gpx2_hist_clear(&gpx2_hist[ch]);
+    for (int p = 0; p < GPX2_COINC_MAX_PAIRS; p++)
+        gpx2_hist_clear(&gpx2_dt_hist[p]);
+}
+
+// Q.8 fixed point as text with two decimals
+static const char *gpx2_q8_str(char *buf, size_t n, int64_t q)
+{
+    uint64_t a = q < 0 ? (uint64_t)-q : (uint64_t)q;
+    uint64_t r = (a * 100 + 128) >> GPX2_STATS_FRAC;
+    snprintf(buf, n, "%s%llu.%02u", q < 0 ? "-" : "", (unsigned long long)(r / 100), (unsigned)(r % 100));
+    return buf;
+}
+
+// one line of the last statistics report: the header, then channels with
+// samples, then the coincidence pairs. Returns false past the last line
+static bool gpx2_stats_print_line(int line)
+{
+    char mean[24], sigma[24];
+    uint64_t s;
+    if (line == 0)
+    {
+        printf("STAT window %lu ms, channels: %s\n", (unsigned long)(gpx2_stats.report_us / 1000),
+               gpx2_stats.value == GPX2_STATS_STOP ? "STOP (LSB)" : "interval (ps)");
+        return true;
+    }
+    // lines 1.. walk the channels, skipping those without samples
+    int idx = 0;
+    for (int ch = 0; ch < gpx2_ndev * GPX2_CHANNELS; ch++)
+    {
+        const gpx2_welford_t *w = &gpx2_stats.report_chan[ch];
+        if (w->n == 0 || ++idx != line)
+            continue;
+        printf("STAT CH%d: n=%lu rate=%llu/s mean=%s sigma=%s min=%lld max=%lld\n", ch + 1,
+               (unsigned long)w->n, (unsigned long long)w->n * 1000000ULL / gpx2_stats.report_us,
+               gpx2_q8_str(mean, sizeof mean, w->mean),
+               gpx2_welford_sigma(w, &s) ? gpx2_q8_str(sigma, sizeof sigma, (int64_t)s) : "-",
+               (long long)w->min, (long long)w->max);
+        return true;
+    }
+    int p = line - idx - 1;
+    if (!gpx2_coinc_enabled || p >= gpx2_coinc.npairs)
+        return false;
+    const gpx2_welford_t *w = &gpx2_stats.report_pair[p];
+    printf("STAT P%d CH%d-CH%d: n=%lu rate=%llu/s mean dT=%s sigma=%s min=%lld max=%lld ps\n", p + 1,
+           gpx2_coinc.pair[p].b + 1, gpx2_coinc.pair[p].a + 1, (unsigned long)w->n,
+           (unsigned long long)w->n * 1000000ULL / gpx2_stats.report_us,
+           gpx2_q8_str(mean, sizeof mean, w->mean),
+           gpx2_welford_sigma(w, &s) ? gpx2_q8_str(sigma, sizeof sigma, (int64_t)s) : "-",
+           w->n ? (long long)w->min : 0LL, w->n ? (long long)w->max : 0LL);
+    return true;
+}
+
+// one GPX2_FRAME_STATS record, a new frame starts with the window length
+static void gpx2_stats_put(uint8_t id, const gpx2_welford_t *w)
+{
+    uint8_t *p = NULL;
+    if (gpx2_stream.type == GPX2_FRAME_STATS)
+        p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_STATS, GPX2_STATS_RECORD);
+    if (p == NULL)
+    {
+        gpx2_stream_flush();
+        gpx2_put_le32(gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_STATS, 4), gpx2_stats.report_us);
+        p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_STATS, GPX2_STATS_RECORD);
+    }
+    uint64_t s;
+    p[0] = id;
+    gpx2_put_le32(p + 1, w->n);
+    gpx2_put_le64(p + 5, (uint64_t)w->mean);
+    gpx2_put_le32(p + 13, gpx2_welford_sigma(w, &s) && s < 0xFFFFFFFF ? (uint32_t)s : 0xFFFFFFFF);
+    gpx2_put_le64(p + 17, (uint64_t)w->min);
+    gpx2_put_le64(p + 25, (uint64_t)w->max);
+}
+
+// close the statistics window when it is due and report it: binary modes send
+// it as frames right away, text goes out one line per loop pass so a report
+// never holds up the readout
+static void gpx2_stats_service(void)
+{
+    if (gpx2_stats_window(&gpx2_stats, hal_time_us()))
+    {
+        if (gpx2_output_mode == GPX2_OUTPUT_BINARY || gpx2_output_mode == GPX2_OUTPUT_PACKED ||
+            gpx2_output_mode == GPX2_OUTPUT_RECORD)
+        {
+            // the window's frames go ahead of its report
+            if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+                gpx2_record_drain();
+            for (uint8_t ch = 0; ch < gpx2_ndev * GPX2_CHANNELS; ch++)
+            {
+                if (gpx2_stats.report_chan[ch].n != 0)
+                    gpx2_stats_put(ch, &gpx2_stats.report_chan[ch]);
+            }
+            for (uint8_t p = 0; p < gpx2_coinc.npairs && gpx2_coinc_enabled; p++)
+                gpx2_stats_put(GPX2_HIST_ID_PAIR + p, &gpx2_stats.report_pair[p]);
+            gpx2_stream_flush();
+        }
+        else
+        {
+            gpx2_stats_line = 0;
+        }
+    }
+    if (gpx2_stats_line >= 0)
+    {
+        gpx2_text_flush(); // keep csv lines whole
+        gpx2_stats_line = gpx2_stats_print_line(gpx2_stats_line) ? gpx2_stats_line + 1 : -1;
+    }
+}
+
+static void gpx2_capture_report(const gpx2_capture_header_t *h)
+{
+    uint32_t avg_us = h->pages ? h->program_us / h->pages : 0;
+    printf("CAPTURE: %lu events in %lu ms (%llu/s), %lu dropped, RAM ring high water %lu/%d pages\n",
+           (unsigned long)h->records, (unsigned long)(h->duration_us / 1000),
+           h->duration_us ? (unsigned long long)h->records * 1000000ULL / h->duration_us : 0ULL,
+           (unsigned long)h->dropped, (unsigned long)h->ram_high, GPX2_CAPTURE_RAM_PAGES);
+    printf("CAPTURE: page program avg %lu us max %lu us, sustained %lu events/s to flash, depth %lu events in flash + %d in RAM\n",
+           (unsigned long)avg_us, (unsigned long)h->program_max_us,
+           avg_us ? (unsigned long)(GPX2_CAPTURE_PAGE_RECORDS * 1000000UL / avg_us) : 0UL,
+           (unsigned long)GPX2_CAPTURE_MAX_RECORDS, GPX2_CAPTURE_RAM_PAGES * GPX2_CAPTURE_PAGE_RECORDS);
+    // flash busy holds up the readout, hits beyond the chip FIFO are lost then
+    printf("CAPTURE: readout held up %lu ms erasing before the start, %lu ms programming during it\n",
+           (unsigned long)(h->erase_us / 1000), (unsigned long)(h->program_us / 1000));
+}
+
+// B: arm or start a capture
+static void gpx2_capture_command(void)
+{
+    if (gpx2_capture_dumping || !gpx2_capture_trigger(&gpx2_capture))
+        printf("CAPTURE busy\n");
+    else if (gpx2_capture.state != GPX2_CAPTURE_READY)
+        printf("CAPTURE erasing flash, starts when done (readout held up ~45 ms per block, %d blocks)\n",
+               HAL_CAPTURE_SIZE / HAL_CAPTURE_BLOCK);
+}
+
+// D: start reading back the capture in flash
+static void gpx2_capture_dump_start(void)
+{
+    if (gpx2_capture.state == GPX2_CAPTURE_RUNNING || gpx2_capture.state == GPX2_CAPTURE_SPILLING ||
+        gpx2_capture_dumping)
+    {
+        printf("CAPTURE busy\n");
+        return;
+    }
+    if (gpx2_capture.state == GPX2_CAPTURE_ERASING || !gpx2_capture_header(&gpx2_capture_dump))
+    {
+        printf("CAPTURE: no capture in flash\n");
+        return;
+    }
+    printf("CAPTURE dump: %lu records\n", (unsigned long)gpx2_capture_dump.records);
+    gpx2_text_flush();
+    gpx2_stream_flush();
+    gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_CAPTURE, 0);
+    gpx2_stream_flush();
+    gpx2_capture_dump_next = 0;
+    gpx2_capture_dump_crc = GPX2_CRC16_INIT;
+    gpx2_capture_dump_dropped = 0;
+    gpx2_capture_dumping = true;
+}
+
+// a few pages of the read back as event frames, then the summary frame
+static void gpx2_capture_dump_step(void)
+{
+    static uint8_t buf[GPX2_FRAME_MAX_PAYLOAD];
+    uint32_t end = gpx2_capture_dump_next + GPX2_CAPTURE_DUMP_PAGES * GPX2_CAPTURE_PAGE_RECORDS;
+    if (end > gpx2_capture_dump.records)
+        end = gpx2_capture_dump.records;
+    bool failed = false;
+    while (gpx2_capture_dump_next < end)
+    {
+        uint32_t n = end - gpx2_capture_dump_next;
+        if (n > GPX2_FRAME_MAX_PAYLOAD / GPX2_EVENT_RECORD)
+            n = GPX2_FRAME_MAX_PAYLOAD / GPX2_EVENT_RECORD;
+        // read first, a failed read must not go out as events
+        if (!gpx2_capture_read(gpx2_capture_dump_next, n, buf))
+        {
+            failed = true;
+            break;
+        }
+        uint8_t *p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_EVENTS, (uint16_t)(n * GPX2_EVENT_RECORD));
+        memcpy(p, buf, n * GPX2_EVENT_RECORD);
+        gpx2_capture_dump_crc = gpx2_crc16(gpx2_capture_dump_crc, p, n * GPX2_EVENT_RECORD);
+        gpx2_stream_flush();
+        gpx2_capture_dump_next += n;
+    }
+    if (failed)
+        printf("\nERROR: capture flash read failed at record %lu, dump aborted\n",
+               (unsigned long)gpx2_capture_dump_next);
+    else if (gpx2_capture_dump_next < gpx2_capture_dump.records)
+        return;
+    // the summary carries the header's count and crc, so an aborted dump
+    // shows up as a mismatch on the host too
+    uint8_t *p = gpx2_stream_reserve(&gpx2_stream, GPX2_FRAME_CAPTURE, GPX2_CAPTURE_SUMMARY);
+    gpx2_put_le32(p, gpx2_capture_dump.records);
+    gpx2_put_le16(p + 4, gpx2_capture_dump.crc);
+    gpx2_put_le32(p + 6, gpx2_capture_dump.duration_us);
+    gpx2_put_le32(p + 10, gpx2_capture_dump.dropped);
+    gpx2_put_le32(p + 14, gpx2_capture_dump_dropped);
+    gpx2_stream_flush();
+    gpx2_capture_dumping = false;
+    if (failed)
+        return;
+    printf("\nCAPTURE dump done: %lu records, crc %04X %s, %lu hits dropped during the read back\n",
+           (unsigned long)gpx2_capture_dump.records, gpx2_capture_dump.crc,
+           gpx2_capture_dump_crc == gpx2_capture_dump.crc ? "ok" : "MISMATCH",
+           (unsigned long)gpx2_capture_dump_dropped);
+}
+
+// erase, program and read back in small steps from the main loop
+static void gpx2_capture_step(void)
+{
+    if (gpx2_capture_service(&gpx2_capture, hal_time_us()))
+    {
+        switch (gpx2_capture.state)
+        {
+        case GPX2_CAPTURE_READY:
+            printf("CAPTURE ready, B starts\n");
+            break;
+        case GPX2_CAPTURE_RUNNING:
+            if (gpx2_capture.hdr.erase_us != 0)
+                printf("CAPTURE region erased, readout held up %lu ms\n",
+                       (unsigned long)(gpx2_capture.hdr.erase_us / 1000));
+            printf("CAPTURE running\n");
+            break;
+        case GPX2_CAPTURE_DONE:
+            gpx2_capture_report(&gpx2_capture.hdr);
+            printf("CAPTURE done, D reads it back\n");
+            break;
+        case GPX2_CAPTURE_FAILED:
+            printf("ERROR: capture flash did not verify\n");
+            break;
+        default:
+            break;
+        }
+    }
+    if (gpx2_capture_dumping)
+        gpx2_capture_dump_step();
+}
+
+// bound the latency of a partly filled binary frame or csv chunk
+static void gpx2_output_idle(void)
+{
+    if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+    {
+        gpx2_record_drain();
+    }
+    if (gpx2_stream.type != 0 && hal_time_us() - gpx2_stream_open_us > GPX2_STREAM_FLUSH_US)
+    {
+        gpx2_stream_flush();
+    }
+    if (gpx2_text.len != 0 && hal_time_us() - gpx2_text_open_us > GPX2_STREAM_FLUSH_US)
+    {
+        gpx2_text_flush();
+    }
+    // a partly filled buffer goes out whenever the endpoint is idle, so
+    // transfers only grow when data comes faster than the bus takes it
+    if (gpx2_bulk_enabled)
+    {
+        hal_bulk_flush();
+    }
+}
+
+// an OPC_INIT restarted the REF index: time bases and open pairings start over
+static void gpx2_epoch_begin(uint32_t epoch)
+{
+    gpx2_time_epoch = epoch;
+    if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+    {
+        // frames of the old epoch first, then the init even without new ones
+        gpx2_record_drain();
+        if (gpx2_record_epoch != epoch)
+            gpx2_record_setup(epoch);
+    }
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_time_reset(&gpx2_time[i]);
+    gpx2_coinc_flush(&gpx2_coinc);
+    gpx2_gate_flush(&gpx2_gate);
+    gpx2_stats_flush(&gpx2_stats);
+}
+
+// main
+int main()
+{
+    hal_console_init(); // enable usb serial output
+    for (int ch = 0; ch < GPX2_ALL_CHANNELS; ch++)
+        gpx2_hist_setup(&gpx2_hist[ch], 0, 256, GPX2_HIST_MAX_BINS); // default covers 0..262143
+    for (int p = 0; p < GPX2_COINC_MAX_PAIRS; p++)
+        gpx2_hist_setup(&gpx2_dt_hist[p], -8192, 16, GPX2_HIST_MAX_BINS); // default +/-8 ns
+    gpx2_gate_init(&gpx2_gate);
+    int userinput = 0;
+    gpx2_watchdog_boot = hal_watchdog_caused_reboot();
+    if (gpx2_watchdog_boot)
+        printf("WARNING: last reset came from the watchdog\n");
+
+    // initialize SPI hardware, CS and INT pins, before the menu so the calibration can use them
+    gpx2_devices_init();
+
+    // headless boot: a valid default profile starts measuring without the menu,
+    // unless the last reboot came from M
+    bool headless = false;
+    uint32_t boot_tag = hal_boot_tag();
+    gpx2_profile_load(&gpx2_profiles);
+    gpx2_dnl_load(&gpx2_dnl_store);
+    const gpx2_profile_t *profile = gpx2_profile_default(&gpx2_profiles);
+    if (profile != NULL && boot_tag != GPX2_BOOT_TAG_MENU)
+    {
+        gpx2_profile_apply(profile);
+        gpx2_devices_init();
+        printf("Boot profile '%s'\n", profile->name);
+        headless = gpx2_validate_input();
+    }
+
+    //cli
+    if (!headless)
+    {
+        userinput = getchar();
+        do
+        {
+            gpx2_input_config();
+        } while (!gpx2_validate_input());
+    }
+
+    // speed from the menu, profile or calibration
+    gpx2_spi_set_speed(gpx2_spi_speed_hz);
+
+    // power-on reset, config write + verify and OPC_INIT; a config that does
+    // not verify is retried from the main loop instead of blocking here
+    for (int i = 0; i < gpx2_ndev; i++)
+        gpx2_time_setup(&gpx2_time[i], gpx2_refclk_period_ps,
+                        gpx2_config[3] | (gpx2_config[4] << 8) | ((gpx2_config[5] & 0x0F) << 16));
+    // correction tables of the HIRES setting in use
+    if (gpx2_dnl_store.enabled)
+    {
+        uint8_t hires = (gpx2_config[1] >> 6) & 0x03;
+        gpx2_dnl_active = gpx2_dnl_apply(&gpx2_dnl, &gpx2_dnl_store, hires,
+                                         gpx2_config[3] | (gpx2_config[4] << 8) | ((gpx2_config[5] & 0x0F) << 16));
+        if (gpx2_dnl_active)
+            printf("DNL correction on for %d channels (HIRES %s)\n", __builtin_popcount(gpx2_dnl.mask),
+                   gpx2_hires_names[hires]);
+        else
+            printf("WARNING: DNL correction enabled but no tables for this HIRES setting\n");
+    }
+    gpx2_acq_configure();
+    gpx2_time_epoch = gpx2_acq_epoch;
+    gpx2_acq_state_t seen_state = gpx2_acq_state;
+
+    if (seen_state == GPX2_ACQ_ERROR)
+        printf("ERROR: config write did not verify, retrying every %d ms (Q resets the pico)\n",
+               GPX2_ACQ_RETRY_US / 1000);
+    else
+        printf("Config written, starting measurement...\n");
+    printf("Press P to pause mearurements, R to resume, C to reset REFNUM, S for counters, T for timing, M for the config menu, Q to restart the pico\n");
+    if (gpx2_hist_enabled || gpx2_coinc_enabled)
+        printf("Histograms: H dumps csv, X dumps binary, Z clears\n");
+    printf("Event data on the %s, U switches\n", gpx2_bulk_enabled ? "usb bulk endpoint" : "usb console");
+    if (gpx2_stats_enabled)
+        printf("Live statistics every %lu ms\n", (unsigned long)(gpx2_stats.window_us / 1000));
+    if (gpx2_capture_enabled && !hal_capture_available())
+    {
+        printf("ERROR: firmware image reaches into the capture region, burst capture off\n");
+        gpx2_capture_enabled = false;
+    }
+    if (gpx2_capture_enabled)
+    {
+        gpx2_capture_init(&gpx2_capture, gpx2_capture_max_events, gpx2_capture_max_ms * 1000);
+        printf("Burst capture: B starts, D reads back (up to %lu events)\n",
+               (unsigned long)gpx2_capture.max_records);
+        if (gpx2_capture.state == GPX2_CAPTURE_DONE)
+            printf("CAPTURE in flash: %lu events, D reads it back\n", (unsigned long)gpx2_capture.hdr.records);
+    }
 
-    uint32_t reference_index[4] = {0};
-    uint32_t stop_results[4] = {0};
+    gpx2_result_t results = {0};
+    uint32_t reported_drops = 0;
+    gpx2_stream_init(&gpx2_stream);
+    gpx2_pack_init(&gpx2_pack);
+    gpx2_raw_ring_init(&gpx2_raw_ring);
+    if (gpx2_output_mode == GPX2_OUTPUT_CSV)
+        gpx2_text_start();
+    else if (gpx2_output_mode == GPX2_OUTPUT_RECORD)
+        gpx2_record_setup(gpx2_acq_epoch);
+    gpx2_perf_init();
+    gpx2_stats_clear(&gpx2_stats, hal_time_us());
+
+    if (gpx2_readout_mode == GPX2_READOUT_IRQ)
+    {
+        gpx2_irq_arm();
+    }
+    else if (gpx2_readout_mode == GPX2_READOUT_CORE1)
+    {
+        // from here on core0 must not touch the SPI bus
+        gpx2_ring_init(&gpx2_ring);
+        hal_core1_launch(gpx2_core1_main);
+    }
+    // fed once per loop pass, in core1 mode only while core1 keeps looping
+    hal_watchdog_enable(GPX2_WATCHDOG_MS);
+    uint32_t seen_beat = gpx2_core1_beat;
 
     while (true)
     {
         // printf("withing measure loop\n");
-        if (clk_reset)
+        bool core1 = (gpx2_readout_mode == GPX2_READOUT_CORE1);
+        if (!core1 || gpx2_core1_beat != seen_beat)
         {
-            gpx2_refclk_reset_unpulse();
-            gpx2_write_and_verify_config(gpx2_config);
-            clk_reset = false;
-            gpx2_start_measurement();
+            hal_watchdog_feed();
+            seen_beat = gpx2_core1_beat;
+        }
+        if (!core1)
+        {
+            gpx2_runtime_service();
         }
 
-        userinput = getchar_timeout_us(0);
-        if (userinput == 'p' || userinput == 'P') // p pauses measurements
+        // every OPC_INIT (R, C, stall recovery, reconfiguration) restarts the REF index
+        uint32_t epoch = gpx2_acq_epoch;
+        if (epoch != gpx2_time_epoch)
+            gpx2_epoch_begin(epoch);
+        // armed/reading flip all the time, only entering and leaving the error state is shown
+        gpx2_acq_state_t st = gpx2_acq_state;
+        if (st == GPX2_ACQ_ERROR && seen_state != GPX2_ACQ_ERROR)
+            printf("ERROR: config write did not verify, retrying every %d ms (Q resets the pico)\n",
+                   GPX2_ACQ_RETRY_US / 1000);
+        else if ((st == GPX2_ACQ_ARMED || st == GPX2_ACQ_PAUSED) && seen_state == GPX2_ACQ_ERROR)
+            printf("Config written, measurement %s\n", gpx2_acq_names[st]);
+        if (st != GPX2_ACQ_CONFIGURING)
+            seen_state = st;
+        static uint32_t seen_reinits = 0, seen_reconfigs = 0;
+        if (gpx2_acq_reinits != seen_reinits)
         {
-            measure = false;
-            gpx2_pins_disable();
-            gpx2_write_and_verify_config(gpx2_config);
+            seen_reinits = gpx2_acq_reinits;
+            printf("WARNING: readout stalled, restarted with OPC_INIT (%lu so far)\n",
+                   (unsigned long)seen_reinits);
         }
-        else if (userinput == 'r' || userinput == 'R') // r restarts measurements
+        if (gpx2_acq_reconfigs != seen_reconfigs)
         {
-            measure = true;
-            gpx2_pins_enable();
-            gpx2_write_and_verify_config(gpx2_config);
-            gpx2_start_measurement();
+            seen_reconfigs = gpx2_acq_reconfigs;
+            printf("WARNING: chip config lost, configuring again (%lu so far)\n",
+                   (unsigned long)seen_reconfigs);
         }
-        else if (userinput == 'c' || userinput == 'C')
+
+        GPX2_PERF_BEGIN(t_cmd);
+        userinput = hal_getchar_timeout_us(0);
+        if (userinput >= 0)
         {
-            gpx2_refclk_reset_pulse();
-            gpx2_write_and_verify_config(gpx2_config);
-            clk_reset = true;
+            GPX2_PERF_COMMAND();
         }
-        else if (userinput == 'q' || userinput == 'Q') // q resets the pico
+        if (userinput == 'q' || userinput == 'Q') // q resets the pico
         {
             restart();
         }
-        if (measure)
+        else if (userinput == 'm' || userinput == 'M') // back to the menu through a reboot
         {
-            // read masurement results
-            gpx2_read_results(reference_index, stop_results);
-
-            // print results for all 4 channels
-            for (int ch = 0; ch < 4; ch++)
+            hal_reboot_tagged(GPX2_BOOT_TAG_MENU);
+        }
+        else if (userinput == 's' || userinput == 'S')
+        {
+            gpx2_print_acq_stats();
+        }
+        else if (userinput == 't' || userinput == 'T') // timing report, acquisition keeps running
+        {
+            gpx2_perf_report();
+        }
+        else if (userinput == 'h' || userinput == 'H') // histograms as csv
+        {
+            if (gpx2_hist_enabled)
+                gpx2_hist_dump_csv();
+            if (gpx2_coinc_enabled)
+                gpx2_dt_hist_dump_csv();
+        }
+        else if (userinput == 'x' || userinput == 'X') // histograms as binary frames
+        {
+            gpx2_hist_dump_binary();
+        }
+        else if (userinput == 'z' || userinput == 'Z') // clear histograms
+        {
+            gpx2_hist_clear_all();
+        }
+        else if (userinput == 'u' || userinput == 'U') // event data to/from the bulk endpoint
+        {
+            gpx2_data_select(!gpx2_bulk_enabled);
+        }
+        else if ((userinput == 'b' || userinput == 'B') && gpx2_capture_enabled)
+        {
+            gpx2_capture_command();
+        }
+        else if ((userinput == 'd' || userinput == 'D') && gpx2_capture_enabled)
+        {
+            gpx2_capture_dump_start();
+        }
+        else if (core1)
+        {
+            // core1 owns the bus, hand P/R/C over
+            if (userinput == 'p' || userinput == 'P' || userinput == 'r' || userinput == 'R' ||
+                userinput == 'c' || userinput == 'C')
             {
-                if (pins[ch] != 0)
+                hal_core1_push((uint32_t)userinput);
+            }
+        }
+        else
+        {
+            gpx2_runtime_command(userinput);
+        }
+        GPX2_PERF_END(GPX2_STAGE_COMMAND, t_cmd);
+        if (gpx2_readout_mode != GPX2_READOUT_POLL)
+        {
+            // irq or core1 fills the ring, main loop only drains it
+            if (!core1)
+            {
+                gpx2_acq_step();
+            }
+            // bounded so commands are still polled when the irq keeps refilling
+            uint32_t epoch;
+            for (int n = 0; n < GPX2_RING_SIZE && gpx2_ring_pop(&gpx2_ring, &results, &epoch); n++)
+            {
+                // read before an OPC_INIT the time bases were already reset for
+                if ((int32_t)(epoch - gpx2_time_epoch) < 0)
                 {
-                    printf("CH%d: REF=%lu   STOP=%lu\n",
-                           ch + 1,
-                           (unsigned long)reference_index[ch],
-                           (unsigned long)stop_results[ch]);
-                    // printf("%d\n",stop_results[ch]); //debug
+                    gpx2_ring_stale++;
+                    continue;
                 }
+                // read after one the top of the loop has not seen yet
+                if (epoch != gpx2_time_epoch)
+                    gpx2_epoch_begin(epoch);
+                gpx2_consume_results(&results);
+            }
+            gpx2_output_idle();
+            uint32_t drops = atomic_load_explicit(&gpx2_ring.dropped, memory_order_relaxed);
+            if (drops != reported_drops)
+            {
+                printf("WARNING: %lu frames dropped, ring high water %lu/%d\n",
+                       (unsigned long)drops,
+                       (unsigned long)atomic_load_explicit(&gpx2_ring.high_water, memory_order_relaxed),
+                       GPX2_RING_SIZE);
+                reported_drops = drops;
             }
         }
-
-        
+        else
+        {
+            // read masurement results, returns after at most GPX2_INT_WAIT_US without INT
+            int got = gpx2_acq_step();
+            for (int i = 0; i < got; i++)
+            {
+                gpx2_consume_results(&gpx2_burst[i]);
+            }
+            gpx2_output_idle();
+        }
+        if (gpx2_stats_enabled)
+        {
+            gpx2_stats_service();
+        }
+        if (gpx2_capture_enabled)
+        {
+            gpx2_capture_step();
+        }
     }
     return 0;
 }
@@ -0,0 +1,222 @@
+#include "gpx2_capture.h"
+#include "gpx2_crc.h"
+#include <string.h>
+
+_Static_assert(sizeof(gpx2_capture_header_t) <= HAL_CAPTURE_PAGE, "capture header exceeds a page");
+_Static_assert(HAL_CAPTURE_SIZE % HAL_CAPTURE_BLOCK == 0, "capture region is not whole blocks");
+
+// page 0 is the header, 0xFF padding and the crc16 of the header in its last
+// two bytes
+#define HEADER_CRC_OFFSET (HAL_CAPTURE_PAGE - 2)
+
+static uint16_t header_crc(const gpx2_capture_header_t *h)
+{
+    return gpx2_crc16(GPX2_CRC16_INIT, (const uint8_t *)h, sizeof(*h));
+}
+
+static bool region_blank(void)
+{
+    uint32_t page[HAL_CAPTURE_PAGE / 4];
+    for (uint32_t off = 0; off < HAL_CAPTURE_SIZE; off += HAL_CAPTURE_PAGE)
+    {
+        if (!hal_capture_read(off, page, sizeof(page)))
+            return false;
+        for (size_t i = 0; i < sizeof(page) / 4; i++)
+        {
+            if (page[i] != 0xFFFFFFFFu)
+                return false;
+        }
+    }
+    return true;
+}
+
+void gpx2_capture_init(gpx2_capture_t *c, uint32_t max_records, uint32_t max_us)
+{
+    memset(c, 0, sizeof(*c));
+    c->max_records = (max_records == 0 || max_records > GPX2_CAPTURE_MAX_RECORDS) ? GPX2_CAPTURE_MAX_RECORDS
+                                                                                 : max_records;
+    c->max_us = max_us;
+    // a capture still in flash stays readable until the next trigger; the
+    // region is not erased here, that would stall the readout right after boot
+    if (gpx2_capture_header(&c->hdr))
+        c->state = GPX2_CAPTURE_DONE;
+    else
+        c->state = region_blank() ? GPX2_CAPTURE_READY : GPX2_CAPTURE_IDLE;
+}
+
+bool gpx2_capture_erase_region(void)
+{
+    for (uint32_t off = 0; off < HAL_CAPTURE_SIZE; off += HAL_CAPTURE_BLOCK)
+    {
+        if (!hal_capture_erase(off))
+            return false;
+    }
+    return true;
+}
+
+bool gpx2_capture_trigger(gpx2_capture_t *c)
+{
+    if (c->state == GPX2_CAPTURE_RUNNING || c->state == GPX2_CAPTURE_SPILLING)
+        return false;
+    if (c->state != GPX2_CAPTURE_ERASING && c->state != GPX2_CAPTURE_READY)
+    {
+        // the last capture goes, erase again
+        c->state = GPX2_CAPTURE_ERASING;
+        c->erase_next = 0;
+        c->erase_us = 0;
+    }
+    c->triggered = true;
+    return true;
+}
+
+void gpx2_capture_stop(gpx2_capture_t *c, uint64_t now_us)
+{
+    if (c->state != GPX2_CAPTURE_RUNNING)
+        return;
+    c->hdr.duration_us = (uint32_t)(now_us - c->start_us);
+    // the partly filled page goes out too, its free slots stay 0xFF
+    if (c->fill != 0)
+    {
+        memset(&c->ram[c->head % GPX2_CAPTURE_RAM_PAGES][c->fill * GPX2_CAPTURE_RECORD], 0xFF,
+               HAL_CAPTURE_PAGE - c->fill * GPX2_CAPTURE_RECORD);
+        c->head++;
+    }
+    c->state = GPX2_CAPTURE_SPILLING;
+}
+
+static void capture_start(gpx2_capture_t *c, uint64_t now_us)
+{
+    uint32_t max_records = c->max_records;
+    uint32_t max_us = c->max_us;
+    c->head = c->tail = 0;
+    c->fill = 0;
+    c->crc = GPX2_CRC16_INIT;
+    memset(&c->hdr, 0, sizeof(c->hdr));
+    c->hdr.erase_us = c->erase_us;
+    c->erase_us = 0;
+    c->max_records = max_records;
+    c->max_us = max_us;
+    c->triggered = false;
+    c->start_us = now_us;
+    c->state = GPX2_CAPTURE_RUNNING;
+}
+
+static bool capture_program(gpx2_capture_t *c, uint64_t now_us)
+{
+    const uint8_t *page = c->ram[c->tail % GPX2_CAPTURE_RAM_PAGES];
+    uint32_t left = c->hdr.records - c->hdr.pages * GPX2_CAPTURE_PAGE_RECORDS;
+    uint32_t n = left < GPX2_CAPTURE_PAGE_RECORDS ? left : GPX2_CAPTURE_PAGE_RECORDS;
+    c->crc = gpx2_crc16(c->crc, page, n * GPX2_CAPTURE_RECORD);
+    bool ok = hal_capture_program((c->hdr.pages + 1) * HAL_CAPTURE_PAGE, page);
+    uint32_t us = (uint32_t)(hal_time_us() - now_us);
+    c->hdr.program_us += us;
+    c->held_us += us;
+    if (us > c->hdr.program_max_us)
+        c->hdr.program_max_us = us;
+    c->hdr.pages++;
+    c->tail++;
+    return ok;
+}
+
+static bool capture_finish(gpx2_capture_t *c)
+{
+    uint8_t page[HAL_CAPTURE_PAGE];
+    memset(page, 0xFF, sizeof(page));
+    c->hdr.magic = GPX2_CAPTURE_MAGIC;
+    c->hdr.version = GPX2_CAPTURE_VERSION;
+    c->hdr.crc = c->crc;
+    memcpy(page, &c->hdr, sizeof(c->hdr));
+    uint16_t crc = header_crc(&c->hdr);
+    page[HEADER_CRC_OFFSET] = crc & 0xFF;
+    page[HEADER_CRC_OFFSET + 1] = crc >> 8;
+    return hal_capture_program(0, page);
+}
+
+bool gpx2_capture_service(gpx2_capture_t *c, uint64_t now_us)
+{
+    switch (c->state)
+    {
+    case GPX2_CAPTURE_ERASING:
+    {
+        bool ok = hal_capture_erase(c->erase_next);
+        uint32_t us = (uint32_t)(hal_time_us() - now_us);
+        c->erase_us += us;
+        c->held_us += us;
+        if (!ok)
+        {
+            c->state = GPX2_CAPTURE_FAILED;
+            return true;
+        }
+        c->erase_next += HAL_CAPTURE_BLOCK;
+        if (c->erase_next < HAL_CAPTURE_SIZE)
+            return false;
+        c->erase_next = 0;
+        c->state = GPX2_CAPTURE_READY;
+        if (c->triggered)
+            capture_start(c, hal_time_us());
+        return true;
+    }
+    case GPX2_CAPTURE_READY:
+        if (!c->triggered)
+            return false;
+        capture_start(c, now_us);
+        return true;
+    case GPX2_CAPTURE_RUNNING:
+        // the limits also end the capture without further events, the count
+        // otherwise only when the next hit comes in
+        if ((c->max_us && now_us - c->start_us >= c->max_us) || c->hdr.records >= c->max_records)
+        {
+            gpx2_capture_stop(c, now_us);
+            return true;
+        }
+        if (c->tail == c->head)
+            return false;
+        if (!capture_program(c, now_us))
+            c->state = GPX2_CAPTURE_FAILED;
+        return c->state == GPX2_CAPTURE_FAILED;
+    case GPX2_CAPTURE_SPILLING:
+        if (c->tail != c->head)
+        {
+            if (!capture_program(c, now_us))
+            {
+                c->state = GPX2_CAPTURE_FAILED;
+                return true;
+            }
+            return false;
+        }
+        c->state = capture_finish(c) ? GPX2_CAPTURE_DONE : GPX2_CAPTURE_FAILED;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool gpx2_capture_header(gpx2_capture_header_t *h)
+{
+    uint8_t page[HAL_CAPTURE_PAGE];
+    if (!hal_capture_read(0, page, sizeof(page)))
+        return false;
+    memcpy(h, page, sizeof(*h));
+    uint16_t crc = page[HEADER_CRC_OFFSET] | (page[HEADER_CRC_OFFSET + 1] << 8);
+    return h->magic == GPX2_CAPTURE_MAGIC && h->version == GPX2_CAPTURE_VERSION && crc == header_crc(h) &&
+           h->records <= GPX2_CAPTURE_MAX_RECORDS;
+}
+
+bool gpx2_capture_read(uint32_t first, uint32_t n, uint8_t *dst)
+{
+    while (n > 0)
+    {
+        uint32_t page = first / GPX2_CAPTURE_PAGE_RECORDS;
+        uint32_t slot = first % GPX2_CAPTURE_PAGE_RECORDS;
+        uint32_t k = GPX2_CAPTURE_PAGE_RECORDS - slot;
+        if (k > n)
+            k = n;
+        if (!hal_capture_read((page + 1) * HAL_CAPTURE_PAGE + slot * GPX2_CAPTURE_RECORD, dst,
+                              k * GPX2_CAPTURE_RECORD))
+            return false;
+        dst += k * GPX2_CAPTURE_RECORD;
+        first += k;
+        n -= k;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+#ifndef GPX2_CAPTURE_H
+#define GPX2_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpx2_hal.h"
+
+// burst capture of raw events into the flash capture region (hal_capture_*)
+//
+// Events are packed as 7 byte records, channel(1, dev * 4 + ch) REF(3)
+// STOP(3) like GPX2_FRAME_EVENTS, GPX2_CAPTURE_PAGE_RECORDS to a flash page.
+// Full pages wait in a RAM ring of GPX2_CAPTURE_RAM_PAGES pages until
+// gpx2_capture_service() programs them, one page per call, so the ring takes
+// bursts faster than flash while the next page fills. Unused record slots of
+// the last page stay erased (0xFF).
+//
+// Page 0 of the region holds the header, written last: record count, crc16
+// over all records in order, duration and drops. A finished capture stays in
+// flash across reboots until the next trigger. The region is only erased on a
+// trigger, a block per service call, or up front by gpx2_capture_erase_region()
+// before acquisition starts. Every erase holds up the readout for its ~45 ms
+// while the chip FIFO only holds a few frames, so hits coming in meanwhile are
+// lost; that time is counted (erase_us, held_us).
+#define GPX2_CAPTURE_RECORD 7
+#define GPX2_CAPTURE_PAGE_RECORDS (HAL_CAPTURE_PAGE / GPX2_CAPTURE_RECORD) // 36
+#define GPX2_CAPTURE_PAGES (HAL_CAPTURE_SIZE / HAL_CAPTURE_PAGE - 1)
+#define GPX2_CAPTURE_MAX_RECORDS ((uint32_t)GPX2_CAPTURE_PAGES * GPX2_CAPTURE_PAGE_RECORDS)
+#define GPX2_CAPTURE_RAM_PAGES 64 // must be a power of 2
+#define GPX2_CAPTURE_MAGIC 0x50434447u // "GDCP"
+#define GPX2_CAPTURE_VERSION 2
+
+typedef enum
+{
+    GPX2_CAPTURE_IDLE = 0, // nothing to do, region not blank
+    GPX2_CAPTURE_ERASING,  // erasing the region, starts right after when triggered
+    GPX2_CAPTURE_READY,    // region erased, waiting for the trigger
+    GPX2_CAPTURE_RUNNING,  // recording
+    GPX2_CAPTURE_SPILLING, // limit reached, programming what is left in RAM
+    GPX2_CAPTURE_DONE,     // header written, can be read back
+    GPX2_CAPTURE_FAILED,   // erase or program did not verify
+} gpx2_capture_state_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t crc; // crc16 of the records
+    uint32_t records;
+    uint32_t duration_us;
+    uint32_t dropped;       // events lost because the RAM ring was full
+    uint32_t ram_high;      // deepest RAM ring fill in pages
+    uint32_t program_us;    // total time spent programming pages
+    uint32_t program_max_us;
+    uint32_t pages; // data pages programmed
+    uint32_t erase_us; // readout held up erasing the region after the trigger
+} gpx2_capture_header_t;
+
+typedef struct
+{
+    uint8_t state; // gpx2_capture_state_t
+    bool triggered;
+    uint32_t max_records; // stop after this many, 0 = region full
+    uint32_t max_us;      // stop after this long, 0 = no limit
+    uint32_t erase_next;  // next block offset to erase
+    uint32_t erase_us;    // erase time since the trigger, into the header
+    uint64_t held_us;     // readout held up by erases and page programs since init
+    uint64_t start_us;
+    uint8_t ram[GPX2_CAPTURE_RAM_PAGES][HAL_CAPTURE_PAGE];
+    uint32_t head;  // page being filled, free running
+    uint32_t tail;  // next page to program, free running
+    uint16_t fill;  // records in the page being filled
+    uint16_t crc;
+    gpx2_capture_header_t hdr;
+} gpx2_capture_t;
+
+// limits of the next captures, picks up a finished capture left in flash or
+// a blank region (READY)
+void gpx2_capture_init(gpx2_capture_t *c, uint32_t max_records, uint32_t max_us);
+// erase the whole region right away, for use before acquisition starts
+bool gpx2_capture_erase_region(void);
+// start recording, right away when the region is erased, else once it is;
+// a finished capture is erased first. False while a capture is running
+bool gpx2_capture_trigger(gpx2_capture_t *c);
+// one flash operation at most: erase a block, program a page or finish the
+// capture; returns true when the state changed
+bool gpx2_capture_service(gpx2_capture_t *c, uint64_t now_us);
+// header of the capture in flash, false if there is no valid one
+bool gpx2_capture_header(gpx2_capture_header_t *h);
+// records first..first+n-1 of the capture in flash, as GPX2_CAPTURE_RECORD byte records
+bool gpx2_capture_read(uint32_t first, uint32_t n, uint8_t *dst);
+
+// limit reached, the rest is programmed by gpx2_capture_service
+void gpx2_capture_stop(gpx2_capture_t *c, uint64_t now_us);
+
+// record one event, false once the capture is no longer running
+static inline bool gpx2_capture_add(gpx2_capture_t *c, uint8_t ch, uint32_t ref, uint32_t stop, uint64_t now_us)
+{
+    if (c->state != GPX2_CAPTURE_RUNNING)
+        return false;
+    if ((c->max_us && now_us - c->start_us >= c->max_us) || c->hdr.records >= c->max_records)
+    {
+        gpx2_capture_stop(c, now_us);
+        return false;
+    }
+    if (c->head - c->tail >= GPX2_CAPTURE_RAM_PAGES)
+    {
+        c->hdr.dropped++; // ring full of pages waiting for flash
+        return true;
+    }
+    uint8_t *p = &c->ram[c->head % GPX2_CAPTURE_RAM_PAGES][c->fill * GPX2_CAPTURE_RECORD];
+    p[0] = ch;
+    p[1] = ref & 0xFF;
+    p[2] = (ref >> 8) & 0xFF;
+    p[3] = (ref >> 16) & 0xFF;
+    p[4] = stop & 0xFF;
+    p[5] = (stop >> 8) & 0xFF;
+    p[6] = (stop >> 16) & 0xFF;
+    c->hdr.records++;
+    if (++c->fill == GPX2_CAPTURE_PAGE_RECORDS)
+    {
+        c->fill = 0;
+        c->head++;
+        if (c->head - c->tail > c->hdr.ram_high)
+            c->hdr.ram_high = c->head - c->tail;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "gpx2_coinc.h"
+#include <string.h>
+
+bool gpx2_coinc_setup(gpx2_coinc_t *c, uint32_t window_ps, uint32_t accidental_delay_ps)
+{
+    if (window_ps == 0 || window_ps > GPX2_COINC_MAX_WINDOW_PS)
+    {
+        return false;
+    }
+    memset(c, 0, sizeof(*c));
+    c->window_ps = window_ps;
+    c->accidental_delay_ps = accidental_delay_ps;
+    return true;
+}
+
+bool gpx2_coinc_add_pair(gpx2_coinc_t *c, uint8_t a, uint8_t b)
+{
+    if (a == b || a >= GPX2_COINC_CHANNELS || b >= GPX2_COINC_CHANNELS ||
+        c->npairs == GPX2_COINC_MAX_PAIRS)
+    {
+        return false;
+    }
+    gpx2_coinc_pair_t *p = &c->pair[c->npairs];
+    memset(p, 0, sizeof(*p));
+    p->a = a;
+    p->b = b;
+    c->pairs_of[a] |= 1 << c->npairs;
+    c->pairs_of[b] |= 1 << c->npairs;
+    c->npairs++;
+    return true;
+}
+
+void gpx2_coinc_flush(gpx2_coinc_t *c)
+{
+    memset(c->head, 0, sizeof(c->head));
+    memset(c->count, 0, sizeof(c->count));
+}
+
+void gpx2_coinc_clear(gpx2_coinc_t *c)
+{
+    gpx2_coinc_flush(c);
+    for (int i = 0; i < c->npairs; i++)
+    {
+        c->pair[i].matched = 0;
+        c->pair[i].accidental = 0;
+        c->pair[i].unmatched_a = 0;
+        c->pair[i].unmatched_b = 0;
+    }
+}
+
+// |x - y| <= w without overflow
+static inline bool coinc_within(uint64_t x, uint64_t y, uint32_t w)
+{
+    return (x > y ? x - y : y - x) <= w;
+}
+
+// hit about to be overwritten, count it unmatched for pairs it never made
+static void coinc_evict(gpx2_coinc_t *c, uint8_t ch, const gpx2_coinc_hit_t *h)
+{
+    uint8_t open = c->pairs_of[ch] & ~h->matched;
+    for (int i = 0; open != 0; i++, open >>= 1)
+    {
+        if (!(open & 1))
+            continue;
+        if (c->pair[i].a == ch)
+            c->pair[i].unmatched_a++;
+        else
+            c->pair[i].unmatched_b++;
+    }
+}
+
+int gpx2_coinc_add(gpx2_coinc_t *c, uint8_t ch, uint64_t t_ps, gpx2_coinc_dt_t *out)
+{
+    if (ch >= GPX2_COINC_CHANNELS)
+    {
+        return 0;
+    }
+    gpx2_coinc_hit_t *slot = &c->hit[ch][c->head[ch]];
+    if (c->count[ch] == GPX2_COINC_DEPTH)
+    {
+        coinc_evict(c, ch, slot);
+    }
+    else
+    {
+        c->count[ch]++;
+    }
+    c->head[ch] = (c->head[ch] + 1) % GPX2_COINC_DEPTH;
+    slot->t_ps = t_ps;
+    slot->matched = 0;
+
+    int n = 0;
+    uint8_t pairs = c->pairs_of[ch];
+    for (int i = 0; pairs != 0; i++, pairs >>= 1)
+    {
+        if (!(pairs & 1))
+            continue;
+        gpx2_coinc_pair_t *p = &c->pair[i];
+        bool is_a = (p->a == ch);
+        uint8_t other = is_a ? p->b : p->a;
+        // accidentals: partner expected delay later when this is a, earlier when b
+        uint64_t shifted = is_a ? t_ps + c->accidental_delay_ps : t_ps - c->accidental_delay_ps;
+
+        gpx2_coinc_hit_t *best = NULL;
+        uint64_t best_dist = UINT64_MAX;
+        for (int k = 0; k < c->count[other]; k++)
+        {
+            gpx2_coinc_hit_t *h = &c->hit[other][k];
+            if (c->accidental_delay_ps != 0 && coinc_within(h->t_ps, shifted, c->window_ps))
+            {
+                p->accidental++;
+            }
+            if (h->matched & (1 << i))
+                continue;
+            uint64_t dist = h->t_ps > t_ps ? h->t_ps - t_ps : t_ps - h->t_ps;
+            if (dist <= c->window_ps && dist < best_dist)
+            {
+                best = h;
+                best_dist = dist;
+            }
+        }
+        if (best != NULL)
+        {
+            best->matched |= 1 << i;
+            slot->matched |= 1 << i;
+            p->matched++;
+            out[n].pair = (uint8_t)i;
+            out[n].dt_ps = is_a ? (int32_t)(best->t_ps - t_ps) : (int32_t)(t_ps - best->t_ps);
+            n++;
+        }
+    }
+    return n;
+}
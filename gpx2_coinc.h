@@ -0,0 +1,70 @@
+#ifndef GPX2_COINC_H
+#define GPX2_COINC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// coincidence matching between channel pairs on ps timestamps
+//
+// the last GPX2_COINC_DEPTH hits of every channel are kept. When a hit arrives
+// it is matched against the buffered hits of the partner channel of every
+// pair it belongs to: the nearest not yet matched hit with |dT| <= window
+// wins, dT = t_b - t_a. Each pair of hits is looked at once, when the later
+// of the two arrives, so hits may come in any order across channels as long
+// as fewer than GPX2_COINC_DEPTH newer hits of the same channel sit in
+// between.
+//
+// accidentals are counted the same way in a window shifted by
+// accidental_delay_ps, far from the real correlation. A hit that leaves the
+// buffer without a partner counts as unmatched for that pair.
+#define GPX2_COINC_CHANNELS 16 // dev * 4 + ch, up to 4 chips
+#define GPX2_COINC_MAX_PAIRS 6
+#define GPX2_COINC_DEPTH 8
+#define GPX2_COINC_MAX_WINDOW_PS INT32_MAX // dT of a match must fit gpx2_coinc_dt_t
+
+typedef struct
+{
+    uint8_t a, b;         // channels 0..15
+    uint32_t matched;     // dT results
+    uint32_t accidental;  // hits inside the delayed window
+    uint32_t unmatched_a; // hits of a that left the buffer without partner
+    uint32_t unmatched_b;
+} gpx2_coinc_pair_t;
+
+typedef struct
+{
+    uint64_t t_ps;
+    uint8_t matched; // bit per pair
+} gpx2_coinc_hit_t;
+
+typedef struct
+{
+    uint8_t pair;  // index into pair[]
+    int32_t dt_ps; // t_b - t_a
+} gpx2_coinc_dt_t;
+
+typedef struct
+{
+    uint32_t window_ps;
+    uint32_t accidental_delay_ps; // 0 = no accidental counting
+    uint8_t npairs;
+    gpx2_coinc_pair_t pair[GPX2_COINC_MAX_PAIRS];
+    uint8_t pairs_of[GPX2_COINC_CHANNELS]; // pair bits each channel is part of
+    gpx2_coinc_hit_t hit[GPX2_COINC_CHANNELS][GPX2_COINC_DEPTH];
+    uint8_t head[GPX2_COINC_CHANNELS];  // next slot to write
+    uint8_t count[GPX2_COINC_CHANNELS]; // buffered hits
+} gpx2_coinc_t;
+
+// window and accidental delay, clears pairs and counters, false if window is
+// 0 or above GPX2_COINC_MAX_WINDOW_PS
+bool gpx2_coinc_setup(gpx2_coinc_t *c, uint32_t window_ps, uint32_t accidental_delay_ps);
+// add a pair, false if a == b, a channel is out of range or the table is full
+bool gpx2_coinc_add_pair(gpx2_coinc_t *c, uint8_t a, uint8_t b);
+// drop buffered hits and zero the counters, pairs are kept
+void gpx2_coinc_clear(gpx2_coinc_t *c);
+// drop buffered hits only, after a REF reset makes old timestamps meaningless
+void gpx2_coinc_flush(gpx2_coinc_t *c);
+// feed one hit, writes up to GPX2_COINC_MAX_PAIRS results to out, returns how many
+int gpx2_coinc_add(gpx2_coinc_t *c, uint8_t ch, uint64_t t_ps, gpx2_coinc_dt_t *out);
+
+#endif
@@ -0,0 +1,17 @@
+#include "gpx2_crc.h"
+
+// nibble table keeps flash use small and is still ~4x faster than bitwise
+static const uint16_t crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+
+uint16_t gpx2_crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        crc = (crc << 4) ^ crc16_nibble[crc >> 12];
+        crc = (crc << 4) ^ crc16_nibble[crc >> 12];
+    }
+    return crc;
+}
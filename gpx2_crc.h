@@ -0,0 +1,11 @@
+#ifndef GPX2_CRC_H
+#define GPX2_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// crc16-ccitt (poly 0x1021), start with GPX2_CRC16_INIT, chainable
+#define GPX2_CRC16_INIT 0xFFFF
+uint16_t gpx2_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+#endif
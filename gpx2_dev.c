@@ -0,0 +1,232 @@
+#include "gpx2_dev.h"
+#include "gpx2_perf.h"
+#include <string.h>
+
+void gpx2_dev_init(gpx2_dev_t *d, uint8_t id, uint8_t bus, uint8_t pin_cs, uint8_t pin_int)
+{
+    memset(d, 0, sizeof(*d));
+    d->id = id;
+    d->bus = bus;
+    d->pin_cs = pin_cs;
+    d->pin_int = pin_int;
+    d->burst_frames = 1;
+    gpx2_dev_readout_range(d, 0, GPX2_CHANNELS);
+    hal_gpio_output(pin_cs, 1); // CS high->deselect GPX2
+    hal_gpio_input(pin_int);
+}
+
+static inline void dev_cs_low(const gpx2_dev_t *d)
+{
+    hal_gpio_put(d->pin_cs, 0);
+}
+static inline void dev_cs_high(const gpx2_dev_t *d)
+{
+    hal_gpio_put(d->pin_cs, 1);
+}
+
+void gpx2_dev_opcode(gpx2_dev_t *d, uint8_t opcode)
+{
+    dev_cs_low(d);
+    hal_spi_write(d->bus, &opcode, 1);
+    dev_cs_high(d);
+}
+
+void gpx2_dev_write_config(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n)
+{
+    uint8_t tx[1 + GPX2_CONFIG_BYTES];
+    // opcode for write config+start address
+    tx[0] = OPC_WRITE_CONFIG | addr;
+    memcpy(&tx[1], &cfg[addr], n);
+    dev_cs_low(d);
+    hal_spi_write(d->bus, tx, 1 + n);
+    dev_cs_high(d);
+}
+
+bool gpx2_dev_verify_config(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n)
+{
+    uint8_t tx[1 + GPX2_CONFIG_BYTES] = {OPC_READ_CONFIG | addr};
+    uint8_t rx[1 + GPX2_CONFIG_BYTES];
+    dev_cs_low(d);
+    hal_spi_transfer(d->bus, tx, rx, 1 + n);
+    dev_cs_high(d);
+    return memcmp(&rx[1], &cfg[addr], n) == 0;
+}
+
+bool gpx2_dev_config_dirty(const gpx2_dev_t *d, const uint8_t *cfg, uint8_t *addr, uint8_t *n)
+{
+    if (!d->config_valid)
+    {
+        *addr = 0;
+        *n = GPX2_CONFIG_BYTES;
+        return true;
+    }
+    int first = -1, last = -1;
+    for (int i = 0; i < GPX2_CONFIG_BYTES; i++)
+    {
+        if (cfg[i] != d->config_chip[i])
+        {
+            if (first < 0)
+                first = i;
+            last = i;
+        }
+    }
+    if (first < 0)
+        return false;
+    *addr = (uint8_t)first;
+    *n = (uint8_t)(last - first + 1);
+    return true;
+}
+
+void gpx2_dev_config_commit(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n)
+{
+    memcpy(&d->config_chip[addr], &cfg[addr], n);
+    d->config_valid = true;
+}
+
+void gpx2_dev_readout_range(gpx2_dev_t *d, uint8_t first, uint8_t count)
+{
+    d->read_first = first;
+    d->read_bytes = count * GPX2_SLOT_BYTES;
+    d->read_burst = (count == GPX2_CHANNELS);
+    d->decode = gpx2_decode_range(first, count);
+    d->tx[0] = OPC_READ_RESULTS + GPX2_RESULTS_ADDR + first * GPX2_SLOT_BYTES;
+}
+
+void gpx2_dev_readout_setup(gpx2_dev_t *d, const uint8_t *cfg, uint8_t burst_frames, uint32_t spi_hz)
+{
+    d->burst_frames = burst_frames ? burst_frames : 1;
+    d->active_mask = cfg[0] & cfg[1] & 0x0F;
+    if (d->active_mask == 0)
+    {
+        gpx2_dev_readout_range(d, 0, GPX2_CHANNELS);
+        return;
+    }
+    uint8_t first = (uint8_t)__builtin_ctz(d->active_mask);
+    uint8_t count = (uint8_t)(32 - __builtin_clz(d->active_mask) - first);
+    // per frame after the first: opcode + range + a transaction, against the
+    // whole frame clocked on in the open one
+    if (count < GPX2_CHANNELS && d->burst_frames > 1 && spi_hz != 0)
+    {
+        uint32_t range_ns = (uint32_t)((1u + count * GPX2_SLOT_BYTES) * 8000000000ull / spi_hz) +
+                            GPX2_DEV_TRANSACTION_NS;
+        uint32_t frame_ns = (uint32_t)(GPX2_FRAME_BYTES * 8000000000ull / spi_hz);
+        if (frame_ns <= range_ns)
+        {
+            first = 0;
+            count = GPX2_CHANNELS;
+        }
+    }
+    gpx2_dev_readout_range(d, first, count);
+}
+
+void gpx2_dev_read_frame(gpx2_dev_t *d, gpx2_result_t *res)
+{
+    // whole frame whatever the readout plan
+    uint8_t tx[1 + GPX2_FRAME_BYTES] = {OPC_READ_RESULTS + GPX2_RESULTS_ADDR};
+    dev_cs_low(d);
+    hal_spi_transfer(d->bus, tx, d->rx, sizeof(tx));
+    dev_cs_high(d);
+    gpx2_decode_results(&d->rx[1], res);
+    res->dev = d->id;
+}
+
+int gpx2_dev_read_parallel(gpx2_dev_t *const *devs, int n, gpx2_result_t *out)
+{
+    GPX2_PERF_BEGIN(t0);
+    int stored = 0;
+    uint8_t frames[GPX2_SPI_BUSES] = {0};
+    uint8_t kept[GPX2_SPI_BUSES] = {0};
+    uint8_t active = 0;
+
+    // opcode + first frame on every bus
+    for (int i = 0; i < n; i++)
+    {
+        dev_cs_low(devs[i]);
+        hal_spi_transfer_start(devs[i]->bus, devs[i]->tx, devs[i]->rx, 1 + devs[i]->read_bytes);
+        active |= 1 << i;
+    }
+    while (active)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (!(active & (1 << i)))
+                continue;
+            gpx2_dev_t *d = devs[i];
+            hal_spi_transfer_wait(d->bus);
+            if (d->raw)
+                d->raw(d->id, &d->rx[1]);
+            gpx2_result_t *res = &out[stored];
+            d->decode(&d->rx[1], res);
+            res->dev = d->id;
+            if (gpx2_results_new_hits(res, &d->last, d->active_mask))
+            {
+                d->events += __builtin_popcount(res->mask);
+                kept[i]++;
+                stored++;
+            }
+            if (++frames[i] >= d->burst_frames || !gpx2_dev_int(d))
+            {
+                dev_cs_high(d);
+                d->batch_count[kept[i]]++;
+                d->frames += kept[i];
+                active &= ~(1 << i);
+                continue;
+            }
+            if (d->read_burst)
+            {
+                // next frame, dummy bytes only
+                hal_spi_transfer_start(d->bus, &d->tx[1], &d->rx[1], GPX2_FRAME_BYTES);
+            }
+            else
+            {
+                // the address would run on into disabled slots, start over
+                dev_cs_high(d);
+                dev_cs_low(d);
+                hal_spi_transfer_start(d->bus, d->tx, d->rx, 1 + d->read_bytes);
+            }
+        }
+    }
+    GPX2_PERF_END(GPX2_STAGE_SPI_READ, t0);
+    return stored;
+}
+
+void gpx2_sched_init(gpx2_sched_t *s, gpx2_dev_t *dev, uint8_t ndev, gpx2_sched_mode_t mode)
+{
+    s->dev = dev;
+    s->ndev = ndev;
+    s->mode = mode;
+    memset(s->next, 0, sizeof(s->next));
+}
+
+bool gpx2_sched_pending(const gpx2_sched_t *s)
+{
+    for (int i = 0; i < s->ndev; i++)
+    {
+        if (gpx2_dev_int(&s->dev[i]))
+            return true;
+    }
+    return false;
+}
+
+int gpx2_sched_service(gpx2_sched_t *s, gpx2_result_t *out)
+{
+    gpx2_dev_t *pick[GPX2_SPI_BUSES];
+    int n = 0;
+    for (uint8_t bus = 0; bus < GPX2_SPI_BUSES; bus++)
+    {
+        uint8_t start = (s->mode == GPX2_SCHED_ROUND_ROBIN) ? s->next[bus] : 0;
+        for (int k = 0; k < s->ndev; k++)
+        {
+            uint8_t i = (start + k) % s->ndev;
+            gpx2_dev_t *d = &s->dev[i];
+            if (d->bus != bus || !gpx2_dev_int(d))
+                continue;
+            pick[n++] = d;
+            s->next[bus] = (i + 1) % s->ndev;
+            break;
+        }
+    }
+    if (n == 0)
+        return 0;
+    return gpx2_dev_read_parallel(pick, n, out);
+}
@@ -0,0 +1,124 @@
+#ifndef GPX2_DEV_H
+#define GPX2_DEV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpx2_hal.h"
+#include "gpx2_results.h"
+
+// one TDC-GPX2: wiring, config shadow and burst readout state. Several chips
+// can share a bus with their own CS and INT, chips on spi0 and spi1 are read
+// at the same time by gpx2_dev_read_parallel()
+
+// spi opcodes for tdc-gpx2
+#define OPC_POWER_RESET 0x30  // power-on reset
+#define OPC_INIT 0x18         // initialize chip and start measurement
+#define OPC_WRITE_CONFIG 0x80 // write configuration
+#define OPC_READ_CONFIG 0x40  // read configuration
+#define OPC_READ_RESULTS 0x60 // read measurement results
+
+#define GPX2_CONFIG_BYTES 17
+#define GPX2_MAX_DEVICES 4
+#define GPX2_SPI_BUSES 2
+
+// burst readout: max frames clocked out in one CS-low transaction
+#define GPX2_BURST_MAX 32
+// CS high and low again between two frames (gpio writes, the chip's CS
+// timing), on top of the opcode byte; weighs a transaction per frame
+// against whole frame bursts
+#define GPX2_DEV_TRANSACTION_NS 500
+
+// sees every frame as clocked out of the chip, empty and stale slots
+// included, before anything is filtered (record output mode)
+typedef void (*gpx2_raw_fn)(uint8_t dev, const uint8_t *frame);
+
+typedef struct
+{
+    uint8_t id;
+    uint8_t bus; // 0/1 -> spi0/spi1
+    uint8_t pin_cs;
+    uint8_t pin_int;
+
+    // config as last written to and verified on the chip
+    uint8_t config_chip[GPX2_CONFIG_BYTES];
+    bool config_valid;
+
+    // readout
+    uint8_t active_mask;  // PIN_ENA & HIT_ENA, channels that can hit
+    uint8_t burst_frames; // frames per burst
+    // result slots read per frame, from gpx2_dev_readout_setup(): a range of
+    // slots is one transaction per frame, a whole frame continues the burst
+    // in the same transaction
+    uint8_t read_first;
+    uint8_t read_bytes;
+    bool read_burst;
+    gpx2_decode_fn decode;
+    gpx2_raw_fn raw;      // NULL unless recording, needs whole frame reads
+    gpx2_result_t last;   // for stale slot detection
+    uint8_t tx[1 + GPX2_FRAME_BYTES];
+    uint8_t rx[1 + GPX2_FRAME_BYTES];
+
+    // counters, written by the reading context
+    uint32_t batch_count[GPX2_BURST_MAX + 1]; // bursts by frames with new hits
+    uint32_t frames;                          // frames with new hits
+    uint32_t events;                          // hits in them
+} gpx2_dev_t;
+
+// CS/INT pins are set up here, the bus with hal_spi_init()
+void gpx2_dev_init(gpx2_dev_t *d, uint8_t id, uint8_t bus, uint8_t pin_cs, uint8_t pin_int);
+// INT is low active
+static inline bool gpx2_dev_int(const gpx2_dev_t *d)
+{
+    return hal_gpio_get(d->pin_int) == 0;
+}
+// single byte command, power reset or init
+void gpx2_dev_opcode(gpx2_dev_t *d, uint8_t opcode);
+// write / read back n config registers from addr in one transaction each
+void gpx2_dev_write_config(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n);
+bool gpx2_dev_verify_config(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n);
+// smallest address range where cfg differs from the chip (all of it before the
+// first write), false when nothing differs
+bool gpx2_dev_config_dirty(const gpx2_dev_t *d, const uint8_t *cfg, uint8_t *addr, uint8_t *n);
+// record a verified write in the shadow
+void gpx2_dev_config_commit(gpx2_dev_t *d, const uint8_t *cfg, uint8_t addr, uint8_t n);
+// frames per burst, channel mask and readout plan for the next measurement.
+// Only the slots from the first to the last enabled channel are read, unless
+// whole frame bursts cost less bus time at spi_hz (GPX2_DEV_TRANSACTION_NS)
+void gpx2_dev_readout_setup(gpx2_dev_t *d, const uint8_t *cfg, uint8_t burst_frames, uint32_t spi_hz);
+// read slots first..first+count-1 per frame (0, GPX2_CHANNELS: whole frames)
+void gpx2_dev_readout_range(gpx2_dev_t *d, uint8_t first, uint8_t count);
+
+// one raw whole frame in one transaction, no stale slot filtering (calibration)
+void gpx2_dev_read_frame(gpx2_dev_t *d, gpx2_result_t *res);
+// one burst from each of n devices whose INT is low, transfers on different
+// buses overlap (devices must not share a bus). A burst keeps clocking frames
+// (the result address wraps from 31 back to 8) while INT stays low, up to
+// burst_frames. Only frames carrying new hits are stored in out, tagged with
+// the device id, returns how many (at most n * GPX2_BURST_MAX). With a slot
+// range every frame is a transaction of its own, still within the burst.
+int gpx2_dev_read_parallel(gpx2_dev_t *const *devs, int n, gpx2_result_t *out);
+
+// readout scheduler: per bus it picks the next device with INT asserted,
+// either round robin or lowest id first
+typedef enum
+{
+    GPX2_SCHED_ROUND_ROBIN = 0,
+    GPX2_SCHED_PRIORITY = 1
+} gpx2_sched_mode_t;
+
+typedef struct
+{
+    gpx2_dev_t *dev;
+    uint8_t ndev;
+    gpx2_sched_mode_t mode;
+    uint8_t next[GPX2_SPI_BUSES]; // round robin position per bus
+} gpx2_sched_t;
+
+void gpx2_sched_init(gpx2_sched_t *s, gpx2_dev_t *dev, uint8_t ndev, gpx2_sched_mode_t mode);
+// any device with INT asserted
+bool gpx2_sched_pending(const gpx2_sched_t *s);
+// one burst from up to one ready device per bus, out needs room for
+// GPX2_SPI_BUSES * GPX2_BURST_MAX frames, returns frames stored
+int gpx2_sched_service(gpx2_sched_t *s, gpx2_result_t *out);
+
+#endif
@@ -0,0 +1,117 @@
+#include "gpx2_dnl.h"
+#include "gpx2_crc.h"
+#include "gpx2_hal.h"
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(sizeof(gpx2_dnl_store_t) <= HAL_FLASH_SECTOR_SIZE, "dnl store exceeds the flash sector");
+
+static uint16_t store_crc(const gpx2_dnl_store_t *s)
+{
+    size_t skip = offsetof(gpx2_dnl_store_t, enabled);
+    return gpx2_crc16(GPX2_CRC16_INIT, (const uint8_t *)s + skip, sizeof(*s) - skip);
+}
+
+// bins per STOP LSB in Q0.32, 0 when there are fewer codes than bins
+static uint32_t dnl_bin_mul(uint32_t divisions)
+{
+    if (divisions < GPX2_DNL_BINS)
+        return 0;
+    return (uint32_t)(((uint64_t)GPX2_DNL_BINS << 32) / divisions);
+}
+
+bool gpx2_dnl_load(gpx2_dnl_store_t *s)
+{
+    if (!hal_flash_read(HAL_FLASH_DNL, s, sizeof(*s)))
+    {
+        memset(s, 0, sizeof(*s));
+    }
+    bool ok = s->magic == GPX2_DNL_MAGIC && s->version == GPX2_DNL_VERSION && s->crc == store_crc(s);
+    if (!ok)
+    {
+        memset(s, 0, sizeof(*s));
+    }
+    return ok;
+}
+
+bool gpx2_dnl_save(gpx2_dnl_store_t *s)
+{
+    s->magic = GPX2_DNL_MAGIC;
+    s->version = GPX2_DNL_VERSION;
+    memset(s->reserved, 0, sizeof(s->reserved));
+    s->crc = store_crc(s);
+    return hal_flash_write(HAL_FLASH_DNL, s, sizeof(*s));
+}
+
+void gpx2_dnl_cal_init(gpx2_dnl_cal_t *c, uint32_t divisions)
+{
+    memset(c, 0, sizeof(*c));
+    c->bin_mul = dnl_bin_mul(divisions);
+    // no bins, gpx2_dnl_cal_add drops everything
+    c->divisions = c->bin_mul ? divisions : 0;
+}
+
+uint16_t gpx2_dnl_build(gpx2_dnl_store_t *s, uint8_t hires, const gpx2_dnl_cal_t *c, uint32_t min_hits)
+{
+    uint16_t built = 0;
+    if (hires >= GPX2_DNL_HIRES)
+        return 0;
+    for (int ch = 0; ch < GPX2_DNL_CHANNELS; ch++)
+    {
+        uint32_t hits = c->hits[ch];
+        if (hits == 0 || hits < min_hits)
+            continue;
+        gpx2_dnl_table_t *t = &s->table[hires][ch];
+        for (int b = 0; b < GPX2_DNL_BINS; b++)
+        {
+            // share of the hits relative to an even spread, rounded
+            uint64_t w = ((uint64_t)c->count[ch][b] * GPX2_DNL_BINS * GPX2_DNL_NOMINAL + hits / 2) / hits;
+            t->width[b] = w > 0xFF ? 0xFF : (uint8_t)w;
+        }
+        t->hits = hits;
+        built |= 1u << ch;
+    }
+    return built;
+}
+
+void gpx2_dnl_range(const gpx2_dnl_table_t *t, uint32_t *min_pct, uint32_t *max_pct)
+{
+    uint8_t lo = 0xFF, hi = 0;
+    for (int b = 0; b < GPX2_DNL_BINS; b++)
+    {
+        if (t->width[b] < lo)
+            lo = t->width[b];
+        if (t->width[b] > hi)
+            hi = t->width[b];
+    }
+    *min_pct = lo * 100u / GPX2_DNL_NOMINAL;
+    *max_pct = hi * 100u / GPX2_DNL_NOMINAL;
+}
+
+bool gpx2_dnl_apply(gpx2_dnl_t *d, const gpx2_dnl_store_t *s, uint8_t hires, uint32_t divisions)
+{
+    d->mask = 0;
+    d->divisions = divisions;
+    d->bin_mul = dnl_bin_mul(divisions);
+    if (hires >= GPX2_DNL_HIRES || d->bin_mul == 0)
+        return false;
+    for (int ch = 0; ch < GPX2_DNL_CHANNELS; ch++)
+    {
+        const gpx2_dnl_table_t *t = &s->table[hires][ch];
+        uint32_t total = 0;
+        for (int b = 0; b < GPX2_DNL_BINS; b++)
+            total += t->width[b];
+        if (t->hits == 0 || total == 0)
+            continue;
+        // cumulative widths scaled to the period, the last edge is exactly divisions
+        uint32_t sum = 0;
+        for (int b = 0; b <= GPX2_DNL_BINS; b++)
+        {
+            d->edge[ch][b] = (uint32_t)((uint64_t)sum * divisions * 256 / total);
+            if (b < GPX2_DNL_BINS)
+                sum += t->width[b];
+        }
+        d->mask |= 1u << ch;
+    }
+    return d->mask != 0;
+}
@@ -0,0 +1,99 @@
+#ifndef GPX2_DNL_H
+#define GPX2_DNL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// code density nonlinearity correction of STOP values
+//
+// Hits uncorrelated to REFCLK fall uniformly into the reference period, so the
+// STOP histogram of a calibration run is flat for a linear interpolator and
+// wide codes collect more hits than narrow ones. The cumulative histogram is
+// therefore the true position of every code:
+//
+//  stop' = REFCLK_DIVISIONS * (hits below stop) / (all hits)
+//
+// It is kept at GPX2_DNL_BINS points per channel; the hot path looks up the
+// bin of a STOP value and interpolates linearly between its two edges.
+//
+// Tables are stored per channel and HIRES setting as bin widths relative to
+// the nominal width (GPX2_DNL_NOMINAL), so they stay valid when
+// REFCLK_DIVISIONS changes. The store lives in its own flash sector with
+// magic, version and crc16; a blank sector or a bad crc reads as no tables.
+#define GPX2_DNL_BINS 64
+#define GPX2_DNL_CHANNELS 16 // channels of all chips, dev * 4 + ch
+#define GPX2_DNL_HIRES 3     // gpx2_hires_mode_t: off, 2x, 4x
+#define GPX2_DNL_NOMINAL 128 // stored width of a bin of nominal size
+#define GPX2_DNL_MAGIC 0x4C4E4447u // "GDNL"
+#define GPX2_DNL_VERSION 1
+
+typedef struct
+{
+    uint32_t hits;                 // calibration hits, 0 = no table
+    uint8_t width[GPX2_DNL_BINS];  // bin widths, GPX2_DNL_NOMINAL = nominal
+} gpx2_dnl_table_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t crc;    // over enabled..table
+    uint8_t enabled; // correction applied while measuring
+    uint8_t reserved[3];
+    gpx2_dnl_table_t table[GPX2_DNL_HIRES][GPX2_DNL_CHANNELS];
+} gpx2_dnl_store_t;
+
+// code density histograms of one calibration run
+typedef struct
+{
+    uint32_t divisions;
+    uint32_t bin_mul; // see gpx2_dnl_t
+    uint32_t hits[GPX2_DNL_CHANNELS];
+    uint32_t count[GPX2_DNL_CHANNELS][GPX2_DNL_BINS];
+} gpx2_dnl_cal_t;
+
+// correction in use, tables of one HIRES setting expanded to bin edges in
+// STOP LSBs (Q24.8) for the current REFCLK_DIVISIONS
+typedef struct
+{
+    uint32_t divisions;
+    uint32_t bin_mul; // GPX2_DNL_BINS / divisions in Q0.32, stop * bin_mul >> 16 = bin in Q16
+    uint16_t mask;    // channels with a table
+    uint32_t edge[GPX2_DNL_CHANNELS][GPX2_DNL_BINS + 1];
+} gpx2_dnl_t;
+
+// read the store from flash, invalid tables are cleared, false if the store
+// was not valid
+bool gpx2_dnl_load(gpx2_dnl_store_t *s);
+// seal with magic, version and crc and write the store to flash
+bool gpx2_dnl_save(gpx2_dnl_store_t *s);
+
+void gpx2_dnl_cal_init(gpx2_dnl_cal_t *c, uint32_t divisions);
+static inline void gpx2_dnl_cal_add(gpx2_dnl_cal_t *c, int ch, uint32_t stop)
+{
+    if (stop >= c->divisions)
+        return;
+    c->count[ch][((uint64_t)stop * c->bin_mul) >> 32]++;
+    c->hits[ch]++;
+}
+// turn the histogram of every channel with at least min_hits into its table
+// for hires, returns the channels built as a mask
+uint16_t gpx2_dnl_build(gpx2_dnl_store_t *s, uint8_t hires, const gpx2_dnl_cal_t *c, uint32_t min_hits);
+// widest and narrowest bin of a table in percent of nominal, 100 = linear
+void gpx2_dnl_range(const gpx2_dnl_table_t *t, uint32_t *min_pct, uint32_t *max_pct);
+
+// expand the tables of hires for divisions, false if there are none
+bool gpx2_dnl_apply(gpx2_dnl_t *d, const gpx2_dnl_store_t *s, uint8_t hires, uint32_t divisions);
+// corrected STOP, values of channels without a table pass unchanged
+static inline uint32_t gpx2_dnl_correct(const gpx2_dnl_t *d, int ch, uint32_t stop)
+{
+    if (!(d->mask & (1u << ch)) || stop >= d->divisions)
+        return stop;
+    uint32_t pos = (uint32_t)(((uint64_t)stop * d->bin_mul) >> 16);
+    const uint32_t *e = &d->edge[ch][pos >> 16];
+    uint32_t q8 = e[0] + (uint32_t)(((uint64_t)(e[1] - e[0]) * (pos & 0xFFFF)) >> 16);
+    uint32_t v = (q8 + 128) >> 8;
+    return v < d->divisions ? v : d->divisions - 1;
+}
+
+#endif
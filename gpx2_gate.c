@@ -0,0 +1,141 @@
+#include "gpx2_gate.h"
+#include <string.h>
+
+void gpx2_gate_init(gpx2_gate_t *g)
+{
+    memset(g, 0, sizeof(*g));
+}
+
+static void gate_update_refs(gpx2_gate_t *g)
+{
+    g->window_refs = 0;
+    for (int ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+    {
+        if (g->rule[ch].flags & GPX2_GATE_WINDOW)
+            g->window_refs |= 1u << g->rule[ch].win_ref;
+    }
+    g->have_t &= g->window_refs;
+}
+
+bool gpx2_gate_set_stop(gpx2_gate_t *g, uint8_t ch, uint32_t lo, uint32_t hi)
+{
+    if (ch >= GPX2_GATE_CHANNELS)
+        return false;
+    gpx2_gate_rule_t *r = &g->rule[ch];
+    r->stop_lo = lo;
+    r->stop_hi = hi;
+    r->flags = lo <= hi ? (r->flags | GPX2_GATE_STOP) : (r->flags & ~GPX2_GATE_STOP);
+    return true;
+}
+
+bool gpx2_gate_set_ref(gpx2_gate_t *g, uint8_t ch, uint32_t lo, uint32_t hi)
+{
+    if (ch >= GPX2_GATE_CHANNELS)
+        return false;
+    gpx2_gate_rule_t *r = &g->rule[ch];
+    r->ref_lo = lo;
+    r->ref_hi = hi;
+    r->flags = lo <= hi ? (r->flags | GPX2_GATE_REF) : (r->flags & ~GPX2_GATE_REF);
+    return true;
+}
+
+bool gpx2_gate_set_window(gpx2_gate_t *g, uint8_t ch, uint8_t ref_ch, int64_t lo_ps, int64_t hi_ps)
+{
+    if (ch >= GPX2_GATE_CHANNELS)
+        return false;
+    gpx2_gate_rule_t *r = &g->rule[ch];
+    if (lo_ps > hi_ps)
+    {
+        r->flags &= ~GPX2_GATE_WINDOW;
+    }
+    else
+    {
+        if (ref_ch >= GPX2_GATE_CHANNELS || ref_ch == ch)
+            return false;
+        r->win_ref = ref_ch;
+        r->win_lo_ps = lo_ps;
+        r->win_hi_ps = hi_ps;
+        r->flags |= GPX2_GATE_WINDOW;
+    }
+    gate_update_refs(g);
+    return true;
+}
+
+bool gpx2_gate_set_prescale(gpx2_gate_t *g, uint8_t ch, uint16_t n)
+{
+    if (ch >= GPX2_GATE_CHANNELS)
+        return false;
+    gpx2_gate_rule_t *r = &g->rule[ch];
+    r->prescale = n;
+    r->prescale_count = 0;
+    r->flags = n > 1 ? (r->flags | GPX2_GATE_PRESCALE) : (r->flags & ~GPX2_GATE_PRESCALE);
+    return true;
+}
+
+void gpx2_gate_clear_counters(gpx2_gate_t *g)
+{
+    memset(g->accepted, 0, sizeof(g->accepted));
+    memset(g->rejected, 0, sizeof(g->rejected));
+}
+
+void gpx2_gate_flush(gpx2_gate_t *g)
+{
+    g->have_t = 0;
+}
+
+uint8_t gpx2_gate_apply(gpx2_gate_t *g, const gpx2_result_t *res, const uint64_t *t_ps)
+{
+    uint8_t base = res->dev * GPX2_CHANNELS;
+    uint8_t mask = res->mask;
+    if (base >= GPX2_GATE_CHANNELS)
+        return mask;
+
+    // reference times first, so a reference hit in the same frame counts
+    uint16_t refs = (g->window_refs >> base) & 0x0F & mask;
+    for (int ch = 0; refs; ch++, refs >>= 1)
+    {
+        if (refs & 1)
+        {
+            g->last_t_ps[base + ch] = t_ps[ch];
+            g->have_t |= 1u << (base + ch);
+        }
+    }
+
+    uint8_t accepted = 0;
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        if (!(mask & (1 << ch)))
+            continue;
+        uint8_t gch = base + ch;
+        gpx2_gate_rule_t *r = &g->rule[gch];
+        uint8_t f = r->flags;
+        int reject = -1;
+        if ((f & GPX2_GATE_STOP) && (res->stop[ch] < r->stop_lo || res->stop[ch] > r->stop_hi))
+            reject = GPX2_GATE_REJ_STOP;
+        else if ((f & GPX2_GATE_REF) && (res->ref[ch] < r->ref_lo || res->ref[ch] > r->ref_hi))
+            reject = GPX2_GATE_REJ_REF;
+        else if (f & GPX2_GATE_WINDOW)
+        {
+            int64_t dt = (int64_t)(t_ps[ch] - g->last_t_ps[r->win_ref]);
+            if (!(g->have_t & (1u << r->win_ref)) || dt < r->win_lo_ps || dt > r->win_hi_ps)
+                reject = GPX2_GATE_REJ_WINDOW;
+        }
+        if (reject < 0 && (f & GPX2_GATE_PRESCALE))
+        {
+            if (r->prescale_count != 0)
+                reject = GPX2_GATE_REJ_PRESCALE;
+            if (++r->prescale_count >= r->prescale)
+                r->prescale_count = 0;
+        }
+        if (reject < 0)
+        {
+            accepted |= 1 << ch;
+            g->accepted[gch]++;
+        }
+        else
+        {
+            g->rejected[gch][reject]++;
+        }
+    }
+    return accepted;
+}
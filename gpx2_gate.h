@@ -0,0 +1,75 @@
+#ifndef GPX2_GATE_H
+#define GPX2_GATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpx2_results.h"
+
+// event gate between readout and histograms/coincidences/output
+//
+// every channel (dev * 4 + ch) has one rule, a table row whose flags select
+// the checks to run, a hit passes when all of them pass:
+//   STOP     raw STOP within [stop_lo, stop_hi]
+//   REF      raw REF index within [ref_lo, ref_hi]
+//   WINDOW   t - t_ref within [win_lo_ps, win_hi_ps], t_ref being the latest
+//            hit of the reference channel (gated or not, same frame included)
+//   PRESCALE of the hits passing the checks above 1 in N is kept
+// channels without flags pass untouched, so an unused gate costs one load
+#define GPX2_GATE_CHANNELS 16
+
+#define GPX2_GATE_STOP 0x01
+#define GPX2_GATE_REF 0x02
+#define GPX2_GATE_WINDOW 0x04
+#define GPX2_GATE_PRESCALE 0x08
+
+typedef enum
+{
+    GPX2_GATE_REJ_STOP = 0,
+    GPX2_GATE_REJ_REF = 1,
+    GPX2_GATE_REJ_WINDOW = 2,
+    GPX2_GATE_REJ_PRESCALE = 3,
+    GPX2_GATE_REJ_COUNT
+} gpx2_gate_reject_t;
+
+typedef struct
+{
+    uint8_t flags;
+    uint8_t win_ref; // reference channel of the window
+    uint16_t prescale;
+    uint16_t prescale_count;
+    uint32_t stop_lo, stop_hi;
+    uint32_t ref_lo, ref_hi;
+    int64_t win_lo_ps, win_hi_ps;
+} gpx2_gate_rule_t;
+
+typedef struct
+{
+    gpx2_gate_rule_t rule[GPX2_GATE_CHANNELS];
+    uint16_t window_refs; // channels serving as window reference
+    uint16_t have_t;      // window_refs that have seen a hit
+    uint64_t last_t_ps[GPX2_GATE_CHANNELS];
+    uint32_t accepted[GPX2_GATE_CHANNELS];
+    uint32_t rejected[GPX2_GATE_CHANNELS][GPX2_GATE_REJ_COUNT];
+} gpx2_gate_t;
+
+// all channels pass, counters zeroed
+void gpx2_gate_init(gpx2_gate_t *g);
+// rules for one channel, lo > hi switches that check off
+bool gpx2_gate_set_stop(gpx2_gate_t *g, uint8_t ch, uint32_t lo, uint32_t hi);
+bool gpx2_gate_set_ref(gpx2_gate_t *g, uint8_t ch, uint32_t lo, uint32_t hi);
+bool gpx2_gate_set_window(gpx2_gate_t *g, uint8_t ch, uint8_t ref_ch, int64_t lo_ps, int64_t hi_ps);
+// n <= 1 keeps every hit
+bool gpx2_gate_set_prescale(gpx2_gate_t *g, uint8_t ch, uint16_t n);
+void gpx2_gate_clear_counters(gpx2_gate_t *g);
+// forget reference times, after a REF reset
+void gpx2_gate_flush(gpx2_gate_t *g);
+// window rules need picosecond times
+static inline bool gpx2_gate_needs_ps(const gpx2_gate_t *g)
+{
+    return g->window_refs != 0;
+}
+// gate the new hits of one frame, t_ps only read for window rules (may be
+// NULL without them), returns the accepted subset of res->mask
+uint8_t gpx2_gate_apply(gpx2_gate_t *g, const gpx2_result_t *res, const uint64_t *t_ps);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef GPX2_HAL_H
+#define GPX2_HAL_H
+
+// thin hardware abstraction in front of the pico sdk calls used by the
+// firmware, so designlab.c also builds on linux against a simulated GPX2
+//   gpx2_hal_pico.c    -> rp2040 (spi, dma, gpio irq, multicore, watchdog)
+//   host/gpx2_hal_sim.c -> linux + behavioral GPX2 model (host/gpx2_sim.c)
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*hal_irq_cb_t)(uint8_t pin);
+
+// console: stdio over usb on the pico, stdin/stdout on linux
+void hal_console_init(void);
+// <0 when nothing arrived within us
+int hal_getchar_timeout_us(uint32_t us);
+// raw bytes, no CR/LF translation
+void hal_write_raw(const uint8_t *data, size_t len);
+
+// event data channel next to the console: the vendor bulk IN endpoint of the
+// composite usb device on the pico (gpx2_usb.h), the file or fifo named by
+// GPX2_SIM_BULK on linux. Two HAL_BULK_BUFFER buffers, one on the wire while
+// the other fills; a full buffer goes out as one transfer.
+#define HAL_BULK_BUFFER 4096
+// the host has configured the device (pico) or the file is open (sim)
+bool hal_bulk_ready(void);
+// copies what fits into the filling buffer, 0 when not ready or both are busy
+size_t hal_bulk_write(const uint8_t *data, size_t len);
+// sends the filling buffer if it holds data and the endpoint is idle
+void hal_bulk_flush(void);
+
+// spi, bus 0/1 -> spi0/spi1, mode 1 (CPOL 0, CPHA 1), msb first
+// returns the baud rate actually set
+unsigned hal_spi_init(uint8_t bus, unsigned baud, uint8_t sck, uint8_t mosi, uint8_t miso);
+unsigned hal_spi_set_baudrate(uint8_t bus, unsigned baud);
+void hal_spi_write(uint8_t bus, const uint8_t *src, size_t len);
+void hal_spi_read(uint8_t bus, uint8_t *dst, size_t len);
+// full duplex burst, dma driven on the pico
+void hal_spi_transfer(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len);
+// the same split in two, so transfers on spi0 and spi1 can run at once.
+// Buffers must stay valid until hal_spi_transfer_wait() returns.
+void hal_spi_transfer_start(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len);
+void hal_spi_transfer_wait(uint8_t bus);
+
+// gpio
+void hal_gpio_output(uint8_t pin, bool level);
+void hal_gpio_input(uint8_t pin);
+void hal_gpio_put(uint8_t pin, bool level);
+bool hal_gpio_get(uint8_t pin);
+// falling edge irq, cb runs in interrupt context
+void hal_gpio_irq_falling(uint8_t pin, hal_irq_cb_t cb);
+void hal_gpio_irq_enable(uint8_t pin, bool enabled);
+
+// time
+uint64_t hal_time_us(void);
+void hal_busy_wait_us(uint32_t us);
+static inline void hal_tight_loop(void)
+{
+}
+// free running cycle counter for short intervals (systick on the pico),
+// intervals must stay below 2^24 cycles there (~134 ms at 125 MHz)
+void hal_cycles_init(void);
+uint32_t hal_cycles(void);
+uint32_t hal_cycles_since(uint32_t start);
+uint32_t hal_cycles_per_us(void);
+
+// persistent storage: HAL_FLASH_SECTORS reserved flash sectors (the last ones
+// on the pico, a file in the sim), each read and rewritten as a whole from offset 0
+#define HAL_FLASH_SECTOR_SIZE 4096
+#define HAL_FLASH_SECTORS 2
+#define HAL_FLASH_PROFILES 0 // gpx2_profile store
+#define HAL_FLASH_DNL 1      // gpx2_dnl correction tables
+bool hal_flash_read(uint8_t sector, void *dst, size_t len);
+// erases the sector first, core1 and the irqs wait meanwhile
+bool hal_flash_write(uint8_t sector, const void *src, size_t len);
+
+// burst capture region: HAL_CAPTURE_SIZE bytes of flash right below the
+// reserved sectors, erased a block and programmed a page at a time. Like
+// hal_flash_write both hold up the other core and the irqs while flash is
+// busy, so the blocks are small
+#define HAL_CAPTURE_SIZE (1024 * 1024)
+#define HAL_CAPTURE_BLOCK 4096
+#define HAL_CAPTURE_PAGE 256
+// false when the firmware image reaches into the region
+bool hal_capture_available(void);
+bool hal_capture_erase(uint32_t offset); // the block at offset, checked blank
+bool hal_capture_program(uint32_t offset, const uint8_t *page);
+bool hal_capture_read(uint32_t offset, void *dst, size_t len);
+
+// liveness guard: reboots unless fed within timeout_ms
+void hal_watchdog_enable(uint32_t timeout_ms);
+void hal_watchdog_feed(void);
+// the last reset came from an expired watchdog (not from hal_reboot*)
+bool hal_watchdog_caused_reboot(void);
+
+// system
+void hal_reboot(void);
+// reboot handing tag to the next boot, hal_boot_tag() returns it once
+void hal_reboot_tagged(uint32_t tag);
+uint32_t hal_boot_tag(void);
+void hal_core1_launch(void (*entry)(void));
+// core0 -> core1 mailbox
+void hal_core1_push(uint32_t value);
+// called on core1, false when empty
+bool hal_core1_pop(uint32_t *value);
+
+#endif
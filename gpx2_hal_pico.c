@@ -0,0 +1,487 @@
+#include "gpx2_hal.h"
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/watchdog.h"
+#include "pico/multicore.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "gpx2_usb.h"
+#include <string.h>
+
+// paired tx/rx dma channels per spi bus, claimed in hal_spi_init
+static int dma_tx[2] = {-1, -1};
+static int dma_rx[2] = {-1, -1};
+static hal_irq_cb_t irq_cb[32];
+
+static inline spi_inst_t *bus_inst(uint8_t bus)
+{
+    return bus ? spi1 : spi0;
+}
+
+void hal_console_init(void)
+{
+    // with tinyusb_device linked by the application stdio_usb does not init
+    // the stack itself, it only checks tud_inited() before attaching to the
+    // CDC interface
+    tusb_init();
+    stdio_init_all(); // enable usb serial output
+}
+
+int hal_getchar_timeout_us(uint32_t us)
+{
+    return getchar_timeout_us(us);
+}
+
+void hal_write_raw(const uint8_t *data, size_t len)
+{
+    stdio_put_string((const char *)data, (int)len, false, false);
+}
+
+// event data: the vendor interface of the composite device as a TinyUSB
+// application driver. bulk_xfer_cb() runs in tud_task() (stdio_usb's
+// background irq) and only clears bulk_busy; transfers are started from the
+// main loop only, with interrupts off so the irq never sees half an xfer.
+static uint8_t bulk_buf[2][HAL_BULK_BUFFER];
+static uint16_t bulk_len[2];
+static uint8_t bulk_fill;         // buffer taking writes
+static volatile bool bulk_busy;   // the other buffer is on the wire
+static volatile bool bulk_opened; // endpoint opened by SET_CONFIGURATION
+
+static void bulk_init(void)
+{
+}
+
+static bool bulk_deinit(void)
+{
+    return true;
+}
+
+static void bulk_reset(uint8_t rhport)
+{
+    (void)rhport;
+    bulk_opened = false;
+    bulk_busy = false;
+    bulk_len[0] = bulk_len[1] = 0;
+}
+
+static uint16_t bulk_open(uint8_t rhport, const tusb_desc_interface_t *itf, uint16_t max_len)
+{
+    const uint16_t len = sizeof(tusb_desc_interface_t) + sizeof(tusb_desc_endpoint_t);
+    if (itf->bInterfaceClass != TUSB_CLASS_VENDOR_SPECIFIC || itf->bInterfaceNumber != GPX2_USB_ITF_BULK ||
+        max_len < len)
+        return 0;
+    const tusb_desc_endpoint_t *ep = (const tusb_desc_endpoint_t *)tu_desc_next(itf);
+    if (ep->bDescriptorType != TUSB_DESC_ENDPOINT || !usbd_edpt_open(rhport, ep))
+        return 0;
+    bulk_opened = true;
+    return len;
+}
+
+static bool bulk_control_xfer_cb(uint8_t rhport, uint8_t stage, const tusb_control_request_t *request)
+{
+    (void)rhport;
+    (void)stage;
+    (void)request;
+    return false; // no vendor requests, stall
+}
+
+static bool bulk_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    (void)rhport;
+    (void)result;
+    (void)xferred_bytes;
+    if (ep_addr == GPX2_USB_EP_BULK_IN)
+        bulk_busy = false;
+    return true;
+}
+
+static const usbd_class_driver_t bulk_driver = {
+    .init = bulk_init,
+    .deinit = bulk_deinit,
+    .reset = bulk_reset,
+    .open = bulk_open,
+    .control_xfer_cb = bulk_control_xfer_cb,
+    .xfer_cb = bulk_xfer_cb,
+    .sof = NULL,
+};
+
+const usbd_class_driver_t *usbd_app_driver_get_cb(uint8_t *driver_count)
+{
+    *driver_count = 1;
+    return &bulk_driver;
+}
+
+bool hal_bulk_ready(void)
+{
+    return bulk_opened && tud_mounted();
+}
+
+void hal_bulk_flush(void)
+{
+    if (!hal_bulk_ready() || bulk_busy || bulk_len[bulk_fill] == 0)
+        return;
+    // a transfer that is a multiple of 64 bytes ends without a short packet,
+    // the host's read just continues with the next one
+    uint32_t irq = save_and_disable_interrupts();
+    bool started = usbd_edpt_xfer(0, GPX2_USB_EP_BULK_IN, bulk_buf[bulk_fill], bulk_len[bulk_fill]);
+    bulk_busy = started; // before the irq can report the transfer done
+    restore_interrupts(irq);
+    if (!started)
+        return;
+    bulk_fill ^= 1;
+    bulk_len[bulk_fill] = 0;
+}
+
+size_t hal_bulk_write(const uint8_t *data, size_t len)
+{
+    if (!hal_bulk_ready())
+        return 0;
+    if (bulk_len[bulk_fill] == HAL_BULK_BUFFER)
+        hal_bulk_flush();
+    size_t room = HAL_BULK_BUFFER - bulk_len[bulk_fill];
+    size_t n = len < room ? len : room;
+    memcpy(bulk_buf[bulk_fill] + bulk_len[bulk_fill], data, n);
+    bulk_len[bulk_fill] += (uint16_t)n;
+    if (bulk_len[bulk_fill] == HAL_BULK_BUFFER)
+        hal_bulk_flush();
+    return n;
+}
+
+unsigned hal_spi_init(uint8_t bus, unsigned baud, uint8_t sck, uint8_t mosi, uint8_t miso)
+{
+    spi_inst_t *spi = bus_inst(bus);
+    unsigned actual = spi_init(spi, baud);
+    spi_set_format(spi, 8, SPI_CPOL_0, SPI_CPHA_1, SPI_MSB_FIRST);
+    gpio_set_function(sck, GPIO_FUNC_SPI);
+    gpio_set_function(mosi, GPIO_FUNC_SPI);
+    gpio_set_function(miso, GPIO_FUNC_SPI);
+
+    if (dma_tx[bus] < 0)
+    {
+        dma_tx[bus] = dma_claim_unused_channel(true);
+        dma_rx[bus] = dma_claim_unused_channel(true);
+    }
+    // tx: paced by spi tx dreq, reads the caller's buffer
+    dma_channel_config c = dma_channel_get_default_config(dma_tx[bus]);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi, true));
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(dma_tx[bus], &c, &spi_get_hw(spi)->dr, NULL, 0, false);
+
+    // rx: everything clocked back, including the byte received during the opcode
+    c = dma_channel_get_default_config(dma_rx[bus]);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(spi, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    dma_channel_configure(dma_rx[bus], &c, NULL, &spi_get_hw(spi)->dr, 0, false);
+    return actual;
+}
+
+unsigned hal_spi_set_baudrate(uint8_t bus, unsigned baud)
+{
+    return spi_set_baudrate(bus_inst(bus), baud);
+}
+
+void hal_spi_write(uint8_t bus, const uint8_t *src, size_t len)
+{
+    spi_write_blocking(bus_inst(bus), src, len);
+}
+
+void hal_spi_read(uint8_t bus, uint8_t *dst, size_t len)
+{
+    spi_read_blocking(bus_inst(bus), 0x00, dst, len);
+}
+
+void hal_spi_transfer_start(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    dma_channel_set_read_addr(dma_tx[bus], tx, false);
+    dma_channel_set_trans_count(dma_tx[bus], len, false);
+    dma_channel_set_write_addr(dma_rx[bus], rx, false);
+    dma_channel_set_trans_count(dma_rx[bus], len, false);
+    // start rx and tx together so the rx fifo never overflows
+    dma_start_channel_mask((1u << dma_tx[bus]) | (1u << dma_rx[bus]));
+}
+
+void hal_spi_transfer_wait(uint8_t bus)
+{
+    dma_channel_wait_for_finish_blocking(dma_rx[bus]);
+}
+
+void hal_spi_transfer(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    hal_spi_transfer_start(bus, tx, rx, len);
+    hal_spi_transfer_wait(bus);
+}
+
+void hal_gpio_output(uint8_t pin, bool level)
+{
+    gpio_init(pin);
+    gpio_set_function(pin, GPIO_FUNC_SIO);
+    gpio_set_dir(pin, GPIO_OUT);
+    gpio_put(pin, level);
+}
+
+void hal_gpio_input(uint8_t pin)
+{
+    gpio_init(pin);
+    gpio_set_function(pin, GPIO_FUNC_SIO);
+    gpio_set_dir(pin, GPIO_IN);
+}
+
+void hal_gpio_put(uint8_t pin, bool level)
+{
+    gpio_put(pin, level);
+}
+
+bool hal_gpio_get(uint8_t pin)
+{
+    return gpio_get(pin);
+}
+
+static void hal_gpio_irq_dispatch(uint gpio, uint32_t events)
+{
+    if ((events & GPIO_IRQ_EDGE_FALL) && irq_cb[gpio])
+    {
+        irq_cb[gpio]((uint8_t)gpio);
+    }
+}
+
+void hal_gpio_irq_falling(uint8_t pin, hal_irq_cb_t cb)
+{
+    irq_cb[pin] = cb;
+    gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_FALL, true, &hal_gpio_irq_dispatch);
+}
+
+void hal_gpio_irq_enable(uint8_t pin, bool enabled)
+{
+    gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL, enabled);
+}
+
+uint64_t hal_time_us(void)
+{
+    return time_us_64();
+}
+
+void hal_busy_wait_us(uint32_t us)
+{
+    busy_wait_us(us);
+}
+
+void hal_cycles_init(void)
+{
+    // processor clock, 24 bit reload, counts down
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+}
+
+uint32_t hal_cycles(void)
+{
+    return systick_hw->cvr;
+}
+
+uint32_t hal_cycles_since(uint32_t start)
+{
+    return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+uint32_t hal_cycles_per_us(void)
+{
+    return clock_get_hz(clk_sys) / 1000000;
+}
+
+void hal_watchdog_enable(uint32_t timeout_ms)
+{
+    watchdog_enable(timeout_ms, true); // paused while debugging
+}
+
+void hal_watchdog_feed(void)
+{
+    watchdog_update();
+}
+
+bool hal_watchdog_caused_reboot(void)
+{
+    // unlike watchdog_caused_reboot() this is false after watchdog_reboot()
+    return watchdog_enable_caused_reboot();
+}
+
+void hal_reboot(void)
+{
+    watchdog_reboot(0, 0, 0); // reboots the chip
+}
+
+// watchdog scratch registers survive a watchdog reboot, 0-3 are free for the
+// application (4-7 are cleared/used by watchdog_reboot and watchdog_enable)
+#define HAL_BOOT_TAG_SCRATCH 0
+#define HAL_BOOT_TAG_VALID 0xB007B007u
+
+void hal_reboot_tagged(uint32_t tag)
+{
+    watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH] = tag;
+    watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH + 1] = HAL_BOOT_TAG_VALID ^ tag;
+    watchdog_reboot(0, 0, 0);
+}
+
+uint32_t hal_boot_tag(void)
+{
+    uint32_t tag = watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH];
+    bool valid = watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH + 1] == (HAL_BOOT_TAG_VALID ^ tag);
+    watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH] = 0;
+    watchdog_hw->scratch[HAL_BOOT_TAG_SCRATCH + 1] = 0;
+    return valid ? tag : 0;
+}
+
+// the last HAL_FLASH_SECTORS sectors of the flash are reserved for hal_flash_*,
+// counted down from the end (sector 0 is the last one), keep the binary below them
+#define HAL_FLASH_OFFSET(sector) (PICO_FLASH_SIZE_BYTES - ((sector) + 1) * FLASH_SECTOR_SIZE)
+
+bool hal_flash_read(uint8_t sector, void *dst, size_t len)
+{
+    if (sector >= HAL_FLASH_SECTORS || len > HAL_FLASH_SECTOR_SIZE)
+        return false;
+    memcpy(dst, (const void *)(XIP_BASE + HAL_FLASH_OFFSET(sector)), len);
+    return true;
+}
+
+// no code may run from flash while it is erased/programmed: core1 is parked
+// in its lockout handler (once hal_core1_launch has started it) and the irqs
+// of this core wait
+static bool __not_in_flash_func(flash_begin)(uint32_t *irq)
+{
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+    if (lockout)
+        multicore_lockout_start_blocking();
+    *irq = save_and_disable_interrupts();
+    return lockout;
+}
+
+static void __not_in_flash_func(flash_end)(uint32_t irq, bool lockout)
+{
+    restore_interrupts(irq);
+    if (lockout)
+        multicore_lockout_end_blocking();
+}
+
+bool hal_flash_write(uint8_t sector, const void *src, size_t len)
+{
+    // programming works on whole pages
+    static uint8_t page_buf[FLASH_SECTOR_SIZE];
+    if (sector >= HAL_FLASH_SECTORS || len > HAL_FLASH_SECTOR_SIZE)
+        return false;
+    size_t n = (len + FLASH_PAGE_SIZE - 1) & ~(size_t)(FLASH_PAGE_SIZE - 1);
+    memset(page_buf, 0xFF, n);
+    memcpy(page_buf, src, len);
+
+    uint32_t irq;
+    bool lockout = flash_begin(&irq);
+    flash_range_erase(HAL_FLASH_OFFSET(sector), FLASH_SECTOR_SIZE);
+    flash_range_program(HAL_FLASH_OFFSET(sector), page_buf, n);
+    flash_end(irq, lockout);
+    return memcmp((const void *)(XIP_BASE + HAL_FLASH_OFFSET(sector)), src, len) == 0;
+}
+
+// the capture region sits right below the reserved sectors. Erased a sector
+// at a time, so the readout is held up for one sector erase (~45 ms) or one
+// page program (~0.5 ms) at most. The chip FIFO holds only a few frames, so
+// at more than a few hundred hits/s an erase loses hits the chip overwrites
+#define HAL_CAPTURE_OFFSET (PICO_FLASH_SIZE_BYTES - HAL_FLASH_SECTORS * FLASH_SECTOR_SIZE - HAL_CAPTURE_SIZE)
+_Static_assert(HAL_CAPTURE_BLOCK == FLASH_SECTOR_SIZE && HAL_CAPTURE_PAGE == FLASH_PAGE_SIZE, "capture geometry");
+
+extern char __flash_binary_end;
+
+bool hal_capture_available(void)
+{
+    // a larger image would erase its own code
+    return (uintptr_t)&__flash_binary_end - XIP_BASE <= HAL_CAPTURE_OFFSET;
+}
+
+bool __not_in_flash_func(hal_capture_erase)(uint32_t offset)
+{
+    if (offset % HAL_CAPTURE_BLOCK || offset >= HAL_CAPTURE_SIZE || !hal_capture_available())
+        return false;
+    uint32_t irq;
+    bool lockout = flash_begin(&irq);
+    flash_range_erase(HAL_CAPTURE_OFFSET + offset, HAL_CAPTURE_BLOCK);
+    flash_end(irq, lockout);
+    const uint32_t *p = (const uint32_t *)(XIP_BASE + HAL_CAPTURE_OFFSET + offset);
+    for (size_t i = 0; i < HAL_CAPTURE_BLOCK / 4; i++)
+    {
+        if (p[i] != 0xFFFFFFFFu)
+            return false;
+    }
+    return true;
+}
+
+bool __not_in_flash_func(hal_capture_program)(uint32_t offset, const uint8_t *page)
+{
+    if (offset % HAL_CAPTURE_PAGE || offset >= HAL_CAPTURE_SIZE || !hal_capture_available())
+        return false;
+    uint32_t irq;
+    bool lockout = flash_begin(&irq);
+    flash_range_program(HAL_CAPTURE_OFFSET + offset, page, HAL_CAPTURE_PAGE);
+    flash_end(irq, lockout);
+    return memcmp((const void *)(XIP_BASE + HAL_CAPTURE_OFFSET + offset), page, HAL_CAPTURE_PAGE) == 0;
+}
+
+bool hal_capture_read(uint32_t offset, void *dst, size_t len)
+{
+    if (offset > HAL_CAPTURE_SIZE || len > HAL_CAPTURE_SIZE - offset)
+        return false;
+    memcpy(dst, (const void *)(XIP_BASE + HAL_CAPTURE_OFFSET + offset), len);
+    return true;
+}
+
+static void (*core1_entry)(void);
+
+static void core1_main(void)
+{
+    // flash writes on core0 park this core (flash_begin)
+    multicore_lockout_victim_init();
+    // SysTick is per core, the stages timed on core1 read this one
+    hal_cycles_init();
+    core1_entry();
+}
+
+void hal_core1_launch(void (*entry)(void))
+{
+    core1_entry = entry;
+    multicore_launch_core1(core1_main);
+}
+
+// core0 -> core1 mailbox in RAM, the inter-core fifo belongs to the lockout
+// (its core1 handler drains the fifo)
+#define CORE1_MBOX 16
+static volatile uint32_t core1_mbox[CORE1_MBOX];
+static volatile uint32_t core1_mbox_head; // written by core0 only
+static volatile uint32_t core1_mbox_tail; // written by core1 only
+
+void hal_core1_push(uint32_t value)
+{
+    while (core1_mbox_head - core1_mbox_tail >= CORE1_MBOX)
+        tight_loop_contents();
+    core1_mbox[core1_mbox_head % CORE1_MBOX] = value;
+    __dmb();
+    core1_mbox_head++;
+}
+
+bool hal_core1_pop(uint32_t *value)
+{
+    if (core1_mbox_tail == core1_mbox_head)
+    {
+        return false;
+    }
+    __dmb();
+    *value = core1_mbox[core1_mbox_tail % CORE1_MBOX];
+    __dmb();
+    core1_mbox_tail++;
+    return true;
+}
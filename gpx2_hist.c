@@ -0,0 +1,50 @@
+#include "gpx2_hist.h"
+#include <string.h>
+
+bool gpx2_hist_setup(gpx2_hist_t *h, int32_t offset, uint32_t bin_width, uint16_t bins)
+{
+    if (bin_width == 0 || bins == 0 || bins > GPX2_HIST_MAX_BINS)
+    {
+        return false;
+    }
+    h->offset = offset;
+    h->bin_width = bin_width;
+    h->bins = bins;
+    // power of 2 widths bin with a shift instead of a divide
+    h->shift = 0xFF;
+    if ((bin_width & (bin_width - 1)) == 0)
+    {
+        uint8_t s = 0;
+        while ((1u << s) != bin_width)
+            s++;
+        h->shift = s;
+    }
+    gpx2_hist_clear(h);
+    return true;
+}
+
+void gpx2_hist_clear(gpx2_hist_t *h)
+{
+    h->entries = 0;
+    h->underflow = 0;
+    h->overflow = 0;
+    memset(h->count, 0, sizeof(h->count));
+}
+
+void gpx2_hist_add(gpx2_hist_t *h, int32_t value)
+{
+    if (value < h->offset)
+    {
+        h->underflow++;
+        return;
+    }
+    uint32_t rel = (uint32_t)((int64_t)value - h->offset);
+    uint32_t bin = (h->shift != 0xFF) ? (rel >> h->shift) : (rel / h->bin_width);
+    if (bin >= h->bins)
+    {
+        h->overflow++;
+        return;
+    }
+    h->count[bin]++;
+    h->entries++;
+}
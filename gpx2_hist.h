@@ -0,0 +1,32 @@
+#ifndef GPX2_HIST_H
+#define GPX2_HIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// fixed size histogram, bin i covers [offset + i*bin_width, offset + (i+1)*bin_width)
+#define GPX2_HIST_MAX_BINS 1024
+
+typedef struct
+{
+    int32_t offset;     // lower edge of bin 0
+    uint32_t bin_width; // values per bin, >= 1
+    uint16_t bins;      // bins in use, <= GPX2_HIST_MAX_BINS
+    uint8_t shift;      // log2(bin_width) when it is a power of 2, else 0xFF
+    uint32_t entries;   // values inside the range
+    uint32_t underflow; // values below offset
+    uint32_t overflow;  // values at or above the upper edge
+    uint32_t count[GPX2_HIST_MAX_BINS];
+} gpx2_hist_t;
+
+// set range and clear, false if the parameters are out of range
+bool gpx2_hist_setup(gpx2_hist_t *h, int32_t offset, uint32_t bin_width, uint16_t bins);
+void gpx2_hist_clear(gpx2_hist_t *h);
+void gpx2_hist_add(gpx2_hist_t *h, int32_t value);
+// lower edge of bin i
+static inline int64_t gpx2_hist_bin_low(const gpx2_hist_t *h, uint16_t i)
+{
+    return (int64_t)h->offset + (int64_t)i * h->bin_width;
+}
+
+#endif
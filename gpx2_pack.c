@@ -0,0 +1,154 @@
+#include "gpx2_pack.h"
+#include <string.h>
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// false when the varint runs past end or is longer than 5 bytes
+static inline bool get_varint(const uint8_t **p, const uint8_t *end, uint32_t *v)
+{
+    uint32_t r = 0;
+    for (int shift = 0; shift < 35 && *p < end; shift += 7)
+    {
+        uint8_t b = *(*p)++;
+        r |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *v = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+// REF difference in the 24 bit ring, -2^23..2^23-1
+static inline int32_t ref_delta(uint32_t ref, uint32_t prev)
+{
+    uint32_t d = (ref - prev) & 0xFFFFFF;
+    return (d & 0x800000) ? (int32_t)d - 0x1000000 : (int32_t)d;
+}
+
+void gpx2_pack_init(gpx2_pack_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->since_key = GPX2_PACK_KEY_FRAMES; // first frame is a keyframe
+}
+
+bool gpx2_pack_add(gpx2_pack_t *p, gpx2_stream_t *s, const gpx2_result_t *res)
+{
+    uint8_t type = GPX2_FRAME_PACKED;
+    if (s->type == 0)
+    {
+        // a new frame, every GPX2_PACK_KEY_FRAMES-th restarts the deltas
+        if (p->since_key >= GPX2_PACK_KEY_FRAMES)
+        {
+            memset(p->ref, 0, sizeof(p->ref));
+            memset(p->stop, 0, sizeof(p->stop));
+            p->since_key = 0;
+            type = GPX2_FRAME_PACKED_KEY;
+        }
+        p->since_key++;
+    }
+    else if (s->type == GPX2_FRAME_PACKED_KEY)
+    {
+        type = GPX2_FRAME_PACKED_KEY;
+    }
+    uint8_t *start = gpx2_stream_reserve(s, type, GPX2_PACK_RECORD_MAX);
+    if (start == NULL)
+    {
+        return false;
+    }
+    uint8_t *q = start;
+    uint8_t mask = res->mask & 0x0F;
+    *q++ = (uint8_t)((res->dev << 4) | mask);
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        if (!(mask & (1 << ch)))
+            continue;
+        int g = res->dev * GPX2_CHANNELS + ch;
+        q = put_varint(q, zigzag(ref_delta(res->ref[ch], p->ref[g])));
+        q = put_varint(q, zigzag((int32_t)res->stop[ch] - (int32_t)p->stop[g]));
+        p->ref[g] = res->ref[ch];
+        p->stop[g] = res->stop[ch];
+    }
+    // give back what the varints did not use
+    s->len -= (uint16_t)(GPX2_PACK_RECORD_MAX - (q - start));
+    return true;
+}
+
+void gpx2_unpack_init(gpx2_unpack_t *u)
+{
+    memset(u, 0, sizeof(*u));
+}
+
+bool gpx2_unpack_frame(gpx2_unpack_t *u, const gpx2_frame_view_t *f)
+{
+    // any missing frame may have been a packed one
+    if (u->have_seq && f->seq != u->next_seq)
+        u->synced = false;
+    u->have_seq = true;
+    u->next_seq = f->seq + 1;
+
+    if (f->type == GPX2_FRAME_PACKED_KEY)
+    {
+        memset(u->ref, 0, sizeof(u->ref));
+        memset(u->stop, 0, sizeof(u->stop));
+        u->synced = true;
+        return true;
+    }
+    if (f->type != GPX2_FRAME_PACKED)
+        return false;
+    if (!u->synced)
+        u->skipped++;
+    return u->synced;
+}
+
+bool gpx2_unpack_next(gpx2_unpack_t *u, const gpx2_frame_view_t *f, size_t *pos, gpx2_result_t *res)
+{
+    const uint8_t *p = f->payload + *pos;
+    const uint8_t *end = f->payload + f->len;
+    if (p >= end)
+        return false;
+    uint8_t presence = *p++;
+    res->dev = (presence >> 4) & 0x03;
+    res->mask = presence & 0x0F;
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        res->ref[ch] = 0;
+        res->stop[ch] = 0;
+        if (!(res->mask & (1 << ch)))
+            continue;
+        int g = res->dev * GPX2_CHANNELS + ch;
+        uint32_t dref, dstop;
+        if (!get_varint(&p, end, &dref) || !get_varint(&p, end, &dstop))
+        {
+            // corrupt despite the crc, the deltas are lost until the next keyframe
+            u->synced = false;
+            return false;
+        }
+        u->ref[g] = (u->ref[g] + (uint32_t)unzigzag(dref)) & 0xFFFFFF;
+        u->stop[g] = u->stop[g] + (uint32_t)unzigzag(dstop);
+        res->ref[ch] = u->ref[g];
+        res->stop[ch] = u->stop[g];
+    }
+    *pos = (size_t)(p - f->payload);
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef GPX2_PACK_H
+#define GPX2_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gpx2_results.h"
+#include "gpx2_stream.h"
+
+// compressed raw events for the binary stream (output mode 4)
+//
+// A GPX2_FRAME_PACKED(_KEY) payload is a list of records, one per result frame:
+//  presence(1)  dev in bits 4..5, channels carrying a hit in bits 0..3
+//  for every channel with a hit, lowest first:
+//   zigzag varint of REF - previous REF of the channel (24 bit wrap, signed)
+//   zigzag varint of STOP - previous STOP of the channel
+// Varints are little-endian groups of 7 bits, bit 7 set on all but the last.
+// Previous values are kept per channel dev * 4 + ch and restart from 0 in a
+// GPX2_FRAME_PACKED_KEY frame: the first frame and then every
+// GPX2_PACK_KEY_FRAMES packed frames. A decoder that missed a frame (sequence
+// gap, bad crc) skips packed frames until the next keyframe.
+#define GPX2_PACK_CHANNELS 16
+#define GPX2_PACK_KEY_FRAMES 16
+#define GPX2_PACK_RECORD_MAX (1 + GPX2_CHANNELS * 2 * 4) // 25 bit zigzag values take 4 varint bytes
+
+typedef struct
+{
+    uint32_t ref[GPX2_PACK_CHANNELS];
+    uint32_t stop[GPX2_PACK_CHANNELS];
+    uint16_t since_key; // packed frames opened since the last keyframe
+} gpx2_pack_t;
+
+void gpx2_pack_init(gpx2_pack_t *p);
+// append the new hits of one result frame, false when the open frame must be
+// finished first
+bool gpx2_pack_add(gpx2_pack_t *p, gpx2_stream_t *s, const gpx2_result_t *res);
+
+// decoder, used on the host side
+typedef struct
+{
+    uint32_t ref[GPX2_PACK_CHANNELS];
+    uint32_t stop[GPX2_PACK_CHANNELS];
+    bool synced;       // delta state is valid
+    bool have_seq;
+    uint32_t next_seq;
+    uint32_t skipped;  // packed frames dropped while waiting for a keyframe
+} gpx2_unpack_t;
+
+void gpx2_unpack_init(gpx2_unpack_t *u);
+// call for every valid frame in stream order, true when f is a packed frame
+// that can be decoded with gpx2_unpack_next
+bool gpx2_unpack_frame(gpx2_unpack_t *u, const gpx2_frame_view_t *f);
+// decode the record at *pos of a packed payload into res (ref/stop of the
+// channels in res->mask), false at the end or on a malformed record
+bool gpx2_unpack_next(gpx2_unpack_t *u, const gpx2_frame_view_t *f, size_t *pos, gpx2_result_t *res);
+
+#endif
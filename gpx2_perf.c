@@ -0,0 +1,107 @@
+#include "gpx2_perf.h"
+
+#if GPX2_PERF
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *const stage_name[GPX2_STAGE_COUNT] = {"wait", "read", "output", "cmd", "config"};
+
+// each stage is only written from one context (irq/core1 or core0), the
+// report may see a torn update which is fine for a live view
+static gpx2_perf_stage_t stage[GPX2_STAGE_COUNT];
+static uint32_t events[GPX2_PERF_CHANNELS];
+static uint32_t commands;
+static uint32_t cycles_per_us = 1;
+
+// snapshot for rates since the previous report
+static uint64_t last_us;
+static uint32_t last_events[GPX2_PERF_CHANNELS];
+
+void gpx2_perf_init(void)
+{
+    hal_cycles_init();
+    cycles_per_us = hal_cycles_per_us();
+    memset(stage, 0, sizeof(stage));
+    for (int i = 0; i < GPX2_STAGE_COUNT; i++)
+        stage[i].min = UINT32_MAX;
+    memset(events, 0, sizeof(events));
+    memset(last_events, 0, sizeof(last_events));
+    commands = 0;
+    last_us = hal_time_us();
+}
+
+// in dual core mode core1 records wait and config while core0 records the
+// rest, each in its own stage and with its own SysTick (hal_cycles_init on both)
+void gpx2_perf_record(gpx2_stage_t s, uint32_t cycles)
+{
+    gpx2_perf_stage_t *st = &stage[s];
+    st->n++;
+    st->sum += cycles;
+    if (cycles < st->min)
+        st->min = cycles;
+    if (cycles > st->max)
+        st->max = cycles;
+
+    uint32_t us = cycles / cycles_per_us;
+    int b = 0;
+    while (us && b < GPX2_PERF_BUCKETS - 1)
+    {
+        us >>= 1;
+        b++;
+    }
+    st->bucket[b]++;
+}
+
+void gpx2_perf_event(int ch)
+{
+    events[ch]++;
+}
+
+void gpx2_perf_command(void)
+{
+    commands++;
+}
+
+static unsigned long cycles_to_ns(uint64_t cycles)
+{
+    return (unsigned long)(cycles * 1000 / cycles_per_us);
+}
+
+void gpx2_perf_report(void)
+{
+    uint64_t now = hal_time_us();
+    uint64_t dt = now - last_us;
+
+    printf("PERF stage   n        min_ns   mean_ns  max_ns   log2(us) buckets\n");
+    for (int i = 0; i < GPX2_STAGE_COUNT; i++)
+    {
+        const gpx2_perf_stage_t *st = &stage[i];
+        uint32_t n = st->n;
+        printf("PERF %-6s %-8lu %-8lu %-8lu %-8lu", stage_name[i], (unsigned long)n,
+               n ? cycles_to_ns(st->min) : 0ul,
+               n ? cycles_to_ns(st->sum / n) : 0ul,
+               cycles_to_ns(st->max));
+        for (int b = 0; b < GPX2_PERF_BUCKETS; b++)
+        {
+            if (st->bucket[b])
+                printf(" %d:%lu", b, (unsigned long)st->bucket[b]);
+        }
+        printf("\n");
+    }
+    printf("PERF commands=%lu polls=%lu\n", (unsigned long)commands,
+           (unsigned long)stage[GPX2_STAGE_COMMAND].n);
+    printf("PERF rate ev/s");
+    for (int ch = 0; ch < GPX2_PERF_CHANNELS; ch++)
+    {
+        uint32_t e = events[ch];
+        if (ch >= 4 && e == 0)
+            continue; // channels of further chips only when they saw events
+        printf(" ch%d=%lu", ch + 1, (unsigned long)(dt ? (uint64_t)(e - last_events[ch]) * 1000000u / dt : 0));
+        last_events[ch] = e;
+    }
+    printf("\n");
+    last_us = now;
+}
+
+#endif
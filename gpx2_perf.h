@@ -0,0 +1,65 @@
+#ifndef GPX2_PERF_H
+#define GPX2_PERF_H
+
+// hot path instrumentation: per stage min/max/mean and a log2 latency
+// histogram, per channel event rate. Build with GPX2_PERF=0 to compile
+// all of it out.
+
+#include <stdint.h>
+#include "gpx2_hal.h"
+
+#ifndef GPX2_PERF
+#define GPX2_PERF 1
+#endif
+
+typedef enum
+{
+    GPX2_STAGE_WAIT_INT, // spinning on the INT pins
+    GPX2_STAGE_SPI_READ, // result frame transfer + decode
+    GPX2_STAGE_OUTPUT,   // per frame processing and output
+    GPX2_STAGE_COMMAND,  // getchar_timeout polling + command handling
+    GPX2_STAGE_CONFIG,   // config write + verify, measurement dead time
+    GPX2_STAGE_COUNT
+} gpx2_stage_t;
+
+#define GPX2_PERF_BUCKETS 16 // log2(us): <1us, 1-2us, ... >=16ms
+#define GPX2_PERF_CHANNELS 16 // dev * 4 + ch
+
+typedef struct
+{
+    uint32_t n;
+    uint32_t min; // cycles
+    uint32_t max;
+    uint64_t sum;
+    uint32_t bucket[GPX2_PERF_BUCKETS];
+} gpx2_perf_stage_t;
+
+#if GPX2_PERF
+
+void gpx2_perf_init(void);
+void gpx2_perf_record(gpx2_stage_t stage, uint32_t cycles);
+void gpx2_perf_event(int ch);
+void gpx2_perf_command(void);
+void gpx2_perf_report(void);
+
+#define GPX2_PERF_BEGIN(t) uint32_t t = hal_cycles()
+#define GPX2_PERF_END(stage, t) gpx2_perf_record(stage, hal_cycles_since(t))
+#define GPX2_PERF_EVENT(ch) gpx2_perf_event(ch)
+#define GPX2_PERF_COMMAND() gpx2_perf_command()
+
+#else
+
+static inline void gpx2_perf_init(void)
+{
+}
+static inline void gpx2_perf_report(void)
+{
+}
+#define GPX2_PERF_BEGIN(t) ((void)0)
+#define GPX2_PERF_END(stage, t) ((void)0)
+#define GPX2_PERF_EVENT(ch) ((void)0)
+#define GPX2_PERF_COMMAND() ((void)0)
+
+#endif
+
+#endif
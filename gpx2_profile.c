@@ -0,0 +1,80 @@
+#include "gpx2_profile.h"
+#include "gpx2_crc.h"
+#include "gpx2_hal.h"
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(sizeof(gpx2_profile_store_t) <= HAL_FLASH_SECTOR_SIZE, "profile store exceeds the flash sector");
+
+// crc over everything after the crc field
+static uint16_t profile_crc(const gpx2_profile_t *p)
+{
+    size_t skip = offsetof(gpx2_profile_t, name);
+    return gpx2_crc16(GPX2_CRC16_INIT, (const uint8_t *)p + skip, sizeof(*p) - skip);
+}
+
+static uint16_t store_crc(const gpx2_profile_store_t *s)
+{
+    size_t skip = offsetof(gpx2_profile_store_t, default_slot);
+    return gpx2_crc16(GPX2_CRC16_INIT, (const uint8_t *)s + skip,
+                      offsetof(gpx2_profile_store_t, slot) - skip);
+}
+
+bool gpx2_profile_valid(const gpx2_profile_t *p)
+{
+    return p->magic == GPX2_PROFILE_MAGIC && p->version == GPX2_PROFILE_VERSION &&
+           p->crc == profile_crc(p);
+}
+
+bool gpx2_profile_load(gpx2_profile_store_t *s)
+{
+    if (!hal_flash_read(HAL_FLASH_PROFILES, s, sizeof(*s)))
+    {
+        memset(s, 0, sizeof(*s));
+    }
+    bool ok = s->magic == GPX2_PROFILE_MAGIC && s->version == GPX2_PROFILE_VERSION &&
+              s->crc == store_crc(s);
+    if (!ok)
+    {
+        s->default_slot = GPX2_PROFILE_NONE;
+    }
+    for (int i = 0; i < GPX2_PROFILE_SLOTS; i++)
+    {
+        if (!gpx2_profile_valid(&s->slot[i]))
+            memset(&s->slot[i], 0, sizeof(s->slot[i]));
+    }
+    return ok;
+}
+
+bool gpx2_profile_save(gpx2_profile_store_t *s)
+{
+    s->magic = GPX2_PROFILE_MAGIC;
+    s->version = GPX2_PROFILE_VERSION;
+    memset(s->reserved, 0, sizeof(s->reserved));
+    s->crc = store_crc(s);
+    return hal_flash_write(HAL_FLASH_PROFILES, s, sizeof(*s));
+}
+
+void gpx2_profile_set(gpx2_profile_t *p, const char *name, const uint8_t *config,
+                      const uint8_t *pins, uint32_t spi_speed_hz, uint8_t devices, uint8_t sched)
+{
+    memset(p, 0, sizeof(*p));
+    p->magic = GPX2_PROFILE_MAGIC;
+    p->version = GPX2_PROFILE_VERSION;
+    strncpy(p->name, name, GPX2_PROFILE_NAME - 1);
+    memcpy(p->config, config, sizeof(p->config));
+    memcpy(p->pins, pins, sizeof(p->pins));
+    p->spi_speed_hz = spi_speed_hz;
+    p->devices = devices;
+    p->sched = sched;
+    p->crc = profile_crc(p);
+}
+
+const gpx2_profile_t *gpx2_profile_default(const gpx2_profile_store_t *s)
+{
+    if (s->default_slot >= GPX2_PROFILE_SLOTS || !gpx2_profile_valid(&s->slot[s->default_slot]))
+    {
+        return NULL;
+    }
+    return &s->slot[s->default_slot];
+}
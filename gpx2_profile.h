@@ -0,0 +1,54 @@
+#ifndef GPX2_PROFILE_H
+#define GPX2_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// named config profiles kept in the reserved flash sector (hal_flash_*)
+//
+// the sector holds one gpx2_profile_store_t: a header with the default slot
+// and GPX2_PROFILE_SLOTS profiles. Header and every profile carry their own
+// version and crc16, a blank sector or a bad crc just reads as empty.
+#define GPX2_PROFILE_MAGIC 0x32585047u // "GPX2"
+#define GPX2_PROFILE_VERSION 1
+#define GPX2_PROFILE_SLOTS 4
+#define GPX2_PROFILE_NAME 16
+#define GPX2_PROFILE_NONE 0xFF
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t crc;                 // over the fields below
+    char name[GPX2_PROFILE_NAME]; // nul terminated
+    uint8_t config[17];           // gpx2_config
+    uint8_t pins[4];
+    uint8_t devices;              // chips read out, 0 in older profiles = 1
+    uint8_t sched;                // gpx2_sched_mode_t
+    uint8_t reserved[1];
+    uint32_t spi_speed_hz;
+} gpx2_profile_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t crc;         // over default_slot..reserved
+    uint8_t default_slot; // GPX2_PROFILE_NONE = menu at boot
+    uint8_t reserved[3];
+    gpx2_profile_t slot[GPX2_PROFILE_SLOTS];
+} gpx2_profile_store_t;
+
+// read the store from flash, invalid header or slots are cleared, false if
+// the header was not valid
+bool gpx2_profile_load(gpx2_profile_store_t *s);
+// seal the header with magic, version and crc and write the store to flash
+bool gpx2_profile_save(gpx2_profile_store_t *s);
+// fill a slot, name is truncated
+void gpx2_profile_set(gpx2_profile_t *p, const char *name, const uint8_t *config,
+                      const uint8_t *pins, uint32_t spi_speed_hz, uint8_t devices, uint8_t sched);
+bool gpx2_profile_valid(const gpx2_profile_t *p);
+// the default profile, NULL when there is none
+const gpx2_profile_t *gpx2_profile_default(const gpx2_profile_store_t *s);
+
+#endif
@@ -0,0 +1,96 @@
+#include "gpx2_results.h"
+
+#include <stddef.h>
+
+static inline uint32_t gpx2_be24(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+}
+
+void gpx2_decode_results(const uint8_t *frame, gpx2_result_t *res)
+{
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        const uint8_t *slot = frame + ch * GPX2_SLOT_BYTES;
+        res->ref[ch] = gpx2_be24(slot);      // 3 bytes reference index
+        res->stop[ch] = gpx2_be24(slot + 3); // 3 bytes stop results
+    }
+}
+
+// slots outside first..last are cleared with constant stores, the compiler
+// unrolls the rest, so no per channel branch is left
+#define GPX2_DECODE_RANGE(first, count)                                                \
+    static void gpx2_decode_##first##_##count(const uint8_t *slots, gpx2_result_t *res) \
+    {                                                                                  \
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)                                     \
+        {                                                                              \
+            if (ch < (first) || ch >= (first) + (count))                               \
+            {                                                                          \
+                res->ref[ch] = 0;                                                      \
+                res->stop[ch] = 0;                                                     \
+                continue;                                                              \
+            }                                                                          \
+            const uint8_t *slot = slots + (ch - (first)) * GPX2_SLOT_BYTES;            \
+            res->ref[ch] = gpx2_be24(slot);                                            \
+            res->stop[ch] = gpx2_be24(slot + 3);                                       \
+        }                                                                              \
+    }
+
+GPX2_DECODE_RANGE(0, 1)
+GPX2_DECODE_RANGE(0, 2)
+GPX2_DECODE_RANGE(0, 3)
+GPX2_DECODE_RANGE(1, 1)
+GPX2_DECODE_RANGE(1, 2)
+GPX2_DECODE_RANGE(1, 3)
+GPX2_DECODE_RANGE(2, 1)
+GPX2_DECODE_RANGE(2, 2)
+GPX2_DECODE_RANGE(3, 1)
+
+gpx2_decode_fn gpx2_decode_range(uint8_t first, uint8_t count)
+{
+    // [first][count - 1], whole frames use gpx2_decode_results
+    static const gpx2_decode_fn table[GPX2_CHANNELS][GPX2_CHANNELS] = {
+        {gpx2_decode_0_1, gpx2_decode_0_2, gpx2_decode_0_3, gpx2_decode_results},
+        {gpx2_decode_1_1, gpx2_decode_1_2, gpx2_decode_1_3, NULL},
+        {gpx2_decode_2_1, gpx2_decode_2_2, NULL, NULL},
+        {gpx2_decode_3_1, NULL, NULL, NULL},
+    };
+    if (first >= GPX2_CHANNELS || count == 0 || first + count > GPX2_CHANNELS)
+        return gpx2_decode_results;
+    return table[first][count - 1];
+}
+
+void gpx2_encode_results(const gpx2_result_t *res, uint8_t *frame)
+{
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        uint8_t *slot = frame + ch * GPX2_SLOT_BYTES;
+        slot[0] = (res->ref[ch] >> 16) & 0xFF;
+        slot[1] = (res->ref[ch] >> 8) & 0xFF;
+        slot[2] = res->ref[ch] & 0xFF;
+        slot[3] = (res->stop[ch] >> 16) & 0xFF;
+        slot[4] = (res->stop[ch] >> 8) & 0xFF;
+        slot[5] = res->stop[ch] & 0xFF;
+    }
+}
+
+uint8_t gpx2_results_new_hits(gpx2_result_t *res, gpx2_result_t *last, uint8_t enabled)
+{
+    uint8_t mask = 0;
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        if (!(enabled & (1 << ch)))
+            continue;
+        // empty fifo slot reads as zeros
+        if (res->ref[ch] == 0 && res->stop[ch] == 0)
+            continue;
+        // stale slot repeats the last hit
+        if (res->ref[ch] == last->ref[ch] && res->stop[ch] == last->stop[ch])
+            continue;
+        last->ref[ch] = res->ref[ch];
+        last->stop[ch] = res->stop[ch];
+        mask |= (1 << ch);
+    }
+    res->mask = mask;
+    return mask;
+}
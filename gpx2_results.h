@@ -0,0 +1,34 @@
+#ifndef GPX2_RESULTS_H
+#define GPX2_RESULTS_H
+
+#include <stdint.h>
+
+// result registers, from datasheet: 4 channels x (3 bytes REF + 3 bytes STOP)
+#define GPX2_RESULTS_ADDR 8
+#define GPX2_CHANNELS 4
+#define GPX2_SLOT_BYTES 6
+#define GPX2_FRAME_BYTES (GPX2_CHANNELS * GPX2_SLOT_BYTES)
+
+// one decoded result frame
+typedef struct
+{
+    uint32_t ref[GPX2_CHANNELS];  // 24bit reference index
+    uint32_t stop[GPX2_CHANNELS]; // 24bit stop result
+    uint8_t mask;                 // channels carrying a new hit
+    uint8_t dev;                  // chip the frame was read from
+} gpx2_result_t;
+
+// decode a raw 24 byte frame, GPX2 sends values as 3-byte big-endian
+void gpx2_decode_results(const uint8_t *frame, gpx2_result_t *res);
+// decode of the slots first..first+count-1 read from their own address, the
+// other slots read as empty (zero); one unrolled function per range, picked
+// when the readout is set up (gpx2_dev_readout_setup)
+typedef void (*gpx2_decode_fn)(const uint8_t *slots, gpx2_result_t *res);
+gpx2_decode_fn gpx2_decode_range(uint8_t first, uint8_t count);
+// the other way round, all 4 slots (recordings generated on the host)
+void gpx2_encode_results(const gpx2_result_t *res, uint8_t *frame);
+// set res->mask to the enabled slots holding a new hit, i.e. neither empty
+// (all zero) nor a repeat of the previous hit in last, which is updated
+uint8_t gpx2_results_new_hits(gpx2_result_t *res, gpx2_result_t *last, uint8_t enabled);
+
+#endif
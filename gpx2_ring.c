@@ -0,0 +1,100 @@
+#include "gpx2_ring.h"
+
+#define GPX2_RING_MASK (GPX2_RING_SIZE - 1)
+#define GPX2_RAW_RING_MASK (GPX2_RAW_RING_SIZE - 1)
+
+_Static_assert((GPX2_RING_SIZE & GPX2_RING_MASK) == 0, "GPX2_RING_SIZE must be a power of 2");
+_Static_assert((GPX2_RAW_RING_SIZE & GPX2_RAW_RING_MASK) == 0, "GPX2_RAW_RING_SIZE must be a power of 2");
+
+// only plain loads/stores are used, no read-modify-write, so this stays
+// lock-free on cortex-m0+ which has no exclusive access instructions
+
+void gpx2_ring_init(gpx2_ring_t *r)
+{
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->high_water, 0, memory_order_relaxed);
+}
+
+bool gpx2_ring_push(gpx2_ring_t *r, const gpx2_result_t *res, uint32_t epoch)
+{
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+
+    if (used >= GPX2_RING_SIZE)
+    {
+        uint32_t dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        atomic_store_explicit(&r->dropped, dropped + 1, memory_order_relaxed);
+        return false;
+    }
+    r->slot[head & GPX2_RING_MASK].res = *res;
+    r->slot[head & GPX2_RING_MASK].epoch = epoch;
+    // publish the slot before moving head
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    if (used + 1 > atomic_load_explicit(&r->high_water, memory_order_relaxed))
+    {
+        atomic_store_explicit(&r->high_water, used + 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool gpx2_ring_pop(gpx2_ring_t *r, gpx2_result_t *res, uint32_t *epoch)
+{
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return false;
+    }
+    *res = r->slot[tail & GPX2_RING_MASK].res;
+    *epoch = r->slot[tail & GPX2_RING_MASK].epoch;
+    // hand the slot back only after it was copied out
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t gpx2_ring_count(gpx2_ring_t *r)
+{
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    return head - tail;
+}
+
+void gpx2_raw_ring_init(gpx2_raw_ring_t *r)
+{
+    atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->dropped, 0, memory_order_relaxed);
+}
+
+bool gpx2_raw_ring_push(gpx2_raw_ring_t *r, const gpx2_raw_frame_t *f)
+{
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - tail >= GPX2_RAW_RING_SIZE)
+    {
+        uint32_t dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        atomic_store_explicit(&r->dropped, dropped + 1, memory_order_relaxed);
+        return false;
+    }
+    r->slot[head & GPX2_RAW_RING_MASK] = *f;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool gpx2_raw_ring_pop(gpx2_raw_ring_t *r, gpx2_raw_frame_t *f)
+{
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (head == tail)
+    {
+        return false;
+    }
+    *f = r->slot[tail & GPX2_RAW_RING_MASK];
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
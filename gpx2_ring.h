@@ -0,0 +1,60 @@
+#ifndef GPX2_RING_H
+#define GPX2_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpx2_results.h"
+
+// single-producer/single-consumer queue of result frames, lock-free
+// producer: irq handler (or acquisition loop), consumer: main loop
+#define GPX2_RING_SIZE 256 // must be a power of 2
+
+typedef struct
+{
+    gpx2_result_t res;
+    uint32_t epoch; // OPC_INIT count when it was read
+} gpx2_ring_slot_t;
+
+typedef struct
+{
+    gpx2_ring_slot_t slot[GPX2_RING_SIZE];
+    atomic_uint head;       // free running write index, producer only
+    atomic_uint tail;       // free running read index, consumer only
+    atomic_uint dropped;    // frames lost because the ring was full
+    atomic_uint high_water; // deepest fill level seen
+} gpx2_ring_t;
+
+void gpx2_ring_init(gpx2_ring_t *r);
+// producer side, returns false (and counts a drop) when full
+bool gpx2_ring_push(gpx2_ring_t *r, const gpx2_result_t *res, uint32_t epoch);
+// consumer side, returns false when empty
+bool gpx2_ring_pop(gpx2_ring_t *r, gpx2_result_t *res, uint32_t *epoch);
+// current fill level, safe from either side
+uint32_t gpx2_ring_count(gpx2_ring_t *r);
+
+// the same queue for frames as clocked out of the chip (record output mode),
+// filled by whoever reads the SPI bus, drained into the stream by the main loop
+#define GPX2_RAW_RING_SIZE 256 // must be a power of 2
+
+typedef struct
+{
+    uint8_t dev;
+    uint32_t epoch; // OPC_INIT count when it was read
+    uint32_t t_us;
+    uint8_t frame[GPX2_FRAME_BYTES];
+} gpx2_raw_frame_t;
+
+typedef struct
+{
+    gpx2_raw_frame_t slot[GPX2_RAW_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+} gpx2_raw_ring_t;
+
+void gpx2_raw_ring_init(gpx2_raw_ring_t *r);
+bool gpx2_raw_ring_push(gpx2_raw_ring_t *r, const gpx2_raw_frame_t *f);
+bool gpx2_raw_ring_pop(gpx2_raw_ring_t *r, gpx2_raw_frame_t *f);
+
+#endif
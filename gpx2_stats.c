@@ -0,0 +1,69 @@
+#include "gpx2_stats.h"
+#include <string.h>
+
+void gpx2_stats_setup(gpx2_stats_t *s, uint32_t window_us, gpx2_stats_value_t value)
+{
+    memset(s, 0, sizeof(*s));
+    s->window_us = window_us;
+    s->value = (uint8_t)value;
+}
+
+void gpx2_stats_clear(gpx2_stats_t *s, uint64_t now_us)
+{
+    memset(s->chan, 0, sizeof(s->chan));
+    memset(s->pair, 0, sizeof(s->pair));
+    s->start_us = now_us;
+}
+
+void gpx2_stats_flush(gpx2_stats_t *s)
+{
+    s->have_t = 0;
+}
+
+bool gpx2_stats_window(gpx2_stats_t *s, uint64_t now_us)
+{
+    if (now_us - s->start_us < s->window_us)
+        return false;
+    memcpy(s->report_chan, s->chan, sizeof(s->chan));
+    memcpy(s->report_pair, s->pair, sizeof(s->pair));
+    s->report_us = (uint32_t)(now_us - s->start_us);
+    s->reports++;
+    gpx2_stats_clear(s, now_us);
+    return true;
+}
+
+// floor(sqrt(v)), bit by bit
+static uint64_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > v)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (v >= r + bit)
+        {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+bool gpx2_welford_sigma(const gpx2_welford_t *w, uint64_t *sigma)
+{
+    if (w->n < 2 || w->m2 == GPX2_STATS_SAT)
+        return false;
+    // m2 is Q.8, the variance goes to Q.16 for a Q.8 root
+    uint64_t var = w->m2 / (w->n - 1);
+    if (var < (1ULL << (64 - GPX2_STATS_FRAC)))
+        *sigma = isqrt64(var << GPX2_STATS_FRAC);
+    else
+        *sigma = isqrt64(var >> GPX2_STATS_FRAC) << GPX2_STATS_FRAC;
+    return true;
+}
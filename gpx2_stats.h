@@ -0,0 +1,115 @@
+#ifndef GPX2_STATS_H
+#define GPX2_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// online statistics per channel and per coincidence pair
+//
+// Every sample updates Welford's running mean and sum of squared deviations
+// in 64 bit fixed point, so no sample is stored and no pass over the data is
+// needed:
+//
+//  n += 1;  d = x - mean;  mean = sum / n;  m2 += d * (x - mean)
+//
+// The mean is taken from the exact sum, so it does not stop moving once d / n
+// drops below its resolution, and kept in Q.8 like m2. m2 grows as
+// n * variance and sticks at UINT64_MAX when it would overflow (n * variance
+// above ~7e16 or a deviation beyond ~11 us, e.g. intervals of a random
+// source), such a window reports no sigma. Samples are collected for
+// window_us, then the accumulators are copied to a report and restarted.
+//
+// Channels (dev * 4 + ch) see either the STOP value of every hit or, for a
+// periodic input, the interval to the previous hit of the channel in ps.
+// Pairs see the coincidence dT in ps.
+#define GPX2_STATS_CHANNELS 16
+#define GPX2_STATS_PAIRS 6  // GPX2_COINC_MAX_PAIRS
+#define GPX2_STATS_FRAC 8   // fractional bits of the mean
+#define GPX2_STATS_SAT UINT64_MAX
+
+typedef enum
+{
+    GPX2_STATS_INTERVAL = 0, // ps since the previous hit of the channel
+    GPX2_STATS_STOP = 1      // STOP value in LSB
+} gpx2_stats_value_t;
+
+typedef struct
+{
+    uint32_t n;
+    int64_t sum;
+    int64_t mean; // Q.GPX2_STATS_FRAC
+    uint64_t m2;  // sum of squared deviations in Q.GPX2_STATS_FRAC, GPX2_STATS_SAT when saturated
+    int64_t min, max;
+} gpx2_welford_t;
+
+typedef struct
+{
+    uint32_t window_us;
+    uint8_t value;   // gpx2_stats_value_t
+    uint16_t have_t; // channels with a previous hit
+    uint64_t last_t_ps[GPX2_STATS_CHANNELS];
+    uint64_t start_us;
+    gpx2_welford_t chan[GPX2_STATS_CHANNELS];
+    gpx2_welford_t pair[GPX2_STATS_PAIRS];
+    // last finished window
+    uint32_t report_us; // its length, 0 before the first window
+    uint32_t reports;   // windows finished so far
+    gpx2_welford_t report_chan[GPX2_STATS_CHANNELS];
+    gpx2_welford_t report_pair[GPX2_STATS_PAIRS];
+} gpx2_stats_t;
+
+static inline void gpx2_welford_add(gpx2_welford_t *w, int64_t x)
+{
+    if (w->n == 0 || x < w->min)
+        w->min = x;
+    if (w->n == 0 || x > w->max)
+        w->max = x;
+    int64_t xq = x * (1 << GPX2_STATS_FRAC);
+    int64_t d = xq - w->mean;
+    w->n++;
+    w->sum += x;
+    w->mean = w->sum * (1 << GPX2_STATS_FRAC) / (int64_t)w->n;
+    int64_t d2 = xq - w->mean;
+    if (w->m2 == GPX2_STATS_SAT)
+        return;
+    // Q.8 * Q.8 back to Q.8, rounded
+    int64_t p;
+    uint64_t m2;
+    if (__builtin_mul_overflow(d, d2, &p) ||
+        __builtin_add_overflow(w->m2, p > 0 ? (uint64_t)(p + 128) >> GPX2_STATS_FRAC : 0, &m2))
+        m2 = GPX2_STATS_SAT;
+    w->m2 = m2;
+}
+
+// window length and channel value, clears everything
+void gpx2_stats_setup(gpx2_stats_t *s, uint32_t window_us, gpx2_stats_value_t value);
+// restart the running window at now_us, the last report is kept
+void gpx2_stats_clear(gpx2_stats_t *s, uint64_t now_us);
+// forget the previous hit times, after a REF reset
+void gpx2_stats_flush(gpx2_stats_t *s);
+// feed one hit, t_ps is only read for GPX2_STATS_INTERVAL
+static inline void gpx2_stats_hit(gpx2_stats_t *s, uint8_t ch, uint32_t stop, uint64_t t_ps)
+{
+    if (s->value == GPX2_STATS_STOP)
+    {
+        gpx2_welford_add(&s->chan[ch], stop);
+        return;
+    }
+    if (s->have_t & (1u << ch))
+        gpx2_welford_add(&s->chan[ch], (int64_t)(t_ps - s->last_t_ps[ch]));
+    s->last_t_ps[ch] = t_ps;
+    s->have_t |= 1u << ch;
+}
+static inline void gpx2_stats_dt(gpx2_stats_t *s, uint8_t pair, int32_t dt_ps)
+{
+    gpx2_welford_add(&s->pair[pair], dt_ps);
+}
+// true once window_us has passed: the window moves to the report and a new
+// one starts
+bool gpx2_stats_window(gpx2_stats_t *s, uint64_t now_us);
+
+// standard deviation in Q.GPX2_STATS_FRAC (sample variance, n - 1), false
+// with fewer than 2 samples or a saturated sum
+bool gpx2_welford_sigma(const gpx2_welford_t *w, uint64_t *sigma);
+
+#endif
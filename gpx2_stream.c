@@ -0,0 +1,163 @@
+#include "gpx2_stream.h"
+#include "gpx2_crc.h"
+#include "gpx2_results.h"
+#include <string.h>
+
+void gpx2_stream_init(gpx2_stream_t *s)
+{
+    s->len = 0;
+    s->type = 0;
+    s->seq = 0;
+}
+
+uint8_t *gpx2_stream_reserve(gpx2_stream_t *s, uint8_t type, uint16_t n)
+{
+    if (s->type == 0)
+    {
+        s->type = type;
+        s->len = 0;
+    }
+    else if (s->type != type)
+    {
+        return NULL;
+    }
+    if (s->len + n > GPX2_FRAME_MAX_PAYLOAD)
+    {
+        return NULL;
+    }
+    uint8_t *p = &s->buf[GPX2_FRAME_HEADER + s->len];
+    s->len += n;
+    return p;
+}
+
+bool gpx2_stream_add_event(gpx2_stream_t *s, uint8_t ch, uint32_t ref, uint32_t stop)
+{
+    uint8_t *p = gpx2_stream_reserve(s, GPX2_FRAME_EVENTS, GPX2_EVENT_RECORD);
+    if (p == NULL)
+    {
+        return false;
+    }
+    p[0] = ch;
+    gpx2_put_le24(p + 1, ref);
+    gpx2_put_le24(p + 4, stop);
+    return true;
+}
+
+bool gpx2_stream_add_time(gpx2_stream_t *s, uint8_t ch, uint64_t t_ps)
+{
+    uint8_t *p = gpx2_stream_reserve(s, GPX2_FRAME_TIMES, GPX2_TIME_RECORD);
+    if (p == NULL)
+    {
+        return false;
+    }
+    p[0] = ch;
+    gpx2_put_le64(p + 1, t_ps);
+    return true;
+}
+
+bool gpx2_stream_add_dt(gpx2_stream_t *s, uint8_t a, uint8_t b, int32_t dt_ps)
+{
+    uint8_t *p = gpx2_stream_reserve(s, GPX2_FRAME_DT, GPX2_DT_RECORD);
+    if (p == NULL)
+    {
+        return false;
+    }
+    p[0] = (uint8_t)((a << 4) | (b & 0x0F));
+    gpx2_put_le32(p + 1, (uint32_t)dt_ps);
+    return true;
+}
+
+bool gpx2_stream_add_raw(gpx2_stream_t *s, uint8_t dev, uint32_t t_us, const uint8_t *frame)
+{
+    uint8_t *p = gpx2_stream_reserve(s, GPX2_FRAME_RAW, GPX2_RAW_RECORD);
+    if (p == NULL)
+    {
+        return false;
+    }
+    p[0] = dev;
+    gpx2_put_le32(p + 1, t_us);
+    memcpy(p + 5, frame, GPX2_FRAME_BYTES);
+    return true;
+}
+
+size_t gpx2_stream_finish(gpx2_stream_t *s)
+{
+    if (s->type == 0)
+    {
+        return 0;
+    }
+    uint8_t *b = s->buf;
+    b[0] = GPX2_SYNC0;
+    b[1] = GPX2_SYNC1;
+    b[2] = s->type;
+    gpx2_put_le16(b + 3, s->len);
+    gpx2_put_le32(b + 5, s->seq);
+    uint16_t crc = gpx2_crc16(GPX2_CRC16_INIT, b + 2, GPX2_FRAME_HEADER - 2 + s->len);
+    gpx2_put_le16(b + GPX2_FRAME_HEADER + s->len, crc);
+
+    size_t size = GPX2_FRAME_HEADER + s->len + GPX2_FRAME_TRAILER;
+    s->seq++;
+    s->type = 0;
+    s->len = 0;
+    return size;
+}
+
+gpx2_parse_status_t gpx2_stream_parse(const uint8_t *data, size_t n, gpx2_frame_view_t *view)
+{
+    if (n == 0)
+    {
+        return GPX2_PARSE_NEED_MORE;
+    }
+    if (data[0] != GPX2_SYNC0 || (n >= 2 && data[1] != GPX2_SYNC1))
+    {
+        return GPX2_PARSE_BAD_SYNC;
+    }
+    if (n < GPX2_FRAME_HEADER)
+    {
+        return GPX2_PARSE_NEED_MORE;
+    }
+    uint16_t len = gpx2_get_le16(data + 3);
+    if (len > GPX2_FRAME_MAX_PAYLOAD)
+    {
+        return GPX2_PARSE_BAD_SYNC;
+    }
+    size_t size = GPX2_FRAME_HEADER + len + GPX2_FRAME_TRAILER;
+    if (n < size)
+    {
+        return GPX2_PARSE_NEED_MORE;
+    }
+    uint16_t crc = gpx2_crc16(GPX2_CRC16_INIT, data + 2, GPX2_FRAME_HEADER - 2 + len);
+    if (crc != gpx2_get_le16(data + GPX2_FRAME_HEADER + len))
+    {
+        return GPX2_PARSE_BAD_CRC;
+    }
+    view->type = data[2];
+    view->len = len;
+    view->seq = gpx2_get_le32(data + 5);
+    view->payload = data + GPX2_FRAME_HEADER;
+    view->size = size;
+    return GPX2_PARSE_OK;
+}
+
+void gpx2_stream_get_event(const uint8_t *payload, size_t i, uint8_t *ch, uint32_t *ref, uint32_t *stop)
+{
+    const uint8_t *p = payload + i * GPX2_EVENT_RECORD;
+    *ch = p[0];
+    *ref = gpx2_get_le24(p + 1);
+    *stop = gpx2_get_le24(p + 4);
+}
+
+void gpx2_stream_get_time(const uint8_t *payload, size_t i, uint8_t *ch, uint64_t *t_ps)
+{
+    const uint8_t *p = payload + i * GPX2_TIME_RECORD;
+    *ch = p[0];
+    *t_ps = gpx2_get_le64(p + 1);
+}
+
+void gpx2_stream_get_dt(const uint8_t *payload, size_t i, uint8_t *a, uint8_t *b, int32_t *dt_ps)
+{
+    const uint8_t *p = payload + i * GPX2_DT_RECORD;
+    *a = p[0] >> 4;
+    *b = p[0] & 0x0F;
+    *dt_ps = (int32_t)gpx2_get_le32(p + 1);
+}
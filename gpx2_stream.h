@@ -0,0 +1,171 @@
+#ifndef GPX2_STREAM_H
+#define GPX2_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// binary framed stream, all fields little-endian
+//
+//  offset size
+//  0      2    sync 0xA5 0x5A
+//  2      1    frame type
+//  3      2    payload length n
+//  5      4    sequence number, +1 per frame, gaps mean lost frames
+//  9      n    payload
+//  9+n    2    crc16-ccitt over type..payload
+//
+// GPX2_FRAME_EVENTS payload is a list of 7 byte records:
+//  channel(1) REF(3) STOP(3)
+// GPX2_FRAME_TIMES payload is a list of 9 byte records:
+//  channel(1) time in ps since the last OPC_INIT/REFCLK reset(8)
+// GPX2_FRAME_DT payload is a list of 5 byte coincidence records:
+//  channels(1, a in the high nibble, b in the low) dT = t_b - t_a in ps(4, signed)
+// channel numbers are dev * 4 + ch (0..15) when several chips are read out
+// GPX2_FRAME_PACKED_KEY/GPX2_FRAME_PACKED carry delta + varint coded events,
+// see gpx2_pack.h
+// GPX2_FRAME_STATS payload is the window length in us(4) followed by 33 byte
+// records of one finished statistics window (gpx2_stats.h):
+//  id(1, channel 0..15 or GPX2_HIST_ID_PAIR + pair) n(4) mean(8, signed Q.8)
+//  sigma(4, Q.8, 0xFFFFFFFF = none) min(8, signed) max(8, signed)
+// GPX2_FRAME_CAPTURE frames enclose the read back of a burst capture
+// (gpx2_capture.h), its records come as GPX2_FRAME_EVENTS frames in between.
+// The opening frame has no payload, the closing one is a summary:
+//  records(4) crc16 of the records(2) duration in us(4) dropped events(4)
+//  hits dropped while it was read back(4)
+// GPX2_FRAME_RAW payload is a list of 29 byte records of the record output
+// mode (5), one per result frame read, empty and stale slots included:
+//  dev(1) time in us(4, low 32 bits of the firmware clock)
+//  result frame(24, as read after OPC_READ_RESULTS: per channel REF(3) STOP(3)
+//  big-endian)
+// GPX2_FRAME_SETUP goes ahead of them, when recording starts and after every
+// OPC_INIT (the REF index restarts):
+//  devices(1) init count(4) REFCLK period in ps(4) config registers(17)
+
+#define GPX2_SYNC0 0xA5
+#define GPX2_SYNC1 0x5A
+#define GPX2_FRAME_HEADER 9
+#define GPX2_FRAME_TRAILER 2
+#define GPX2_FRAME_MAX_PAYLOAD 448
+#define GPX2_FRAME_MAX (GPX2_FRAME_HEADER + GPX2_FRAME_MAX_PAYLOAD + GPX2_FRAME_TRAILER)
+
+#define GPX2_EVENT_RECORD 7
+#define GPX2_TIME_RECORD 9
+#define GPX2_DT_RECORD 5
+#define GPX2_STATS_RECORD 33
+#define GPX2_CAPTURE_SUMMARY 18
+#define GPX2_RAW_RECORD 29
+#define GPX2_SETUP_PAYLOAD 26
+
+typedef enum
+{
+    GPX2_FRAME_EVENTS = 1,
+    GPX2_FRAME_HIST = 2,
+    GPX2_FRAME_TIMES = 3,
+    GPX2_FRAME_DT = 4,
+    GPX2_FRAME_PACKED_KEY = 5,
+    GPX2_FRAME_PACKED = 6,
+    GPX2_FRAME_STATS = 7,
+    GPX2_FRAME_CAPTURE = 8,
+    GPX2_FRAME_RAW = 9,
+    GPX2_FRAME_SETUP = 10,
+} gpx2_frame_type_t;
+
+static inline void gpx2_put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+static inline void gpx2_put_le24(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+}
+static inline void gpx2_put_le32(uint8_t *p, uint32_t v)
+{
+    gpx2_put_le16(p, v & 0xFFFF);
+    gpx2_put_le16(p + 2, v >> 16);
+}
+static inline void gpx2_put_le64(uint8_t *p, uint64_t v)
+{
+    gpx2_put_le32(p, (uint32_t)v);
+    gpx2_put_le32(p + 4, (uint32_t)(v >> 32));
+}
+static inline uint16_t gpx2_get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+static inline uint32_t gpx2_get_le24(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+static inline uint32_t gpx2_get_le32(const uint8_t *p)
+{
+    return gpx2_get_le16(p) | ((uint32_t)gpx2_get_le16(p + 2) << 16);
+}
+static inline uint64_t gpx2_get_le64(const uint8_t *p)
+{
+    return gpx2_get_le32(p) | ((uint64_t)gpx2_get_le32(p + 4) << 32);
+}
+
+// GPX2_FRAME_HIST payload is one chunk of a histogram:
+//  channel(1) first_bin(2) total_bins(2) offset(4, signed) bin_width(4)
+//  underflow(4) overflow(4) counts(4 each, up to GPX2_HIST_CHUNK_BINS)
+// channel is 0..15 for STOP histograms, GPX2_HIST_ID_PAIR + i for the dT
+// histogram of coincidence pair i
+#define GPX2_HIST_CHUNK_HEADER 21
+#define GPX2_HIST_ID_PAIR 0x10
+#define GPX2_HIST_CHUNK_BINS ((GPX2_FRAME_MAX_PAYLOAD - GPX2_HIST_CHUNK_HEADER) / 4)
+
+// frame builder
+typedef struct
+{
+    uint8_t buf[GPX2_FRAME_MAX];
+    uint16_t len; // payload bytes in the open frame
+    uint8_t type; // type of the open frame, 0 when none
+    uint32_t seq; // sequence number of the next frame
+} gpx2_stream_t;
+
+void gpx2_stream_init(gpx2_stream_t *s);
+// room for n payload bytes in a frame of the given type, NULL if the open
+// frame has another type or not enough space left -> finish it first
+uint8_t *gpx2_stream_reserve(gpx2_stream_t *s, uint8_t type, uint16_t n);
+// append one event record, false when the frame must be finished first
+bool gpx2_stream_add_event(gpx2_stream_t *s, uint8_t ch, uint32_t ref, uint32_t stop);
+// append one timestamp record, false when the frame must be finished first
+bool gpx2_stream_add_time(gpx2_stream_t *s, uint8_t ch, uint64_t t_ps);
+// append one coincidence record, false when the frame must be finished first
+bool gpx2_stream_add_dt(gpx2_stream_t *s, uint8_t a, uint8_t b, int32_t dt_ps);
+// append one raw result frame (GPX2_FRAME_RAW), false when the frame must be finished first
+bool gpx2_stream_add_raw(gpx2_stream_t *s, uint8_t dev, uint32_t t_us, const uint8_t *frame);
+// close the open frame, returns its total size in s->buf (0 if nothing was added)
+size_t gpx2_stream_finish(gpx2_stream_t *s);
+
+// parser, used on the host side
+typedef enum
+{
+    GPX2_PARSE_OK,        // a valid frame starts at data[0]
+    GPX2_PARSE_NEED_MORE, // looks like a frame but is not complete yet
+    GPX2_PARSE_BAD_SYNC,  // no sync word at data[0], skip a byte
+    GPX2_PARSE_BAD_CRC,   // complete frame with crc mismatch, skip a byte
+} gpx2_parse_status_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint16_t len;
+    uint32_t seq;
+    const uint8_t *payload;
+    size_t size; // total frame size including header and crc
+} gpx2_frame_view_t;
+
+gpx2_parse_status_t gpx2_stream_parse(const uint8_t *data, size_t n, gpx2_frame_view_t *view);
+// decode event record i of an events payload
+void gpx2_stream_get_event(const uint8_t *payload, size_t i, uint8_t *ch, uint32_t *ref, uint32_t *stop);
+// decode timestamp record i of a times payload
+void gpx2_stream_get_time(const uint8_t *payload, size_t i, uint8_t *ch, uint64_t *t_ps);
+// decode coincidence record i of a dT payload
+void gpx2_stream_get_dt(const uint8_t *payload, size_t i, uint8_t *a, uint8_t *b, int32_t *dt_ps);
+
+#endif
@@ -0,0 +1,134 @@
+#include "gpx2_text.h"
+#include <string.h>
+
+// "00".."99", two digits per division by 100
+static const char gpx2_digits2[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+int gpx2_text_u32(char *p, uint32_t v)
+{
+    char tmp[10];
+    int n = sizeof(tmp);
+    while (v >= 100)
+    {
+        uint32_t q = v / 100;
+        const char *d = &gpx2_digits2[(v - q * 100) * 2];
+        tmp[--n] = d[1];
+        tmp[--n] = d[0];
+        v = q;
+    }
+    if (v >= 10)
+    {
+        tmp[--n] = gpx2_digits2[v * 2 + 1];
+        tmp[--n] = gpx2_digits2[v * 2];
+    }
+    else
+    {
+        tmp[--n] = (char)('0' + v);
+    }
+    memcpy(p, &tmp[n], sizeof(tmp) - n);
+    return sizeof(tmp) - n;
+}
+
+// exactly 9 digits, leading zeros kept
+static void text_u32_9(char *p, uint32_t v)
+{
+    for (int i = 7; i >= 1; i -= 2)
+    {
+        uint32_t q = v / 100;
+        const char *d = &gpx2_digits2[(v - q * 100) * 2];
+        p[i] = d[0];
+        p[i + 1] = d[1];
+        v = q;
+    }
+    p[0] = (char)('0' + v);
+}
+
+int gpx2_text_u64(char *p, uint64_t v)
+{
+    if (v <= UINT32_MAX)
+        return gpx2_text_u32(p, (uint32_t)v);
+    // one 64 bit division per 9 digits, the rest is 32 bit math
+    uint64_t hi = v / 1000000000u;
+    uint32_t lo = (uint32_t)(v - hi * 1000000000u);
+    int n = gpx2_text_u64(p, hi);
+    text_u32_9(p + n, lo);
+    return n + 9;
+}
+
+int gpx2_text_i32(char *p, int32_t v)
+{
+    if (v >= 0)
+        return gpx2_text_u32(p, (uint32_t)v);
+    *p = '-';
+    return 1 + gpx2_text_u32(p + 1, 0u - (uint32_t)v);
+}
+
+void gpx2_text_add_frame(gpx2_text_t *t, const gpx2_result_t *res, const uint64_t *t_ps, uint8_t columns)
+{
+    char *p = t->buf + t->len;
+    p += gpx2_text_u32(p, res->dev + 1u);
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        if (!(columns & (1 << ch)))
+            continue;
+        *p++ = ',';
+        bool hit = res->mask & (1 << ch);
+        if (t_ps != NULL)
+        {
+            if (hit)
+                p += gpx2_text_u64(p, t_ps[ch]);
+            continue;
+        }
+        if (hit)
+            p += gpx2_text_u32(p, res->ref[ch]);
+        *p++ = ',';
+        if (hit)
+            p += gpx2_text_u32(p, res->stop[ch]);
+    }
+    *p++ = '\n';
+    t->len = p - t->buf;
+}
+
+void gpx2_text_add_dt(gpx2_text_t *t, int pair, int32_t dt_ps)
+{
+    char *p = t->buf + t->len;
+    p += gpx2_text_u32(p, (uint32_t)pair + 1);
+    *p++ = ',';
+    p += gpx2_text_i32(p, dt_ps);
+    *p++ = '\n';
+    t->len = p - t->buf;
+}
+
+int gpx2_text_header(char *p, uint8_t columns, bool ps)
+{
+    char *s = p;
+    memcpy(p, "dev", 3);
+    p += 3;
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+    {
+        if (!(columns & (1 << ch)))
+            continue;
+        char d = (char)('1' + ch);
+        if (ps)
+        {
+            memcpy(p, ",t", 2);
+            p[2] = d;
+            p += 3;
+        }
+        else
+        {
+            memcpy(p, ",ref", 4);
+            p[4] = d;
+            memcpy(p + 5, ",stop", 5);
+            p[10] = d;
+            p += 11;
+        }
+    }
+    *p++ = '\n';
+    return (int)(p - s);
+}
@@ -0,0 +1,44 @@
+#ifndef GPX2_TEXT_H
+#define GPX2_TEXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gpx2_results.h"
+
+// allocation-free CSV output: integers are formatted two digits per step from
+// a lookup table into one static buffer, which is written out in large chunks
+// instead of one printf/stdio write per line
+#define GPX2_TEXT_BUF 2048
+#define GPX2_TEXT_LINE_MAX 128 // longest line a gpx2_text_add_* appends
+
+typedef struct
+{
+    char buf[GPX2_TEXT_BUF];
+    size_t len;
+} gpx2_text_t;
+
+// decimal digits without terminator, return the number of chars written
+int gpx2_text_u32(char *p, uint32_t v);
+int gpx2_text_u64(char *p, uint64_t v);
+int gpx2_text_i32(char *p, int32_t v);
+
+static inline void gpx2_text_init(gpx2_text_t *t)
+{
+    t->len = 0;
+}
+// room for one more line, flush the buffer first otherwise
+static inline bool gpx2_text_room(const gpx2_text_t *t)
+{
+    return t->len + GPX2_TEXT_LINE_MAX <= GPX2_TEXT_BUF;
+}
+
+// one line per frame: dev, then per channel in columns REF,STOP (raw) or the
+// ps time (t_ps != NULL); channels without a new hit leave their fields empty
+void gpx2_text_add_frame(gpx2_text_t *t, const gpx2_result_t *res, const uint64_t *t_ps, uint8_t columns);
+// one line per coincidence: pair,dt_ps
+void gpx2_text_add_dt(gpx2_text_t *t, int pair, int32_t dt_ps);
+// header line matching gpx2_text_add_frame, returns its length
+int gpx2_text_header(char *p, uint8_t columns, bool ps);
+
+#endif
@@ -0,0 +1,62 @@
+#include "gpx2_time.h"
+
+bool gpx2_time_setup(gpx2_time_t *t, uint32_t period_ps, uint32_t divisions)
+{
+    if (period_ps == 0 || divisions == 0)
+    {
+        return false;
+    }
+    t->period_ps = period_ps;
+    t->divisions = divisions;
+    // usual setup has REFCLK_DIVISIONS = period in ps, STOP is already in ps
+    t->stop_q16 = 0;
+    if (period_ps != divisions)
+    {
+        t->stop_q16 = (uint32_t)((((uint64_t)period_ps << 16) + divisions / 2) / divisions);
+    }
+    t->refs_per_us_q16 = (uint32_t)((1000000ULL << 16) / period_ps);
+    gpx2_time_reset(t);
+    return true;
+}
+
+void gpx2_time_reset(gpx2_time_t *t)
+{
+    t->valid = false;
+    t->ref_last = 0;
+    t->us_last = 0;
+    t->wraps = 0;
+}
+
+uint64_t gpx2_time_unwrap(gpx2_time_t *t, uint32_t ref, uint64_t now_us)
+{
+    ref &= GPX2_REF_MASK;
+    if (!t->valid)
+    {
+        // first hit after a reset is in the first REF epoch
+        t->valid = true;
+        t->ref_last = ref;
+        t->us_last = now_us;
+        return ref;
+    }
+
+    uint64_t expect = t->ref_last;
+    if (now_us > t->us_last)
+    {
+        expect += ((now_us - t->us_last) * t->refs_per_us_q16) >> 16;
+    }
+    // signed 24 bit distance from the expected index
+    int32_t d = (int32_t)(((ref - (uint32_t)expect) & GPX2_REF_MASK) << 8) >> 8;
+    if (d < 0 && expect < (uint64_t)-d)
+    {
+        return ref; // before the first rollover
+    }
+    uint64_t ext = expect + d;
+
+    if (ext > t->ref_last)
+    {
+        t->wraps += (uint32_t)((ext >> GPX2_REF_BITS) - (t->ref_last >> GPX2_REF_BITS));
+        t->ref_last = ext;
+        t->us_last = now_us;
+    }
+    return ext;
+}
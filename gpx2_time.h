@@ -0,0 +1,52 @@
+#ifndef GPX2_TIME_H
+#define GPX2_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// REF/STOP to absolute picoseconds, integer math only (no FPU on the M0+)
+//
+//  t_ps = REF * period_ps + STOP * period_ps / REFCLK_DIVISIONS
+//
+// REF is a 24 bit index that wraps every 2^24 REFCLK periods (3.3 s at 5 MHz).
+// It is extended to 64 bits by taking the value closest to where REF should be
+// now: the newest extended REF seen on any channel plus the host time elapsed
+// since then. Hits may arrive out of order between channels and a channel may
+// stay silent for any time, as long as the host clock is off by less than half
+// a wrap between hits.
+#define GPX2_REF_BITS 24
+#define GPX2_REF_MASK ((1u << GPX2_REF_BITS) - 1)
+
+typedef struct
+{
+    uint32_t period_ps;       // REFCLK period
+    uint32_t divisions;       // REFCLK_DIVISIONS, STOP LSBs per period
+    uint32_t stop_q16;        // ps per STOP LSB in Q16.16, 0 when the LSB is 1 ps
+    uint32_t refs_per_us_q16; // REF ticks per microsecond in Q16.16
+    bool valid;               // ref_last holds a hit
+    uint64_t ref_last;        // newest extended REF
+    uint64_t us_last;         // host time when ref_last was seen
+    uint32_t wraps;           // REF rollovers crossed so far
+} gpx2_time_t;
+
+// set the REFCLK period and divisions and forget the REF history,
+// false if either is zero
+bool gpx2_time_setup(gpx2_time_t *t, uint32_t period_ps, uint32_t divisions);
+// forget the REF history, after OPC_INIT or a REFCLK reset
+void gpx2_time_reset(gpx2_time_t *t);
+// extend a 24 bit REF seen at host time now_us to 64 bits
+uint64_t gpx2_time_unwrap(gpx2_time_t *t, uint32_t ref, uint64_t now_us);
+// STOP fraction in ps
+static inline uint32_t gpx2_time_stop_ps(const gpx2_time_t *t, uint32_t stop)
+{
+    if (t->stop_q16 == 0)
+        return stop;
+    return (uint32_t)(((uint64_t)stop * t->stop_q16 + 0x8000) >> 16);
+}
+// absolute time of a hit in ps
+static inline uint64_t gpx2_time_ps(gpx2_time_t *t, uint32_t ref, uint32_t stop, uint64_t now_us)
+{
+    return gpx2_time_unwrap(t, ref, now_us) * t->period_ps + gpx2_time_stop_ps(t, stop);
+}
+
+#endif
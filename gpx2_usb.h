@@ -0,0 +1,31 @@
+#ifndef GPX2_USB_H
+#define GPX2_USB_H
+
+// USB layout of the composite device (usb_descriptors.c), shared with the
+// host reader (host/gpx2_usbfs.cpp)
+//
+//   interface 0+1  CDC ACM: the console, pico_stdio_usb on top of it
+//   interface 2    vendor class, one bulk IN endpoint: event data
+//                  (hal_bulk_*), no control requests
+//
+// bcdDevice differs from the SDK's plain CDC device with the same VID/PID, so
+// hosts that cache the interface layout per VID/PID/revision pick up the
+// new one.
+#define GPX2_USB_VID 0x2E8A // Raspberry Pi
+#define GPX2_USB_PID 0x000A // pico_stdio_usb's default
+#define GPX2_USB_BCD_DEVICE 0x0110
+
+#define GPX2_USB_ITF_CDC 0
+#define GPX2_USB_ITF_CDC_DATA 1
+#define GPX2_USB_ITF_BULK 2
+#define GPX2_USB_ITF_COUNT 3
+
+#define GPX2_USB_EP_CDC_NOTIF 0x81
+#define GPX2_USB_EP_CDC_OUT 0x02
+#define GPX2_USB_EP_CDC_IN 0x82
+#define GPX2_USB_EP_BULK_IN 0x83
+
+// full speed bulk packet size
+#define GPX2_USB_BULK_PACKET 64
+
+#endif
@@ -0,0 +1,262 @@
+#include "gpx2_analysis.h"
+
+#include <atomic>
+#include <cmath>
+
+namespace gpx2 {
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++)
+        workers_.emplace_back([this] { run(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &w : workers_)
+        w.join();
+}
+
+void ThreadPool::run()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+void Welford::merge(const Welford &o)
+{
+    if (o.n == 0)
+        return;
+    if (n == 0)
+    {
+        *this = o;
+        return;
+    }
+    double total = (double)(n + o.n);
+    double d = o.mean - mean;
+    mean += d * (double)o.n / total;
+    m2 += o.m2 + d * d * (double)n * (double)o.n / total;
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+    n += o.n;
+}
+
+double Welford::sigma() const
+{
+    return n > 1 ? std::sqrt(m2 / (double)(n - 1)) : 0.0;
+}
+
+void Histogram::merge(const Histogram &o)
+{
+    for (size_t i = 0; i < count.size() && i < o.count.size(); i++)
+        count[i] += o.count[i];
+    underflow += o.underflow;
+    overflow += o.overflow;
+}
+
+AnalysisResult::AnalysisResult(const AnalysisConfig &cfg)
+    : dt(cfg.pairs.size()), dt_hist(cfg.pairs.size(), Histogram(cfg.dt))
+{
+    for (auto &h : stop_hist)
+        h = Histogram(cfg.stop);
+}
+
+void AnalysisResult::merge(const AnalysisResult &o)
+{
+    if (o.events == 0)
+        return;
+    t_first = events ? std::min(t_first, o.t_first) : o.t_first;
+    t_last = events ? std::max(t_last, o.t_last) : o.t_last;
+    for (int g = 0; g < CHANNELS; g++)
+    {
+        if (o.stop[g].n)
+        {
+            chan_first[g] = stop[g].n ? std::min(chan_first[g], o.chan_first[g]) : o.chan_first[g];
+            chan_last[g] = stop[g].n ? std::max(chan_last[g], o.chan_last[g]) : o.chan_last[g];
+        }
+        stop[g].merge(o.stop[g]);
+        stop_hist[g].merge(o.stop_hist[g]);
+    }
+    for (size_t p = 0; p < dt.size(); p++)
+    {
+        dt[p].merge(o.dt[p]);
+        dt_hist[p].merge(o.dt_hist[p]);
+    }
+    events += o.events;
+    blocks += o.blocks;
+}
+
+namespace {
+
+// dT of every b hit against the closer of the previous and the next a hit
+void pair_block(const ColumnReader::Block &b, int ca, int cb, int64_t window, Welford &w, Histogram &h,
+                std::vector<int64_t> &prev_a)
+{
+    constexpr int64_t NONE = INT64_MIN;
+    prev_a.resize(b.n);
+    int64_t last = NONE;
+    for (uint32_t i = 0; i < b.n; i++)
+    {
+        if (b.channel[i] == ca)
+            last = b.t_ps[i];
+        prev_a[i] = last;
+    }
+    int64_t next = NONE;
+    for (uint32_t i = b.n; i-- > 0;)
+    {
+        if (b.channel[i] == ca)
+        {
+            next = b.t_ps[i];
+            continue;
+        }
+        if (b.channel[i] != cb)
+            continue;
+        int64_t t = b.t_ps[i];
+        int64_t dt = 0;
+        bool have = false;
+        if (prev_a[i] != NONE)
+        {
+            dt = t - prev_a[i];
+            have = true;
+        }
+        if (next != NONE && (!have || std::llabs(t - next) < std::llabs(dt)))
+        {
+            dt = t - next;
+            have = true;
+        }
+        if (have && std::llabs(dt) <= window)
+        {
+            w.add(dt);
+            h.add(dt);
+        }
+    }
+}
+
+void analyze_block(const ColumnReader::Block &b, const AnalysisConfig &cfg, AnalysisResult &r,
+                   std::vector<int64_t> &scratch)
+{
+    if (b.n == 0)
+        return;
+    int64_t lo = b.t_ps[0], hi = b.t_ps[0];
+    for (uint32_t i = 0; i < b.n; i++)
+    {
+        int g = b.channel[i] & (CHANNELS - 1);
+        int64_t t = b.t_ps[i];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+        if (r.stop[g].n == 0 || t < r.chan_first[g])
+            r.chan_first[g] = t;
+        if (r.stop[g].n == 0 || t > r.chan_last[g])
+            r.chan_last[g] = t;
+        r.stop[g].add(b.stop[i]);
+        r.stop_hist[g].add(b.stop[i]);
+    }
+    for (size_t p = 0; p < cfg.pairs.size(); p++)
+        pair_block(b, cfg.pairs[p].first, cfg.pairs[p].second, cfg.window_ps, r.dt[p], r.dt_hist[p], scratch);
+    r.t_first = r.events ? std::min(r.t_first, lo) : lo;
+    r.t_last = r.events ? std::max(r.t_last, hi) : hi;
+    r.events += b.n;
+    r.blocks++;
+}
+
+} // namespace
+
+AnalysisResult analyze(const ColumnReader &file, const AnalysisConfig &cfg, ThreadPool &pool)
+{
+    // one task per worker, each takes the next block until none is left;
+    // blocks are merged in worker order, which only moves the float rounding
+    std::atomic<size_t> next{0};
+    size_t blocks = file.blocks();
+    std::vector<std::future<AnalysisResult>> parts;
+    for (unsigned w = 0; w < pool.size(); w++)
+    {
+        parts.push_back(pool.submit([&] {
+            AnalysisResult r(cfg);
+            std::vector<int64_t> scratch;
+            for (size_t i; (i = next.fetch_add(1)) < blocks;)
+                analyze_block(file.block(i), cfg, r, scratch);
+            return r;
+        }));
+    }
+    AnalysisResult total(cfg);
+    for (auto &p : parts)
+        total.merge(p.get());
+    return total;
+}
+
+void print_summary(std::FILE *out, const AnalysisResult &r, const AnalysisConfig &cfg)
+{
+    double span_s = (double)(r.t_last - r.t_first) * 1e-12;
+    std::fprintf(out, "%llu events in %llu blocks, t_ps span %.6f s\n", (unsigned long long)r.events,
+                 (unsigned long long)r.blocks, span_s);
+    for (int g = 0; g < CHANNELS; g++)
+    {
+        const Welford &w = r.stop[g];
+        if (w.n == 0)
+            continue;
+        double ch_span = (double)(r.chan_last[g] - r.chan_first[g]) * 1e-12;
+        std::fprintf(out, "CH%d: n=%llu rate=%.1f/s STOP mean=%.2f sigma=%.2f min=%lld max=%lld\n", g + 1,
+                     (unsigned long long)w.n, ch_span > 0 ? (double)(w.n - 1) / ch_span : 0.0, w.mean, w.sigma(),
+                     (long long)w.min, (long long)w.max);
+    }
+    for (size_t p = 0; p < cfg.pairs.size(); p++)
+    {
+        const Welford &w = r.dt[p];
+        std::fprintf(out, "P%zu CH%d-CH%d: n=%llu", p + 1, cfg.pairs[p].second + 1, cfg.pairs[p].first + 1,
+                     (unsigned long long)w.n);
+        if (w.n)
+            std::fprintf(out, " mean dT=%.2f sigma=%.2f min=%lld max=%lld ps", w.mean, w.sigma(),
+                         (long long)w.min, (long long)w.max);
+        std::fprintf(out, "\n");
+    }
+}
+
+bool write_hist_csv(const char *path, const AnalysisResult &r)
+{
+    std::FILE *out = std::fopen(path, "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "channel,bin,low,count\n");
+    auto write = [out](const char *name, const Histogram &h) {
+        for (size_t i = 0; i < h.count.size(); i++)
+            std::fprintf(out, "%s,%zu,%lld,%llu\n", name, i,
+                         (long long)(h.spec.low + (int64_t)(i * h.spec.width)), (unsigned long long)h.count[i]);
+        std::fprintf(out, "%s,underflow,,%llu\n", name, (unsigned long long)h.underflow);
+        std::fprintf(out, "%s,overflow,,%llu\n", name, (unsigned long long)h.overflow);
+    };
+    char name[24]; // "P" and any size_t
+    for (int g = 0; g < CHANNELS; g++)
+    {
+        if (r.stop[g].n == 0)
+            continue;
+        std::snprintf(name, sizeof name, "%d", g + 1);
+        write(name, r.stop_hist[g]);
+    }
+    for (size_t p = 0; p < r.dt_hist.size(); p++)
+    {
+        std::snprintf(name, sizeof name, "P%zu", p + 1);
+        write(name, r.dt_hist[p]);
+    }
+    bool ok = std::ferror(out) == 0;
+    return std::fclose(out) == 0 && ok;
+}
+
+} // namespace gpx2
@@ -0,0 +1,155 @@
+#ifndef GPX2_ANALYSIS_H
+#define GPX2_ANALYSIS_H
+
+// histograms and summary statistics over a column file, in parallel
+//
+// The blocks of the file are handed out to the workers of a ThreadPool one
+// at a time; each worker fills its own histograms and accumulators and the
+// partial results are merged at the end (counts add up, mean and variance
+// with the pairwise update of Chan et al.), so counts and histograms do not
+// depend on the number of threads and mean/sigma only in their rounding.
+//
+// Per channel: a STOP histogram, STOP statistics and the hit rate over the
+// span of t_ps. Per pair (a, b): dT = t_b - t_a of every hit of b against
+// the nearest hit of a in stream order within the same block, when
+// |dT| <= window_ps, as histogram and statistics.
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gpx2_colfile.h"
+
+namespace gpx2 {
+
+constexpr int CHANNELS = 16;
+
+class ThreadPool
+{
+public:
+    // threads = 0 uses one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    unsigned size() const { return (unsigned)workers_.size(); }
+
+    template <typename F>
+    auto submit(F f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+private:
+    void run();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+struct Welford
+{
+    uint64_t n = 0;
+    double mean = 0;
+    double m2 = 0;
+    int64_t min = 0, max = 0;
+
+    void add(int64_t x)
+    {
+        if (n == 0 || x < min)
+            min = x;
+        if (n == 0 || x > max)
+            max = x;
+        n++;
+        double d = (double)x - mean;
+        mean += d / (double)n;
+        m2 += d * ((double)x - mean);
+    }
+    void merge(const Welford &o);
+    // sample standard deviation, 0 with fewer than 2 samples
+    double sigma() const;
+};
+
+struct HistSpec
+{
+    int64_t low = 0;      // lower edge of bin 0
+    uint64_t width = 1;   // bin width
+    uint32_t bins = 1024;
+};
+
+struct Histogram
+{
+    HistSpec spec;
+    std::vector<uint64_t> count;
+    uint64_t underflow = 0;
+    uint64_t overflow = 0;
+
+    Histogram() = default;
+    explicit Histogram(const HistSpec &s) : spec(s), count(s.bins) {}
+    void add(int64_t v)
+    {
+        if (v < spec.low)
+        {
+            underflow++;
+            return;
+        }
+        uint64_t bin = (uint64_t)(v - spec.low) / spec.width;
+        if (bin >= spec.bins)
+            overflow++;
+        else
+            count[bin]++;
+    }
+    void merge(const Histogram &o);
+};
+
+struct AnalysisConfig
+{
+    HistSpec stop{0, 256, 1024};    // LSB
+    HistSpec dt{-10240, 20, 1024};  // ps
+    int64_t window_ps = 10000;      // largest |dT| counted as a coincidence
+    std::vector<std::pair<int, int>> pairs; // channels 0..15
+};
+
+struct AnalysisResult
+{
+    uint64_t events = 0;
+    uint64_t blocks = 0;
+    int64_t t_first = 0, t_last = 0; // t_ps span, over all channels
+    Welford stop[CHANNELS];
+    Histogram stop_hist[CHANNELS];
+    int64_t chan_first[CHANNELS] = {}, chan_last[CHANNELS] = {};
+    std::vector<Welford> dt;
+    std::vector<Histogram> dt_hist;
+
+    explicit AnalysisResult(const AnalysisConfig &cfg);
+    void merge(const AnalysisResult &o);
+};
+
+AnalysisResult analyze(const ColumnReader &file, const AnalysisConfig &cfg, ThreadPool &pool);
+
+// summary table for people
+void print_summary(std::FILE *out, const AnalysisResult &r, const AnalysisConfig &cfg);
+// channel,bin,low,count like gpx2_decode, STOP histograms 1..16, pairs P1..
+bool write_hist_csv(const char *path, const AnalysisResult &r);
+
+} // namespace gpx2
+
+#endif
@@ -0,0 +1,212 @@
+// Coincidence matching (gpx2_coinc.c): pair table limits, known dT in both
+// arrival orders, accidentals in the delayed window, unmatched hits leaving
+// the buffer, and channel pairs of a simulated chip whose dT is set by the
+// channel delays.
+
+#include <cmath>
+#include <cstdlib>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_coinc.h"
+#include "gpx2_time.h"
+}
+
+namespace {
+
+gpx2_coinc_t co;
+gpx2_coinc_dt_t out[GPX2_COINC_MAX_PAIRS];
+
+void pairs()
+{
+    GPX2_CHECK(!gpx2_coinc_setup(&co, 0, 0));
+    // dT of a match is an int32_t
+    GPX2_CHECK(!gpx2_coinc_setup(&co, (uint32_t)INT32_MAX + 1, 0));
+    GPX2_CHECK(!gpx2_coinc_setup(&co, UINT32_MAX, 0));
+    GPX2_CHECK(gpx2_coinc_setup(&co, INT32_MAX, 0));
+    GPX2_CHECK(gpx2_coinc_setup(&co, 1000, 0));
+    GPX2_CHECK(!gpx2_coinc_add_pair(&co, 3, 3));
+    GPX2_CHECK(!gpx2_coinc_add_pair(&co, 0, GPX2_COINC_CHANNELS));
+    for (uint8_t i = 0; i < GPX2_COINC_MAX_PAIRS; i++)
+        GPX2_CHECK(gpx2_coinc_add_pair(&co, 0, (uint8_t)(i + 1)));
+    GPX2_CHECK(!gpx2_coinc_add_pair(&co, 1, 2));
+    GPX2_CHECK_EQ(co.npairs, GPX2_COINC_MAX_PAIRS);
+    GPX2_CHECK_EQ(co.pairs_of[0], (1 << GPX2_COINC_MAX_PAIRS) - 1);
+    GPX2_CHECK_EQ(co.pairs_of[2], 0x02);
+    // a hit on channel 0 matches the partner of every pair
+    for (uint8_t ch = 1; ch <= GPX2_COINC_MAX_PAIRS; ch++)
+        GPX2_CHECK_EQ(gpx2_coinc_add(&co, ch, 10000 + 10 * ch, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 0, 10000, out), GPX2_COINC_MAX_PAIRS);
+    for (int i = 0; i < GPX2_COINC_MAX_PAIRS; i++)
+    {
+        GPX2_CHECK_EQ(out[i].pair, i);
+        GPX2_CHECK_EQ(out[i].dt_ps, 10 * (i + 1));
+    }
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, GPX2_COINC_CHANNELS, 0, out), 0);
+}
+
+// pulses 1 us apart, b 1234 ps after a, the later hit of a pair arriving
+// first every third pulse; no accidentals without a delayed window
+void known_dt()
+{
+    GPX2_CHECK(gpx2_coinc_setup(&co, 5000, 0));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 2, 9));
+    int results = 0, wrong = 0;
+    for (uint64_t k = 0; k < 10000; k++)
+    {
+        uint64_t t = 1000000 + k * 1000000;
+        int n;
+        if (k % 3 == 0)
+        {
+            n = gpx2_coinc_add(&co, 9, t + 1234, out);
+            n += gpx2_coinc_add(&co, 2, t, out + n);
+        }
+        else
+        {
+            n = gpx2_coinc_add(&co, 2, t, out);
+            n += gpx2_coinc_add(&co, 9, t + 1234, out + n);
+        }
+        results += n;
+        wrong += n != 1 || out[0].dt_ps != 1234 || out[0].pair != 0;
+    }
+    GPX2_CHECK_EQ(results, 10000);
+    GPX2_CHECK_EQ(wrong, 0);
+    GPX2_CHECK_EQ(co.pair[0].matched, 10000);
+    GPX2_CHECK_EQ(co.pair[0].accidental, 0);
+    GPX2_CHECK_EQ(co.pair[0].unmatched_a + co.pair[0].unmatched_b, 0);
+
+    // b ahead of a gives a negative dT, outside the window nothing
+    gpx2_coinc_clear(&co);
+    GPX2_CHECK_EQ(co.pair[0].matched, 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 50000, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 2, 50700, out), 1);
+    GPX2_CHECK_EQ(out[0].dt_ps, -700);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 2, 60000, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 65001, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 65000, out), 1);
+    GPX2_CHECK_EQ(out[0].dt_ps, 5000);
+    // the nearest open partner wins, a matched one is not taken twice
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 80000, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 80300, out), 0);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 2, 80200, out), 1);
+    GPX2_CHECK_EQ(out[0].dt_ps, 100);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 2, 80250, out), 1);
+    GPX2_CHECK_EQ(out[0].dt_ps, -250);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 2, 80260, out), 0);
+
+    // flush forgets the buffered hits but keeps the counts
+    uint32_t matched = co.pair[0].matched;
+    gpx2_coinc_flush(&co);
+    GPX2_CHECK_EQ(gpx2_coinc_add(&co, 9, 80300, out), 0);
+    GPX2_CHECK_EQ(co.pair[0].matched, matched);
+}
+
+// periodic pulses 100 ns apart with the accidental window one period late:
+// every b hit after the first sees the a hit of the previous pulse there
+void accidentals()
+{
+    GPX2_CHECK(gpx2_coinc_setup(&co, 5000, 100000));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 0, 1));
+    for (uint64_t k = 0; k < 1000; k++)
+    {
+        uint64_t t = 1000000 + k * 100000;
+        gpx2_coinc_add(&co, 0, t, out);
+        gpx2_coinc_add(&co, 1, t + 1000, out);
+    }
+    GPX2_CHECK_EQ(co.pair[0].matched, 1000);
+    GPX2_CHECK_EQ(co.pair[0].accidental, 999);
+    GPX2_CHECK_EQ(co.pair[0].unmatched_a + co.pair[0].unmatched_b, 0);
+}
+
+// hits without a partner count once they are pushed out of the buffer
+void unmatched()
+{
+    GPX2_CHECK(gpx2_coinc_setup(&co, 1000, 0));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 4, 5));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 6, 4));
+    for (uint64_t k = 0; k < 20; k++)
+        gpx2_coinc_add(&co, 4, k * 100000, out);
+    GPX2_CHECK_EQ(co.pair[0].unmatched_a, 20 - GPX2_COINC_DEPTH);
+    GPX2_CHECK_EQ(co.pair[1].unmatched_b, 20 - GPX2_COINC_DEPTH);
+    GPX2_CHECK_EQ(co.pair[0].unmatched_b + co.pair[1].unmatched_a, 0);
+    // a hit matched in one pair is still open in the other
+    gpx2_coinc_add(&co, 5, 1900000, out);
+    for (uint64_t k = 0; k < GPX2_COINC_DEPTH; k++)
+        gpx2_coinc_add(&co, 4, 3000000 + k * 100000, out);
+    GPX2_CHECK_EQ(co.pair[0].matched, 1);
+    GPX2_CHECK_EQ(co.pair[0].unmatched_a, 20 - 1);
+    GPX2_CHECK_EQ(co.pair[1].unmatched_b, 20);
+}
+
+// channel k of a simulated chip is 1000 ps * k behind channel 0, each with
+// 20 ps rms jitter, so dT(0,k) is 1000 * k ps with 28 ps rms
+void chip_pairs()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 0, 0x0D));
+    gpx2_time_t tm;
+    GPX2_CHECK(gpx2_time_setup(&tm, 200000, 200000));
+    GPX2_CHECK(gpx2_coinc_setup(&co, 10000, 0));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 0, 2));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 0, 3));
+    GPX2_CHECK(gpx2_coinc_add_pair(&co, 3, 2));
+    gpx2_dev_t *devs[1] = {&d};
+    gpx2_result_t res[GPX2_BURST_MAX];
+    double sum[3] = {}, sum2[3] = {};
+    uint32_t n[3] = {}, outliers = 0, pulses = 0;
+    while (pulses < 3000)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        int got = gpx2_dev_read_parallel(devs, 1, res);
+        uint64_t now_us = hal_time_us();
+        for (int i = 0; i < got; i++)
+        {
+            pulses += res[i].mask == 0x0D;
+            for (uint8_t ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res[i].mask & (1 << ch)))
+                    continue;
+                uint64_t t = gpx2_time_ps(&tm, res[i].ref[ch], res[i].stop[ch], now_us);
+                int k = gpx2_coinc_add(&co, ch, t, out);
+                for (int j = 0; j < k; j++)
+                {
+                    const int32_t want[3] = {2000, 3000, -1000};
+                    int p = out[j].pair;
+                    double dev = out[j].dt_ps - want[p];
+                    outliers += std::fabs(dev) > 200;
+                    sum[p] += dev;
+                    sum2[p] += dev * dev;
+                    n[p]++;
+                }
+            }
+        }
+    }
+    GPX2_CHECK(pulses >= 3000);
+    GPX2_CHECK_EQ(outliers, 0);
+    for (int p = 0; p < 3; p++)
+    {
+        // every pulse gives one match per pair
+        GPX2_CHECK_EQ(n[p], co.pair[p].matched);
+        GPX2_CHECK(n[p] >= pulses);
+        double mean = sum[p] / n[p];
+        double rms = std::sqrt(sum2[p] / n[p] - mean * mean);
+        GPX2_CHECK(std::fabs(mean) < 5);
+        GPX2_CHECK(rms > 20 && rms < 40);
+        GPX2_CHECK_EQ(co.pair[p].unmatched_a + co.pair[p].unmatched_b, 0);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    pairs();
+    known_dt();
+    accidentals();
+    unmatched();
+    gpx2::test::sim_start(5000);
+    chip_pairs();
+    return gpx2::test::finish("gpx2_coinc_test");
+}
@@ -0,0 +1,166 @@
+#include "gpx2_colfile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gpx2 {
+
+namespace {
+
+size_t file_size(uint64_t blocks)
+{
+    return COL_HEADER + (size_t)blocks * col_block_bytes(COL_BLOCK_EVENTS);
+}
+
+} // namespace
+
+bool ColumnWriter::open(const std::string &path, uint64_t refclk_ps, uint32_t divisions)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+        return false;
+    n_ = 0;
+    if (!remap(file_size(GROW_BLOCKS)))
+    {
+        int err = errno;
+        ::close(fd_);
+        fd_ = -1;
+        errno = err;
+        return false;
+    }
+    ColHeader *h = hdr();
+    std::memset(h, 0, sizeof *h);
+    h->magic = COL_MAGIC;
+    h->version = COL_VERSION;
+    h->block_events = COL_BLOCK_EVENTS;
+    h->divisions = divisions;
+    h->refclk_ps = refclk_ps;
+    return true;
+}
+
+bool ColumnWriter::remap(size_t size)
+{
+    if (ftruncate(fd_, (off_t)size) != 0)
+        return false;
+    if (map_)
+        munmap(map_, map_size_);
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+    {
+        map_ = nullptr;
+        map_size_ = 0;
+        return false;
+    }
+    map_ = (uint8_t *)p;
+    map_size_ = size;
+    return true;
+}
+
+// point the columns at the block event n_ starts, growing the file first when
+// it is not mapped yet
+bool ColumnWriter::start_block()
+{
+    if (!map_)
+        return false;
+    uint64_t b = n_ / COL_BLOCK_EVENTS;
+    if (file_size(b + 1) > map_size_)
+    {
+        // the header count is what a reader trusts, keep it current
+        hdr()->events = n_;
+        if (!remap(file_size(b + GROW_BLOCKS)))
+            return false;
+    }
+    uint8_t *p = map_ + file_size(b);
+    t_ps_ = (int64_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 8;
+    ref_ = (uint32_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 4;
+    stop_ = (uint32_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 4;
+    channel_ = p;
+    return true;
+}
+
+bool ColumnWriter::close()
+{
+    if (fd_ < 0)
+        return true;
+    bool ok = map_ != nullptr;
+    if (map_)
+    {
+        hdr()->events = n_;
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        map_size_ = 0;
+    }
+    uint64_t blocks = (n_ + COL_BLOCK_EVENTS - 1) / COL_BLOCK_EVENTS;
+    ok &= ftruncate(fd_, (off_t)file_size(blocks)) == 0;
+    ok &= ::close(fd_) == 0;
+    fd_ = -1;
+    return ok;
+}
+
+ColumnReader::~ColumnReader()
+{
+    if (map_)
+        munmap((void *)map_, map_size_);
+}
+
+bool ColumnReader::open(const std::string &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < COL_HEADER)
+    {
+        ::close(fd);
+        error = "not a column file";
+        return false;
+    }
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    map_ = (const uint8_t *)p;
+    map_size_ = (size_t)st.st_size;
+    const ColHeader &h = header();
+    if (h.magic != COL_MAGIC || h.version != COL_VERSION || h.block_events != COL_BLOCK_EVENTS)
+        error = "not a column file";
+    else if (file_size(blocks()) > map_size_)
+        error = "truncated";
+    else
+        return true;
+    munmap(p, map_size_);
+    map_ = nullptr;
+    return false;
+}
+
+ColumnReader::Block ColumnReader::block(size_t i) const
+{
+    const uint8_t *p = map_ + file_size(i);
+    Block b;
+    b.t_ps = (const int64_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 8;
+    b.ref = (const uint32_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 4;
+    b.stop = (const uint32_t *)p;
+    p += (size_t)COL_BLOCK_EVENTS * 4;
+    b.channel = p;
+    uint64_t left = events() - (uint64_t)i * COL_BLOCK_EVENTS;
+    b.n = left < COL_BLOCK_EVENTS ? (uint32_t)left : COL_BLOCK_EVENTS;
+    return b;
+}
+
+} // namespace gpx2
@@ -0,0 +1,130 @@
+#ifndef GPX2_COLFILE_H
+#define GPX2_COLFILE_H
+
+// columnar event file (.gpxc) of the host capture tool, memory mapped for
+// writing and reading, all fields little-endian (native on the hosts we use)
+//
+//  offset size
+//  0      64   header, ColHeader
+//  64     ...  blocks of block_events events, column after column:
+//               t_ps(8 each, signed) ref(4 each) stop(4 each) channel(1 each)
+//
+// Every block has the full size, the last one holds events % block_events
+// events and the rest of it is zero. The writer grows the file
+// GROW_BLOCKS blocks at a time with ftruncate and maps it again, so appending
+// is a store into the mapping; the header event count is updated when a block
+// fills and on close, a capture that was killed loses at most its last block.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gpx2 {
+
+struct Event
+{
+    uint8_t channel; // dev * 4 + ch, 0..15
+    uint32_t ref;    // REF as received, 0 for ps timestamps
+    uint32_t stop;
+    int64_t t_ps;    // REF unwrapped and scaled, or the ps timestamp
+};
+
+constexpr uint32_t COL_MAGIC = 0x43585047; // "GPXC"
+constexpr uint32_t COL_VERSION = 1;
+constexpr uint32_t COL_BLOCK_EVENTS = 65536;
+constexpr size_t COL_HEADER = 64;
+
+struct ColHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_events;
+    uint32_t divisions; // REFCLK_DIVISIONS used for t_ps
+    uint64_t events;
+    uint64_t refclk_ps; // REFCLK period used for t_ps
+    uint8_t reserved[32];
+};
+static_assert(sizeof(ColHeader) == COL_HEADER, "column file header is 64 bytes");
+
+constexpr size_t col_block_bytes(uint32_t block_events)
+{
+    return (size_t)block_events * (8 + 4 + 4 + 1);
+}
+
+class ColumnWriter
+{
+public:
+    static constexpr size_t GROW_BLOCKS = 64;
+
+    ColumnWriter() = default;
+    ColumnWriter(const ColumnWriter &) = delete;
+    ColumnWriter &operator=(const ColumnWriter &) = delete;
+    ~ColumnWriter() { close(); }
+
+    // create or truncate path, false with errno set on failure
+    bool open(const std::string &path, uint64_t refclk_ps, uint32_t divisions);
+    // false when the file could not be grown (disk full)
+    bool append(const Event &e)
+    {
+        uint32_t i = (uint32_t)(n_ % COL_BLOCK_EVENTS);
+        if (i == 0 && !start_block())
+            return false;
+        t_ps_[i] = e.t_ps;
+        ref_[i] = e.ref;
+        stop_[i] = e.stop;
+        channel_[i] = e.channel;
+        if (++n_ % COL_BLOCK_EVENTS == 0)
+            hdr()->events = n_;
+        return true;
+    }
+    // trim to the used blocks and write the final count
+    bool close();
+    uint64_t events() const { return n_; }
+
+private:
+    bool start_block();
+    bool remap(size_t size);
+    ColHeader *hdr() { return (ColHeader *)map_; }
+
+    int fd_ = -1;
+    uint8_t *map_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t n_ = 0;
+    int64_t *t_ps_ = nullptr;
+    uint32_t *ref_ = nullptr;
+    uint32_t *stop_ = nullptr;
+    uint8_t *channel_ = nullptr;
+};
+
+class ColumnReader
+{
+public:
+    struct Block
+    {
+        const int64_t *t_ps;
+        const uint32_t *ref;
+        const uint32_t *stop;
+        const uint8_t *channel;
+        uint32_t n;
+    };
+
+    ColumnReader() = default;
+    ColumnReader(const ColumnReader &) = delete;
+    ColumnReader &operator=(const ColumnReader &) = delete;
+    ~ColumnReader();
+
+    // false when path is missing, not a column file or shorter than its header says
+    bool open(const std::string &path, std::string &error);
+    const ColHeader &header() const { return *(const ColHeader *)map_; }
+    uint64_t events() const { return header().events; }
+    size_t blocks() const { return (size_t)((events() + COL_BLOCK_EVENTS - 1) / COL_BLOCK_EVENTS); }
+    Block block(size_t i) const;
+
+private:
+    const uint8_t *map_ = nullptr;
+    size_t map_size_ = 0;
+};
+
+} // namespace gpx2
+
+#endif
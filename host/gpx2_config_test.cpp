@@ -0,0 +1,157 @@
+// Config shadow and partial writes (gpx2_dev.c): the dirty range against the
+// shadow, and a changed register written and read back on a simulated chip
+// by itself against the whole 17 byte config, in bytes, transactions and
+// modeled bus time, with the chip's registers checked afterwards.
+
+#include <cstring>
+
+#include "gpx2_test.h"
+
+namespace {
+
+void dirty_range()
+{
+    gpx2_dev_t d;
+    gpx2_dev_init(&d, 0, 0, 17, 20);
+    uint8_t cfg[GPX2_CONFIG_BYTES];
+    std::memcpy(cfg, gpx2::test::CONFIG, sizeof cfg);
+    uint8_t addr = 0xFF, n = 0;
+
+    // nothing written yet: all of it
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 0);
+    GPX2_CHECK_EQ(n, GPX2_CONFIG_BYTES);
+    gpx2_dev_config_commit(&d, cfg, 0, GPX2_CONFIG_BYTES);
+    GPX2_CHECK(!gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+
+    cfg[5] ^= 0x01;
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 5);
+    GPX2_CHECK_EQ(n, 1);
+    cfg[3] ^= 0x80;
+    cfg[9] ^= 0x10;
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 3);
+    GPX2_CHECK_EQ(n, 7);
+    cfg[16] ^= 0x04;
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 3);
+    GPX2_CHECK_EQ(n, 14);
+
+    // a partial commit only clears its own range
+    gpx2_dev_config_commit(&d, cfg, 3, 7);
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 16);
+    GPX2_CHECK_EQ(n, 1);
+    gpx2_dev_config_commit(&d, cfg, 16, 1);
+    GPX2_CHECK(!gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK(std::memcmp(d.config_chip, cfg, sizeof cfg) == 0);
+}
+
+struct Cost
+{
+    uint64_t bytes, transactions, config_writes, bus_ps;
+};
+
+Cost cost_now(const gpx2_sim_t *chip)
+{
+    return Cost{chip->bytes, chip->transactions, chip->config_writes, hal_sim_bus_ps()};
+}
+
+Cost cost_since(const gpx2_sim_t *chip, const Cost &start)
+{
+    Cost now = cost_now(chip);
+    return Cost{now.bytes - start.bytes, now.transactions - start.transactions,
+                now.config_writes - start.config_writes, now.bus_ps - start.bus_ps};
+}
+
+// write and read back what the shadow says changed, as gpx2_update_config()
+Cost update(gpx2_dev_t *d, const uint8_t *cfg, bool partial, bool *ok)
+{
+    const gpx2_sim_t *chip = hal_sim_chip(d->id);
+    Cost start = cost_now(chip);
+    uint8_t addr = 0, n = GPX2_CONFIG_BYTES;
+    if (partial && !gpx2_dev_config_dirty(d, cfg, &addr, &n))
+    {
+        *ok = true;
+        return cost_since(chip, start);
+    }
+    gpx2_dev_write_config(d, cfg, addr, n);
+    *ok = gpx2_dev_verify_config(d, cfg, addr, n);
+    if (*ok)
+        gpx2_dev_config_commit(d, cfg, addr, n);
+    return cost_since(chip, start);
+}
+
+void chip_update(uint32_t spi_hz)
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 1, 0x0F, spi_hz));
+    const gpx2_sim_t *chip = hal_sim_chip(1);
+    uint8_t cfg[GPX2_CONFIG_BYTES];
+    std::memcpy(cfg, d.config_chip, sizeof cfg);
+    bool ok;
+
+    // unchanged: no bus traffic at all
+    Cost none = update(&d, cfg, true, &ok);
+    GPX2_CHECK(ok);
+    GPX2_CHECK_EQ(none.transactions, 0);
+
+    // one register, the pause/resume case (HIT_ENA)
+    cfg[1] &= 0xF0;
+    Cost one = update(&d, cfg, true, &ok);
+    GPX2_CHECK(ok);
+    GPX2_CHECK_EQ(one.transactions, 2);
+    GPX2_CHECK_EQ(one.bytes, 2 * (1 + 1));
+    GPX2_CHECK_EQ(one.config_writes, 1);
+    GPX2_CHECK(std::memcmp(chip->cfg, cfg, sizeof cfg) == 0);
+
+    cfg[1] |= 0x0F;
+    Cost full = update(&d, cfg, false, &ok);
+    GPX2_CHECK(ok);
+    GPX2_CHECK_EQ(full.transactions, 2);
+    GPX2_CHECK_EQ(full.bytes, 2 * (1 + GPX2_CONFIG_BYTES));
+    GPX2_CHECK(std::memcmp(chip->cfg, cfg, sizeof cfg) == 0);
+    // the per call and CS overheads are the same, the 32 more clocked bytes
+    // make the difference; host time running meanwhile makes it less
+    uint64_t extra_ps = 2 * (GPX2_CONFIG_BYTES - 1) * 8 * 1000000000000ULL / spi_hz;
+    GPX2_CHECK(one.bus_ps < full.bus_ps);
+    GPX2_CHECK(full.bus_ps - one.bus_ps > extra_ps / 2);
+    GPX2_CHECK(full.bus_ps - one.bus_ps < extra_ps * 11 / 10);
+
+    // REFCLK_DIVISIONS, three registers in a row
+    cfg[3] = 0x20;
+    cfg[4] = 0xA1;
+    cfg[5] = 0x07;
+    Cost three = update(&d, cfg, true, &ok);
+    GPX2_CHECK(ok);
+    GPX2_CHECK_EQ(three.bytes, 2 * (1 + 3));
+    GPX2_CHECK(std::memcmp(chip->cfg, cfg, sizeof cfg) == 0);
+
+    // the chip drops its config: the read back catches it and the shadow
+    // keeps the range dirty
+    gpx2_sim_glitch(hal_sim_chip(1));
+    cfg[7] ^= 0x01;
+    uint8_t addr, n;
+    GPX2_CHECK(!gpx2_dev_verify_config(&d, d.config_chip, 0, GPX2_CONFIG_BYTES));
+    gpx2_dev_write_config(&d, cfg, 7, 1);
+    GPX2_CHECK(!gpx2_dev_verify_config(&d, cfg, 0, GPX2_CONFIG_BYTES));
+    GPX2_CHECK(gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+    GPX2_CHECK_EQ(addr, 7);
+    Cost again = update(&d, cfg, false, &ok);
+    GPX2_CHECK(ok);
+    GPX2_CHECK_EQ(again.bytes, 2 * (1 + GPX2_CONFIG_BYTES));
+    GPX2_CHECK(std::memcmp(chip->cfg, cfg, sizeof cfg) == 0);
+    GPX2_CHECK(!gpx2_dev_config_dirty(&d, cfg, &addr, &n));
+}
+
+} // namespace
+
+int main()
+{
+    dirty_range();
+    gpx2::test::sim_start(1000);
+    chip_update(4000000);
+    chip_update(20000000);
+    return gpx2::test::finish("gpx2_config_test");
+}
@@ -0,0 +1,317 @@
+// Decode and validate a binary capture from the designlab firmware
+// (output mode 1 or 4) and convert it to CSV.
+//
+//   gpx2_decode capture.bin [out.csv] [hist.csv] [stats.csv]
+//
+// Raw events (plain or packed) fill the ref/stop columns, picosecond timestamps (time format 1)
+// the t_ps column and coincidence results the partner/dt_ps columns. Histogram dumps (X command) are reassembled and written to hist.csv,
+// live statistics windows (menu O) to stats.csv. A burst capture read back (D) is checked against the
+// record count and crc16 of its closing summary frame. Raw result frames of the record mode (5) are
+// only counted, gpx2_replay takes them.
+// With several chips the channel column counts on across them, chip d
+// channel c is (d - 1) * 4 + c. Bytes between frames (e.g. console text) are skipped. After a lost
+// frame, packed frames are skipped up to the next keyframe. Exit code is 1 when
+// crc errors or sequence gaps were found.
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+extern "C" {
+#include "gpx2_crc.h"
+#include "gpx2_pack.h"
+#include "gpx2_stream.h"
+}
+
+namespace {
+
+struct Summary
+{
+    uint64_t frames = 0;
+    uint64_t events = 0;
+    uint64_t crc_errors = 0;
+    uint64_t lost_frames = 0;
+    uint64_t skipped_bytes = 0;
+    uint64_t bad_packed = 0;
+    uint64_t raw_frames = 0; // result frames of the record mode
+    // event records since the last capture frame
+    uint32_t capture_records = 0;
+    uint16_t capture_crc = GPX2_CRC16_INIT;
+    uint64_t captures = 0;
+    uint64_t capture_errors = 0;
+};
+
+void write_events(std::FILE *out, const gpx2_frame_view_t &f, Summary &sum)
+{
+    size_t n = f.len / GPX2_EVENT_RECORD;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t ch;
+        uint32_t ref, stop;
+        gpx2_stream_get_event(f.payload, i, &ch, &ref, &stop);
+        std::fprintf(out, "%u,%u,%u,%u,,,\n", f.seq, ch + 1, ref, stop);
+    }
+    sum.events += n;
+    sum.capture_records += (uint32_t)n;
+    sum.capture_crc = gpx2_crc16(sum.capture_crc, f.payload, n * GPX2_EVENT_RECORD);
+}
+
+void write_packed(std::FILE *out, gpx2_unpack_t &u, const gpx2_frame_view_t &f, Summary &sum)
+{
+    size_t pos = 0;
+    gpx2_result_t res;
+    while (gpx2_unpack_next(&u, &f, &pos, &res))
+    {
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if (!(res.mask & (1 << ch)))
+                continue;
+            std::fprintf(out, "%u,%u,%u,%u,,,\n", f.seq, res.dev * GPX2_CHANNELS + ch + 1,
+                         res.ref[ch], res.stop[ch]);
+            sum.events++;
+        }
+    }
+    if (pos != f.len)
+        sum.bad_packed++;
+}
+
+void write_times(std::FILE *out, const gpx2_frame_view_t &f, Summary &sum)
+{
+    size_t n = f.len / GPX2_TIME_RECORD;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t ch;
+        uint64_t t_ps;
+        gpx2_stream_get_time(f.payload, i, &ch, &t_ps);
+        std::fprintf(out, "%u,%u,,,%llu,,\n", f.seq, ch + 1, (unsigned long long)t_ps);
+    }
+    sum.events += n;
+}
+
+void write_dts(std::FILE *out, const gpx2_frame_view_t &f, Summary &sum)
+{
+    size_t n = f.len / GPX2_DT_RECORD;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t a, b;
+        int32_t dt;
+        gpx2_stream_get_dt(f.payload, i, &a, &b, &dt);
+        std::fprintf(out, "%u,%u,,,,%u,%d\n", f.seq, a + 1, b + 1, dt);
+    }
+    sum.events += n;
+}
+
+struct Histogram
+{
+    int32_t offset = 0;
+    uint32_t width = 0;
+    uint32_t underflow = 0;
+    uint32_t overflow = 0;
+    std::vector<uint32_t> count;
+};
+
+void collect_hist(const gpx2_frame_view_t &f, std::map<int, Histogram> &hists)
+{
+    if (f.len < GPX2_HIST_CHUNK_HEADER)
+        return;
+    const uint8_t *p = f.payload;
+    Histogram &h = hists[p[0]];
+    uint16_t first = gpx2_get_le16(p + 1);
+    uint16_t total = gpx2_get_le16(p + 3);
+    h.offset = (int32_t)gpx2_get_le32(p + 5);
+    h.width = gpx2_get_le32(p + 9);
+    h.underflow = gpx2_get_le32(p + 13);
+    h.overflow = gpx2_get_le32(p + 17);
+    h.count.resize(total);
+    size_t n = (f.len - GPX2_HIST_CHUNK_HEADER) / 4;
+    for (size_t i = 0; i < n && first + i < total; i++)
+        h.count[first + i] = gpx2_get_le32(p + GPX2_HIST_CHUNK_HEADER + 4 * i);
+}
+
+bool write_hist(const char *path, const std::map<int, Histogram> &hists)
+{
+    std::FILE *out = std::fopen(path, "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "channel,bin,low,count\n");
+    for (const auto &[id, h] : hists)
+    {
+        // STOP histograms are 1..16, dT histograms of coincidence pairs P1..
+        char name[16]; // "P" and any int
+        if (id >= GPX2_HIST_ID_PAIR)
+            std::snprintf(name, sizeof name, "P%d", id - GPX2_HIST_ID_PAIR + 1);
+        else
+            std::snprintf(name, sizeof name, "%d", id + 1);
+        for (size_t i = 0; i < h.count.size(); i++)
+            std::fprintf(out, "%s,%zu,%lld,%u\n", name, i,
+                         (long long)h.offset + (long long)i * h.width, h.count[i]);
+        std::fprintf(out, "%s,underflow,,%u\n", name, h.underflow);
+        std::fprintf(out, "%s,overflow,,%u\n", name, h.overflow);
+    }
+    std::fclose(out);
+    return true;
+}
+
+void check_capture(const gpx2_frame_view_t &f, Summary &sum)
+{
+    if (f.len < GPX2_CAPTURE_SUMMARY)
+    {
+        // read back starts, count from here
+        sum.capture_records = 0;
+        sum.capture_crc = GPX2_CRC16_INIT;
+        return;
+    }
+    uint32_t records = gpx2_get_le32(f.payload);
+    uint16_t crc = gpx2_get_le16(f.payload + 4);
+    bool ok = records == sum.capture_records && crc == sum.capture_crc;
+    std::cerr << "capture: " << records << " records in " << gpx2_get_le32(f.payload + 6) / 1000
+              << " ms, " << gpx2_get_le32(f.payload + 10) << " dropped, " << gpx2_get_le32(f.payload + 14)
+              << " dropped during the read back, "
+              << (ok ? "count and crc ok" : "MISMATCH") << "\n";
+    sum.captures++;
+    if (!ok)
+        sum.capture_errors++;
+    sum.capture_records = 0;
+    sum.capture_crc = GPX2_CRC16_INIT;
+}
+
+void write_stats(std::FILE *out, const gpx2_frame_view_t &f)
+{
+    if (!out || f.len < 4)
+        return;
+    uint32_t window_us = gpx2_get_le32(f.payload);
+    for (size_t off = 4; off + GPX2_STATS_RECORD <= f.len; off += GPX2_STATS_RECORD)
+    {
+        const uint8_t *p = f.payload + off;
+        char name[16]; // "P" and any int
+        if (p[0] >= GPX2_HIST_ID_PAIR)
+            std::snprintf(name, sizeof name, "P%d", p[0] - GPX2_HIST_ID_PAIR + 1);
+        else
+            std::snprintf(name, sizeof name, "%d", p[0] + 1);
+        uint32_t sigma = gpx2_get_le32(p + 13);
+        std::fprintf(out, "%u,%u,%s,%u,%.2f,", f.seq, window_us, name, gpx2_get_le32(p + 1),
+                     (int64_t)gpx2_get_le64(p + 5) / 256.0);
+        if (sigma != 0xFFFFFFFF)
+            std::fprintf(out, "%.2f", sigma / 256.0);
+        std::fprintf(out, ",%lld,%lld\n", (long long)gpx2_get_le64(p + 17), (long long)gpx2_get_le64(p + 25));
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " capture.bin [out.csv] [hist.csv] [stats.csv]\n";
+        return 2;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 2;
+    }
+    std::FILE *out = stdout;
+    if (argc > 2 && !(out = std::fopen(argv[2], "w")))
+    {
+        std::cerr << "cannot create " << argv[2] << "\n";
+        return 2;
+    }
+    std::fprintf(out, "seq,channel,ref,stop,t_ps,partner,dt_ps\n");
+    std::FILE *stats = nullptr;
+    if (argc > 4)
+    {
+        if (!(stats = std::fopen(argv[4], "w")))
+        {
+            std::cerr << "cannot create " << argv[4] << "\n";
+            return 2;
+        }
+        std::fprintf(stats, "seq,window_us,channel,n,mean,sigma,min,max\n");
+    }
+
+    Summary sum;
+    std::map<int, Histogram> hists;
+    gpx2_unpack_t unpack;
+    gpx2_unpack_init(&unpack);
+    bool have_seq = false;
+    uint32_t next_seq = 0;
+    std::vector<uint8_t> buf;
+    size_t pos = 0;
+    std::vector<char> chunk(1 << 16);
+
+    while (true)
+    {
+        in.read(chunk.data(), chunk.size());
+        std::streamsize got = in.gcount();
+        bool eof = got == 0;
+        // drop consumed bytes before appending
+        buf.erase(buf.begin(), buf.begin() + pos);
+        pos = 0;
+        buf.insert(buf.end(), chunk.data(), chunk.data() + got);
+
+        while (pos < buf.size())
+        {
+            gpx2_frame_view_t f;
+            gpx2_parse_status_t st = gpx2_stream_parse(buf.data() + pos, buf.size() - pos, &f);
+            if (st == GPX2_PARSE_NEED_MORE && !eof)
+                break;
+            if (st != GPX2_PARSE_OK)
+            {
+                if (st == GPX2_PARSE_BAD_CRC)
+                    sum.crc_errors++;
+                sum.skipped_bytes++;
+                pos++;
+                continue;
+            }
+            if (have_seq && f.seq != next_seq)
+                sum.lost_frames += (uint32_t)(f.seq - next_seq);
+            have_seq = true;
+            next_seq = f.seq + 1;
+            sum.frames++;
+            if (f.type == GPX2_FRAME_EVENTS)
+                write_events(out, f, sum);
+            else if (f.type == GPX2_FRAME_TIMES)
+                write_times(out, f, sum);
+            else if (f.type == GPX2_FRAME_DT)
+                write_dts(out, f, sum);
+            else if (f.type == GPX2_FRAME_HIST)
+                collect_hist(f, hists);
+            else if (f.type == GPX2_FRAME_STATS)
+                write_stats(stats, f);
+            else if (f.type == GPX2_FRAME_CAPTURE)
+                check_capture(f, sum);
+            else if (f.type == GPX2_FRAME_RAW)
+                sum.raw_frames += f.len / GPX2_RAW_RECORD;
+            if (gpx2_unpack_frame(&unpack, &f))
+                write_packed(out, unpack, f, sum);
+            pos += f.size;
+        }
+        if (eof)
+            break;
+    }
+    if (out != stdout)
+        std::fclose(out);
+    if (stats)
+        std::fclose(stats);
+    if (argc > 3 && !write_hist(argv[3], hists))
+    {
+        std::cerr << "cannot create " << argv[3] << "\n";
+        return 2;
+    }
+
+    std::cerr << "frames=" << sum.frames
+              << " events=" << sum.events
+              << " crc_errors=" << sum.crc_errors
+              << " lost_frames=" << sum.lost_frames
+              << " skipped_bytes=" << sum.skipped_bytes;
+    if (unpack.skipped || sum.bad_packed)
+        std::cerr << " packed_skipped=" << unpack.skipped << " packed_bad=" << sum.bad_packed;
+    if (sum.raw_frames)
+        std::cerr << " raw_frames=" << sum.raw_frames;
+    std::cerr << "\n";
+    return (sum.crc_errors || sum.lost_frames || sum.bad_packed || sum.capture_errors) ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+// DNL correction (gpx2_dnl.c): a code density run on a simulated chip whose
+// STOP code widths vary by +/- 30 %, the tables built from it, and the STOP
+// histogram of a second run flat after the correction; then the store in the
+// simulated flash sector with its magic, version and crc checks.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_dnl.h"
+}
+
+namespace {
+
+constexpr uint32_t DIVISIONS = 200000; // CONFIG REFCLK_DIVISIONS
+constexpr uint32_t HITS = 100000;      // per channel and run
+constexpr int EVAL_BINS = 32;
+
+gpx2_dnl_store_t store;
+gpx2_dnl_cal_t cal;
+gpx2_dnl_t dnl;
+
+// HITS new hits on every channel of chip d, handed to add(ch, stop) as
+// gpx2_dnl_calibrate() in designlab.c collects them
+template <typename Add>
+bool collect(gpx2_dev_t *d, Add add)
+{
+    gpx2_result_t res, last;
+    std::memset(&last, 0, sizeof last);
+    uint32_t hits[GPX2_CHANNELS] = {};
+    uint8_t done = 0;
+    while (done != d->active_mask)
+    {
+        if (!gpx2::test::wait_int(d))
+            return false;
+        gpx2_dev_read_frame(d, &res);
+        uint8_t m = gpx2_results_new_hits(&res, &last, d->active_mask);
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if (!(m & (1 << ch)))
+                continue;
+            add(ch, res.stop[ch]);
+            if (++hits[ch] >= HITS)
+                done |= 1 << ch;
+        }
+    }
+    return true;
+}
+
+// largest deviation of an EVAL_BINS STOP histogram from flat, as a fraction
+double flatness(const uint32_t *count, uint32_t total)
+{
+    double worst = 0;
+    for (int b = 0; b < EVAL_BINS; b++)
+        worst = std::fmax(worst, std::fabs((double)count[b] * EVAL_BINS / total - 1));
+    return worst;
+}
+
+void correction()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 0, 0x07));
+    gpx2_dnl_cal_init(&cal, DIVISIONS);
+    GPX2_CHECK(collect(&d, [](int ch, uint32_t stop) { gpx2_dnl_cal_add(&cal, ch, stop); }));
+
+    // channel 3 is off and gets no table, nor does one below min_hits
+    std::memset(&store, 0, sizeof store);
+    GPX2_CHECK_EQ(gpx2_dnl_build(&store, 0, &cal, HITS * 2), 0);
+    GPX2_CHECK_EQ(gpx2_dnl_build(&store, GPX2_DNL_HIRES, &cal, HITS), 0);
+    GPX2_CHECK_EQ(gpx2_dnl_build(&store, 0, &cal, HITS), 0x07);
+    for (int ch = 0; ch < 3; ch++)
+    {
+        // code widths are 1 / (1 + 0.3 cos), 77..143 % of nominal
+        uint32_t lo, hi;
+        gpx2_dnl_range(&store.table[0][ch], &lo, &hi);
+        GPX2_CHECK(lo < 85 && lo > 65);
+        GPX2_CHECK(hi > 125 && hi < 160);
+        uint32_t sum = 0;
+        for (int b = 0; b < GPX2_DNL_BINS; b++)
+            sum += store.table[0][ch].width[b];
+        GPX2_CHECK(sum > GPX2_DNL_BINS * GPX2_DNL_NOMINAL - GPX2_DNL_BINS &&
+                   sum < GPX2_DNL_BINS * GPX2_DNL_NOMINAL + GPX2_DNL_BINS);
+    }
+
+    GPX2_CHECK(!gpx2_dnl_apply(&dnl, &store, 1, DIVISIONS));
+    GPX2_CHECK(!gpx2_dnl_apply(&dnl, &store, 0, GPX2_DNL_BINS - 1));
+    GPX2_CHECK(gpx2_dnl_apply(&dnl, &store, 0, DIVISIONS));
+    GPX2_CHECK_EQ(dnl.mask, 0x07);
+    // every code maps into the period, in order; no table, no change
+    for (int ch = 0; ch < 4; ch++)
+    {
+        uint32_t prev = 0, backwards = 0, outside = 0;
+        for (uint32_t stop = 0; stop < DIVISIONS; stop++)
+        {
+            uint32_t v = gpx2_dnl_correct(&dnl, ch, stop);
+            backwards += v < prev;
+            outside += v >= DIVISIONS;
+            prev = v;
+        }
+        GPX2_CHECK_EQ(backwards, 0);
+        GPX2_CHECK_EQ(outside, 0);
+    }
+    GPX2_CHECK_EQ(gpx2_dnl_correct(&dnl, 3, 12345), 12345);
+    GPX2_CHECK_EQ(gpx2_dnl_correct(&dnl, 0, DIVISIONS + 7), DIVISIONS + 7);
+
+    // a second run: raw STOP codes 40 % off flat, corrected ones within the
+    // counting noise of both runs and the 64 point tables (5 to 8 %)
+    static std::vector<uint32_t> run[GPX2_CHANNELS];
+    GPX2_CHECK(collect(&d, [](int ch, uint32_t stop) { run[ch].push_back(stop); }));
+    for (int ch = 0; ch < 3; ch++)
+    {
+        uint32_t raw[EVAL_BINS] = {}, fixed[EVAL_BINS] = {};
+        for (uint32_t stop : run[ch])
+        {
+            raw[(uint64_t)stop * EVAL_BINS / DIVISIONS]++;
+            fixed[(uint64_t)gpx2_dnl_correct(&dnl, ch, stop) * EVAL_BINS / DIVISIONS]++;
+        }
+        double before = flatness(raw, (uint32_t)run[ch].size());
+        double after = flatness(fixed, (uint32_t)run[ch].size());
+        GPX2_CHECK(before > 0.25);
+        GPX2_CHECK(after < 0.1);
+        GPX2_CHECK(after < before / 3);
+    }
+}
+
+void store_checks(const char *path)
+{
+    // blank flash: no store, nothing to apply
+    gpx2_dnl_store_t s;
+    gpx2_dnl_t none;
+    GPX2_CHECK(!gpx2_dnl_load(&s));
+    GPX2_CHECK_EQ(s.table[0][0].hits, 0);
+    GPX2_CHECK(!gpx2_dnl_apply(&none, &s, 0, DIVISIONS));
+
+    store.enabled = 1;
+    std::memset(store.reserved, 0x55, sizeof store.reserved);
+    GPX2_CHECK(gpx2_dnl_save(&store));
+    GPX2_CHECK_EQ(store.magic, GPX2_DNL_MAGIC);
+    GPX2_CHECK_EQ(store.version, GPX2_DNL_VERSION);
+    GPX2_CHECK_EQ(store.reserved[0], 0);
+    GPX2_CHECK(gpx2_dnl_load(&s));
+    GPX2_CHECK(std::memcmp(&s, &store, sizeof s) == 0);
+
+    // the file behind the flash holds the store at its sector
+    FILE *f = std::fopen(path, "rb");
+    GPX2_CHECK(f != nullptr);
+    if (f)
+    {
+        static uint8_t sector[HAL_FLASH_SECTOR_SIZE];
+        std::fseek(f, (long)HAL_FLASH_DNL * HAL_FLASH_SECTOR_SIZE, SEEK_SET);
+        GPX2_CHECK_EQ(std::fread(sector, 1, sizeof sector, f), sizeof sector);
+        std::fclose(f);
+        GPX2_CHECK(std::memcmp(sector, &store, sizeof store) == 0);
+        GPX2_CHECK_EQ(sector[sizeof store], 0xFF);
+    }
+
+    // a flipped table bit, another version and another magic all read as
+    // no tables
+    gpx2_dnl_store_t bad = store;
+    bad.table[0][1].width[17] ^= 0x04;
+    GPX2_CHECK(hal_flash_write(HAL_FLASH_DNL, &bad, sizeof bad));
+    GPX2_CHECK(!gpx2_dnl_load(&s));
+    GPX2_CHECK_EQ(s.enabled + s.table[0][1].hits, 0);
+    bad = store;
+    bad.version = GPX2_DNL_VERSION + 1;
+    GPX2_CHECK(hal_flash_write(HAL_FLASH_DNL, &bad, sizeof bad));
+    GPX2_CHECK(!gpx2_dnl_load(&s));
+    bad = store;
+    bad.magic ^= 0x01000000;
+    GPX2_CHECK(hal_flash_write(HAL_FLASH_DNL, &bad, sizeof bad));
+    GPX2_CHECK(!gpx2_dnl_load(&s));
+
+    // saved again, the loaded tables correct like the ones built
+    GPX2_CHECK(gpx2_dnl_save(&store));
+    GPX2_CHECK(gpx2_dnl_load(&s));
+    gpx2_dnl_t loaded;
+    GPX2_CHECK(gpx2_dnl_apply(&loaded, &s, 0, DIVISIONS));
+    GPX2_CHECK_EQ(loaded.mask, 0x07);
+    GPX2_CHECK(std::memcmp(loaded.edge, dnl.edge, 3 * sizeof dnl.edge[0]) == 0);
+}
+
+} // namespace
+
+int main()
+{
+    char path[] = "/tmp/gpx2_dnl_test_XXXXXX";
+    int fd = mkstemp(path);
+    GPX2_CHECK(fd >= 0);
+    close(fd);
+    setenv("GPX2_SIM_FLASH", path, 1);
+    gpx2::test::sim_start(50000, 0.3);
+    correction();
+    store_checks(path);
+    unlink(path);
+    return gpx2::test::finish("gpx2_dnl_test");
+}
@@ -0,0 +1,303 @@
+// Event gate (gpx2_gate.c): rule setters, random rules and frames against a
+// straightforward reference of the documented checks, exact prescaling, the
+// counters adding up, a throughput floor, and STOP and window rules on hits
+// of a simulated chip.
+
+#include <chrono>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_gate.h"
+}
+
+namespace {
+
+gpx2_gate_t gate;
+
+void setters()
+{
+    gpx2_gate_init(&gate);
+    GPX2_CHECK(!gpx2_gate_set_stop(&gate, GPX2_GATE_CHANNELS, 0, 1));
+    GPX2_CHECK(!gpx2_gate_set_ref(&gate, GPX2_GATE_CHANNELS, 0, 1));
+    GPX2_CHECK(!gpx2_gate_set_prescale(&gate, GPX2_GATE_CHANNELS, 2));
+    GPX2_CHECK(!gpx2_gate_set_window(&gate, 3, 3, 0, 1));
+    GPX2_CHECK(!gpx2_gate_set_window(&gate, 3, GPX2_GATE_CHANNELS, 0, 1));
+    GPX2_CHECK(gpx2_gate_set_window(&gate, 3, 9, -5, 5));
+    GPX2_CHECK(gpx2_gate_set_stop(&gate, 3, 10, 20));
+    GPX2_CHECK(gpx2_gate_set_prescale(&gate, 3, 4));
+    GPX2_CHECK_EQ(gate.rule[3].flags, GPX2_GATE_STOP | GPX2_GATE_WINDOW | GPX2_GATE_PRESCALE);
+    GPX2_CHECK_EQ(gate.window_refs, 1 << 9);
+    GPX2_CHECK(gpx2_gate_needs_ps(&gate));
+    // lo > hi and n <= 1 switch a check off
+    GPX2_CHECK(gpx2_gate_set_window(&gate, 3, 0, 1, 0));
+    GPX2_CHECK(gpx2_gate_set_stop(&gate, 3, 1, 0));
+    GPX2_CHECK(gpx2_gate_set_prescale(&gate, 3, 1));
+    GPX2_CHECK_EQ(gate.rule[3].flags, 0);
+    GPX2_CHECK_EQ(gate.window_refs, 0);
+    GPX2_CHECK(!gpx2_gate_needs_ps(&gate));
+
+    // without rules every hit passes and t_ps is not needed
+    gpx2_result_t res = {};
+    res.dev = 2;
+    res.mask = 0x0B;
+    GPX2_CHECK_EQ(gpx2_gate_apply(&gate, &res, nullptr), 0x0B);
+    GPX2_CHECK_EQ(gate.accepted[8] + gate.accepted[9] + gate.accepted[11], 3);
+}
+
+// the documented semantics, written out plainly
+struct Reference
+{
+    gpx2_gate_rule_t rule[GPX2_GATE_CHANNELS];
+    bool have_t[GPX2_GATE_CHANNELS] = {};
+    uint64_t last_t[GPX2_GATE_CHANNELS] = {};
+    uint32_t passed[GPX2_GATE_CHANNELS] = {}; // hits that reached the prescaler
+
+    uint8_t apply(const gpx2_result_t &res, const uint64_t *t, int *reason)
+    {
+        int base = res.dev * GPX2_CHANNELS;
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if (!(res.mask & (1 << ch)))
+                continue;
+            bool is_ref = false;
+            for (const gpx2_gate_rule_t &r : rule)
+                is_ref |= (r.flags & GPX2_GATE_WINDOW) && r.win_ref == base + ch;
+            if (is_ref)
+            {
+                have_t[base + ch] = true;
+                last_t[base + ch] = t[ch];
+            }
+        }
+        uint8_t accepted = 0;
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            reason[ch] = -1;
+            if (!(res.mask & (1 << ch)))
+                continue;
+            const gpx2_gate_rule_t &r = rule[base + ch];
+            if ((r.flags & GPX2_GATE_STOP) && !(res.stop[ch] >= r.stop_lo && res.stop[ch] <= r.stop_hi))
+                reason[ch] = GPX2_GATE_REJ_STOP;
+            else if ((r.flags & GPX2_GATE_REF) && !(res.ref[ch] >= r.ref_lo && res.ref[ch] <= r.ref_hi))
+                reason[ch] = GPX2_GATE_REJ_REF;
+            else if ((r.flags & GPX2_GATE_WINDOW) &&
+                     !(have_t[r.win_ref] && (int64_t)(t[ch] - last_t[r.win_ref]) >= r.win_lo_ps &&
+                       (int64_t)(t[ch] - last_t[r.win_ref]) <= r.win_hi_ps))
+                reason[ch] = GPX2_GATE_REJ_WINDOW;
+            else if ((r.flags & GPX2_GATE_PRESCALE) && passed[base + ch]++ % r.prescale != 0)
+                reason[ch] = GPX2_GATE_REJ_PRESCALE;
+            if (reason[ch] < 0)
+                accepted |= 1 << ch;
+        }
+        return accepted;
+    }
+};
+
+uint32_t rng = 99;
+uint32_t next()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+void random_rules()
+{
+    for (int round = 0; round < 50; round++)
+    {
+        gpx2_gate_init(&gate);
+        for (uint8_t ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+        {
+            uint32_t pick = next();
+            if (pick & 1)
+            {
+                uint32_t lo = next() % 200000;
+                gpx2_gate_set_stop(&gate, ch, lo, lo + next() % 150000);
+            }
+            if (pick & 2)
+            {
+                uint32_t lo = next() % 1000;
+                gpx2_gate_set_ref(&gate, ch, lo, lo + next() % 800);
+            }
+            if (pick & 4)
+            {
+                uint8_t ref = (uint8_t)((ch + 1 + next() % 15) % GPX2_GATE_CHANNELS);
+                int64_t lo = (int64_t)(next() % 400000) - 200000;
+                gpx2_gate_set_window(&gate, ch, ref, lo, lo + next() % 300000);
+            }
+            if (pick & 8)
+                gpx2_gate_set_prescale(&gate, ch, (uint16_t)(2 + next() % 9));
+        }
+        Reference want;
+        for (int ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+            want.rule[ch] = gate.rule[ch];
+
+        uint32_t hits[GPX2_GATE_CHANNELS] = {};
+        uint32_t reasons[GPX2_GATE_CHANNELS][GPX2_GATE_REJ_COUNT] = {};
+        int wrong = 0;
+        uint64_t now = 1000000;
+        for (int n = 0; n < 4000; n++)
+        {
+            gpx2_result_t res = {};
+            res.dev = (uint8_t)(next() % 4);
+            res.mask = (uint8_t)(next() & 0x0F);
+            uint64_t t[GPX2_CHANNELS];
+            now += next() % 100000;
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                res.ref[ch] = next() % 2000;
+                res.stop[ch] = next() % 200000;
+                t[ch] = now + next() % 200000;
+                if (res.mask & (1 << ch))
+                    hits[res.dev * GPX2_CHANNELS + ch]++;
+            }
+            int reason[GPX2_CHANNELS];
+            uint8_t expect = want.apply(res, t, reason);
+            wrong += gpx2_gate_apply(&gate, &res, t) != expect;
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (reason[ch] >= 0)
+                    reasons[res.dev * GPX2_CHANNELS + ch][reason[ch]]++;
+            }
+        }
+        GPX2_CHECK_EQ(wrong, 0);
+        for (int ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+        {
+            uint32_t rejected = 0;
+            for (int k = 0; k < GPX2_GATE_REJ_COUNT; k++)
+            {
+                GPX2_CHECK_EQ(gate.rejected[ch][k], reasons[ch][k]);
+                rejected += gate.rejected[ch][k];
+            }
+            GPX2_CHECK_EQ(gate.accepted[ch] + rejected, hits[ch]);
+        }
+    }
+}
+
+// 1 in N of the hits that pass the other checks, the first one included
+void prescale()
+{
+    gpx2_gate_init(&gate);
+    GPX2_CHECK(gpx2_gate_set_prescale(&gate, 1, 7));
+    GPX2_CHECK(gpx2_gate_set_stop(&gate, 1, 0, 999));
+    gpx2_result_t res = {};
+    res.mask = 0x02;
+    int kept_at_multiple = 0, n_pass = 0;
+    for (int n = 0; n < 1400; n++)
+    {
+        res.stop[1] = (n % 2) ? 500 : 5000; // every other hit fails STOP
+        bool pass = res.stop[1] <= 999;
+        uint8_t acc = gpx2_gate_apply(&gate, &res, nullptr);
+        if (pass)
+        {
+            kept_at_multiple += (acc != 0) == (n_pass % 7 == 0);
+            n_pass++;
+        }
+        else
+        {
+            GPX2_CHECK_EQ(acc, 0);
+        }
+    }
+    GPX2_CHECK_EQ(kept_at_multiple, 700);
+    GPX2_CHECK_EQ(gate.accepted[1], 100);
+    GPX2_CHECK_EQ(gate.rejected[1][GPX2_GATE_REJ_PRESCALE], 600);
+    GPX2_CHECK_EQ(gate.rejected[1][GPX2_GATE_REJ_STOP], 700);
+    gpx2_gate_clear_counters(&gate);
+    GPX2_CHECK_EQ(gate.accepted[1] + gate.rejected[1][GPX2_GATE_REJ_STOP], 0);
+}
+
+// the gate sits in the per frame path: well above the frames/s the readout
+// delivers (half a million here leaves room for a loaded host), every check on
+// every channel
+void throughput()
+{
+    gpx2_gate_init(&gate);
+    for (uint8_t ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+    {
+        gpx2_gate_set_stop(&gate, ch, 1000, 190000);
+        gpx2_gate_set_ref(&gate, ch, 0, 0xFFFFFF);
+        gpx2_gate_set_window(&gate, ch, (uint8_t)(ch ^ 1), -1000000, 1000000);
+        gpx2_gate_set_prescale(&gate, ch, 3);
+    }
+    constexpr int FRAMES = 2000000;
+    gpx2_result_t res = {};
+    res.mask = 0x0F;
+    uint64_t t[GPX2_CHANNELS] = {};
+    uint32_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int n = 0; n < FRAMES; n++)
+    {
+        res.dev = (uint8_t)(n & 3);
+        res.stop[n & 3] = (uint32_t)n % 200000;
+        t[n & 3] = (uint64_t)n * 1000;
+        sink += gpx2_gate_apply(&gate, &res, t);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    uint32_t total = 0;
+    for (int ch = 0; ch < GPX2_GATE_CHANNELS; ch++)
+    {
+        total += gate.accepted[ch];
+        for (int k = 0; k < GPX2_GATE_REJ_COUNT; k++)
+            total += gate.rejected[ch][k];
+    }
+    GPX2_CHECK_EQ(total, 4u * FRAMES);
+    GPX2_CHECK(sink > 0);
+    GPX2_CHECK(FRAMES / s > 5e5);
+}
+
+// hits of a simulated chip: a STOP window keeps its share of the REFCLK
+// period, and windows against channel 0 keep or drop channel 1 (1000 ps
+// later) as a whole
+void chip_rules()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 0, 0x07));
+    gpx2_gate_init(&gate);
+    GPX2_CHECK(gpx2_gate_set_stop(&gate, 2, 50000, 99999));
+    GPX2_CHECK(gpx2_gate_set_window(&gate, 1, 0, 850, 1150));
+    gpx2_gate_t off;
+    gpx2_gate_init(&off);
+    GPX2_CHECK(gpx2_gate_set_window(&off, 1, 0, 1200, 5000));
+    gpx2_dev_t *devs[1] = {&d};
+    gpx2_result_t res[GPX2_BURST_MAX];
+    uint32_t frames = 0, bad_stop = 0;
+    while (frames < 3000)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        int n = gpx2_dev_read_parallel(devs, 1, res);
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t t[GPX2_CHANNELS];
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+                t[ch] = (uint64_t)res[i].ref[ch] * 200000 + res[i].stop[ch];
+            uint8_t acc = gpx2_gate_apply(&gate, &res[i], t);
+            gpx2_gate_apply(&off, &res[i], t);
+            bad_stop += (acc & 0x04) && (res[i].stop[2] < 50000 || res[i].stop[2] > 99999);
+            frames += res[i].mask == 0x07;
+        }
+    }
+    GPX2_CHECK(frames >= 3000);
+    GPX2_CHECK_EQ(bad_stop, 0);
+    uint32_t in = gate.accepted[2], all = in + gate.rejected[2][GPX2_GATE_REJ_STOP];
+    GPX2_CHECK(in > all / 4 - all / 20 && in < all / 4 + all / 20);
+    GPX2_CHECK(gate.accepted[1] > 0);
+    GPX2_CHECK_EQ(gate.rejected[1][GPX2_GATE_REJ_WINDOW], 0);
+    GPX2_CHECK_EQ(gate.accepted[0], off.accepted[0]);
+    GPX2_CHECK_EQ(off.accepted[1], 0);
+    GPX2_CHECK_EQ(off.rejected[1][GPX2_GATE_REJ_WINDOW], gate.accepted[1]);
+}
+
+} // namespace
+
+int main()
+{
+    setters();
+    random_rules();
+    prescale();
+    throughput();
+    gpx2::test::sim_start(5000);
+    chip_rules();
+    return gpx2::test::finish("gpx2_gate_test");
+}
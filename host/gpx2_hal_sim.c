@@ -0,0 +1,817 @@
+// linux backend of gpx2_hal.h: console on stdin/stdout, SPI and GPIO wired to
+// the behavioral GPX2 model in gpx2_sim.c, threads standing in for the gpio
+// irq and core1.
+//
+// Simulated time is wall clock time plus the modeled SPI bus time, so the
+// report at exit reflects both the firmware's CPU cost and the bus. Every row
+// of the designlab.c wiring table has a simulated chip, transfers started on
+// spi0 and spi1 overlap in time.
+//
+// Environment:
+//   GPX2_SIM_RATE       pulses per second (default 1000)
+//   GPX2_SIM_REFCLK_HZ  reference clock (default 5000000)
+//   GPX2_SIM_JITTER_PS  rms jitter per channel (default 20)
+//   GPX2_SIM_DNL        STOP code width variation, e.g. 0.3 = +/-30% (default 0 = linear)
+//   GPX2_SIM_SECONDS    stop after this much simulated time (default 5)
+//   GPX2_SIM_FRAMES     stop after this many result reads (default 0 = off)
+//   GPX2_SIM_SEED       generator seed
+//   GPX2_SIM_SPI_MAX_HZ above this SPI clock read bytes get bit errors (default 0 = off)
+//   GPX2_SIM_FLASH      file backing the flash sectors and the capture region (default: memory only)
+//   GPX2_SIM_PAGE_US    time a capture page program blocks the caller (default 400)
+//   GPX2_SIM_ERASE_MS   time a capture block erase blocks the caller (default 45)
+//   GPX2_SIM_BOOT_TAG   value hal_boot_tag() returns (default 0)
+//   GPX2_SIM_WATCHDOG_BOOT  1: hal_watchdog_caused_reboot() reports a watchdog reset
+//   GPX2_SIM_STALL_S    chip 1 readout hangs (INT stuck low) at this simulated time
+//   GPX2_SIM_GLITCH_S   chip 1 loses its config and run state at this simulated time
+//   GPX2_SIM_BULK       file or fifo standing in for the usb bulk endpoint (default: none, never ready)
+//
+// An expired watchdog prints the report and exits with status 3.
+
+#define _GNU_SOURCE
+#include "gpx2_hal.h"
+#include "gpx2_hal_sim.h"
+#include "gpx2_sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// must match gpx2_wiring in designlab.c
+#define SIM_CHIPS HAL_SIM_CHIPS
+#define SIM_BUSES 2
+static const struct
+{
+    uint8_t bus, cs, intr;
+} sim_wiring[SIM_CHIPS] = {{0, 17, 20}, {1, 13, 21}, {0, 22, 26}, {1, 9, 27}};
+
+// fixed cost of one CS low period on the bus
+#define SIM_CS_OVERHEAD_PS 200000ULL
+// fixed cost of one blocking SPI call (FIFO fill and drain), so byte-wise
+// transfers cost more than one call for the same bytes
+#define SIM_SPI_CALL_OVERHEAD_PS 500000ULL
+
+static gpx2_sim_t sim[SIM_CHIPS];
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned spi_baud[SIM_BUSES] = {1000000, 1000000};
+static uint64_t bus_ps;      // accumulated time spent waiting for the bus
+static uint64_t bus_busy_ps[SIM_BUSES];  // modeled time each bus was clocking
+static uint64_t bus_end_ps[SIM_BUSES];   // end of the transfer in flight
+static uint64_t bulk_bytes, bulk_transfers; // GPX2_SIM_BULK
+static unsigned spi_max_hz;  // MISO bit errors above this clock, 0 = never
+static uint32_t spi_noise = 0x12345678;
+static uint64_t start_ns;
+static double run_seconds = 5.0;
+static uint64_t run_frames = 0;
+static pthread_t main_thread;
+static bool stdin_eof = false;
+static double stall_s, glitch_s; // fault injection times, 0 = off
+static bool stalled, glitched;
+
+// watchdog, fed in simulated time and checked by its own thread
+static uint64_t wdt_timeout_ps;
+static uint64_t wdt_fed_ps;
+static pthread_t wdt_thread;
+
+// irq emulation, one entry per chip INT pin
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static hal_irq_cb_t irq_cb[SIM_CHIPS];
+static volatile bool irq_enabled[SIM_CHIPS];
+static volatile bool irq_pending[SIM_CHIPS];
+static uint64_t irq_falls[SIM_CHIPS]; // INT falling edges seen so far
+static bool irq_running;
+static pthread_t irq_thread;
+
+// core1 emulation
+static pthread_t core1_thread;
+// held while a flash operation runs, core1 and the irq wait on it
+static pthread_mutex_t flash_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mbox_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t mbox[16];
+static unsigned mbox_head, mbox_count;
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// simulated time in ps, call with sim_lock held
+static uint64_t sim_now_ps(void)
+{
+    return (wall_ns() - start_ns) * 1000ULL + bus_ps;
+}
+
+static double env_num(const char *name, double def)
+{
+    const char *v = getenv(name);
+    return v ? atof(v) : def;
+}
+
+static void sim_report(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    double t = sim_now_ps() * 1e-12;
+    fflush(stdout);
+    hal_bulk_flush();
+    fprintf(stderr, "\nsim: %.3f s simulated, %.3f s waiting for the bus, spi %u Hz\n",
+            t, bus_ps * 1e-12, spi_baud[0]);
+    for (int k = 0; k < SIM_CHIPS; k++)
+    {
+        const gpx2_sim_t *c = &sim[k];
+        if (c->transactions == 0)
+            continue;
+        fprintf(stderr, "sim chip %d (spi%u): %llu pulses, %llu hits stored, %llu hits lost in chip fifo\n",
+                k + 1, sim_wiring[k].bus, (unsigned long long)c->pulses,
+                (unsigned long long)c->hits, (unsigned long long)c->hits_lost);
+        fprintf(stderr, "sim chip %d: %llu transactions, %llu bytes, %llu config writes, %llu empty slots\n",
+                k + 1, (unsigned long long)c->transactions, (unsigned long long)c->bytes,
+                (unsigned long long)c->config_writes, (unsigned long long)c->empty_slots);
+        fprintf(stderr, "sim chip %d: %llu result reads, %.0f reads/s\n", k + 1,
+                (unsigned long long)c->result_reads, t > 0 ? c->result_reads / t : 0.0);
+    }
+    for (int b = 0; b < SIM_BUSES; b++)
+    {
+        if (bus_busy_ps[b])
+            fprintf(stderr, "sim: spi%d busy %.3f s (%.1f%%)\n", b, bus_busy_ps[b] * 1e-12,
+                    t > 0 ? bus_busy_ps[b] * 1e-10 / t : 0.0);
+    }
+    if (bulk_transfers)
+        fprintf(stderr, "sim bulk: %llu bytes in %llu transfers\n", (unsigned long long)bulk_bytes,
+                (unsigned long long)bulk_transfers);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+// injected faults hit chip 1 once their time has come, call with sim_lock held
+static void sim_faults(uint64_t now_ps)
+{
+    if (stall_s > 0 && !stalled && now_ps * 1e-12 >= stall_s)
+    {
+        stalled = true;
+        gpx2_sim_stall(&sim[0]);
+        fprintf(stderr, "sim: chip 1 readout stalled at %.3f s\n", now_ps * 1e-12);
+    }
+    if (glitch_s > 0 && !glitched && now_ps * 1e-12 >= glitch_s)
+    {
+        glitched = true;
+        gpx2_sim_glitch(&sim[0]);
+        fprintf(stderr, "sim: chip 1 lost its config at %.3f s\n", now_ps * 1e-12);
+    }
+}
+
+static uint64_t sim_result_reads(void)
+{
+    uint64_t n = 0;
+    for (int k = 0; k < SIM_CHIPS; k++)
+        n += sim[k].result_reads;
+    return n;
+}
+
+// end of run, only the main thread exits so atexit handlers run once
+static void sim_check_end(void)
+{
+    if (!pthread_equal(pthread_self(), main_thread))
+        return;
+    pthread_mutex_lock(&sim_lock);
+    bool done = sim_now_ps() * 1e-12 >= run_seconds ||
+                (run_frames && sim_result_reads() >= run_frames);
+    pthread_mutex_unlock(&sim_lock);
+    if (done)
+        exit(0);
+}
+
+void hal_console_init(void)
+{
+    main_thread = pthread_self();
+    start_ns = wall_ns();
+    // unbuffered so poll() on fd 0 sees everything scanf has not consumed
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    gpx2_sim_params_t p = {0};
+    p.rate_hz = env_num("GPX2_SIM_RATE", 1000);
+    p.refclk_hz = (uint32_t)env_num("GPX2_SIM_REFCLK_HZ", 5000000);
+    p.jitter_ps = (uint32_t)env_num("GPX2_SIM_JITTER_PS", 20);
+    p.dnl = env_num("GPX2_SIM_DNL", 0);
+    p.seed = (uint64_t)env_num("GPX2_SIM_SEED", 1);
+    // same seed: every chip sees the same pulses, each with its own offsets
+    for (int k = 0; k < SIM_CHIPS; k++)
+    {
+        for (int ch = 0; ch < GPX2_SIM_CHANNELS; ch++)
+            p.delay_ps[ch] = 1000u * ch + 500u * k;
+        gpx2_sim_init(&sim[k], &p);
+    }
+    run_seconds = env_num("GPX2_SIM_SECONDS", 5);
+    run_frames = (uint64_t)env_num("GPX2_SIM_FRAMES", 0);
+    spi_max_hz = (unsigned)env_num("GPX2_SIM_SPI_MAX_HZ", 0);
+    stall_s = env_num("GPX2_SIM_STALL_S", 0);
+    glitch_s = env_num("GPX2_SIM_GLITCH_S", 0);
+    atexit(sim_report);
+}
+
+int hal_getchar_timeout_us(uint32_t us)
+{
+    sim_check_end();
+    if (stdin_eof)
+        return -1;
+    struct pollfd pfd = {.fd = 0, .events = POLLIN};
+    if (poll(&pfd, 1, (int)(us / 1000)) <= 0)
+        return -1;
+    int c = getchar();
+    if (c == EOF)
+    {
+        stdin_eof = true;
+        return -1;
+    }
+    return c;
+}
+
+void hal_write_raw(const uint8_t *data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+}
+
+// bulk endpoint stand-in: a fifo is opened once a reader has it open (the
+// host opening the device), retried every 100 ms, and closed again when the
+// reader goes away; a regular file is created on first use. A buffer goes
+// out with one blocking write, so the second buffer is never needed here.
+static int bulk_fd = -1;
+static uint64_t bulk_retry_us;
+static uint8_t bulk_buf[HAL_BULK_BUFFER];
+static size_t bulk_len;
+
+bool hal_bulk_ready(void)
+{
+    const char *path = getenv("GPX2_SIM_BULK");
+    if (bulk_fd >= 0 || !path)
+        return bulk_fd >= 0;
+    uint64_t now = hal_time_us();
+    if (bulk_retry_us != 0 && now < bulk_retry_us)
+        return false;
+    bulk_retry_us = now + 100000;
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+    {
+        // ENXIO without a reader
+        bulk_fd = open(path, O_WRONLY | O_NONBLOCK);
+        if (bulk_fd >= 0)
+            fcntl(bulk_fd, F_SETFL, fcntl(bulk_fd, F_GETFL) & ~O_NONBLOCK);
+    }
+    else
+    {
+        bulk_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (bulk_fd >= 0)
+        signal(SIGPIPE, SIG_IGN);
+    bulk_len = 0;
+    return bulk_fd >= 0;
+}
+
+void hal_bulk_flush(void)
+{
+    if (bulk_fd < 0 || bulk_len == 0)
+        return;
+    size_t done = 0;
+    while (done < bulk_len)
+    {
+        ssize_t n = write(bulk_fd, bulk_buf + done, bulk_len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            // reader gone, like a device the host let go of
+            close(bulk_fd);
+            bulk_fd = -1;
+            break;
+        }
+        done += (size_t)n;
+    }
+    bulk_bytes += done;
+    bulk_transfers++;
+    bulk_len = 0;
+}
+
+size_t hal_bulk_write(const uint8_t *data, size_t len)
+{
+    if (!hal_bulk_ready())
+        return 0;
+    size_t n = len < HAL_BULK_BUFFER - bulk_len ? len : HAL_BULK_BUFFER - bulk_len;
+    memcpy(bulk_buf + bulk_len, data, n);
+    bulk_len += n;
+    if (bulk_len == HAL_BULK_BUFFER)
+        hal_bulk_flush();
+    return n;
+}
+
+unsigned hal_spi_init(uint8_t bus, unsigned baud, uint8_t sck, uint8_t mosi, uint8_t miso)
+{
+    (void)sck;
+    (void)mosi;
+    (void)miso;
+    return hal_spi_set_baudrate(bus, baud);
+}
+
+unsigned hal_spi_set_baudrate(uint8_t bus, unsigned baud)
+{
+    spi_baud[bus] = baud ? baud : 1;
+    return spi_baud[bus];
+}
+
+// the selected chip on a bus, NULL when CS is high everywhere
+static gpx2_sim_t *sim_selected(uint8_t bus)
+{
+    for (int k = 0; k < SIM_CHIPS; k++)
+    {
+        if (sim_wiring[k].bus == bus && sim[k].selected)
+            return &sim[k];
+    }
+    return NULL;
+}
+
+// core1 and the irq are held up while core0 writes flash
+static void sim_flash_wait(void)
+{
+    pthread_mutex_lock(&flash_lock);
+    pthread_mutex_unlock(&flash_lock);
+}
+
+// bytes are exchanged right away, the bus stays busy until bus_end_ps
+static void sim_spi_start(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    sim_flash_wait();
+    pthread_mutex_lock(&sim_lock);
+    uint64_t now = sim_now_ps();
+    sim_faults(now);
+    gpx2_sim_t *chip = sim_selected(bus);
+    if (chip)
+        gpx2_sim_advance(chip, now);
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t in = chip ? gpx2_sim_xfer(chip, tx ? tx[i] : 0x00) : 0xFF;
+        if (spi_max_hz && spi_baud[bus] > spi_max_hz)
+        {
+            // too fast for the board: about one read byte in 32 gets a flipped bit
+            spi_noise ^= spi_noise << 13;
+            spi_noise ^= spi_noise >> 17;
+            spi_noise ^= spi_noise << 5;
+            if ((spi_noise & 31) == 0)
+                in ^= (uint8_t)(1u << ((spi_noise >> 5) & 7));
+        }
+        if (rx)
+            rx[i] = in;
+    }
+    uint64_t cost = SIM_SPI_CALL_OVERHEAD_PS + (uint64_t)len * 8 * 1000000000000ULL / spi_baud[bus];
+    uint64_t start = bus_end_ps[bus] > now ? bus_end_ps[bus] : now;
+    bus_end_ps[bus] = start + cost;
+    bus_busy_ps[bus] += cost;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+// time only passes for the waiting side, a transfer that ran while the
+// other bus was waited for costs nothing extra
+static void sim_spi_wait(uint8_t bus)
+{
+    pthread_mutex_lock(&sim_lock);
+    uint64_t now = sim_now_ps();
+    if (bus_end_ps[bus] > now)
+        bus_ps += bus_end_ps[bus] - now;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static void sim_spi(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    sim_spi_start(bus, tx, rx, len);
+    sim_spi_wait(bus);
+}
+
+void hal_spi_write(uint8_t bus, const uint8_t *src, size_t len)
+{
+    sim_spi(bus, src, NULL, len);
+}
+
+void hal_spi_read(uint8_t bus, uint8_t *dst, size_t len)
+{
+    sim_spi(bus, NULL, dst, len);
+}
+
+void hal_spi_transfer(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    sim_spi(bus, tx, rx, len);
+}
+
+void hal_spi_transfer_start(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    sim_spi_start(bus, tx, rx, len);
+}
+
+void hal_spi_transfer_wait(uint8_t bus)
+{
+    sim_spi_wait(bus);
+}
+
+void hal_gpio_output(uint8_t pin, bool level)
+{
+    hal_gpio_put(pin, level);
+}
+
+void hal_gpio_input(uint8_t pin)
+{
+    (void)pin;
+}
+
+static int sim_chip_by_cs(uint8_t pin)
+{
+    for (int k = 0; k < SIM_CHIPS; k++)
+    {
+        if (sim_wiring[k].cs == pin)
+            return k;
+    }
+    return -1;
+}
+
+static int sim_chip_by_int(uint8_t pin)
+{
+    for (int k = 0; k < SIM_CHIPS; k++)
+    {
+        if (sim_wiring[k].intr == pin)
+            return k;
+    }
+    return -1;
+}
+
+void hal_gpio_put(uint8_t pin, bool level)
+{
+    int k = sim_chip_by_cs(pin);
+    if (k < 0)
+        return;
+    pthread_mutex_lock(&sim_lock);
+    gpx2_sim_advance(&sim[k], sim_now_ps());
+    if (!level)
+        bus_ps += SIM_CS_OVERHEAD_PS;
+    gpx2_sim_cs(&sim[k], level);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+bool hal_gpio_get(uint8_t pin)
+{
+    int k = sim_chip_by_int(pin);
+    if (k < 0)
+        return true;
+    sim_check_end();
+    sim_flash_wait();
+    pthread_mutex_lock(&sim_lock);
+    uint64_t now = sim_now_ps();
+    sim_faults(now);
+    gpx2_sim_advance(&sim[k], now);
+    bool level = gpx2_sim_int(&sim[k]);
+    pthread_mutex_unlock(&sim_lock);
+    return level;
+}
+
+// raises the callback on falling INT edges, the chip model counts them so an
+// edge between two polls is not missed, and one seen while disabled stays
+// pending like the rp2040 edge latch
+static void *irq_main(void *arg)
+{
+    (void)arg;
+    while (true)
+    {
+        for (int k = 0; k < SIM_CHIPS; k++)
+        {
+            if (!irq_cb[k])
+                continue;
+            hal_gpio_get(sim_wiring[k].intr);
+            pthread_mutex_lock(&sim_lock);
+            uint64_t n = sim[k].int_falls;
+            pthread_mutex_unlock(&sim_lock);
+            if (n != irq_falls[k])
+                irq_pending[k] = true;
+            irq_falls[k] = n;
+            pthread_mutex_lock(&irq_lock);
+            if (irq_pending[k] && irq_enabled[k])
+            {
+                irq_pending[k] = false;
+                irq_cb[k](sim_wiring[k].intr);
+            }
+            pthread_mutex_unlock(&irq_lock);
+        }
+        struct timespec ts = {0, 2000};
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+void hal_gpio_irq_falling(uint8_t pin, hal_irq_cb_t cb)
+{
+    int k = sim_chip_by_int(pin);
+    if (k < 0 || irq_cb[k])
+        return;
+    // like gpio_set_irq_enabled(), an edge from before is acknowledged
+    pthread_mutex_lock(&sim_lock);
+    irq_falls[k] = sim[k].int_falls;
+    pthread_mutex_unlock(&sim_lock);
+    pthread_mutex_lock(&irq_lock);
+    irq_cb[k] = cb;
+    irq_enabled[k] = true;
+    pthread_mutex_unlock(&irq_lock);
+    if (!irq_running)
+    {
+        irq_running = true;
+        pthread_create(&irq_thread, NULL, irq_main, NULL);
+    }
+}
+
+void hal_gpio_irq_enable(uint8_t pin, bool enabled)
+{
+    int k = sim_chip_by_int(pin);
+    if (k < 0)
+        return;
+    // waits for a running callback, like masking the irq on the same core
+    pthread_mutex_lock(&irq_lock);
+    irq_enabled[k] = enabled;
+    pthread_mutex_unlock(&irq_lock);
+}
+
+uint64_t hal_time_us(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    uint64_t us = sim_now_ps() / 1000000ULL;
+    pthread_mutex_unlock(&sim_lock);
+    return us;
+}
+
+void hal_busy_wait_us(uint32_t us)
+{
+    struct timespec ts = {us / 1000000, (long)(us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+
+// host cycles are nanoseconds of simulated time, so modeled bus time shows
+// up in the perf report
+static uint32_t sim_cycles(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    uint32_t ns = (uint32_t)(sim_now_ps() / 1000ULL);
+    pthread_mutex_unlock(&sim_lock);
+    return ns;
+}
+
+void hal_cycles_init(void)
+{
+}
+
+uint32_t hal_cycles(void)
+{
+    return sim_cycles();
+}
+
+uint32_t hal_cycles_since(uint32_t start)
+{
+    return sim_cycles() - start;
+}
+
+uint32_t hal_cycles_per_us(void)
+{
+    return 1000;
+}
+
+static void *wdt_main(void *arg)
+{
+    (void)arg;
+    while (true)
+    {
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, NULL);
+        pthread_mutex_lock(&sim_lock);
+        uint64_t now = sim_now_ps();
+        bool expired = now - wdt_fed_ps > wdt_timeout_ps;
+        pthread_mutex_unlock(&sim_lock);
+        if (expired)
+        {
+            fflush(stdout);
+            fprintf(stderr, "\nsim: watchdog expired at %.3f s\n", now * 1e-12);
+            sim_report();
+            _exit(3);
+        }
+    }
+    return NULL;
+}
+
+void hal_watchdog_enable(uint32_t timeout_ms)
+{
+    pthread_mutex_lock(&sim_lock);
+    bool running = wdt_timeout_ps != 0;
+    wdt_timeout_ps = (uint64_t)timeout_ms * 1000000000ULL;
+    wdt_fed_ps = sim_now_ps();
+    pthread_mutex_unlock(&sim_lock);
+    if (!running)
+        pthread_create(&wdt_thread, NULL, wdt_main, NULL);
+}
+
+void hal_watchdog_feed(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    wdt_fed_ps = sim_now_ps();
+    pthread_mutex_unlock(&sim_lock);
+}
+
+bool hal_watchdog_caused_reboot(void)
+{
+    return env_num("GPX2_SIM_WATCHDOG_BOOT", 0) != 0;
+}
+
+void hal_reboot(void)
+{
+    fprintf(stderr, "sim: reboot requested\n");
+    exit(0);
+}
+
+void hal_reboot_tagged(uint32_t tag)
+{
+    fprintf(stderr, "sim: reboot requested, boot tag 0x%08x\n", tag);
+    exit(0);
+}
+
+uint32_t hal_boot_tag(void)
+{
+    return (uint32_t)env_num("GPX2_SIM_BOOT_TAG", 0);
+}
+
+// flash sectors and capture region, erased state is 0xFF, the file holds
+// them in that order
+static uint8_t flash_sector[HAL_FLASH_SECTORS][HAL_FLASH_SECTOR_SIZE];
+static uint8_t flash_capture[HAL_CAPTURE_SIZE];
+static bool flash_loaded = false;
+
+static void sim_flash_load(void)
+{
+    if (flash_loaded)
+        return;
+    flash_loaded = true;
+    memset(flash_sector, 0xFF, sizeof(flash_sector));
+    memset(flash_capture, 0xFF, sizeof(flash_capture));
+    const char *path = getenv("GPX2_SIM_FLASH");
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (f)
+    {
+        size_t n = fread(flash_sector, 1, sizeof(flash_sector), f);
+        n = fread(flash_capture, 1, sizeof(flash_capture), f);
+        (void)n;
+        fclose(f);
+    }
+}
+
+static bool sim_flash_save(void)
+{
+    const char *path = getenv("GPX2_SIM_FLASH");
+    if (!path)
+        return true;
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(flash_sector, 1, sizeof(flash_sector), f) == sizeof(flash_sector) &&
+              fwrite(flash_capture, 1, sizeof(flash_capture), f) == sizeof(flash_capture);
+    return fclose(f) == 0 && ok;
+}
+
+bool hal_flash_read(uint8_t sector, void *dst, size_t len)
+{
+    if (sector >= HAL_FLASH_SECTORS || len > HAL_FLASH_SECTOR_SIZE)
+        return false;
+    sim_flash_load();
+    memcpy(dst, flash_sector[sector], len);
+    return true;
+}
+
+bool hal_flash_write(uint8_t sector, const void *src, size_t len)
+{
+    if (sector >= HAL_FLASH_SECTORS || len > HAL_FLASH_SECTOR_SIZE)
+        return false;
+    sim_flash_load();
+    memset(flash_sector[sector], 0xFF, sizeof(flash_sector[sector]));
+    memcpy(flash_sector[sector], src, len);
+    return sim_flash_save();
+}
+
+// capture region: the caller sleeps for the modeled erase/program time with
+// flash_lock held, so core1 and the irq stop at their next SPI or INT access
+// like on the pico. The file is only written with the header page, which a
+// capture programs last
+bool hal_capture_available(void)
+{
+    return true;
+}
+
+bool hal_capture_erase(uint32_t offset)
+{
+    if (offset % HAL_CAPTURE_BLOCK || offset >= HAL_CAPTURE_SIZE)
+        return false;
+    sim_flash_load();
+    pthread_mutex_lock(&flash_lock);
+    hal_busy_wait_us((uint32_t)(env_num("GPX2_SIM_ERASE_MS", 45) * 1000));
+    pthread_mutex_unlock(&flash_lock);
+    memset(flash_capture + offset, 0xFF, HAL_CAPTURE_BLOCK);
+    return offset != 0 || sim_flash_save();
+}
+
+bool hal_capture_program(uint32_t offset, const uint8_t *page)
+{
+    if (offset % HAL_CAPTURE_PAGE || offset >= HAL_CAPTURE_SIZE)
+        return false;
+    sim_flash_load();
+    pthread_mutex_lock(&flash_lock);
+    hal_busy_wait_us((uint32_t)env_num("GPX2_SIM_PAGE_US", 400));
+    pthread_mutex_unlock(&flash_lock);
+    // programming only clears bits
+    for (int i = 0; i < HAL_CAPTURE_PAGE; i++)
+        flash_capture[offset + i] &= page[i];
+    if (offset == 0 && !sim_flash_save())
+        return false;
+    return memcmp(flash_capture + offset, page, HAL_CAPTURE_PAGE) == 0;
+}
+
+bool hal_capture_read(uint32_t offset, void *dst, size_t len)
+{
+    if (offset > HAL_CAPTURE_SIZE || len > HAL_CAPTURE_SIZE - offset)
+        return false;
+    sim_flash_load();
+    memcpy(dst, flash_capture + offset, len);
+    return true;
+}
+
+static void *core1_main(void *entry)
+{
+    ((void (*)(void))entry)();
+    return NULL;
+}
+
+void hal_core1_launch(void (*entry)(void))
+{
+    pthread_create(&core1_thread, NULL, core1_main, (void *)entry);
+}
+
+void hal_core1_push(uint32_t value)
+{
+    while (true)
+    {
+        pthread_mutex_lock(&mbox_lock);
+        if (mbox_count < 16)
+        {
+            mbox[(mbox_head + mbox_count++) % 16] = value;
+            pthread_mutex_unlock(&mbox_lock);
+            return;
+        }
+        pthread_mutex_unlock(&mbox_lock);
+        sched_yield();
+    }
+}
+
+bool hal_core1_pop(uint32_t *value)
+{
+    bool ok = false;
+    pthread_mutex_lock(&mbox_lock);
+    if (mbox_count)
+    {
+        *value = mbox[mbox_head];
+        mbox_head = (mbox_head + 1) % 16;
+        mbox_count--;
+        ok = true;
+    }
+    pthread_mutex_unlock(&mbox_lock);
+    return ok;
+}
+
+void hal_sim_wiring(uint8_t k, uint8_t *bus, uint8_t *cs, uint8_t *intr)
+{
+    *bus = sim_wiring[k].bus;
+    *cs = sim_wiring[k].cs;
+    *intr = sim_wiring[k].intr;
+}
+
+gpx2_sim_t *hal_sim_chip(uint8_t k)
+{
+    return &sim[k];
+}
+
+void hal_sim_snapshot(uint8_t k, gpx2_sim_t *out)
+{
+    pthread_mutex_lock(&sim_lock);
+    gpx2_sim_advance(&sim[k], sim_now_ps());
+    *out = sim[k];
+    pthread_mutex_unlock(&sim_lock);
+}
+
+uint64_t hal_sim_bus_ps(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    uint64_t ps = bus_ps;
+    pthread_mutex_unlock(&sim_lock);
+    return ps;
+}
@@ -0,0 +1,24 @@
+#ifndef GPX2_HAL_SIM_H
+#define GPX2_HAL_SIM_H
+
+// what the host tests see of gpx2_hal_sim.c besides gpx2_hal.h: the
+// simulated chips behind the designlab.c wiring table and the modeled bus
+// time. hal_console_init() sets the chips up from the GPX2_SIM_* variables.
+
+#include <stdint.h>
+#include "gpx2_sim.h"
+
+#define HAL_SIM_CHIPS 4
+
+// pins and bus of chip k, as in gpx2_wiring
+void hal_sim_wiring(uint8_t k, uint8_t *bus, uint8_t *cs, uint8_t *intr);
+// chip k's model, its FIFOs and counters, only while no other thread (irq,
+// core1) touches the chips
+gpx2_sim_t *hal_sim_chip(uint8_t k);
+// copy of chip k's model taken under the sim lock, up to date
+void hal_sim_snapshot(uint8_t k, gpx2_sim_t *out);
+// modeled time spent waiting for the bus so far (transfers, CS and SPI call
+// overheads), in ps
+uint64_t hal_sim_bus_ps(void);
+
+#endif
@@ -0,0 +1,183 @@
+// Histograms (gpx2_hist.c): bin edges, underflow and overflow, the shift and
+// divide paths for power of two and other widths against a 64 bit reference,
+// and STOP values read from a simulated chip.
+
+#include <vector>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_hist.h"
+}
+
+namespace {
+
+gpx2_hist_t hist;
+
+// bin of value in a 64 bit reference, -1 underflow, bins overflow
+int64_t ref_bin(int64_t offset, int64_t width, int64_t bins, int64_t value)
+{
+    if (value < offset)
+        return -1;
+    int64_t bin = (value - offset) / width;
+    return bin < bins ? bin : bins;
+}
+
+void check_against_ref(const std::vector<int32_t> &values)
+{
+    std::vector<uint32_t> count(hist.bins + 2, 0);
+    for (int32_t v : values)
+        count[ref_bin(hist.offset, hist.bin_width, hist.bins, v) + 1]++;
+    GPX2_CHECK_EQ(hist.underflow, count[0]);
+    GPX2_CHECK_EQ(hist.overflow, count[hist.bins + 1]);
+    GPX2_CHECK_EQ(hist.entries + hist.underflow + hist.overflow, values.size());
+    int wrong = 0;
+    for (uint16_t i = 0; i < hist.bins; i++)
+        wrong += hist.count[i] != count[i + 1];
+    GPX2_CHECK_EQ(wrong, 0);
+}
+
+void setup()
+{
+    GPX2_CHECK(!gpx2_hist_setup(&hist, 0, 0, 10));
+    GPX2_CHECK(!gpx2_hist_setup(&hist, 0, 1, 0));
+    GPX2_CHECK(!gpx2_hist_setup(&hist, 0, 1, GPX2_HIST_MAX_BINS + 1));
+    GPX2_CHECK(gpx2_hist_setup(&hist, 0, 1, GPX2_HIST_MAX_BINS));
+    GPX2_CHECK_EQ(hist.shift, 0);
+    GPX2_CHECK(gpx2_hist_setup(&hist, 0, 4096, 10));
+    GPX2_CHECK_EQ(hist.shift, 12);
+    GPX2_CHECK(gpx2_hist_setup(&hist, 0, 0x80000000u, 2));
+    GPX2_CHECK_EQ(hist.shift, 31);
+    GPX2_CHECK(gpx2_hist_setup(&hist, 0, 1000, 10));
+    GPX2_CHECK_EQ(hist.shift, 0xFF);
+    GPX2_CHECK_EQ(gpx2_hist_bin_low(&hist, 3), 3000);
+}
+
+void edges()
+{
+    GPX2_CHECK(gpx2_hist_setup(&hist, -100, 10, 5));
+    gpx2_hist_add(&hist, -101);
+    GPX2_CHECK_EQ(hist.underflow, 1);
+    gpx2_hist_add(&hist, -100);
+    gpx2_hist_add(&hist, -91);
+    GPX2_CHECK_EQ(hist.count[0], 2);
+    gpx2_hist_add(&hist, -90);
+    GPX2_CHECK_EQ(hist.count[1], 1);
+    gpx2_hist_add(&hist, -51);
+    GPX2_CHECK_EQ(hist.count[4], 1);
+    gpx2_hist_add(&hist, -50);
+    GPX2_CHECK_EQ(hist.overflow, 1);
+    gpx2_hist_add(&hist, INT32_MAX);
+    gpx2_hist_add(&hist, INT32_MIN);
+    GPX2_CHECK_EQ(hist.overflow, 2);
+    GPX2_CHECK_EQ(hist.underflow, 2);
+    GPX2_CHECK_EQ(hist.entries, 4);
+    gpx2_hist_clear(&hist);
+    GPX2_CHECK_EQ(hist.entries + hist.underflow + hist.overflow + hist.count[0], 0);
+    GPX2_CHECK_EQ(hist.bins, 5);
+
+    // the whole int32 range in two bins
+    GPX2_CHECK(gpx2_hist_setup(&hist, INT32_MIN, 0x80000000u, 2));
+    gpx2_hist_add(&hist, INT32_MIN);
+    gpx2_hist_add(&hist, -1);
+    gpx2_hist_add(&hist, 0);
+    gpx2_hist_add(&hist, INT32_MAX);
+    GPX2_CHECK_EQ(hist.count[0], 2);
+    GPX2_CHECK_EQ(hist.count[1], 2);
+    GPX2_CHECK_EQ(hist.overflow + hist.underflow, 0);
+}
+
+void random_widths()
+{
+    const uint32_t widths[] = {1, 2, 3, 7, 16, 250, 1000, 1024, 99991, 1u << 20, 0x7FFFFFFFu};
+    const int32_t offsets[] = {0, -1, 12345, -200000, INT32_MIN, INT32_MAX - 1000};
+    const uint16_t bins[] = {1, 7, 200, GPX2_HIST_MAX_BINS};
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    std::vector<int32_t> values(20000);
+    for (uint32_t w : widths)
+    {
+        for (int32_t o : offsets)
+        {
+            for (uint16_t b : bins)
+            {
+                GPX2_CHECK(gpx2_hist_setup(&hist, o, w, b));
+                int64_t span = (int64_t)w * b;
+                for (int32_t &v : values)
+                {
+                    s ^= s << 13;
+                    s ^= s >> 7;
+                    s ^= s << 17;
+                    // mostly around the range, edges included
+                    int64_t x = (int64_t)o - span / 8 + (int64_t)(s % (uint64_t)(span + span / 4 + 2));
+                    if ((s >> 60) == 0)
+                        x = (int64_t)o + (int64_t)((s >> 20) % b) * w - ((s >> 40) & 1);
+                    v = (int32_t)(x < INT32_MIN ? INT32_MIN : x > INT32_MAX ? INT32_MAX : x);
+                    gpx2_hist_add(&hist, v);
+                }
+                check_against_ref(values);
+            }
+        }
+    }
+}
+
+// STOP codes of a simulated chip run 0..REFCLK_DIVISIONS-1 (1 ps each at the
+// CONFIG defaults) and land in bins like the reference says
+void chip_stops()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 1, 0x05));
+    gpx2_dev_t *devs[1] = {&d};
+    std::vector<int32_t> stops;
+    gpx2_result_t res[GPX2_BURST_MAX];
+    while (stops.size() < 6000)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        int n = gpx2_dev_read_parallel(devs, 1, res);
+        for (int i = 0; i < n; i++)
+        {
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (res[i].mask & (1 << ch))
+                    stops.push_back((int32_t)res[i].stop[ch]);
+            }
+        }
+    }
+    GPX2_CHECK(stops.size() >= 6000);
+
+    // 200 bins of 1000 ps cover the REFCLK period exactly
+    GPX2_CHECK(gpx2_hist_setup(&hist, 0, 1000, 200));
+    for (int32_t v : stops)
+        gpx2_hist_add(&hist, v);
+    check_against_ref(stops);
+    GPX2_CHECK_EQ(hist.entries, stops.size());
+    // pulses are random against REFCLK: every bin sees some, none most
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for (uint16_t i = 0; i < hist.bins; i++)
+    {
+        lo = hist.count[i] < lo ? hist.count[i] : lo;
+        hi = hist.count[i] > hi ? hist.count[i] : hi;
+    }
+    GPX2_CHECK(lo > 0);
+    GPX2_CHECK(hi < 4 * stops.size() / hist.bins);
+
+    // a window in the middle with a width that is no power of two
+    GPX2_CHECK(gpx2_hist_setup(&hist, 50000, 1250, 64));
+    for (int32_t v : stops)
+        gpx2_hist_add(&hist, v);
+    check_against_ref(stops);
+    GPX2_CHECK(hist.underflow > 0);
+    GPX2_CHECK(hist.overflow > 0);
+}
+
+} // namespace
+
+int main()
+{
+    setup();
+    edges();
+    random_widths();
+    gpx2::test::sim_start(5000);
+    chip_stops();
+    return gpx2::test::finish("gpx2_hist_test");
+}
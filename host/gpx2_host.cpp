@@ -0,0 +1,382 @@
+// Capture the designlab firmware output into a column file and analyze it.
+//
+//   gpx2_host capture <tty|file|-> out.gpxc [--baud n] [--seconds s] [--events n]
+//                     [--refclk-ps ps] [--divisions n]
+//   gpx2_host analyze in.gpxc [--threads n] [--pair a,b]... [--window ps]
+//                     [--stop-hist low,width,bins] [--dt-hist low,width,bins]
+//                     [--hist hist.csv]
+//
+// capture reads a serial port (set to raw mode), a file or stdin on its own
+// I/O thread, which hands chunks to the parser thread through a bounded
+// queue, so a slow disk or a burst of parsing never leaves the port unread.
+// Text result lines (CHn: REF=... STOP=..., CHn: T=... ps) and binary frames
+// of output modes 1 and 4 are understood, see gpx2_parse.h, and go into the
+// memory mapped column file of gpx2_colfile.h. It stops at the end of the
+// input, after --seconds or --events, or on Ctrl-C. --refclk-ps and
+// --divisions turn REF/STOP into t_ps and must match menu 8 (both default to
+// 200000, STOP in ps).
+//
+// analyze builds per channel STOP histograms and statistics and dT
+// histograms of the --pair channels (1..16, dT = t_b - t_a) on a thread pool,
+// prints a summary and writes the histograms as CSV like gpx2_decode.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "gpx2_analysis.h"
+#include "gpx2_colfile.h"
+#include "gpx2_parse.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t CHUNK = 1 << 16;
+constexpr size_t QUEUE_CHUNKS = 256; // 16 MB between the port and the parser
+
+std::atomic<bool> interrupted{false};
+
+void on_sigint(int)
+{
+    interrupted = true;
+}
+
+// chunks from the I/O thread to the parser, a closed queue drains and ends
+class ChunkQueue
+{
+public:
+    // false when the consumer is gone
+    bool push(std::vector<uint8_t> &&chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (chunks_.size() >= QUEUE_CHUNKS)
+            stalls_++;
+        not_full_.wait(lock, [this] { return chunks_.size() < QUEUE_CHUNKS || done_; });
+        if (done_)
+            return false;
+        chunks_.push_back(std::move(chunk));
+        high_ = std::max(high_, chunks_.size());
+        not_empty_.notify_one();
+        return true;
+    }
+    // false once closed and empty
+    bool pop(std::vector<uint8_t> &chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !chunks_.empty() || closed_; });
+        if (chunks_.empty())
+            return false;
+        chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+    // producer: no more chunks
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+    // consumer: stop taking chunks
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        not_full_.notify_all();
+    }
+    size_t high() const { return high_; }
+    uint64_t stalls() const { return stalls_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+    std::deque<std::vector<uint8_t>> chunks_;
+    bool closed_ = false, done_ = false;
+    size_t high_ = 0;
+    uint64_t stalls_ = 0;
+};
+
+speed_t baud_constant(long baud)
+{
+    switch (baud)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B115200;
+    }
+}
+
+// raw 8N1 without flow control; the Pico's USB CDC ignores the rate
+bool setup_tty(int fd, long baud)
+{
+    termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+        return false;
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_constant(baud));
+    cfsetospeed(&tio, baud_constant(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+// I/O thread: read until end of input, deadline or interrupt
+void read_loop(int fd, ChunkQueue &q, Clock::time_point deadline, std::atomic<bool> &stop)
+{
+    while (!stop && !interrupted && Clock::now() < deadline)
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        int r = poll(&pfd, 1, 100);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+        {
+            if (r < 0)
+                break;
+            continue;
+        }
+        std::vector<uint8_t> chunk(CHUNK);
+        ssize_t n = read(fd, chunk.data(), chunk.size());
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            break;
+        chunk.resize((size_t)n);
+        if (!q.push(std::move(chunk)))
+            break;
+    }
+    q.close();
+}
+
+struct Options
+{
+    std::vector<std::string> args;
+    long baud = 115200;
+    double seconds = 0;
+    uint64_t max_events = 0;
+    uint64_t refclk_ps = 200000;
+    uint32_t divisions = 200000;
+    unsigned threads = 0;
+    const char *hist = nullptr;
+    gpx2::AnalysisConfig analysis;
+};
+
+bool parse_spec(const char *s, gpx2::HistSpec &spec)
+{
+    long long low;
+    unsigned long long width;
+    unsigned bins;
+    if (std::sscanf(s, "%lld,%llu,%u", &low, &width, &bins) != 3 || width == 0 || bins == 0)
+        return false;
+    spec = gpx2::HistSpec{low, width, bins};
+    return true;
+}
+
+bool parse_options(int argc, char **argv, Options &o)
+{
+    for (int i = 2; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a.rfind("--", 0) != 0)
+        {
+            o.args.push_back(a);
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *v = argv[++i];
+        if (a == "--baud")
+            o.baud = std::atol(v);
+        else if (a == "--seconds")
+            o.seconds = std::atof(v);
+        else if (a == "--events")
+            o.max_events = std::strtoull(v, nullptr, 0);
+        else if (a == "--refclk-ps")
+            o.refclk_ps = std::strtoull(v, nullptr, 0);
+        else if (a == "--divisions")
+            o.divisions = (uint32_t)std::strtoul(v, nullptr, 0);
+        else if (a == "--threads")
+            o.threads = (unsigned)std::atoi(v);
+        else if (a == "--window")
+            o.analysis.window_ps = std::atoll(v);
+        else if (a == "--hist")
+            o.hist = v;
+        else if (a == "--stop-hist")
+        {
+            if (!parse_spec(v, o.analysis.stop))
+                return false;
+        }
+        else if (a == "--dt-hist")
+        {
+            if (!parse_spec(v, o.analysis.dt))
+                return false;
+        }
+        else if (a == "--pair")
+        {
+            int x, y;
+            if (std::sscanf(v, "%d,%d", &x, &y) != 2 || x < 1 || y < 1 || x > gpx2::CHANNELS ||
+                y > gpx2::CHANNELS || x == y)
+                return false;
+            o.analysis.pairs.emplace_back(x - 1, y - 1);
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+int capture(const Options &o)
+{
+    if (o.args.size() != 2)
+        return -1;
+    const std::string &src = o.args[0];
+    int fd = src == "-" ? STDIN_FILENO : open(src.c_str(), O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+        std::cerr << "cannot open " << src << ": " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    if (isatty(fd) && !setup_tty(fd, o.baud))
+    {
+        std::cerr << "cannot set up " << src << ": " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    gpx2::ColumnWriter writer;
+    if (!writer.open(o.args[1], o.refclk_ps, o.divisions))
+    {
+        std::cerr << "cannot create " << o.args[1] << ": " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    std::signal(SIGINT, on_sigint);
+
+    auto t0 = Clock::now();
+    auto deadline = o.seconds > 0 ? t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.seconds))
+                                  : Clock::time_point::max();
+    ChunkQueue queue;
+    std::atomic<bool> stop{false};
+    std::thread io(read_loop, fd, std::ref(queue), deadline, std::ref(stop));
+
+    gpx2::StreamParser parser(o.refclk_ps, o.divisions);
+    std::vector<gpx2::Event> events;
+    std::vector<uint8_t> chunk;
+    bool full = false;
+    auto report = t0 + std::chrono::seconds(1);
+    uint64_t limit = o.max_events ? o.max_events : UINT64_MAX;
+    auto store = [&] {
+        for (const auto &e : events)
+        {
+            if (writer.events() >= limit)
+                break;
+            if (!writer.append(e))
+            {
+                full = true;
+                break;
+            }
+        }
+        events.clear();
+    };
+    while (!full && writer.events() < limit && queue.pop(chunk))
+    {
+        parser.feed(chunk.data(), chunk.size(), events);
+        store();
+        if (Clock::now() >= report)
+        {
+            double s = std::chrono::duration<double>(Clock::now() - t0).count();
+            std::cerr << "\r" << writer.events() << " events, " << (uint64_t)(writer.events() / s) << "/s   "
+                      << std::flush;
+            report += std::chrono::seconds(1);
+        }
+    }
+    stop = true;
+    queue.cancel();
+    io.join();
+    parser.finish(events);
+    store();
+    if (fd != STDIN_FILENO)
+        close(fd);
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    bool ok = writer.close() && !full;
+
+    const gpx2::ParseStats &st = parser.stats();
+    std::cerr << "\r" << writer.events() << " events in " << s << " s, " << st.bytes << " bytes ("
+              << st.bytes / s * 1e-6 << " MB/s)\n"
+              << "lines=" << st.lines << " text_events=" << st.text_events << " frames=" << st.frames
+              << " frame_events=" << st.frame_events << " crc_errors=" << st.crc_errors
+              << " lost_frames=" << st.lost_frames << " packed_skipped=" << st.packed_skipped
+              << " other_frames=" << st.other_frames << "\n"
+              << "queue high=" << queue.high() << "/" << QUEUE_CHUNKS << " chunks, stalls=" << queue.stalls()
+              << "\n";
+    if (!ok)
+        std::cerr << "writing " << o.args[1] << " failed: " << std::strerror(errno) << "\n";
+    return ok ? 0 : 1;
+}
+
+int analyze(const Options &o)
+{
+    if (o.args.size() != 1)
+        return -1;
+    gpx2::ColumnReader file;
+    std::string error;
+    if (!file.open(o.args[0], error))
+    {
+        std::cerr << o.args[0] << ": " << error << "\n";
+        return 2;
+    }
+    gpx2::ThreadPool pool(o.threads);
+    auto t0 = Clock::now();
+    gpx2::AnalysisResult r = gpx2::analyze(file, o.analysis, pool);
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    gpx2::print_summary(stdout, r, o.analysis);
+    std::fprintf(stderr, "%u threads, %.3f s, %.1f Mev/s\n", pool.size(), s, r.events / s * 1e-6);
+    if (o.hist && !gpx2::write_hist_csv(o.hist, r))
+    {
+        std::cerr << "cannot write " << o.hist << "\n";
+        return 2;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    int rc = -1; // usage
+    if (argc >= 2 && parse_options(argc, argv, o))
+    {
+        if (std::strcmp(argv[1], "capture") == 0)
+            rc = capture(o);
+        else if (std::strcmp(argv[1], "analyze") == 0)
+            rc = analyze(o);
+    }
+    if (rc >= 0)
+        return rc;
+    std::cerr << "usage: " << argv[0] << " capture <tty|file|-> out.gpxc [options]\n"
+              << "       " << argv[0] << " analyze in.gpxc [options]\n";
+    return 2;
+}
@@ -0,0 +1,250 @@
+// Throughput of the gpx2_host pipeline on generated data: parsing text
+// result lines, raw event frames (mode 1) and packed frames (mode 4),
+// appending to the column file and histogramming it with 1, 2, 4, ... threads.
+//
+//   gpx2_host_bench [events] [file.gpxc]
+//
+// Events are 4 channels of one poisson pulse source at 200k pulses/s, 1 ns
+// apart with a little jitter, like gpx2_pack_bench. The column file goes to
+// /tmp/gpx2_host_bench.gpxc unless given and is removed afterwards. Exit code
+// is 1 when a parser does not return the generated events or the histograms
+// differ between thread counts.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gpx2_analysis.h"
+#include "gpx2_colfile.h"
+#include "gpx2_parse.h"
+
+extern "C" {
+#include "gpx2_pack.h"
+#include "gpx2_stream.h"
+}
+
+namespace {
+
+constexpr uint64_t REFCLK_PS = 200000; // 5 MHz REFCLK, STOP in ps (REFCLK_DIVISIONS 200000)
+constexpr size_t CHUNK = 1 << 16;      // like a serial read in gpx2_host
+
+uint64_t xorshift(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1DULL;
+}
+
+std::vector<gpx2_result_t> make_frames(size_t events)
+{
+    std::vector<gpx2_result_t> frames;
+    frames.reserve(events / GPX2_CHANNELS + 1);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    uint64_t t_ps = 0;
+    for (size_t n = 0; n < events; n += GPX2_CHANNELS)
+    {
+        double u = ((xorshift(rng) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+        t_ps += (uint64_t)(-std::log(u) / 2e5 * 1e12);
+        gpx2_result_t f{};
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            uint64_t t = t_ps + 1000u * ch + (xorshift(rng) >> 58);
+            f.ref[ch] = (uint32_t)(t / REFCLK_PS) & 0xFFFFFF;
+            f.stop[ch] = (uint32_t)(t % REFCLK_PS);
+            f.mask |= 1 << ch;
+        }
+        frames.push_back(f);
+    }
+    return frames;
+}
+
+// designlab.c gpx2_print_results()
+std::vector<uint8_t> encode_text(const std::vector<gpx2_result_t> &frames)
+{
+    std::vector<uint8_t> out;
+    char line[64];
+    for (const auto &res : frames)
+    {
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            int n = std::snprintf(line, sizeof line, "CH%d: REF=%lu   STOP=%lu\n", ch + 1,
+                                  (unsigned long)res.ref[ch], (unsigned long)res.stop[ch]);
+            out.insert(out.end(), line, line + n);
+        }
+    }
+    return out;
+}
+
+// designlab.c gpx2_stream_results() / gpx2_stream_packed()
+std::vector<uint8_t> encode_frames(const std::vector<gpx2_result_t> &frames, bool packed)
+{
+    static gpx2_stream_t s;
+    gpx2_pack_t pack;
+    std::vector<uint8_t> out;
+    gpx2_stream_init(&s);
+    gpx2_pack_init(&pack);
+    auto add = [&](const gpx2_result_t &res) {
+        if (packed)
+            return gpx2_pack_add(&pack, &s, &res);
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            if (!gpx2_stream_add_event(&s, (uint8_t)ch, res.ref[ch], res.stop[ch]))
+                return false;
+        return true;
+    };
+    for (const auto &res : frames)
+    {
+        // whole result frames only, so a retry never repeats a channel
+        if (!packed && GPX2_FRAME_MAX_PAYLOAD - s.len < GPX2_CHANNELS * GPX2_EVENT_RECORD)
+        {
+            size_t size = gpx2_stream_finish(&s);
+            out.insert(out.end(), s.buf, s.buf + size);
+        }
+        if (!add(res))
+        {
+            size_t size = gpx2_stream_finish(&s);
+            out.insert(out.end(), s.buf, s.buf + size);
+            add(res);
+        }
+    }
+    size_t size = gpx2_stream_finish(&s);
+    out.insert(out.end(), s.buf, s.buf + size);
+    return out;
+}
+
+uint64_t mix(uint64_t h, const gpx2::Event &e)
+{
+    h = (h ^ (e.channel | (uint64_t)e.ref << 8 | (uint64_t)e.stop << 32)) * 0x100000001B3ULL;
+    return (h ^ (uint64_t)e.t_ps) * 0x100000001B3ULL;
+}
+
+template <typename F>
+double seconds(F &&f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// parse buf in serial sized chunks, events collected in out
+double parse(const std::vector<uint8_t> &buf, std::vector<gpx2::Event> &out)
+{
+    out.clear();
+    return seconds([&] {
+        gpx2::StreamParser p(REFCLK_PS, (uint32_t)REFCLK_PS);
+        for (size_t pos = 0; pos < buf.size(); pos += CHUNK)
+            p.feed(buf.data() + pos, std::min(CHUNK, buf.size() - pos), out);
+        p.finish(out);
+    });
+}
+
+bool same_hist(const gpx2::AnalysisResult &a, const gpx2::AnalysisResult &b)
+{
+    if (a.events != b.events)
+        return false;
+    for (int g = 0; g < gpx2::CHANNELS; g++)
+        if (a.stop_hist[g].count != b.stop_hist[g].count || a.stop[g].n != b.stop[g].n)
+            return false;
+    for (size_t p = 0; p < a.dt_hist.size(); p++)
+        if (a.dt_hist[p].count != b.dt_hist[p].count || a.dt[p].n != b.dt[p].n)
+            return false;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t n = 20000000;
+    std::string path = "/tmp/gpx2_host_bench.gpxc";
+    for (int i = 1; i < argc; i++)
+    {
+        char *end;
+        size_t v = std::strtoul(argv[i], &end, 0);
+        if (*end == '\0')
+            n = v;
+        else
+            path = argv[i];
+    }
+
+    auto frames = make_frames(n);
+    n = frames.size() * GPX2_CHANNELS;
+    bool ok = true;
+
+    // the text parser is the reference, the binary ones must agree with it
+    std::vector<gpx2::Event> events, check;
+    uint64_t ref_hash = 0;
+    const char *names[] = {"text lines", "raw frames", "packed frames"};
+    for (int kind = 0; kind < 3; kind++)
+    {
+        std::vector<uint8_t> buf = kind == 0 ? encode_text(frames) : encode_frames(frames, kind == 2);
+        std::vector<gpx2::Event> &out = kind == 0 ? events : check;
+        out.reserve(n);
+        double s = parse(buf, out);
+        uint64_t h = 0;
+        for (const auto &e : out)
+            h = mix(h, e);
+        if (kind == 0)
+            ref_hash = h;
+        bool good = out.size() == n && h == ref_hash;
+        ok &= good;
+        std::printf("parse %-14s %10zu events %7.1f MB  %7.1f MB/s  %6.1f Mev/s%s\n", names[kind], out.size(),
+                    buf.size() * 1e-6, buf.size() / s * 1e-6, out.size() / s * 1e-6,
+                    good ? "" : "  MISMATCH");
+    }
+    check = std::vector<gpx2::Event>();
+
+    gpx2::ColumnWriter writer;
+    if (!writer.open(path, REFCLK_PS, (uint32_t)REFCLK_PS))
+    {
+        std::perror(path.c_str());
+        return 2;
+    }
+    double s = seconds([&] {
+        for (const auto &e : events)
+            writer.append(e);
+        writer.close();
+    });
+    std::printf("append %23zu events %7.1f MB  %7.1f MB/s  %6.1f Mev/s\n", n,
+                n * 17e-6, n * 17 / s * 1e-6, n / s * 1e-6);
+    events = std::vector<gpx2::Event>();
+
+    gpx2::ColumnReader file;
+    std::string error;
+    if (!file.open(path, error))
+    {
+        std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+        return 2;
+    }
+    gpx2::AnalysisConfig cfg;
+    cfg.pairs = {{0, 1}, {0, 2}, {0, 3}};
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < hw; t *= 2)
+        counts.push_back(t);
+    counts.push_back(hw);
+    gpx2::AnalysisResult first(cfg);
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        gpx2::ThreadPool pool(counts[i]);
+        gpx2::AnalysisResult r(cfg);
+        double t = seconds([&] { r = gpx2::analyze(file, cfg, pool); });
+        bool good = r.events == n && (i == 0 || same_hist(r, first));
+        ok &= good;
+        std::printf("histogram %2u threads %14llu events %7.3f s   %6.1f Mev/s  dT P1 n=%llu sigma=%.2f ps%s\n",
+                    counts[i], (unsigned long long)r.events, t, r.events / t * 1e-6,
+                    (unsigned long long)r.dt[0].n, r.dt[0].sigma(), good ? "" : "  MISMATCH");
+        if (i == 0)
+            first = std::move(r);
+    }
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
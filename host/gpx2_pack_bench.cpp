@@ -0,0 +1,294 @@
+// Compare the packed event frames of output mode 4 (gpx2_pack.c) against the
+// plain 7 byte records of output mode 1: bytes on the wire and events per
+// second for encoding and decoding, with a round trip check.
+//
+//   gpx2_pack_bench [capture.bin] [frames]
+//
+// Synthetic captures are 4 channels of one pulse source at a few rates, all
+// channels hit and with channels missing at random. capture.bin is a raw
+// format mode 1 capture (e.g. from designlab_sim), its events are grouped back
+// into result frames and encoded again both ways. Exit code is 1 when a round
+// trip does not reproduce the events.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "gpx2_pack.h"
+#include "gpx2_stream.h"
+}
+
+namespace {
+
+constexpr uint64_t REFCLK_PS = 200000; // 5 MHz REFCLK, STOP in ps (REFCLK_DIVISIONS 200000)
+
+uint64_t xorshift(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1DULL;
+}
+
+// poisson pulses seen by 4 channels 1 ns apart with a little jitter, like
+// gpx2_sim.c; keep is the chance of a channel recording the pulse
+std::vector<gpx2_result_t> make_frames(size_t n, double rate_hz, double keep)
+{
+    std::vector<gpx2_result_t> frames;
+    frames.reserve(n);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    uint64_t t_ps = 0;
+    while (frames.size() < n)
+    {
+        double u = ((xorshift(rng) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+        t_ps += (uint64_t)(-std::log(u) / rate_hz * 1e12);
+        gpx2_result_t f{};
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if ((xorshift(rng) >> 11) * (1.0 / 9007199254740992.0) >= keep)
+                continue;
+            uint64_t t = t_ps + 1000u * ch + (xorshift(rng) >> 58);
+            f.ref[ch] = (uint32_t)(t / REFCLK_PS) & 0xFFFFFF;
+            f.stop[ch] = (uint32_t)(t % REFCLK_PS);
+            f.mask |= 1 << ch;
+        }
+        if (f.mask)
+            frames.push_back(f);
+    }
+    return frames;
+}
+
+// events of a mode 1 capture, a new result frame starts when the chip changes
+// or the channel does not count up
+std::vector<gpx2_result_t> load_capture(const char *path)
+{
+    std::vector<gpx2_result_t> frames;
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return frames;
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+    gpx2_result_t cur{};
+    int last = -1;
+    while (pos < buf.size())
+    {
+        gpx2_frame_view_t f;
+        if (gpx2_stream_parse(buf.data() + pos, buf.size() - pos, &f) != GPX2_PARSE_OK)
+        {
+            pos++;
+            continue;
+        }
+        pos += f.size;
+        if (f.type != GPX2_FRAME_EVENTS)
+            continue;
+        for (size_t i = 0; i < f.len / GPX2_EVENT_RECORD; i++)
+        {
+            uint8_t g;
+            uint32_t ref, stop;
+            gpx2_stream_get_event(f.payload, i, &g, &ref, &stop);
+            int dev = g / GPX2_CHANNELS, ch = g % GPX2_CHANNELS;
+            if (cur.mask && (dev != cur.dev || ch <= last))
+            {
+                frames.push_back(cur);
+                cur = gpx2_result_t{};
+            }
+            cur.dev = (uint8_t)dev;
+            cur.ref[ch] = ref;
+            cur.stop[ch] = stop;
+            cur.mask |= 1 << ch;
+            last = ch;
+        }
+    }
+    if (cur.mask)
+        frames.push_back(cur);
+    return frames;
+}
+
+size_t count_events(const std::vector<gpx2_result_t> &frames)
+{
+    size_t n = 0;
+    for (const auto &f : frames)
+        n += __builtin_popcount(f.mask);
+    return n;
+}
+
+// designlab.c gpx2_stream_results() in raw format, frames sent when full
+std::vector<uint8_t> encode_plain(const std::vector<gpx2_result_t> &frames)
+{
+    static gpx2_stream_t s;
+    std::vector<uint8_t> out;
+    gpx2_stream_init(&s);
+    for (const auto &res : frames)
+    {
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if (!(res.mask & (1 << ch)))
+                continue;
+            uint8_t g = (uint8_t)(res.dev * GPX2_CHANNELS + ch);
+            if (!gpx2_stream_add_event(&s, g, res.ref[ch], res.stop[ch]))
+            {
+                size_t size = gpx2_stream_finish(&s);
+                out.insert(out.end(), s.buf, s.buf + size);
+                gpx2_stream_add_event(&s, g, res.ref[ch], res.stop[ch]);
+            }
+        }
+    }
+    size_t size = gpx2_stream_finish(&s);
+    out.insert(out.end(), s.buf, s.buf + size);
+    return out;
+}
+
+// designlab.c gpx2_stream_packed()
+std::vector<uint8_t> encode_packed(const std::vector<gpx2_result_t> &frames)
+{
+    static gpx2_stream_t s;
+    gpx2_pack_t pack;
+    std::vector<uint8_t> out;
+    gpx2_stream_init(&s);
+    gpx2_pack_init(&pack);
+    for (const auto &res : frames)
+    {
+        if (!gpx2_pack_add(&pack, &s, &res))
+        {
+            size_t size = gpx2_stream_finish(&s);
+            out.insert(out.end(), s.buf, s.buf + size);
+            gpx2_pack_add(&pack, &s, &res);
+        }
+    }
+    size_t size = gpx2_stream_finish(&s);
+    out.insert(out.end(), s.buf, s.buf + size);
+    return out;
+}
+
+// checksum over the decoded events so the decoders cannot be optimized away
+uint64_t mix(uint64_t h, uint32_t g, uint32_t ref, uint32_t stop)
+{
+    return (h ^ (g | (uint64_t)ref << 8 | (uint64_t)stop << 32)) * 0x100000001B3ULL;
+}
+
+uint64_t decode_plain(const std::vector<uint8_t> &buf, size_t &events)
+{
+    uint64_t h = 0;
+    size_t pos = 0;
+    events = 0;
+    while (pos < buf.size())
+    {
+        gpx2_frame_view_t f;
+        if (gpx2_stream_parse(buf.data() + pos, buf.size() - pos, &f) != GPX2_PARSE_OK)
+            break;
+        pos += f.size;
+        for (size_t i = 0; i < f.len / GPX2_EVENT_RECORD; i++)
+        {
+            uint8_t g;
+            uint32_t ref, stop;
+            gpx2_stream_get_event(f.payload, i, &g, &ref, &stop);
+            h = mix(h, g, ref, stop);
+            events++;
+        }
+    }
+    return h;
+}
+
+uint64_t decode_packed(const std::vector<uint8_t> &buf, size_t &events)
+{
+    uint64_t h = 0;
+    size_t pos = 0;
+    gpx2_unpack_t u;
+    gpx2_unpack_init(&u);
+    events = 0;
+    while (pos < buf.size())
+    {
+        gpx2_frame_view_t f;
+        if (gpx2_stream_parse(buf.data() + pos, buf.size() - pos, &f) != GPX2_PARSE_OK)
+            break;
+        pos += f.size;
+        if (!gpx2_unpack_frame(&u, &f))
+            continue;
+        size_t rec = 0;
+        gpx2_result_t res;
+        while (gpx2_unpack_next(&u, &f, &rec, &res))
+        {
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res.mask & (1 << ch)))
+                    continue;
+                h = mix(h, res.dev * GPX2_CHANNELS + ch, res.ref[ch], res.stop[ch]);
+                events++;
+            }
+        }
+    }
+    return h;
+}
+
+template <typename F>
+double seconds(F &&f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool run(const std::string &name, const std::vector<gpx2_result_t> &frames)
+{
+    size_t events = count_events(frames);
+    std::vector<uint8_t> plain, packed;
+    size_t n_plain = 0, n_packed = 0;
+    uint64_t h_plain = 0, h_packed = 0;
+    double te_plain = seconds([&] { plain = encode_plain(frames); });
+    double te_packed = seconds([&] { packed = encode_packed(frames); });
+    double td_plain = seconds([&] { h_plain = decode_plain(plain, n_plain); });
+    double td_packed = seconds([&] { h_packed = decode_packed(packed, n_packed); });
+    bool ok = n_plain == events && n_packed == events && h_plain == h_packed;
+
+    std::printf("%-24s %9zu events  plain %9zu B (%.2f B/ev)  packed %9zu B (%.2f B/ev)  ratio %.2f\n",
+                name.c_str(), events, plain.size(), (double)plain.size() / events, packed.size(),
+                (double)packed.size() / events, (double)plain.size() / packed.size());
+    std::printf("%-24s encode %.1f / %.1f Mev/s  decode %.1f / %.1f Mev/s (plain / packed)%s\n", "",
+                events / te_plain * 1e-6, events / te_packed * 1e-6, events / td_plain * 1e-6,
+                events / td_packed * 1e-6, ok ? "" : "  ROUND TRIP FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *capture = nullptr;
+    size_t n = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        char *end;
+        size_t v = std::strtoul(argv[i], &end, 0);
+        if (*end == '\0')
+            n = v;
+        else
+            capture = argv[i];
+    }
+
+    bool ok = true;
+    for (double rate : {1e3, 2e4, 2e5})
+    {
+        std::string name = "synthetic " + std::to_string((int)(rate / 1000)) + "k/s";
+        ok &= run(name, make_frames(n, rate, 1.0));
+        ok &= run(name + " 50%", make_frames(n, rate, 0.5));
+    }
+    if (capture)
+    {
+        auto frames = load_capture(capture);
+        if (frames.empty())
+        {
+            std::cerr << "no events in " << capture << "\n";
+            return 2;
+        }
+        ok &= run(capture, frames);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "gpx2_parse.h"
+
+#include <cstring>
+
+namespace gpx2 {
+
+namespace {
+
+constexpr size_t LINE_MAX = 4096; // longer runs without newline are dropped
+
+// unsigned decimal at *p, false when there is no digit
+inline bool get_uint(const char *&p, const char *end, uint64_t &v)
+{
+    const char *start = p;
+    v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (uint64_t)(*p++ - '0');
+    return p != start;
+}
+
+inline bool get_text(const char *&p, const char *end, const char *s)
+{
+    size_t n = std::strlen(s);
+    if ((size_t)(end - p) < n || std::memcmp(p, s, n) != 0)
+        return false;
+    p += n;
+    return true;
+}
+
+} // namespace
+
+StreamParser::StreamParser(uint64_t refclk_ps, uint32_t divisions)
+    : refclk_ps_(refclk_ps), divisions_(divisions)
+{
+    gpx2_unpack_init(&unpack_);
+}
+
+void StreamParser::feed(const uint8_t *data, size_t n, std::vector<Event> &out)
+{
+    stats_.bytes += n;
+    pending_.insert(pending_.end(), data, data + n);
+    size_t used = parse(pending_.data(), pending_.size(), false, out);
+    pending_.erase(pending_.begin(), pending_.begin() + used);
+}
+
+void StreamParser::finish(std::vector<Event> &out)
+{
+    parse(pending_.data(), pending_.size(), true, out);
+    pending_.clear();
+}
+
+// returns the bytes consumed, the rest is an incomplete line or frame
+size_t StreamParser::parse(const uint8_t *p, size_t n, bool eof, std::vector<Event> &out)
+{
+    size_t pos = 0;
+    while (pos < n)
+    {
+        if (p[pos] == GPX2_SYNC0)
+        {
+            gpx2_frame_view_t f;
+            gpx2_parse_status_t st = gpx2_stream_parse(p + pos, n - pos, &f);
+            if (st == GPX2_PARSE_OK)
+            {
+                frame(f, out);
+                pos += f.size;
+                continue;
+            }
+            if (st == GPX2_PARSE_NEED_MORE && !eof)
+                return pos;
+            if (st == GPX2_PARSE_BAD_CRC)
+                stats_.crc_errors++;
+            pos++;
+            continue;
+        }
+        // text up to the newline, or up to what may be the next frame
+        const uint8_t *start = p + pos;
+        size_t left = n - pos;
+        const uint8_t *nl = (const uint8_t *)std::memchr(start, '\n', left);
+        const uint8_t *sync = (const uint8_t *)std::memchr(start, GPX2_SYNC0, nl ? (size_t)(nl - start) : left);
+        const uint8_t *end = sync ? sync : nl;
+        if (!end)
+        {
+            if (!eof && left < LINE_MAX)
+                return pos;
+            end = p + n;
+        }
+        line((const char *)start, (const char *)end, out);
+        pos = (size_t)(end - p) + (end == nl ? 1 : 0);
+    }
+    return pos;
+}
+
+void StreamParser::line(const char *p, const char *end, std::vector<Event> &out)
+{
+    stats_.lines++;
+    if (end > p && end[-1] == '\r')
+        end--;
+    uint64_t v;
+    // several chips: "D<d> " ahead of the channel, which already counts on
+    if (p < end && *p == 'D')
+    {
+        p++;
+        if (!get_uint(p, end, v) || !get_text(p, end, " "))
+            return;
+    }
+    uint64_t n;
+    if (!get_text(p, end, "CH") || !get_uint(p, end, n) || !get_text(p, end, ": "))
+        return;
+    if (n < 1 || n > GPX2_PACK_CHANNELS)
+        return;
+    uint8_t g = (uint8_t)(n - 1);
+    if (get_text(p, end, "T="))
+    {
+        if (!get_uint(p, end, v) || !get_text(p, end, " ps"))
+            return;
+        out.push_back(Event{g, 0, 0, (int64_t)v});
+        stats_.text_events++;
+        return;
+    }
+    uint64_t ref, stop;
+    if (!get_text(p, end, "REF=") || !get_uint(p, end, ref))
+        return;
+    while (p < end && *p == ' ')
+        p++;
+    if (!get_text(p, end, "STOP=") || !get_uint(p, end, stop))
+        return;
+    raw_event(g, (uint32_t)ref, (uint32_t)stop, out);
+    stats_.text_events++;
+}
+
+void StreamParser::frame(const gpx2_frame_view_t &f, std::vector<Event> &out)
+{
+    if (have_seq_ && f.seq != next_seq_)
+        stats_.lost_frames += (uint32_t)(f.seq - next_seq_);
+    have_seq_ = true;
+    next_seq_ = f.seq + 1;
+    stats_.frames++;
+
+    if (f.type == GPX2_FRAME_EVENTS)
+    {
+        size_t n = f.len / GPX2_EVENT_RECORD;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint8_t g;
+            uint32_t ref, stop;
+            gpx2_stream_get_event(f.payload, i, &g, &ref, &stop);
+            if (g < GPX2_PACK_CHANNELS)
+                raw_event(g, ref, stop, out);
+        }
+        stats_.frame_events += n;
+    }
+    else if (f.type == GPX2_FRAME_TIMES)
+    {
+        size_t n = f.len / GPX2_TIME_RECORD;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint8_t g;
+            uint64_t t_ps;
+            gpx2_stream_get_time(f.payload, i, &g, &t_ps);
+            if (g < GPX2_PACK_CHANNELS)
+                out.push_back(Event{g, 0, 0, (int64_t)t_ps});
+        }
+        stats_.frame_events += n;
+    }
+    else if (f.type != GPX2_FRAME_PACKED && f.type != GPX2_FRAME_PACKED_KEY)
+    {
+        stats_.other_frames++;
+    }
+    // sees every frame to notice gaps
+    if (gpx2_unpack_frame(&unpack_, &f))
+    {
+        size_t pos = 0;
+        gpx2_result_t res;
+        while (gpx2_unpack_next(&unpack_, &f, &pos, &res))
+        {
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res.mask & (1 << ch)))
+                    continue;
+                raw_event((uint8_t)(res.dev * GPX2_CHANNELS + ch), res.ref[ch], res.stop[ch], out);
+                stats_.frame_events++;
+            }
+        }
+    }
+    stats_.packed_skipped = unpack_.skipped;
+}
+
+void StreamParser::raw_event(uint8_t g, uint32_t ref, uint32_t stop, std::vector<Event> &out)
+{
+    int dev = g / GPX2_CHANNELS;
+    if (have_ref_[dev] && ref + 0x800000 < last_ref_[dev])
+        wraps_[dev]++;
+    have_ref_[dev] = true;
+    last_ref_[dev] = ref;
+    uint64_t cycles = (wraps_[dev] << 24) + ref;
+    uint64_t frac = divisions_ ? (uint64_t)stop * refclk_ps_ / divisions_ : stop;
+    out.push_back(Event{g, ref, stop, (int64_t)(cycles * refclk_ps_ + frac)});
+}
+
+} // namespace gpx2
@@ -0,0 +1,78 @@
+#ifndef GPX2_PARSE_H
+#define GPX2_PARSE_H
+
+// incremental parser for everything the designlab firmware sends: console
+// text with the result lines of the text output modes
+//
+//   [D<d> ]CH<n>: REF=<ref>   STOP=<stop>
+//   [D<d> ]CH<n>: T=<t> ps
+//
+// (n is the global channel dev * 4 + ch + 1) and binary frames of output modes
+// 1 and 4 (gpx2_stream.h): raw events, packed events and ps timestamps. Other
+// text lines and frames (menus, histogram dumps, statistics, dT records) are
+// counted and skipped. The input may be cut anywhere, feed() keeps an
+// incomplete line or frame for the next call.
+//
+// Raw events get t_ps = REF * refclk_ps + STOP * refclk_ps / divisions, with
+// REF unwrapped past its 24 bit range per chip. A REF that goes back by more
+// than half the range counts as a wrap; a REF reset (OPC_INIT) looks like one
+// too, so t_ps only stays monotonic within a run.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gpx2_colfile.h"
+
+extern "C" {
+#include "gpx2_pack.h"
+}
+
+namespace gpx2 {
+
+struct ParseStats
+{
+    uint64_t bytes = 0;
+    uint64_t lines = 0;        // text lines seen
+    uint64_t text_events = 0;  // events from result lines
+    uint64_t frames = 0;       // valid binary frames
+    uint64_t frame_events = 0; // events from event, packed and time frames
+    uint64_t crc_errors = 0;
+    uint64_t lost_frames = 0;
+    uint64_t packed_skipped = 0; // packed frames dropped waiting for a keyframe
+    uint64_t other_frames = 0;   // histogram, statistics, dT, capture frames
+};
+
+class StreamParser
+{
+public:
+    StreamParser(uint64_t refclk_ps, uint32_t divisions);
+
+    // parse n more bytes, events found are appended to out
+    void feed(const uint8_t *data, size_t n, std::vector<Event> &out);
+    // end of input: a last line without newline still counts
+    void finish(std::vector<Event> &out);
+    const ParseStats &stats() const { return stats_; }
+
+private:
+    size_t parse(const uint8_t *p, size_t n, bool eof, std::vector<Event> &out);
+    void frame(const gpx2_frame_view_t &f, std::vector<Event> &out);
+    void line(const char *p, const char *end, std::vector<Event> &out);
+    void raw_event(uint8_t g, uint32_t ref, uint32_t stop, std::vector<Event> &out);
+
+    uint64_t refclk_ps_;
+    uint32_t divisions_;
+    std::vector<uint8_t> pending_;
+    ParseStats stats_;
+    bool have_seq_ = false;
+    uint32_t next_seq_ = 0;
+    gpx2_unpack_t unpack_;
+    // REF unwrap per chip
+    uint32_t last_ref_[GPX2_PACK_CHANNELS / GPX2_CHANNELS] = {};
+    uint64_t wraps_[GPX2_PACK_CHANNELS / GPX2_CHANNELS] = {};
+    bool have_ref_[GPX2_PACK_CHANNELS / GPX2_CHANNELS] = {};
+};
+
+} // namespace gpx2
+
+#endif
@@ -0,0 +1,287 @@
+// Result readout cost per channel mask: whole 24 byte frames against the slot
+// range gpx2_dev_readout_setup() plans, both through gpx2_dev.c on the
+// behavioral chip model (gpx2_sim.c).
+//
+//   gpx2_readout_bench [pulses] [spi_hz] [rate_hz]
+//
+// For every mask 1..15 and for single frames and GPX2_BURST_MAX frame bursts
+// the chip sees pulses pulses (default 50000) at rate_hz (default 5000/s),
+// read at spi_hz (default 4 MHz as in designlab.c). Reported per event (hit
+// read): SPI bytes, CS transactions and bus microseconds with the bus model
+// of gpx2_hal_sim.c (0.2 us per CS low period, 0.5 us per SPI call, 8 bits
+// per byte at spi_hz), and the CPU nanoseconds of the decode per frame on
+// this host. Exit code is 1 when the planned readout stores other events than
+// the whole frame one.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include "gpx2_dev.h"
+#include "gpx2_results.h"
+#include "gpx2_sim.h"
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint8_t PIN_CS = 17;
+constexpr uint8_t PIN_INT = 20;
+constexpr uint64_t CS_OVERHEAD_PS = 200000;       // as SIM_CS_OVERHEAD_PS
+constexpr uint64_t SPI_CALL_OVERHEAD_PS = 500000; // as SIM_SPI_CALL_OVERHEAD_PS
+
+// designlab.c defaults, the channel mask goes into PIN_ENA and HIT_ENA
+constexpr uint8_t CONFIG[GPX2_CONFIG_BYTES] = {0x31, 0x01, 0x1F, 0x40, 0x0D, 0x03, 0xC0, 0x53, 0xA1,
+                                               0x13, 0x00, 0x0A, 0xCC, 0xCC, 0x31, 0x8E, 0x04};
+
+// the one chip behind the HAL below, time only passes on the bus and while
+// waiting for the next hit
+gpx2_sim_t chip;
+uint64_t now_ps;
+uint32_t spi_hz;
+
+} // namespace
+
+extern "C" {
+
+void hal_gpio_output(uint8_t pin, bool level)
+{
+    hal_gpio_put(pin, level);
+}
+
+void hal_gpio_input(uint8_t pin)
+{
+    (void)pin;
+}
+
+void hal_gpio_put(uint8_t pin, bool level)
+{
+    if (pin != PIN_CS)
+        return;
+    gpx2_sim_advance(&chip, now_ps);
+    if (!level)
+        now_ps += CS_OVERHEAD_PS;
+    gpx2_sim_cs(&chip, level);
+}
+
+bool hal_gpio_get(uint8_t pin)
+{
+    if (pin != PIN_INT)
+        return true;
+    gpx2_sim_advance(&chip, now_ps);
+    return gpx2_sim_int(&chip);
+}
+
+void hal_spi_transfer_start(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    (void)bus;
+    gpx2_sim_advance(&chip, now_ps);
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t in = gpx2_sim_xfer(&chip, tx ? tx[i] : 0x00);
+        if (rx)
+            rx[i] = in;
+    }
+    now_ps += SPI_CALL_OVERHEAD_PS + (uint64_t)len * 8 * 1000000000000ULL / spi_hz;
+}
+
+void hal_spi_transfer_wait(uint8_t bus)
+{
+    (void)bus;
+}
+
+void hal_spi_transfer(uint8_t bus, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    hal_spi_transfer_start(bus, tx, rx, len);
+}
+
+void hal_spi_write(uint8_t bus, const uint8_t *src, size_t len)
+{
+    hal_spi_transfer_start(bus, src, nullptr, len);
+}
+
+} // extern "C"
+
+namespace {
+
+struct Run
+{
+    uint64_t events = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t transactions = 0;
+    uint64_t bus_ps = 0;
+    uint64_t lost = 0;
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a over the stored hits
+    double decode_ns = 0;                   // per frame
+    uint8_t first = 0, count = 0;
+};
+
+void hash_u32(uint64_t &h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++, v >>= 8)
+    {
+        h ^= v & 0xFF;
+        h *= 1099511628211ULL;
+    }
+}
+
+// CPU time of d->decode on frames of read_bytes random bytes; the call goes
+// through the function pointer into gpx2_dev.c, so it is not optimized away
+double decode_ns(const gpx2_dev_t &d)
+{
+    constexpr size_t FRAMES = 4096, ROUNDS = 256;
+    std::vector<uint8_t> raw(FRAMES * GPX2_FRAME_BYTES);
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    for (auto &b : raw)
+    {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        b = (uint8_t)s;
+    }
+    gpx2_result_t res;
+    auto t0 = Clock::now();
+    for (size_t r = 0; r < ROUNDS; r++)
+    {
+        for (size_t f = 0; f < FRAMES; f++)
+            d.decode(&raw[f * GPX2_FRAME_BYTES], &res);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    return ns / (FRAMES * ROUNDS);
+}
+
+Run run(uint8_t mask, uint8_t burst, bool planned, uint64_t pulses, double rate_hz)
+{
+    gpx2_sim_params_t p = {};
+    p.rate_hz = rate_hz;
+    p.refclk_hz = 5000000;
+    p.jitter_ps = 20;
+    p.seed = 1;
+    gpx2_sim_init(&chip, &p);
+    now_ps = 0;
+
+    uint8_t cfg[GPX2_CONFIG_BYTES];
+    std::memcpy(cfg, CONFIG, sizeof cfg);
+    cfg[0] = (uint8_t)((cfg[0] & ~0x0F) | mask);
+    cfg[1] = (uint8_t)((cfg[1] & ~0x0F) | mask);
+
+    static gpx2_dev_t d;
+    gpx2_dev_init(&d, 0, 0, PIN_CS, PIN_INT);
+    gpx2_dev_opcode(&d, OPC_POWER_RESET);
+    gpx2_dev_write_config(&d, cfg, 0, GPX2_CONFIG_BYTES);
+    gpx2_dev_opcode(&d, OPC_INIT);
+    gpx2_dev_readout_setup(&d, cfg, burst, spi_hz);
+    if (!planned)
+        gpx2_dev_readout_range(&d, 0, GPX2_CHANNELS);
+
+    Run r;
+    r.first = d.read_first;
+    r.count = (uint8_t)(d.read_bytes / GPX2_SLOT_BYTES);
+    uint64_t bytes0 = chip.bytes, transactions0 = chip.transactions;
+    gpx2_dev_t *devs[1] = {&d};
+    gpx2_result_t out[GPX2_BURST_MAX];
+    while (chip.pulses < pulses || gpx2_dev_int(&d))
+    {
+        if (!gpx2_dev_int(&d))
+        {
+            // idle until the next pulse, not bus time
+            if (chip.next_hit_ps > now_ps)
+                now_ps = chip.next_hit_ps;
+            continue;
+        }
+        uint64_t t0 = now_ps;
+        int n = gpx2_dev_read_parallel(devs, 1, out);
+        r.bus_ps += now_ps - t0;
+        for (int i = 0; i < n; i++)
+        {
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(out[i].mask & (1 << ch)))
+                    continue;
+                hash_u32(r.hash, (uint32_t)ch);
+                hash_u32(r.hash, out[i].ref[ch]);
+                hash_u32(r.hash, out[i].stop[ch]);
+            }
+        }
+    }
+    r.events = d.events;
+    r.frames = d.frames;
+    r.bytes = chip.bytes - bytes0;
+    r.transactions = chip.transactions - transactions0;
+    r.lost = chip.hits_lost;
+    r.decode_ns = decode_ns(d);
+    return r;
+}
+
+double per(uint64_t v, uint64_t events)
+{
+    return events ? (double)v / (double)events : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint64_t pulses = 50000;
+    spi_hz = 4000000;
+    double rate_hz = 5000;
+    int arg = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        char *end;
+        double v = std::strtod(argv[i], &end);
+        if (*end != '\0' || v <= 0 || arg > 2)
+        {
+            std::fprintf(stderr, "usage: %s [pulses] [spi_hz] [rate_hz]\n", argv[0]);
+            return 2;
+        }
+        if (arg == 0)
+            pulses = (uint64_t)v;
+        else if (arg == 1)
+            spi_hz = (uint32_t)v;
+        else
+            rate_hz = v;
+        arg++;
+    }
+
+    bool ok = true;
+    for (uint8_t burst : {(uint8_t)1, (uint8_t)GPX2_BURST_MAX})
+    {
+        std::printf("\n%u frame%s per burst, %llu pulses at %.0f/s, SPI %.1f MHz\n", burst, burst > 1 ? "s" : "",
+                    (unsigned long long)pulses, rate_hz, spi_hz * 1e-6);
+        std::printf("mask  planned readout    bytes/event     transactions/event   bus us/event     "
+                    "decode ns/frame   lost\n");
+        std::printf("                         whole   plan    whole   plan         whole   plan     whole  plan\n");
+        for (uint8_t mask = 1; mask < 16; mask++)
+        {
+            Run whole = run(mask, burst, false, pulses, rate_hz);
+            Run plan = run(mask, burst, true, pulses, rate_hz);
+            char range[24];
+            if (plan.count == GPX2_CHANNELS)
+                std::snprintf(range, sizeof range, "whole frame");
+            else
+                std::snprintf(range, sizeof range, "CH%u-CH%u %2u bytes", plan.first + 1, plan.first + plan.count,
+                              plan.count * GPX2_SLOT_BYTES);
+            std::printf("0x%X   %-18s %6.2f %6.2f    %6.3f %6.3f       %7.2f %6.2f   %6.1f %5.1f   %llu/%llu\n", mask,
+                        range, per(whole.bytes, whole.events), per(plan.bytes, plan.events),
+                        per(whole.transactions, whole.events), per(plan.transactions, plan.events),
+                        per(whole.bus_ps, whole.events) * 1e-6, per(plan.bus_ps, plan.events) * 1e-6,
+                        whole.decode_ns, plan.decode_ns, (unsigned long long)whole.lost,
+                        (unsigned long long)plan.lost);
+            // without losses both must store the very same hits
+            if (whole.lost == 0 && plan.lost == 0 && (whole.events != plan.events || whole.hash != plan.hash))
+            {
+                std::printf("      mismatch: %llu events whole, %llu planned\n", (unsigned long long)whole.events,
+                            (unsigned long long)plan.events);
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,714 @@
+// Replay recorded result frames through the firmware's per frame path built
+// for Linux and report what it costs, so hot path regressions show up as
+// numbers instead of as lost hits in the lab.
+//
+//   gpx2_replay [recording.bin] [frames] [--save dir]
+//
+// A recording is what output mode 5 sends (GPX2_FRAME_SETUP, then
+// GPX2_FRAME_RAW frames of every 24 byte result frame read after
+// OPC_READ_RESULTS, empty and stale slots included, and GPX2_FRAME_STATS
+// frames when live statistics run, see gpx2_stream.h), saved from the serial
+// port or from designlab_sim. Its statistics windows go out again where they
+// were recorded, and their hit count is shown against the replayed events. Without one a fixed set of scenarios is generated, frames
+// each (default 1000000), and --save writes them out as recordings:
+//
+//  single     one channel, 100k pulses/s, STOP histogram
+//  four       all four channels, 100k pulses/s, STOP histograms
+//  distance   pulse distance combine: STOP1/STOP2 reported on channel 1
+//  width      pulse width combine, likewise
+//  saturated  all channels with FIFOs full, a quarter of the slots stale;
+//             ps timestamps, histograms, 3 coincidence pairs and statistics
+//
+// A recording is replayed both ways (plain and full processing). Every
+// scenario runs per output mode (text, csv, binary, packed), once to warm up
+// and once timed. The per frame path follows gpx2_consume_results() in
+// designlab.c and uses the same modules: stale slot filtering
+// (gpx2_results_new_hits), REF unwrap and ps conversion (gpx2_time),
+// histograms, coincidences, statistics and the printf, CSV, event frame and
+// packed encoders; output goes to a memory sink instead of USB. Calls to the
+// malloc family and operator new are counted during the timed pass, the
+// firmware path must make none. Exit code is 1 when one did or the two passes
+// disagree.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "gpx2_coinc.h"
+#include "gpx2_hist.h"
+#include "gpx2_pack.h"
+#include "gpx2_results.h"
+#include "gpx2_stats.h"
+#include "gpx2_stream.h"
+#include "gpx2_text.h"
+#include "gpx2_time.h"
+}
+
+// allocation counter, the target links with -Wl,--wrap=malloc,...
+static uint64_t allocations = 0;
+
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void *__wrap_malloc(size_t n)
+{
+    allocations++;
+    return __real_malloc(n);
+}
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocations++;
+    return __real_calloc(n, size);
+}
+void *__wrap_realloc(void *p, size_t n)
+{
+    allocations++;
+    return __real_realloc(p, n);
+}
+}
+
+void *operator new(size_t n)
+{
+    allocations++;
+    if (void *p = __real_malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+constexpr int CONFIG_BYTES = 17;
+constexpr int MAX_DEVICES = 4;
+constexpr uint8_t INIT_MARK = 0xFF;  // dev of a frame standing for a GPX2_FRAME_SETUP
+constexpr uint8_t STATS_MARK = 0xFE; // dev of a frame standing for a GPX2_FRAME_STATS, t_us its index
+constexpr uint32_t REFCLK_PS = 200000;
+
+// designlab.c gpx2_config defaults: STOP1 only, REFCLK_DIVISIONS 200000
+const uint8_t default_config[CONFIG_BYTES] = {0x31, 0x01, 0x1F, 0x40, 0x0D, 0x03, 0xC0, 0x53, 0xA1,
+                                              0x13, 0x00, 0x0A, 0xCC, 0xCC, 0x31, 0x8E, 0x04};
+
+struct RawFrame
+{
+    uint8_t dev;
+    uint32_t t_us;
+    uint8_t frame[GPX2_FRAME_BYTES];
+};
+
+struct Recording
+{
+    uint8_t ndev = 1;
+    uint32_t refclk_ps = REFCLK_PS;
+    uint8_t config[CONFIG_BYTES];
+    std::vector<RawFrame> frames;
+    std::vector<std::vector<uint8_t>> stats; // GPX2_FRAME_STATS payloads as recorded
+};
+
+enum Output
+{
+    OUT_TEXT,
+    OUT_CSV,
+    OUT_BINARY,
+    OUT_PACKED,
+    OUT_COUNT
+};
+const char *const output_names[OUT_COUNT] = {"text", "csv", "binary", "packed"};
+
+struct Processing
+{
+    const char *name;
+    bool ps;    // ps timestamps (time format 1)
+    bool hist;  // STOP histograms (menu F)
+    bool coinc; // pairs 1-2, 1-3, 1-4 (menu I), dT histograms
+    bool stats; // live statistics (menu O)
+};
+const Processing plain{"plain", false, true, false, false};
+const Processing full{"full", true, true, true, true};
+
+uint64_t xorshift(uint64_t &s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1DULL;
+}
+
+double uniform(uint64_t &s)
+{
+    return ((xorshift(s) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// pulses at rate_hz (poisson) or back to back every gap_ps; hit slots of
+// channels in mask, the rest empty. combine != 0 reports the STOP1/STOP2
+// distance or width on channel 1 like the chip in pulse distance/width mode.
+// stale is the chance of a slot repeating its previous hit instead
+Recording make_recording(size_t frames, uint8_t mask, int combine, double rate_hz, uint64_t gap_ps, double stale)
+{
+    Recording r;
+    std::memcpy(r.config, default_config, CONFIG_BYTES);
+    uint8_t enable = combine ? 0x03 : mask;
+    r.config[0] = (uint8_t)((r.config[0] & 0xF0) | enable);
+    r.config[1] = (uint8_t)((r.config[1] & 0xC0) | (combine << 4) | enable);
+    r.frames.reserve(frames);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    uint64_t t_ps = 1000000;
+    gpx2_result_t res{}, last{};
+    while (r.frames.size() < frames)
+    {
+        t_ps += gap_ps ? gap_ps : (uint64_t)(-std::log(uniform(rng)) / rate_hz * 1e12);
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            res.ref[ch] = 0;
+            res.stop[ch] = 0;
+            if (!(mask & (1 << ch)))
+                continue;
+            if (last.ref[ch] != 0 && uniform(rng) < stale)
+            {
+                res.ref[ch] = last.ref[ch];
+                res.stop[ch] = last.stop[ch];
+                continue;
+            }
+            uint64_t t = t_ps + 1000u * ch + (xorshift(rng) >> 58);
+            res.ref[ch] = (uint32_t)(t / REFCLK_PS) & GPX2_REF_MASK;
+            res.stop[ch] = (uint32_t)(t % REFCLK_PS);
+            if (combine)
+                res.stop[ch] = (combine == 1 ? 2000u : 5000u) + (uint32_t)(xorshift(rng) >> 56);
+            last.ref[ch] = res.ref[ch];
+            last.stop[ch] = res.stop[ch];
+        }
+        RawFrame f;
+        f.dev = 0;
+        f.t_us = (uint32_t)(t_ps / 1000000);
+        gpx2_encode_results(&res, f.frame);
+        r.frames.push_back(f);
+    }
+    return r;
+}
+
+bool load_recording(const char *path, Recording &r)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bool have_setup = false;
+    size_t pos = 0;
+    while (pos < buf.size())
+    {
+        gpx2_frame_view_t f;
+        if (gpx2_stream_parse(buf.data() + pos, buf.size() - pos, &f) != GPX2_PARSE_OK)
+        {
+            pos++;
+            continue;
+        }
+        pos += f.size;
+        if (f.type == GPX2_FRAME_SETUP && f.len >= GPX2_SETUP_PAYLOAD)
+        {
+            if (have_setup)
+            {
+                // OPC_INIT, the time bases restart
+                RawFrame m{};
+                m.dev = INIT_MARK;
+                r.frames.push_back(m);
+                continue;
+            }
+            r.ndev = f.payload[0];
+            r.refclk_ps = gpx2_get_le32(f.payload + 5);
+            std::memcpy(r.config, f.payload + 9, CONFIG_BYTES);
+            have_setup = true;
+        }
+        else if (f.type == GPX2_FRAME_STATS && have_setup && f.len >= 4)
+        {
+            // statistics windows the firmware closed while recording
+            RawFrame m{};
+            m.dev = STATS_MARK;
+            m.t_us = (uint32_t)r.stats.size();
+            r.stats.emplace_back(f.payload, f.payload + f.len);
+            r.frames.push_back(m);
+        }
+        else if (f.type == GPX2_FRAME_RAW && have_setup)
+        {
+            for (size_t off = 0; off + GPX2_RAW_RECORD <= f.len; off += GPX2_RAW_RECORD)
+            {
+                RawFrame m;
+                m.dev = f.payload[off];
+                m.t_us = gpx2_get_le32(f.payload + off + 1);
+                std::memcpy(m.frame, f.payload + off + 5, GPX2_FRAME_BYTES);
+                if (m.dev < MAX_DEVICES)
+                    r.frames.push_back(m);
+            }
+        }
+    }
+    return have_setup && r.ndev >= 1 && r.ndev <= MAX_DEVICES;
+}
+
+// as output mode 5 would have sent it
+bool save_recording(const std::string &path, const Recording &r)
+{
+    std::FILE *out = std::fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    static gpx2_stream_t s;
+    gpx2_stream_init(&s);
+    auto setup = [&](uint32_t epoch) {
+        uint8_t *p = gpx2_stream_reserve(&s, GPX2_FRAME_SETUP, GPX2_SETUP_PAYLOAD);
+        p[0] = r.ndev;
+        gpx2_put_le32(p + 1, epoch);
+        gpx2_put_le32(p + 5, r.refclk_ps);
+        std::memcpy(p + 9, r.config, CONFIG_BYTES);
+        std::fwrite(s.buf, 1, gpx2_stream_finish(&s), out);
+    };
+    uint32_t epoch = 1;
+    setup(epoch);
+    for (const auto &f : r.frames)
+    {
+        if (f.dev == INIT_MARK)
+        {
+            std::fwrite(s.buf, 1, gpx2_stream_finish(&s), out);
+            setup(++epoch);
+            continue;
+        }
+        if (!gpx2_stream_add_raw(&s, f.dev, f.t_us, f.frame))
+        {
+            std::fwrite(s.buf, 1, gpx2_stream_finish(&s), out);
+            gpx2_stream_add_raw(&s, f.dev, f.t_us, f.frame);
+        }
+    }
+    std::fwrite(s.buf, 1, gpx2_stream_finish(&s), out);
+    return std::fclose(out) == 0;
+}
+
+// stands in for hal_write_raw: the bytes are copied like into the USB
+// buffer, then dropped
+struct Sink
+{
+    uint8_t buf[1 << 16];
+    size_t pos = 0;
+    uint64_t bytes = 0;
+
+    void write(const void *data, size_t n)
+    {
+        if (pos + n > sizeof buf)
+            pos = 0;
+        std::memcpy(buf + pos, data, n);
+        pos += n;
+        bytes += n;
+    }
+};
+
+// the firmware's per frame state, static there as well
+struct Pipeline
+{
+    Output out;
+    Processing proc;
+    const Recording *rec;
+    uint8_t ndev;
+    uint8_t active[MAX_DEVICES];
+    gpx2_result_t last[MAX_DEVICES];
+    gpx2_time_t time[MAX_DEVICES];
+    gpx2_hist_t hist[GPX2_COINC_CHANNELS];
+    gpx2_hist_t dt_hist[GPX2_COINC_MAX_PAIRS];
+    gpx2_coinc_t coinc;
+    gpx2_stats_t stats;
+    gpx2_stream_t stream;
+    gpx2_pack_t pack;
+    gpx2_text_t text;
+    Sink sink;
+    uint64_t us_high = 0; // recorded time extended past 32 bits
+    uint32_t us_last = 0;
+    uint64_t frames = 0, events = 0;
+    uint64_t windows = 0, window_hits = 0; // recorded statistics windows
+
+    void setup(const Recording &r, Output o, const Processing &p)
+    {
+        out = o;
+        proc = p;
+        rec = &r;
+        ndev = r.ndev;
+        uint32_t divisions = r.config[3] | (r.config[4] << 8) | ((r.config[5] & 0x0F) << 16);
+        for (int i = 0; i < MAX_DEVICES; i++)
+        {
+            // gpx2_dev_readout_setup()
+            active[i] = r.config[0] & r.config[1] & 0x0F;
+            last[i] = gpx2_result_t{};
+            gpx2_time_setup(&time[i], r.refclk_ps, divisions);
+        }
+        for (auto &h : hist)
+            gpx2_hist_setup(&h, 0, 256, GPX2_HIST_MAX_BINS);
+        for (auto &h : dt_hist)
+            gpx2_hist_setup(&h, -8192, 16, GPX2_HIST_MAX_BINS);
+        gpx2_coinc_setup(&coinc, 10000, 0);
+        if (proc.coinc)
+            for (uint8_t b = 1; b < GPX2_CHANNELS; b++)
+                gpx2_coinc_add_pair(&coinc, 0, b);
+        gpx2_stats_setup(&stats, 1000000, GPX2_STATS_STOP);
+        gpx2_stats_clear(&stats, 0);
+        gpx2_stream_init(&stream);
+        gpx2_pack_init(&pack);
+        gpx2_text_init(&text);
+        sink.pos = 0;
+        sink.bytes = 0;
+        us_high = 0;
+        us_last = 0;
+        frames = events = 0;
+        windows = window_hits = 0;
+    }
+
+    void stream_flush()
+    {
+        size_t size = gpx2_stream_finish(&stream);
+        if (size)
+            sink.write(stream.buf, size);
+    }
+
+    void text_reserve()
+    {
+        if (!gpx2_text_room(&text))
+        {
+            sink.write(text.buf, text.len);
+            text.len = 0;
+        }
+    }
+
+    // gpx2_output_results()
+    void output(const gpx2_result_t *res, const uint64_t *t_ps)
+    {
+        char line[64];
+        switch (out)
+        {
+        case OUT_TEXT:
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res->mask & (1 << ch)))
+                    continue;
+                int n = 0;
+                if (ndev > 1)
+                    n = std::snprintf(line, sizeof line, "D%d ", res->dev + 1);
+                int g = res->dev * GPX2_CHANNELS + ch;
+                if (t_ps)
+                    n += std::snprintf(line + n, sizeof line - n, "CH%d: T=%llu ps\n", g + 1,
+                                       (unsigned long long)t_ps[ch]);
+                else
+                    n += std::snprintf(line + n, sizeof line - n, "CH%d: REF=%lu   STOP=%lu\n", g + 1,
+                                       (unsigned long)res->ref[ch], (unsigned long)res->stop[ch]);
+                sink.write(line, (size_t)n);
+            }
+            break;
+        case OUT_CSV:
+            text_reserve();
+            gpx2_text_add_frame(&text, res, t_ps, active[res->dev]);
+            break;
+        case OUT_PACKED:
+            if (!t_ps)
+            {
+                if (!gpx2_pack_add(&pack, &stream, res))
+                {
+                    stream_flush();
+                    gpx2_pack_add(&pack, &stream, res);
+                }
+                break;
+            }
+            // ps timestamps keep their fixed size records
+            [[fallthrough]];
+        case OUT_BINARY:
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res->mask & (1 << ch)))
+                    continue;
+                uint8_t g = (uint8_t)(res->dev * GPX2_CHANNELS + ch);
+                auto add = [&] {
+                    return t_ps ? gpx2_stream_add_time(&stream, g, t_ps[ch])
+                                : gpx2_stream_add_event(&stream, g, res->ref[ch], res->stop[ch]);
+                };
+                if (!add())
+                {
+                    stream_flush();
+                    add();
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // gpx2_output_dt()
+    void output_dt(const gpx2_coinc_pair_t *p, int pair, int32_t dt_ps)
+    {
+        if (out == OUT_BINARY || out == OUT_PACKED)
+        {
+            if (!gpx2_stream_add_dt(&stream, p->a, p->b, dt_ps))
+            {
+                stream_flush();
+                gpx2_stream_add_dt(&stream, p->a, p->b, dt_ps);
+            }
+        }
+        else if (out == OUT_TEXT)
+        {
+            char line[48];
+            int n = std::snprintf(line, sizeof line, "P%d CH%d-CH%d: DT=%ld ps\n", pair + 1, p->b + 1, p->a + 1,
+                                  (long)dt_ps);
+            sink.write(line, (size_t)n);
+        }
+        else
+        {
+            text_reserve();
+            gpx2_text_add_dt(&text, pair, dt_ps);
+        }
+    }
+
+    // a recorded statistics window goes out again, gpx2_stats_service():
+    // binary modes send the frame, text and csv one STAT line per record
+    void stats_report(const std::vector<uint8_t> &payload)
+    {
+        windows++;
+        uint32_t window_us = gpx2_get_le32(payload.data());
+        bool binary = out == OUT_BINARY || out == OUT_PACKED;
+        if (binary)
+        {
+            stream_flush();
+            std::memcpy(gpx2_stream_reserve(&stream, GPX2_FRAME_STATS, payload.size()), payload.data(),
+                        payload.size());
+            stream_flush();
+        }
+        for (size_t off = 4; off + GPX2_STATS_RECORD <= payload.size(); off += GPX2_STATS_RECORD)
+        {
+            const uint8_t *p = payload.data() + off;
+            uint32_t n = gpx2_get_le32(p + 1);
+            if (p[0] < GPX2_HIST_ID_PAIR)
+                window_hits += n;
+            if (binary)
+                continue;
+            uint32_t sigma = gpx2_get_le32(p + 13);
+            char sigma_str[16] = "-";
+            if (sigma != 0xFFFFFFFF)
+                std::snprintf(sigma_str, sizeof sigma_str, "%.2f", sigma / 256.0);
+            char line[160];
+            int len = std::snprintf(line, sizeof line,
+                                    "STAT %s%d: n=%lu rate=%llu/s mean=%.2f sigma=%s min=%lld max=%lld\n",
+                                    p[0] >= GPX2_HIST_ID_PAIR ? "P" : "CH",
+                                    p[0] >= GPX2_HIST_ID_PAIR ? p[0] - GPX2_HIST_ID_PAIR + 1 : p[0] + 1,
+                                    (unsigned long)n,
+                                    window_us ? (unsigned long long)n * 1000000ULL / window_us : 0ULL,
+                                    (int64_t)gpx2_get_le64(p + 5) / 256.0, sigma_str,
+                                    (long long)gpx2_get_le64(p + 17), (long long)gpx2_get_le64(p + 25));
+            if (out == OUT_CSV && text.len)
+            {
+                // keep csv lines whole
+                sink.write(text.buf, text.len);
+                text.len = 0;
+            }
+            sink.write(line, (size_t)len);
+        }
+    }
+
+    // one recorded frame: what gpx2_dev_read_parallel() does after the
+    // transfer, then gpx2_consume_results()
+    void frame(const RawFrame &f)
+    {
+        if (f.dev == STATS_MARK)
+        {
+            stats_report(rec->stats[f.t_us]);
+            return;
+        }
+        if (f.dev == INIT_MARK)
+        {
+            for (int i = 0; i < MAX_DEVICES; i++)
+                gpx2_time_reset(&time[i]);
+            gpx2_coinc_flush(&coinc);
+            gpx2_stats_flush(&stats);
+            return;
+        }
+        gpx2_result_t res;
+        gpx2_decode_results(f.frame, &res);
+        res.dev = f.dev;
+        if (!gpx2_results_new_hits(&res, &last[f.dev], active[f.dev]))
+            return;
+        frames++;
+        events += (uint64_t)__builtin_popcount(res.mask);
+
+        if (f.t_us < us_last)
+            us_high += 1ull << 32;
+        us_last = f.t_us;
+        uint64_t now_us = us_high | f.t_us;
+
+        uint64_t t_ps[GPX2_CHANNELS];
+        for (int ch = 0; ch < GPX2_CHANNELS && proc.ps; ch++)
+        {
+            if (res.mask & (1 << ch))
+                t_ps[ch] = gpx2_time_ps(&time[res.dev], res.ref[ch], res.stop[ch], now_us);
+        }
+        for (int ch = 0; ch < GPX2_CHANNELS && proc.hist; ch++)
+        {
+            if (res.mask & (1 << ch))
+                gpx2_hist_add(&hist[res.dev * GPX2_CHANNELS + ch], (int32_t)res.stop[ch]);
+        }
+        for (int ch = 0; ch < GPX2_CHANNELS && proc.stats; ch++)
+        {
+            if (res.mask & (1 << ch))
+                gpx2_stats_hit(&stats, (uint8_t)(res.dev * GPX2_CHANNELS + ch), res.stop[ch],
+                               proc.ps ? t_ps[ch] : 0);
+        }
+        if (proc.stats)
+            gpx2_stats_window(&stats, now_us);
+        if (proc.coinc)
+        {
+            // gpx2_coinc_results()
+            gpx2_coinc_dt_t dt[GPX2_COINC_MAX_PAIRS];
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (!(res.mask & (1 << ch)))
+                    continue;
+                int n = gpx2_coinc_add(&coinc, (uint8_t)(res.dev * GPX2_CHANNELS + ch), t_ps[ch], dt);
+                for (int i = 0; i < n; i++)
+                {
+                    gpx2_hist_add(&dt_hist[dt[i].pair], dt[i].dt_ps);
+                    if (proc.stats)
+                        gpx2_stats_dt(&stats, dt[i].pair, dt[i].dt_ps);
+                    output_dt(&coinc.pair[dt[i].pair], dt[i].pair, dt[i].dt_ps);
+                }
+            }
+        }
+        else
+        {
+            output(&res, proc.ps ? t_ps : nullptr);
+        }
+    }
+
+    void finish()
+    {
+        stream_flush();
+        if (text.len)
+            sink.write(text.buf, text.len);
+        text.len = 0;
+    }
+};
+
+struct Pass
+{
+    uint64_t frames, events, bytes, allocations;
+    double seconds;
+    uint64_t windows, window_hits;
+};
+
+Pass replay(Pipeline &p, const Recording &r, Output o, const Processing &proc)
+{
+    p.setup(r, o, proc);
+    uint64_t a0 = allocations;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto &f : r.frames)
+        p.frame(f);
+    p.finish();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return Pass{p.frames, p.events, p.sink.bytes, allocations - a0, s, p.windows, p.window_hits};
+}
+
+bool run(const std::string &name, const Recording &r, const Processing &proc)
+{
+    static Pipeline p; // ~100 KB of firmware state, static like there
+    bool ok = true;
+    for (int o = 0; o < OUT_COUNT; o++)
+    {
+        Pass warm = replay(p, r, (Output)o, proc);
+        Pass t = replay(p, r, (Output)o, proc);
+        bool same = warm.events == t.events && warm.bytes == t.bytes;
+        ok &= same && t.allocations == 0;
+        std::printf("%-22s %-6s %9llu events %7.2f Mev/s %7.1f ns/event %6.2f B/event  %s%s\n",
+                    (name + " " + proc.name).c_str(), output_names[o], (unsigned long long)t.events,
+                    t.events / t.seconds * 1e-6, t.seconds * 1e9 / (double)(t.events ? t.events : 1),
+                    (double)t.bytes / (double)(t.events ? t.events : 1),
+                    t.allocations ? "ALLOCATES" : "no allocations", same ? "" : "  PASSES DIFFER");
+        if (t.allocations)
+            std::printf("%-22s %llu allocations in the timed pass\n", "",
+                        (unsigned long long)t.allocations);
+        if (o == OUT_COUNT - 1 && t.windows)
+            std::printf("%-22s %llu recorded statistics windows, %llu hits in them, %llu replayed\n", "",
+                        (unsigned long long)t.windows, (unsigned long long)t.window_hits,
+                        (unsigned long long)t.events);
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *recording = nullptr;
+    const char *save = nullptr;
+    size_t frames = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        char *end;
+        size_t v = std::strtoul(argv[i], &end, 0);
+        if (std::strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+            save = argv[++i];
+        else if (*end == '\0')
+            frames = v;
+        else
+            recording = argv[i];
+    }
+
+    bool ok = true;
+    if (recording)
+    {
+        Recording r;
+        if (!load_recording(recording, r))
+        {
+            std::fprintf(stderr, "%s: no output mode 5 recording\n", recording);
+            return 2;
+        }
+        std::printf("%s: %zu frames, %d chip(s), config", recording, r.frames.size(), r.ndev);
+        for (int i = 0; i < CONFIG_BYTES; i++)
+            std::printf(" %02X", r.config[i]);
+        std::printf("\n");
+        ok &= run("recording", r, plain);
+        ok &= run("recording", r, full);
+        return ok ? 0 : 1;
+    }
+
+    struct Scenario
+    {
+        const char *name;
+        uint8_t mask;
+        int combine;
+        double rate_hz;
+        uint64_t gap_ps;
+        double stale;
+        const Processing &proc;
+    };
+    const Scenario scenarios[] = {
+        {"single", 0x01, 0, 1e5, 0, 0.0, plain},
+        {"four", 0x0F, 0, 1e5, 0, 0.0, plain},
+        {"distance", 0x01, 1, 1e5, 0, 0.0, plain},
+        {"width", 0x01, 2, 1e5, 0, 0.0, plain},
+        {"saturated", 0x0F, 0, 0, 1500000, 0.25, full},
+    };
+    for (const auto &sc : scenarios)
+    {
+        Recording r = make_recording(frames, sc.mask, sc.combine, sc.rate_hz, sc.gap_ps, sc.stale);
+        if (save && !save_recording(std::string(save) + "/" + sc.name + ".bin", r))
+        {
+            std::fprintf(stderr, "cannot write %s/%s.bin\n", save, sc.name);
+            return 2;
+        }
+        ok &= run(sc.name, r, sc.proc);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+// Result frame readout and decode (gpx2_results.c, gpx2_dev.c): known frames,
+// encode round trip, the slot range decoders, the new hit filter, and whole
+// frames clocked out of a simulated chip in one transaction against the hits
+// waiting in its FIFOs.
+
+#include <cstring>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_results.h"
+}
+
+namespace {
+
+void known_frames()
+{
+    // per channel REF(3) STOP(3), big-endian
+    const uint8_t frame[GPX2_FRAME_BYTES] = {
+        0x12, 0x34, 0x56, 0xAB, 0xCD, 0xEF, // CH1
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // CH2 empty
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // CH3 all ones
+        0x00, 0x00, 0x01, 0x03, 0x0D, 0x40, // CH4 REF 1, STOP 200000
+    };
+    gpx2_result_t res;
+    gpx2_decode_results(frame, &res);
+    GPX2_CHECK_EQ(res.ref[0], 0x123456);
+    GPX2_CHECK_EQ(res.stop[0], 0xABCDEF);
+    GPX2_CHECK_EQ(res.ref[1], 0);
+    GPX2_CHECK_EQ(res.stop[1], 0);
+    GPX2_CHECK_EQ(res.ref[2], 0xFFFFFF);
+    GPX2_CHECK_EQ(res.stop[2], 0xFFFFFF);
+    GPX2_CHECK_EQ(res.ref[3], 1);
+    GPX2_CHECK_EQ(res.stop[3], 200000);
+
+    uint8_t again[GPX2_FRAME_BYTES];
+    gpx2_encode_results(&res, again);
+    GPX2_CHECK(std::memcmp(frame, again, sizeof frame) == 0);
+}
+
+void random_round_trip()
+{
+    uint32_t s = 12345;
+    for (int n = 0; n < 1000; n++)
+    {
+        uint8_t frame[GPX2_FRAME_BYTES], again[GPX2_FRAME_BYTES];
+        for (auto &b : frame)
+        {
+            s = s * 1664525u + 1013904223u;
+            b = (uint8_t)(s >> 24);
+        }
+        gpx2_result_t res;
+        gpx2_decode_results(frame, &res);
+        gpx2_encode_results(&res, again);
+        GPX2_CHECK(std::memcmp(frame, again, sizeof frame) == 0);
+
+        // a slot range read from its own address decodes like the whole frame
+        for (uint8_t first = 0; first < GPX2_CHANNELS; first++)
+        {
+            for (uint8_t count = 1; first + count <= GPX2_CHANNELS; count++)
+            {
+                gpx2_result_t part;
+                gpx2_decode_range(first, count)(&frame[first * GPX2_SLOT_BYTES], &part);
+                for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+                {
+                    bool in = ch >= first && ch < first + count;
+                    GPX2_CHECK_EQ(part.ref[ch], in ? res.ref[ch] : 0);
+                    GPX2_CHECK_EQ(part.stop[ch], in ? res.stop[ch] : 0);
+                }
+            }
+        }
+    }
+}
+
+void new_hits()
+{
+    gpx2_result_t last = {};
+    gpx2_result_t res = {};
+    res.ref[0] = 10;
+    res.stop[0] = 20;
+    res.ref[2] = 30;
+    res.stop[2] = 40;
+    // CH2 empty, CH3 disabled
+    GPX2_CHECK_EQ(gpx2_results_new_hits(&res, &last, 0x0B), 0x01);
+    GPX2_CHECK_EQ(res.mask, 0x01);
+    // the same slot again is stale
+    gpx2_result_t again = res;
+    GPX2_CHECK_EQ(gpx2_results_new_hits(&again, &last, 0x0F), 0x04);
+    GPX2_CHECK_EQ(gpx2_results_new_hits(&again, &last, 0x0F), 0x00);
+    again.stop[0] = 21;
+    GPX2_CHECK_EQ(gpx2_results_new_hits(&again, &last, 0x0F), 0x01);
+}
+
+// whole frames from the simulated chip: every slot that had a hit waiting
+// must carry exactly that hit, and the FIFO must give it up
+void chip_frames()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 0, 0x0F));
+    gpx2_sim_t *chip = hal_sim_chip(0);
+    int frames = 0;
+    for (int n = 0; n < 200; n++)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        gpx2_sim_hit_t want[GPX2_CHANNELS] = {};
+        uint8_t waiting = 0;
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            const gpx2_sim_fifo_t *f = &chip->fifo[ch];
+            if (f->count)
+            {
+                want[ch] = f->hit[f->head];
+                waiting |= 1 << ch;
+            }
+        }
+        uint64_t reads = chip->result_reads, transactions = chip->transactions;
+        gpx2_result_t res;
+        gpx2_dev_read_frame(&d, &res);
+        GPX2_CHECK_EQ(chip->result_reads - reads, 1);
+        GPX2_CHECK_EQ(chip->transactions - transactions, 1);
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            if (!(waiting & (1 << ch)))
+                continue;
+            GPX2_CHECK_EQ(res.ref[ch], want[ch].ref);
+            GPX2_CHECK_EQ(res.stop[ch], want[ch].stop);
+        }
+        frames += waiting != 0;
+    }
+    GPX2_CHECK(frames >= 100);
+}
+
+} // namespace
+
+int main()
+{
+    known_frames();
+    random_round_trip();
+    new_hits();
+    gpx2::test::sim_start(5000);
+    chip_frames();
+    return gpx2::test::finish("gpx2_results_test");
+}
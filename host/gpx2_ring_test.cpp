@@ -0,0 +1,224 @@
+// Result frame ring (gpx2_ring.c): fill, overrun and drop counting, the epoch
+// tag kept with every frame, indices wrapping past UINT32_MAX, a producer and a consumer thread, and the irq
+// readout of designlab.c filling it from a simulated chip where every hit
+// read must come out of the ring or be counted as dropped.
+
+#include <atomic>
+#include <ctime>
+#include <thread>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_ring.h"
+}
+
+namespace {
+
+gpx2_ring_t ring;
+
+gpx2_result_t frame(uint32_t seq)
+{
+    gpx2_result_t res = {};
+    res.ref[0] = seq;
+    res.stop[0] = ~seq;
+    res.mask = 0x01;
+    return res;
+}
+
+void fill_and_overrun()
+{
+    gpx2_ring_init(&ring);
+    gpx2_result_t res;
+    uint32_t epoch;
+    GPX2_CHECK(!gpx2_ring_pop(&ring, &res, &epoch));
+    int pushed = 0;
+    for (uint32_t i = 0; i < GPX2_RING_SIZE + 44; i++)
+    {
+        gpx2_result_t f = frame(i);
+        pushed += gpx2_ring_push(&ring, &f, i / 100);
+    }
+    GPX2_CHECK_EQ(pushed, GPX2_RING_SIZE);
+    GPX2_CHECK_EQ(ring.dropped, 44);
+    GPX2_CHECK_EQ(ring.high_water, GPX2_RING_SIZE);
+    GPX2_CHECK_EQ(gpx2_ring_count(&ring), GPX2_RING_SIZE);
+    // the oldest frames are kept, the ones pushed into a full ring are lost
+    for (uint32_t i = 0; i < GPX2_RING_SIZE; i++)
+    {
+        GPX2_CHECK(gpx2_ring_pop(&ring, &res, &epoch));
+        GPX2_CHECK_EQ(res.ref[0], i);
+        GPX2_CHECK_EQ(res.stop[0], ~i);
+        GPX2_CHECK_EQ(epoch, i / 100);
+    }
+    GPX2_CHECK(!gpx2_ring_pop(&ring, &res, &epoch));
+    GPX2_CHECK_EQ(gpx2_ring_count(&ring), 0);
+    GPX2_CHECK_EQ(ring.high_water, GPX2_RING_SIZE);
+}
+
+// free running indices overflow after 2^32 frames, about 4 days at 10k/s
+void index_wrap()
+{
+    gpx2_ring_init(&ring);
+    ring.head = UINT32_MAX - 10;
+    ring.tail = UINT32_MAX - 10;
+    gpx2_result_t res;
+    uint32_t epoch;
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < 3 * GPX2_RING_SIZE; i++)
+    {
+        gpx2_result_t f = frame(i);
+        GPX2_CHECK(gpx2_ring_push(&ring, &f, 0));
+        if (i % 2)
+        {
+            GPX2_CHECK(gpx2_ring_pop(&ring, &res, &epoch));
+            GPX2_CHECK_EQ(res.ref[0], next);
+            next++;
+        }
+        GPX2_CHECK_EQ(gpx2_ring_count(&ring), i + 1 - next);
+        if (gpx2_ring_count(&ring) == GPX2_RING_SIZE)
+            break;
+    }
+    GPX2_CHECK_EQ(gpx2_ring_count(&ring), GPX2_RING_SIZE);
+    gpx2_result_t f = frame(0);
+    GPX2_CHECK(!gpx2_ring_push(&ring, &f, 0));
+    GPX2_CHECK_EQ(ring.dropped, 1);
+    while (gpx2_ring_pop(&ring, &res, &epoch))
+    {
+        GPX2_CHECK_EQ(res.ref[0], next);
+        next++;
+    }
+    GPX2_CHECK_EQ(gpx2_ring_count(&ring), 0);
+}
+
+// one producer, one consumer on other cores: order is kept, nothing is
+// duplicated, and every frame is either popped or dropped
+void two_threads()
+{
+    constexpr uint32_t FRAMES = 2000000;
+    gpx2_ring_init(&ring);
+    std::atomic<bool> done{false};
+    uint32_t accepted = 0;
+    std::thread producer([&] {
+        for (uint32_t i = 1; i <= FRAMES; i++)
+        {
+            gpx2_result_t f = frame(i);
+            accepted += gpx2_ring_push(&ring, &f, i);
+        }
+        done = true;
+    });
+    uint32_t popped = 0, last = 0, disorder = 0;
+    gpx2_result_t res;
+    uint32_t epoch;
+    while (true)
+    {
+        bool fin = done;
+        while (gpx2_ring_pop(&ring, &res, &epoch))
+        {
+            disorder += res.ref[0] <= last || res.stop[0] != ~res.ref[0] || epoch != res.ref[0];
+            last = res.ref[0];
+            popped++;
+        }
+        if (fin)
+            break;
+    }
+    producer.join();
+    GPX2_CHECK_EQ(disorder, 0);
+    GPX2_CHECK_EQ(popped, accepted);
+    GPX2_CHECK_EQ(popped + ring.dropped, FRAMES);
+    GPX2_CHECK(ring.high_water <= GPX2_RING_SIZE);
+}
+
+// the irq readout: the INT callback drains the chip into the ring while the
+// main loop is stalled long enough for the ring to overrun
+gpx2_dev_t dev;
+std::atomic<uint32_t> dropped_hits{0};
+
+void int_callback(uint8_t pin)
+{
+    (void)pin;
+    gpx2_dev_t *devs[1] = {&dev};
+    gpx2_result_t out[GPX2_BURST_MAX];
+    for (int n = 0; n < 16 && gpx2_dev_int(&dev); n++)
+    {
+        int got = gpx2_dev_read_parallel(devs, 1, out);
+        for (int i = 0; i < got; i++)
+        {
+            if (!gpx2_ring_push(&ring, &out[i], 0))
+                dropped_hits += __builtin_popcount(out[i].mask);
+        }
+    }
+}
+
+// an edge is only seen once, INT still low after a capped drain (or before
+// arming) is picked up from the main loop as gpx2_irq_kick() does
+void kick()
+{
+    if (gpx2_dev_int(&dev))
+    {
+        hal_gpio_irq_enable(dev.pin_int, false);
+        int_callback(dev.pin_int);
+        hal_gpio_irq_enable(dev.pin_int, true);
+    }
+}
+
+void sleep_ms(long ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+    nanosleep(&ts, nullptr);
+}
+
+void irq_fill()
+{
+    GPX2_CHECK(gpx2::test::chip_start(&dev, 0, 0x0F));
+    gpx2_ring_init(&ring);
+    hal_gpio_irq_falling(dev.pin_int, &int_callback);
+    uint64_t popped_frames = 0, popped_hits = 0;
+    gpx2_result_t res;
+    uint32_t epoch;
+    for (int round = 0; round < 3; round++)
+    {
+        // stalled main loop, then catch up
+        sleep_ms(150);
+        for (int n = 0; n < 50; n++)
+        {
+            while (gpx2_ring_pop(&ring, &res, &epoch))
+            {
+                popped_frames++;
+                popped_hits += __builtin_popcount(res.mask);
+            }
+            kick();
+            sleep_ms(1);
+        }
+    }
+    hal_gpio_irq_enable(dev.pin_int, false);
+    while (gpx2_ring_pop(&ring, &res, &epoch))
+    {
+        popped_frames++;
+        popped_hits += __builtin_popcount(res.mask);
+    }
+
+    gpx2_sim_t chip;
+    hal_sim_snapshot(0, &chip);
+    uint64_t waiting = 0;
+    for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        waiting += chip.fifo[ch].count;
+    GPX2_CHECK(ring.dropped > 0);
+    GPX2_CHECK(popped_frames > 500);
+    GPX2_CHECK_EQ(ring.high_water, GPX2_RING_SIZE);
+    GPX2_CHECK_EQ(popped_frames + ring.dropped, dev.frames);
+    GPX2_CHECK_EQ(popped_hits + dropped_hits, dev.events);
+    // every hit the chip stored was read or is still waiting in its FIFOs
+    GPX2_CHECK_EQ(dev.events + waiting, chip.hits);
+}
+
+} // namespace
+
+int main()
+{
+    fill_and_overrun();
+    index_wrap();
+    two_threads();
+    gpx2::test::sim_start(5000);
+    irq_fill();
+    return gpx2::test::finish("gpx2_ring_test");
+}
@@ -0,0 +1,269 @@
+#include "gpx2_sim.h"
+
+#include <math.h>
+#include <string.h>
+
+#define OPC_POWER_RESET 0x30
+#define OPC_INIT 0x18
+#define OPC_WRITE_CONFIG 0x80
+#define OPC_READ_CONFIG 0x40
+#define OPC_READ_RESULTS 0x60
+
+#define RESULTS_FIRST 8
+#define RESULTS_LAST 31
+
+static uint64_t sim_rand(gpx2_sim_t *sim)
+{
+    // xorshift64*
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double sim_uniform(gpx2_sim_t *sim)
+{
+    return ((sim_rand(sim) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double sim_gauss(gpx2_sim_t *sim)
+{
+    // box-muller, one value is enough here
+    return sqrt(-2.0 * log(sim_uniform(sim))) * cos(6.283185307179586 * sim_uniform(sim));
+}
+
+static uint64_t sim_next_interval_ps(gpx2_sim_t *sim)
+{
+    if (sim->p.rate_hz <= 0)
+        return UINT64_MAX / 2;
+    double ps = -log(sim_uniform(sim)) * 1e12 / sim->p.rate_hz;
+    return ps < 1 ? 1 : (uint64_t)ps;
+}
+
+static uint32_t sim_refclk_divisions(const gpx2_sim_t *sim)
+{
+    return sim->cfg[3] | (sim->cfg[4] << 8) | ((sim->cfg[5] & 0x0F) << 16);
+}
+
+static bool sim_channel_enabled(const gpx2_sim_t *sim, int ch)
+{
+    // PIN_ENA and HIT_ENA set, bit 6 of config 0 disables all STOP inputs
+    return (sim->cfg[0] & (1 << ch)) && (sim->cfg[1] & (1 << ch)) && !(sim->cfg[0] & (1 << 6));
+}
+
+static void sim_clear_fifos(gpx2_sim_t *sim)
+{
+    memset(sim->fifo, 0, sizeof(sim->fifo));
+}
+
+void gpx2_sim_init(gpx2_sim_t *sim, const gpx2_sim_params_t *params)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->p = *params;
+    sim->rng = params->seed ? params->seed : 0x9E3779B97F4A7C15ULL;
+    sim->next_hit_ps = sim_next_interval_ps(sim);
+}
+
+// store a hit at absolute time t_ps into the channel FIFO
+static void sim_store_hit(gpx2_sim_t *sim, int ch, uint64_t t_ps)
+{
+    gpx2_sim_fifo_t *f = &sim->fifo[ch];
+    if (f->count == GPX2_SIM_FIFO_DEPTH)
+    {
+        sim->hits_lost++;
+        return;
+    }
+    if (gpx2_sim_int(sim))
+        sim->int_falls++;
+    uint64_t period_ps = 1000000000000ULL / sim->p.refclk_hz;
+    uint32_t div = sim_refclk_divisions(sim);
+    uint64_t rel = t_ps - sim->ref_epoch_ps;
+    gpx2_sim_hit_t *h = &f->hit[(f->head + f->count) % GPX2_SIM_FIFO_DEPTH];
+    h->ref = (uint32_t)(rel / period_ps) & 0xFFFFFF;
+    if (sim->p.dnl > 0)
+    {
+        // nonlinear interpolator: code widths vary by +/- dnl along the
+        // period, a different pattern per channel and HIRES setting
+        double k = 6.283185307179586 * (3 + (sim->cfg[1] >> 6));
+        double x = (double)(rel % period_ps) / period_ps;
+        x += sim->p.dnl / k * (sin(k * x + ch) - sin(ch));
+        h->stop = (uint32_t)(x * div) & 0xFFFFFF;
+    }
+    else
+    {
+        h->stop = (uint32_t)((rel % period_ps) * div / period_ps) & 0xFFFFFF;
+    }
+    f->count++;
+    sim->hits++;
+}
+
+void gpx2_sim_advance(gpx2_sim_t *sim, uint64_t now_ps)
+{
+    if (now_ps <= sim->now_ps)
+        return;
+    sim->now_ps = now_ps;
+
+    while (sim->next_hit_ps <= now_ps)
+    {
+        uint64_t t = sim->next_hit_ps;
+        sim->next_hit_ps += sim_next_interval_ps(sim);
+        if (!sim->running)
+            continue;
+        sim->pulses++;
+        bool room = false;
+        for (int ch = 0; ch < GPX2_SIM_CHANNELS; ch++)
+        {
+            if (!sim_channel_enabled(sim, ch))
+                continue;
+            int64_t jitter = (int64_t)(sim_gauss(sim) * sim->p.jitter_ps);
+            uint64_t t_ch = t + sim->p.delay_ps[ch] + jitter;
+            if (t_ch < sim->ref_epoch_ps)
+                t_ch = sim->ref_epoch_ps;
+            sim_store_hit(sim, ch, t_ch);
+            room |= sim->fifo[ch].count < GPX2_SIM_FIFO_DEPTH;
+        }
+        // nobody is reading: account for the backlog without generating it
+        if (!room && sim->next_hit_ps + 1000000000ULL < now_ps)
+        {
+            uint64_t skipped = (uint64_t)((now_ps - sim->next_hit_ps) * 1e-12 * sim->p.rate_hz);
+            sim->pulses += skipped;
+            for (int ch = 0; ch < GPX2_SIM_CHANNELS; ch++)
+                if (sim_channel_enabled(sim, ch))
+                    sim->hits_lost += skipped;
+            sim->next_hit_ps = now_ps + sim_next_interval_ps(sim);
+        }
+    }
+}
+
+void gpx2_sim_cs(gpx2_sim_t *sim, bool level)
+{
+    if (!level && !sim->selected)
+    {
+        sim->selected = true;
+        sim->have_opcode = false;
+        sim->transactions++;
+    }
+    else if (level)
+    {
+        sim->selected = false;
+    }
+}
+
+static uint8_t sim_result_byte(gpx2_sim_t *sim)
+{
+    uint8_t off = sim->addr - RESULTS_FIRST;
+    int ch = off / 6;
+    int b = off % 6;
+    gpx2_sim_hit_t *l = &sim->latched[ch];
+    if (b == 0 && !sim->stuck)
+    {
+        // first byte of a slot pops the channel FIFO, an empty FIFO reads as zeros
+        gpx2_sim_fifo_t *f = &sim->fifo[ch];
+        if (f->count)
+        {
+            *l = f->hit[f->head];
+            f->head = (f->head + 1) % GPX2_SIM_FIFO_DEPTH;
+            f->count--;
+        }
+        else
+        {
+            l->ref = 0;
+            l->stop = 0;
+            sim->empty_slots++;
+        }
+    }
+    uint32_t v = b < 3 ? l->ref : l->stop;
+    return (v >> (8 * (2 - b % 3))) & 0xFF;
+}
+
+uint8_t gpx2_sim_xfer(gpx2_sim_t *sim, uint8_t mosi)
+{
+    if (!sim->selected)
+        return 0xFF;
+    sim->bytes++;
+
+    if (!sim->have_opcode)
+    {
+        sim->have_opcode = true;
+        sim->opcode = mosi;
+        sim->addr = mosi & 0x1F;
+        if (mosi == OPC_POWER_RESET)
+        {
+            gpx2_sim_glitch(sim);
+        }
+        else if (mosi == OPC_INIT)
+        {
+            sim->running = true;
+            sim->stuck = false;
+            sim->ref_epoch_ps = sim->now_ps;
+            sim_clear_fifos(sim);
+        }
+        else if ((mosi & 0xE0) == OPC_WRITE_CONFIG)
+        {
+            sim->config_writes++;
+        }
+        else if ((mosi & 0xE0) == OPC_READ_RESULTS)
+        {
+            sim->result_reads++;
+            if (sim->addr < RESULTS_FIRST)
+                sim->addr = RESULTS_FIRST;
+        }
+        return 0x00;
+    }
+
+    uint8_t miso = 0x00;
+    switch (sim->opcode & 0xE0)
+    {
+    case OPC_WRITE_CONFIG:
+        if (sim->addr < sizeof(sim->cfg))
+        {
+            sim->cfg[sim->addr] = mosi;
+            // REFCLK reset bit restarts the REF index
+            if (sim->addr == 0 && (mosi & (1 << 7)))
+                sim->ref_epoch_ps = sim->now_ps;
+        }
+        sim->addr++;
+        break;
+    case OPC_READ_CONFIG:
+        if (sim->addr < sizeof(sim->cfg))
+            miso = sim->cfg[sim->addr];
+        sim->addr++;
+        break;
+    case OPC_READ_RESULTS:
+        miso = sim_result_byte(sim);
+        sim->addr = (sim->addr == RESULTS_LAST) ? RESULTS_FIRST : sim->addr + 1;
+        break;
+    default:
+        break;
+    }
+    return miso;
+}
+
+void gpx2_sim_glitch(gpx2_sim_t *sim)
+{
+    memset(sim->cfg, 0, sizeof(sim->cfg));
+    sim->running = false;
+    sim->stuck = false;
+    sim_clear_fifos(sim);
+}
+
+void gpx2_sim_stall(gpx2_sim_t *sim)
+{
+    if (gpx2_sim_int(sim))
+        sim->int_falls++;
+    sim->stuck = true;
+}
+
+bool gpx2_sim_int(const gpx2_sim_t *sim)
+{
+    if (!sim->running)
+        return true;
+    if (sim->stuck)
+        return false;
+    for (int ch = 0; ch < GPX2_SIM_CHANNELS; ch++)
+    {
+        if (sim->fifo[ch].count)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef GPX2_SIM_H
+#define GPX2_SIM_H
+
+// behavioral model of a TDC-GPX2 as seen over SPI
+//  - opcodes 0x30 power reset, 0x18 init, 0x80|a write config,
+//    0x40|a read config, 0x60|a read results
+//  - 17 byte config register file, auto-increment addressing
+//  - 8 deep FIFO per channel, result registers 8..31 (REF/STOP per channel),
+//    the read address wraps from 31 back to 8
+//  - INT is low while any FIFO holds data
+//  - synthetic hit generator, poisson distributed at a configurable rate
+//  - optional nonlinear interpolator, STOP codes of sinusoidally varying width
+//  - faults: a stalled readout (INT stuck low, result slots repeat the last
+//    hit until OPC_INIT) and a glitch that loses config and run state
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GPX2_SIM_CHANNELS 4
+#define GPX2_SIM_FIFO_DEPTH 8
+
+typedef struct
+{
+    uint32_t ref;
+    uint32_t stop;
+} gpx2_sim_hit_t;
+
+typedef struct
+{
+    gpx2_sim_hit_t hit[GPX2_SIM_FIFO_DEPTH];
+    uint8_t head;
+    uint8_t count;
+} gpx2_sim_fifo_t;
+
+typedef struct
+{
+    double rate_hz;          // pulses per second, every enabled channel sees each pulse
+    uint32_t refclk_hz;      // reference clock feeding the REF index
+    uint32_t jitter_ps;      // rms timing jitter per channel
+    uint32_t delay_ps[GPX2_SIM_CHANNELS]; // fixed offset per channel
+    double dnl;              // code width variation of the interpolator (0..0.9), 0 = linear
+    uint64_t seed;
+} gpx2_sim_params_t;
+
+typedef struct
+{
+    gpx2_sim_params_t p;
+
+    uint8_t cfg[17];
+    bool running; // after OPC_INIT
+    bool stuck;   // stalled readout, cleared by OPC_INIT or power reset
+
+    // spi transaction state
+    bool selected;
+    bool have_opcode;
+    uint8_t opcode;
+    uint8_t addr;
+    gpx2_sim_hit_t latched[GPX2_SIM_CHANNELS]; // slot being clocked out
+
+    gpx2_sim_fifo_t fifo[GPX2_SIM_CHANNELS];
+
+    // time base, ps since power-up and since the last REF index reset
+    uint64_t now_ps;
+    uint64_t ref_epoch_ps;
+    uint64_t next_hit_ps;
+    uint64_t rng;
+
+    // counters
+    uint64_t pulses;         // generated pulses
+    uint64_t hits;           // hits stored in a FIFO
+    uint64_t hits_lost;      // hits lost to a full FIFO
+    uint64_t transactions;   // CS low periods
+    uint64_t bytes;          // bytes clocked in either direction
+    uint64_t result_reads;   // transactions with a read results opcode
+    uint64_t config_writes;  // transactions with a write config opcode
+    uint64_t empty_slots;    // result slots read while the FIFO was empty
+    uint64_t int_falls;      // INT falling edges
+} gpx2_sim_t;
+
+void gpx2_sim_init(gpx2_sim_t *sim, const gpx2_sim_params_t *params);
+// move simulated time forward, generating hits that became due
+void gpx2_sim_advance(gpx2_sim_t *sim, uint64_t now_ps);
+void gpx2_sim_cs(gpx2_sim_t *sim, bool level);
+// one full duplex byte
+uint8_t gpx2_sim_xfer(gpx2_sim_t *sim, uint8_t mosi);
+// INT pin level, low active
+bool gpx2_sim_int(const gpx2_sim_t *sim);
+// faults: config and run state lost (as after a power reset), readout stalled
+void gpx2_sim_glitch(gpx2_sim_t *sim);
+void gpx2_sim_stall(gpx2_sim_t *sim);
+
+#endif
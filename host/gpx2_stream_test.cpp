@@ -0,0 +1,255 @@
+// Binary frame stream (gpx2_stream.c) and the host parser (gpx2_parse.cpp):
+// records round trip, every single bit error is caught, sequence gaps and
+// garbage between frames are counted, and events read from a simulated chip
+// come back unchanged through frames fed to the parser in odd sized pieces.
+
+#include <algorithm>
+#include <vector>
+
+#include "gpx2_parse.h"
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_stream.h"
+}
+
+namespace {
+
+constexpr uint64_t REFCLK_PS = 200000; // 5 MHz
+constexpr uint32_t DIVISIONS = 200000; // CONFIG REFCLK_DIVISIONS, 1 ps
+
+struct Record
+{
+    uint8_t ch;
+    uint32_t ref, stop;
+};
+
+// event frames holding recs, appended to out
+void build(gpx2_stream_t &s, const std::vector<Record> &recs, std::vector<uint8_t> &out)
+{
+    auto flush = [&] {
+        size_t n = gpx2_stream_finish(&s);
+        out.insert(out.end(), s.buf, s.buf + n);
+    };
+    for (const Record &r : recs)
+    {
+        if (!gpx2_stream_add_event(&s, r.ch, r.ref, r.stop))
+        {
+            flush();
+            GPX2_CHECK(gpx2_stream_add_event(&s, r.ch, r.ref, r.stop));
+        }
+    }
+    flush();
+}
+
+std::vector<Record> random_records(size_t n, uint32_t seed)
+{
+    std::vector<Record> recs(n);
+    for (Record &r : recs)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        r.ch = (uint8_t)(seed >> 28);
+        seed = seed * 1664525u + 1013904223u;
+        r.ref = seed >> 8;
+        seed = seed * 1664525u + 1013904223u;
+        r.stop = seed >> 8;
+    }
+    return recs;
+}
+
+void round_trip()
+{
+    gpx2_stream_t s;
+    gpx2_stream_init(&s);
+    GPX2_CHECK_EQ(gpx2_stream_finish(&s), 0);
+
+    std::vector<Record> recs = random_records(1000, 1);
+    std::vector<uint8_t> bytes;
+    build(s, recs, bytes);
+
+    size_t pos = 0, got = 0;
+    uint32_t seq = 0;
+    while (pos < bytes.size())
+    {
+        gpx2_frame_view_t f;
+        GPX2_CHECK_EQ(gpx2_stream_parse(&bytes[pos], bytes.size() - pos, &f), GPX2_PARSE_OK);
+        GPX2_CHECK_EQ(f.type, GPX2_FRAME_EVENTS);
+        GPX2_CHECK_EQ(f.seq, seq++);
+        GPX2_CHECK_EQ(f.len % GPX2_EVENT_RECORD, 0);
+        GPX2_CHECK(f.len <= GPX2_FRAME_MAX_PAYLOAD);
+        for (size_t i = 0; i < f.len / GPX2_EVENT_RECORD; i++, got++)
+        {
+            uint8_t ch;
+            uint32_t ref, stop;
+            gpx2_stream_get_event(f.payload, i, &ch, &ref, &stop);
+            GPX2_CHECK_EQ(ch, recs[got].ch);
+            GPX2_CHECK_EQ(ref, recs[got].ref);
+            GPX2_CHECK_EQ(stop, recs[got].stop);
+        }
+        pos += f.size;
+    }
+    GPX2_CHECK_EQ(got, recs.size());
+    // full frames only but the last one
+    GPX2_CHECK_EQ(seq, (recs.size() + 63) / (GPX2_FRAME_MAX_PAYLOAD / GPX2_EVENT_RECORD));
+
+    // a frame of one type does not take records of another
+    gpx2_stream_init(&s);
+    GPX2_CHECK(gpx2_stream_add_time(&s, 3, 0x0123456789ABCDEFULL));
+    GPX2_CHECK(!gpx2_stream_add_event(&s, 0, 0, 0));
+    GPX2_CHECK(!gpx2_stream_add_dt(&s, 0, 1, 0));
+    size_t n = gpx2_stream_finish(&s);
+    gpx2_frame_view_t f;
+    GPX2_CHECK_EQ(gpx2_stream_parse(s.buf, n, &f), GPX2_PARSE_OK);
+    GPX2_CHECK_EQ(f.type, GPX2_FRAME_TIMES);
+    uint8_t ch;
+    uint64_t t;
+    gpx2_stream_get_time(f.payload, 0, &ch, &t);
+    GPX2_CHECK_EQ(ch, 3);
+    GPX2_CHECK(t == 0x0123456789ABCDEFULL);
+    GPX2_CHECK(gpx2_stream_add_dt(&s, 2, 7, -123456));
+    n = gpx2_stream_finish(&s);
+    GPX2_CHECK_EQ(gpx2_stream_parse(s.buf, n, &f), GPX2_PARSE_OK);
+    GPX2_CHECK_EQ(f.seq, 1);
+    uint8_t a, b;
+    int32_t dt;
+    gpx2_stream_get_dt(f.payload, 0, &a, &b, &dt);
+    GPX2_CHECK_EQ(a, 2);
+    GPX2_CHECK_EQ(b, 7);
+    GPX2_CHECK_EQ(dt, -123456);
+}
+
+// crc16-ccitt catches every single bit error, a broken sync or length is
+// never taken for a frame either
+void bit_errors()
+{
+    gpx2_stream_t s;
+    gpx2_stream_init(&s);
+    std::vector<uint8_t> frame;
+    build(s, random_records(10, 2), frame);
+    gpx2_frame_view_t f;
+    GPX2_CHECK_EQ(gpx2_stream_parse(frame.data(), frame.size(), &f), GPX2_PARSE_OK);
+    GPX2_CHECK_EQ(f.size, frame.size());
+    int accepted = 0;
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            std::vector<uint8_t> bad = frame;
+            bad[i] ^= (uint8_t)(1 << bit);
+            accepted += gpx2_stream_parse(bad.data(), bad.size(), &f) == GPX2_PARSE_OK;
+        }
+    }
+    GPX2_CHECK_EQ(accepted, 0);
+    frame[GPX2_FRAME_HEADER] ^= 0x10;
+    GPX2_CHECK_EQ(gpx2_stream_parse(frame.data(), frame.size(), &f), GPX2_PARSE_BAD_CRC);
+    GPX2_CHECK_EQ(gpx2_stream_parse(frame.data(), GPX2_FRAME_HEADER - 1, &f), GPX2_PARSE_NEED_MORE);
+    GPX2_CHECK_EQ(gpx2_stream_parse(frame.data() + 1, frame.size() - 1, &f), GPX2_PARSE_BAD_SYNC);
+}
+
+// lost frames show as sequence gaps, a corrupted one as a crc error plus a
+// gap, text and garbage in between do not cost any frame
+void parser_gaps()
+{
+    gpx2_stream_t s;
+    gpx2_stream_init(&s);
+    std::vector<Record> recs = random_records(64 * 10, 3);
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t i = 0; i < recs.size(); i += 64)
+    {
+        std::vector<uint8_t> one;
+        build(s, std::vector<Record>(recs.begin() + i, recs.begin() + i + 64), one);
+        frames.push_back(one);
+    }
+    std::vector<uint8_t> bytes;
+    const char text[] = "Menu\r\nACQ: read=1\n";
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        if (i == 2)
+            continue; // lost
+        std::vector<uint8_t> fr = frames[i];
+        if (i == 5)
+            fr[20] ^= 0x01; // corrupted
+        bytes.insert(bytes.end(), fr.begin(), fr.end());
+        if (i == 7)
+            bytes.insert(bytes.end(), text, text + sizeof text - 1);
+        if (i == 8)
+            bytes.insert(bytes.end(), {0xA5, 0x5A, 0x01, 0xFF});
+    }
+    gpx2::StreamParser p(REFCLK_PS, DIVISIONS);
+    std::vector<gpx2::Event> out;
+    p.feed(bytes.data(), bytes.size(), out);
+    p.finish(out);
+    GPX2_CHECK_EQ(p.stats().frames, 8);
+    GPX2_CHECK_EQ(p.stats().lost_frames, 2);
+    GPX2_CHECK(p.stats().crc_errors >= 1);
+    GPX2_CHECK_EQ(p.stats().frame_events, 8 * 64);
+    GPX2_CHECK_EQ(out.size(), 8 * 64);
+    GPX2_CHECK(p.stats().lines >= 2);
+}
+
+// hits read from a simulated chip, streamed the way designlab.c does in
+// output mode 1 and parsed back on the host side
+void chip_stream()
+{
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 2, 0x0F));
+    gpx2_dev_t *devs[1] = {&d};
+    std::vector<Record> sent;
+    gpx2_result_t res[GPX2_BURST_MAX];
+    while (sent.size() < 4000)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        int n = gpx2_dev_read_parallel(devs, 1, res);
+        for (int i = 0; i < n; i++)
+        {
+            for (uint8_t ch = 0; ch < GPX2_CHANNELS; ch++)
+            {
+                if (res[i].mask & (1 << ch))
+                    sent.push_back(Record{(uint8_t)(res[i].dev * GPX2_CHANNELS + ch), res[i].ref[ch], res[i].stop[ch]});
+            }
+        }
+    }
+    GPX2_CHECK(sent.size() >= 4000);
+    GPX2_CHECK_EQ(d.events, sent.size());
+
+    gpx2_stream_t s;
+    gpx2_stream_init(&s);
+    std::vector<uint8_t> bytes;
+    build(s, sent, bytes);
+
+    gpx2::StreamParser p(REFCLK_PS, DIVISIONS);
+    std::vector<gpx2::Event> out;
+    size_t chunk = 1;
+    for (size_t pos = 0; pos < bytes.size(); pos += chunk, chunk = chunk % 97 + 13)
+        p.feed(&bytes[pos], std::min(chunk, bytes.size() - pos), out);
+    p.finish(out);
+    GPX2_CHECK_EQ(p.stats().crc_errors, 0);
+    GPX2_CHECK_EQ(p.stats().lost_frames, 0);
+    GPX2_CHECK_EQ(out.size(), sent.size());
+    int64_t last_t[GPX2_CHANNELS * 4] = {};
+    size_t order = 0;
+    for (size_t i = 0; i < out.size() && i < sent.size(); i++)
+    {
+        GPX2_CHECK_EQ(out[i].channel, sent[i].ch);
+        GPX2_CHECK_EQ(out[i].ref, sent[i].ref);
+        GPX2_CHECK_EQ(out[i].stop, sent[i].stop);
+        GPX2_CHECK_EQ(out[i].t_ps, (int64_t)sent[i].ref * (int64_t)REFCLK_PS + sent[i].stop);
+        // a single run, time only moves forward per channel
+        order += out[i].t_ps <= last_t[out[i].channel];
+        last_t[out[i].channel] = out[i].t_ps;
+    }
+    GPX2_CHECK_EQ(order, 0);
+}
+
+} // namespace
+
+int main()
+{
+    round_trip();
+    bit_errors();
+    parser_gaps();
+    gpx2::test::sim_start(5000);
+    chip_stream();
+    return gpx2::test::finish("gpx2_stream_test");
+}
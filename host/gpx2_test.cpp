@@ -0,0 +1,75 @@
+#include "gpx2_test.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace gpx2::test {
+
+int checks = 0;
+int failures = 0;
+
+const uint8_t CONFIG[GPX2_CONFIG_BYTES] = {0x31, 0x01, 0x1F, 0x40, 0x0D, 0x03, 0xC0, 0x53, 0xA1,
+                                           0x13, 0x00, 0x0A, 0xCC, 0xCC, 0x31, 0x8E, 0x04};
+
+void fail(const char *file, int line, const char *expr)
+{
+    failures++;
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+}
+
+void fail_eq(const char *file, int line, const char *a, const char *b, long long va, long long vb)
+{
+    failures++;
+    std::fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", file, line, a, b, va, vb);
+}
+
+int finish(const char *name)
+{
+    std::printf("%s: %d checks, %d failed\n", name, checks, failures);
+    std::fflush(stdout);
+    return failures ? 1 : 0;
+}
+
+void sim_start(double rate_hz, double dnl)
+{
+    char v[32];
+    std::snprintf(v, sizeof v, "%g", rate_hz);
+    setenv("GPX2_SIM_RATE", v, 1);
+    std::snprintf(v, sizeof v, "%g", dnl);
+    setenv("GPX2_SIM_DNL", v, 1);
+    setenv("GPX2_SIM_SECONDS", "1e9", 1);
+    hal_console_init();
+}
+
+bool chip_start(gpx2_dev_t *d, uint8_t k, uint8_t mask, uint32_t spi_hz)
+{
+    uint8_t bus, cs, intr;
+    hal_sim_wiring(k, &bus, &cs, &intr);
+    gpx2_dev_init(d, k, bus, cs, intr);
+    hal_spi_init(bus, spi_hz, 0, 0, 0);
+    uint8_t cfg[GPX2_CONFIG_BYTES];
+    std::memcpy(cfg, CONFIG, sizeof cfg);
+    cfg[0] = (uint8_t)((cfg[0] & ~0x0F) | (mask & 0x0F));
+    cfg[1] = (uint8_t)((cfg[1] & ~0x0F) | (mask & 0x0F));
+    gpx2_dev_opcode(d, OPC_POWER_RESET);
+    gpx2_dev_write_config(d, cfg, 0, GPX2_CONFIG_BYTES);
+    if (!gpx2_dev_verify_config(d, cfg, 0, GPX2_CONFIG_BYTES))
+        return false;
+    gpx2_dev_config_commit(d, cfg, 0, GPX2_CONFIG_BYTES);
+    gpx2_dev_readout_setup(d, cfg, 1, spi_hz);
+    gpx2_dev_opcode(d, OPC_INIT);
+    return true;
+}
+
+bool wait_int(const gpx2_dev_t *d, uint32_t timeout_ms)
+{
+    uint64_t end = hal_time_us() + (uint64_t)timeout_ms * 1000;
+    while (!gpx2_dev_int(d))
+    {
+        if (hal_time_us() > end)
+            return false;
+    }
+    return true;
+}
+
+} // namespace gpx2::test
@@ -0,0 +1,58 @@
+#ifndef GPX2_TEST_H
+#define GPX2_TEST_H
+
+// shared bits of the host tests (ctest, see CMakeLists.txt): checks that count
+// failures instead of aborting, and the simulated chips of gpx2_hal_sim.c set
+// up the way designlab.c does it. A test's exit code is gpx2::test::finish().
+
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+#include "gpx2_dev.h"
+#include "gpx2_hal_sim.h"
+}
+
+namespace gpx2::test {
+
+extern int checks;
+extern int failures;
+
+void fail(const char *file, int line, const char *expr);
+void fail_eq(const char *file, int line, const char *a, const char *b, long long va, long long vb);
+// prints the tally, 0 when every check passed
+int finish(const char *name);
+
+// designlab.c power-up config (17 registers)
+extern const uint8_t CONFIG[GPX2_CONFIG_BYTES];
+
+// simulated chips with pulses at rate_hz (every enabled channel sees each
+// one, 1000 ps apart per channel and 500 ps per chip), STOP code widths
+// varying by +/- dnl; the run never ends on its own. Once per process.
+void sim_start(double rate_hz, double dnl = 0);
+// chip k of the wiring table configured with the STOP inputs in mask,
+// verified and measuring, read a frame at a time
+bool chip_start(gpx2_dev_t *d, uint8_t k, uint8_t mask, uint32_t spi_hz = 10000000);
+// wait until INT of d is low, false after timeout_ms
+bool wait_int(const gpx2_dev_t *d, uint32_t timeout_ms = 1000);
+
+} // namespace gpx2::test
+
+#define GPX2_CHECK(cond)                                       \
+    do                                                         \
+    {                                                          \
+        gpx2::test::checks++;                                  \
+        if (!(cond))                                           \
+            gpx2::test::fail(__FILE__, __LINE__, #cond);       \
+    } while (0)
+
+#define GPX2_CHECK_EQ(a, b)                                                                      \
+    do                                                                                           \
+    {                                                                                            \
+        gpx2::test::checks++;                                                                    \
+        long long va_ = (long long)(a), vb_ = (long long)(b);                                    \
+        if (va_ != vb_)                                                                          \
+            gpx2::test::fail_eq(__FILE__, __LINE__, #a, #b, va_, vb_);                           \
+    } while (0)
+
+#endif
@@ -0,0 +1,117 @@
+// Compare the firmware's text outputs on the host: the printf line per
+// channel of output mode 0 against the table based CSV emitter (gpx2_text.c)
+// of output mode 3, both writing synthetic result frames to a file.
+//
+//   gpx2_text_bench [frames] [out]
+//
+// out defaults to /dev/null. On the target the same comparison is the OUTPUT
+// stage of the T report with output mode 0 vs 3.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include "gpx2_text.h"
+}
+
+namespace {
+
+std::vector<gpx2_result_t> make_frames(size_t n)
+{
+    // 4 channels, REF counting up like a 5 MHz REFCLK at ~20 kHz pulse rate
+    std::vector<gpx2_result_t> frames(n);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    uint32_t ref = 1;
+    for (auto &f : frames)
+    {
+        ref += 200 + (uint32_t)(rng >> 56);
+        for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+        {
+            rng ^= rng >> 12;
+            rng ^= rng << 25;
+            rng ^= rng >> 27;
+            f.ref[ch] = ref & 0xFFFFFF;
+            f.stop[ch] = (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32) % 200000;
+        }
+        f.mask = 0x0F;
+        f.dev = 0;
+    }
+    return frames;
+}
+
+// designlab.c gpx2_print_results()
+long run_printf(std::FILE *out, const std::vector<gpx2_result_t> &frames)
+{
+    long bytes = 0;
+    for (const auto &res : frames)
+    {
+        for (int ch = 0; ch < 4; ch++)
+        {
+            if (!(res.mask & (1 << ch)))
+                continue;
+            bytes += std::fprintf(out, "CH%d: REF=%lu   STOP=%lu\n", ch + 1,
+                                  (unsigned long)res.ref[ch], (unsigned long)res.stop[ch]);
+        }
+    }
+    return bytes;
+}
+
+// designlab.c output mode 3
+long run_csv(std::FILE *out, const std::vector<gpx2_result_t> &frames)
+{
+    static gpx2_text_t text;
+    long bytes = 0;
+    gpx2_text_init(&text);
+    for (const auto &res : frames)
+    {
+        if (!gpx2_text_room(&text))
+        {
+            bytes += (long)std::fwrite(text.buf, 1, text.len, out);
+            text.len = 0;
+        }
+        gpx2_text_add_frame(&text, &res, nullptr, 0x0F);
+    }
+    return bytes + (long)std::fwrite(text.buf, 1, text.len, out);
+}
+
+template <typename F>
+double seconds(F &&f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 1000000;
+    const char *path = argc > 2 ? argv[2] : "/dev/null";
+    std::FILE *out = std::fopen(path, "w");
+    if (!out)
+    {
+        std::cerr << "cannot create " << path << "\n";
+        return 2;
+    }
+    // unbuffered like the usb console, every call is a write
+    std::setvbuf(out, nullptr, _IONBF, 0);
+    auto frames = make_frames(n);
+
+    long bytes_printf = 0, bytes_csv = 0;
+    double t_printf = seconds([&] { bytes_printf = run_printf(out, frames); });
+    double t_csv = seconds([&] { bytes_csv = run_csv(out, frames); });
+    std::fclose(out);
+
+    double events = 4.0 * n;
+    std::printf("printf: %.3f s, %.0f lines/s, %.0f events/s, %ld bytes\n", t_printf,
+                events / t_printf, events / t_printf, bytes_printf);
+    std::printf("csv:    %.3f s, %.0f lines/s, %.0f events/s, %ld bytes\n", t_csv,
+                n / t_csv, events / t_csv, bytes_csv);
+    std::printf("speedup %.1fx in events/s\n", t_printf / t_csv);
+    return 0;
+}
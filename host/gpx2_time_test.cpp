@@ -0,0 +1,164 @@
+// REF/STOP to picoseconds (gpx2_time.c): the Q16 STOP scaling against an
+// exact 128 bit reference, REF unwrap across rollovers with out of order
+// channels and silent gaps, and hits from a simulated chip with a fast REFCLK
+// so REF wraps a few times during the test.
+
+#include <cstdlib>
+
+#include "gpx2_test.h"
+
+extern "C" {
+#include "gpx2_time.h"
+}
+
+namespace {
+
+gpx2_time_t tm;
+
+uint64_t exact_stop_ps(uint32_t period_ps, uint32_t divisions, uint32_t stop)
+{
+    unsigned __int128 num = (unsigned __int128)stop * period_ps * 2 + divisions;
+    return (uint64_t)(num / ((unsigned __int128)divisions * 2));
+}
+
+void stop_scaling()
+{
+    GPX2_CHECK(!gpx2_time_setup(&tm, 0, 1000));
+    GPX2_CHECK(!gpx2_time_setup(&tm, 1000, 0));
+
+    // REFCLK_DIVISIONS equal to the period: STOP is already in ps
+    GPX2_CHECK(gpx2_time_setup(&tm, 200000, 200000));
+    GPX2_CHECK_EQ(tm.stop_q16, 0);
+    GPX2_CHECK_EQ(gpx2_time_stop_ps(&tm, 123456), 123456);
+
+    const uint32_t periods[] = {20000, 40000, 100000, 125000, 200000, 1000000};
+    const uint32_t divisions[] = {1000, 3333, 8192, 50000, 200000, 1000000, 1u << 22};
+    for (uint32_t p : periods)
+    {
+        for (uint32_t div : divisions)
+        {
+            GPX2_CHECK(gpx2_time_setup(&tm, p, div));
+            // the Q16 factor is off by at most half an LSB, which adds up
+            // over the STOP range to divisions / 2^17 ps
+            uint64_t tol = 1 + div / (1u << 17);
+            uint64_t worst = 0;
+            for (uint32_t stop = 0; stop < div; stop += 1 + div / 5000)
+            {
+                uint64_t want = exact_stop_ps(p, div, stop);
+                uint64_t got = gpx2_time_stop_ps(&tm, stop);
+                uint64_t err = got > want ? got - want : want - got;
+                worst = err > worst ? err : worst;
+            }
+            GPX2_CHECK(worst <= tol);
+            GPX2_CHECK(gpx2_time_stop_ps(&tm, div - 1) < p + tol);
+        }
+    }
+}
+
+// the true extended REF runs on for several wraps; hits of four channels come
+// a little out of order, with host time jitter and silent stretches
+void unwrap()
+{
+    const uint32_t period = 200000; // 5 MHz, a wrap every 3.36 s
+    GPX2_CHECK(gpx2_time_setup(&tm, period, period));
+
+    // before the first rollover a REF below the first one is not a wrap
+    GPX2_CHECK_EQ(gpx2_time_unwrap(&tm, 5000, 1000), 5000);
+    GPX2_CHECK_EQ(gpx2_time_unwrap(&tm, 4000, 1000), 4000);
+    GPX2_CHECK_EQ(tm.wraps, 0);
+
+    gpx2_time_reset(&tm);
+    uint64_t ext = 1000, wrong = 0;
+    uint32_t s = 7;
+    for (int n = 0; n < 200000; n++)
+    {
+        s = s * 1664525u + 1013904223u;
+        // mostly short steps, now and then a gap of up to 1.2 s
+        uint64_t step = (s >> 28) == 0 ? (s >> 8) % 6000000 : (s >> 16) % 2000;
+        ext += step;
+        for (int ch = 0; ch < 4; ch++)
+        {
+            s = s * 1664525u + 1013904223u;
+            uint64_t hit = ext > 50 ? ext - (s >> 26) : ext; // up to 63 REFs late
+            int64_t jitter_us = (int64_t)((s >> 8) % 20001) - 10000;
+            int64_t now_us = (int64_t)(ext * period / 1000000) + jitter_us;
+            uint64_t got = gpx2_time_unwrap(&tm, (uint32_t)hit & GPX2_REF_MASK, now_us < 0 ? 0 : (uint64_t)now_us);
+            wrong += got != hit;
+        }
+    }
+    GPX2_CHECK_EQ(wrong, 0);
+    GPX2_CHECK(ext >> GPX2_REF_BITS >= 10);
+    GPX2_CHECK_EQ(tm.wraps, tm.ref_last >> GPX2_REF_BITS);
+
+    // absolute ps of an extended REF against 128 bit math
+    GPX2_CHECK(gpx2_time_setup(&tm, 125000, 100000));
+    gpx2_time_unwrap(&tm, 0, 0);
+    uint64_t ref = (5ULL << GPX2_REF_BITS) + 777;
+    uint64_t now_us = ref * 125000 / 1000000;
+    uint64_t t_ps = gpx2_time_ps(&tm, (uint32_t)ref & GPX2_REF_MASK, 99999, now_us);
+    uint64_t want = (uint64_t)((unsigned __int128)ref * 125000) + exact_stop_ps(125000, 100000, 99999);
+    GPX2_CHECK(t_ps + 1 >= want && t_ps <= want + 1);
+}
+
+// a simulated chip with a 50 MHz REFCLK wraps REF every 0.34 s; the channels
+// of one pulse are 1000 ps apart and the pulses keep pace with the host clock
+void chip_times()
+{
+    const uint32_t period = 20000;
+    gpx2_dev_t d;
+    GPX2_CHECK(gpx2::test::chip_start(&d, 0, 0x0F));
+    // CONFIG keeps REFCLK_DIVISIONS at 200000, 0.1 ps per STOP LSB here
+    GPX2_CHECK(gpx2_time_setup(&tm, period, 200000));
+    gpx2_dev_t *devs[1] = {&d};
+    gpx2_result_t res[GPX2_BURST_MAX];
+    int64_t offset = 0;
+    bool have_offset = false;
+    uint64_t frames = 0, bad_dt = 0, bad_pace = 0, last_t = 0, backwards = 0;
+    uint64_t end_us = hal_time_us() + 1200000;
+    while (hal_time_us() < end_us)
+    {
+        if (!gpx2::test::wait_int(&d))
+            break;
+        int n = gpx2_dev_read_parallel(devs, 1, res);
+        uint64_t now_us = hal_time_us();
+        for (int i = 0; i < n; i++)
+        {
+            if (res[i].mask != 0x0F)
+                continue;
+            uint64_t t[GPX2_CHANNELS];
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++)
+                t[ch] = gpx2_time_ps(&tm, res[i].ref[ch], res[i].stop[ch], now_us);
+            for (int ch = 1; ch < GPX2_CHANNELS; ch++)
+                bad_dt += std::llabs((int64_t)(t[ch] - t[0]) - 1000 * ch) > 150;
+            backwards += t[0] <= last_t;
+            last_t = t[0];
+            // the chip's time runs with the host clock from OPC_INIT on, the
+            // read comes after the pulse by far less than a REF wrap (0.34 s)
+            int64_t off = (int64_t)now_us * 1000000 - (int64_t)t[0];
+            if (!have_offset)
+            {
+                offset = off;
+                have_offset = true;
+            }
+            bad_pace += std::llabs(off - offset) > 100000000000LL;
+            frames++;
+        }
+    }
+    GPX2_CHECK(frames >= 1000);
+    GPX2_CHECK_EQ(bad_dt, 0);
+    GPX2_CHECK_EQ(backwards, 0);
+    GPX2_CHECK_EQ(bad_pace, 0);
+    GPX2_CHECK(tm.wraps >= 3);
+}
+
+} // namespace
+
+int main()
+{
+    stop_scaling();
+    unwrap();
+    setenv("GPX2_SIM_REFCLK_HZ", "50000000", 1);
+    gpx2::test::sim_start(2000);
+    chip_times();
+    return gpx2::test::finish("gpx2_time_test");
+}
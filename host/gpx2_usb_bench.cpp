@@ -0,0 +1,251 @@
+// Event data throughput over the CDC console vs the bulk endpoint.
+//
+//   gpx2_usb_bench [seconds]
+//   gpx2_usb_bench --tty /dev/ttyACM0 [--device /dev/bus/usb/BBB/DDD] [seconds]
+//
+// With --tty the firmware must be measuring in a binary output mode (E: 1, 4
+// or 5) with its event data on the console, at a rate above what the link
+// takes. The console is read for the given seconds (default 5), then U moves
+// the data to the bulk endpoint, which is read through usbfs as long, and a
+// second U moves it back.
+//
+// Without --tty a loopback stand-in runs on the host alone: a writer thread
+// encodes event frames (mode 1, gpx2_stream.h) as fast as it can and writes
+// them the way the two firmware paths hand them to USB, 64 byte CDC packets
+// into a pty that is read in raw mode like /dev/ttyACM*, and HAL_BULK_BUFFER
+// transfers into a pipe. That covers the host side of both paths and checks
+// that every frame arrives; the bus itself (12 Mbit/s full speed either way)
+// is not modelled.
+//
+// Every side is parsed with gpx2_parse.h and reported as MB/s, events/s,
+// frames, CRC errors, lost frames and bytes per read. Exit code is 1 when a
+// loopback side loses or corrupts frames, 2 when a device cannot be opened.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "gpx2_parse.h"
+#include "gpx2_usbfs.h"
+
+extern "C" {
+#include "gpx2_hal.h"
+#include "gpx2_stream.h"
+#include "gpx2_usb.h"
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint64_t REFCLK_PS = 200000; // menu 8 default, STOP in ps
+constexpr size_t READ_CHUNK = 1 << 16;
+
+struct Result
+{
+    double seconds = 0;
+    uint64_t reads = 0;
+    gpx2::ParseStats stats;
+};
+
+// read src until the deadline, parsing as it comes
+Result measure(gpx2::ByteSource &src, double seconds)
+{
+    Result r;
+    gpx2::StreamParser parser(REFCLK_PS, (uint32_t)REFCLK_PS);
+    std::vector<uint8_t> buf(READ_CHUNK);
+    std::vector<gpx2::Event> events;
+    auto t0 = Clock::now();
+    auto deadline = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    while (Clock::now() < deadline)
+    {
+        long n = src.read(buf.data(), buf.size(), 50);
+        if (n < 0)
+            break;
+        if (n == 0)
+            continue;
+        r.reads++;
+        events.clear();
+        parser.feed(buf.data(), (size_t)n, events);
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    r.stats = parser.stats();
+    return r;
+}
+
+void print(const char *name, const Result &r)
+{
+    const gpx2::ParseStats &s = r.stats;
+    std::printf("%-5s %8.2f MB %7.2f MB/s %7.3f Mev/s  frames=%llu crc_errors=%llu lost=%llu  %llu reads, %.0f bytes/read\n",
+                name, s.bytes * 1e-6, s.bytes / r.seconds * 1e-6, s.frame_events / r.seconds * 1e-6,
+                (unsigned long long)s.frames, (unsigned long long)s.crc_errors,
+                (unsigned long long)s.lost_frames, (unsigned long long)r.reads,
+                r.reads ? (double)s.bytes / (double)r.reads : 0.0);
+}
+
+// loopback writer: frames of 4 channel events, written chunk bytes at a time
+void produce(int fd, size_t chunk, std::atomic<bool> &stop)
+{
+    static gpx2_stream_t s; // one writer at a time
+    gpx2_stream_init(&s);
+    std::vector<uint8_t> pending;
+    uint32_t n = 0;
+    while (!stop)
+    {
+        while (pending.size() < chunk)
+        {
+            for (int ch = 0; ch < GPX2_CHANNELS; ch++, n++)
+            {
+                if (!gpx2_stream_add_event(&s, (uint8_t)ch, n & 0xFFFFFF, n % REFCLK_PS))
+                {
+                    size_t size = gpx2_stream_finish(&s);
+                    pending.insert(pending.end(), s.buf, s.buf + size);
+                    gpx2_stream_add_event(&s, (uint8_t)ch, n & 0xFFFFFF, n % REFCLK_PS);
+                }
+            }
+        }
+        size_t done = 0;
+        while (done + chunk <= pending.size() && !stop)
+        {
+            pollfd pfd{fd, POLLOUT, 0};
+            if (poll(&pfd, 1, 50) <= 0)
+                continue;
+            ssize_t w = write(fd, pending.data() + done, chunk);
+            if (w < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                stop = true;
+                break;
+            }
+            done += (size_t)w;
+        }
+        pending.erase(pending.begin(), pending.begin() + (long)done);
+    }
+}
+
+Result loopback(const char *name, int write_fd, gpx2::FdReader &reader, size_t chunk, double seconds)
+{
+    std::atomic<bool> stop{false};
+    std::thread writer(produce, write_fd, chunk, std::ref(stop));
+    Result r = measure(reader, seconds);
+    stop = true;
+    writer.join();
+    print(name, r);
+    return r;
+}
+
+bool intact(const Result &r)
+{
+    return r.stats.frames > 0 && r.stats.crc_errors == 0 && r.stats.lost_frames == 0;
+}
+
+int run_loopback(double seconds)
+{
+    // CDC stand-in: the pty master plays the device, the slave is the tty
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        std::perror("pty");
+        return 2;
+    }
+    gpx2::FdReader tty;
+    if (!tty.open(ptsname(master)))
+    {
+        std::fprintf(stderr, "%s\n", tty.error().c_str());
+        return 2;
+    }
+    Result cdc = loopback("cdc", master, tty, GPX2_USB_BULK_PACKET, seconds);
+    close(master);
+
+    // bulk stand-in: a pipe, one write per transfer
+    int p[2];
+    if (pipe(p) != 0)
+    {
+        std::perror("pipe");
+        return 2;
+    }
+    fcntl(p[1], F_SETPIPE_SZ, 2 * HAL_BULK_BUFFER);
+    gpx2::FdReader bulk;
+    bulk.attach(p[0]);
+    Result blk = loopback("bulk", p[1], bulk, HAL_BULK_BUFFER, seconds);
+    close(p[1]);
+
+    std::printf("bulk/cdc %.2fx\n", (double)blk.stats.bytes / blk.seconds / ((double)cdc.stats.bytes / cdc.seconds));
+    return intact(cdc) && intact(blk) ? 0 : 1;
+}
+
+int run_device(const std::string &tty_path, std::string device, double seconds)
+{
+    int fd = open(tty_path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    termios tio;
+    if (fd < 0 || tcgetattr(fd, &tio) != 0)
+    {
+        std::fprintf(stderr, "%s: %s\n", tty_path.c_str(), std::strerror(errno));
+        return 2;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIFLUSH);
+    gpx2::FdReader tty;
+    tty.attach(fd);
+
+    if (device.empty())
+        device = gpx2::find_usb_device(GPX2_USB_VID, GPX2_USB_PID);
+    gpx2::UsbfsReader bulk;
+    if (device.empty() || !bulk.open(device, GPX2_USB_ITF_BULK, GPX2_USB_EP_BULK_IN))
+    {
+        std::fprintf(stderr, "%s\n", device.empty() ? "no usb device" : bulk.error().c_str());
+        return 2;
+    }
+
+    Result cdc = measure(tty, seconds);
+    print("cdc", cdc);
+    if (write(fd, "U", 1) != 1)
+        return 2;
+    Result blk = measure(bulk, seconds);
+    print("bulk", blk);
+    if (write(fd, "U", 1) != 1)
+        return 2;
+    if (cdc.stats.bytes > 0)
+        std::printf("bulk/cdc %.2fx\n", (double)blk.stats.bytes / blk.seconds / ((double)cdc.stats.bytes / cdc.seconds));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double seconds = 5;
+    std::string tty, device;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a == "--tty" && i + 1 < argc)
+            tty = argv[++i];
+        else if (a == "--device" && i + 1 < argc)
+            device = argv[++i];
+        else if (std::atof(argv[i]) > 0)
+            seconds = std::atof(argv[i]);
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--tty /dev/ttyACM0 [--device /dev/bus/usb/BBB/DDD]] [seconds]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+    return tty.empty() ? run_loopback(seconds) : run_device(tty, device, seconds);
+}
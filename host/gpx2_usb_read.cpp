@@ -0,0 +1,189 @@
+// Read event data from the designlab bulk endpoint (menu R / U) into a file.
+//
+//   gpx2_usb_read [--device /dev/bus/usb/BBB/DDD | --id vid:pid] [--loopback path]
+//                 [--seconds s] [--bytes n] [--urbs n] [--urb-size n] out|-
+//
+// The device is opened through usbfs (gpx2_usbfs.h), by default the first
+// one with the firmware's VID:PID (gpx2_usb.h), and interface 2 is claimed
+// while the console stays with the CDC driver on /dev/ttyACM*. --loopback
+// reads a file or fifo instead, e.g. the GPX2_SIM_BULK fifo of designlab_sim:
+//
+//   mkfifo /tmp/bulk; gpx2_usb_read --loopback /tmp/bulk out.bin &
+//   GPX2_SIM_BULK=/tmp/bulk designlab_sim < keys
+//
+// The data is written as it comes, the binary frames of output modes 1, 4
+// and 5 (and csv text of mode 3); pipe it to gpx2_host capture - or
+// gpx2_decode. Stops at the end of the input, after --seconds or --bytes, or
+// on Ctrl-C, and reports bytes, rate and transfers on stderr.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gpx2_usbfs.h"
+
+extern "C" {
+#include "gpx2_usb.h"
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> interrupted{false};
+
+void on_sigint(int)
+{
+    interrupted = true;
+}
+
+struct Options
+{
+    std::string device;
+    uint16_t vid = GPX2_USB_VID, pid = GPX2_USB_PID;
+    std::string loopback;
+    double seconds = 0;
+    uint64_t max_bytes = 0;
+    unsigned urbs = 8;
+    size_t urb_size = 16384;
+    std::string out;
+};
+
+bool parse_options(int argc, char **argv, Options &o)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a.rfind("--", 0) != 0)
+        {
+            if (!o.out.empty())
+                return false;
+            o.out = a;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *v = argv[++i];
+        if (a == "--device")
+            o.device = v;
+        else if (a == "--id")
+        {
+            unsigned x, y;
+            if (std::sscanf(v, "%x:%x", &x, &y) != 2)
+                return false;
+            o.vid = (uint16_t)x;
+            o.pid = (uint16_t)y;
+        }
+        else if (a == "--loopback")
+            o.loopback = v;
+        else if (a == "--seconds")
+            o.seconds = std::atof(v);
+        else if (a == "--bytes")
+            o.max_bytes = std::strtoull(v, nullptr, 0);
+        else if (a == "--urbs")
+            o.urbs = (unsigned)std::strtoul(v, nullptr, 0);
+        else if (a == "--urb-size")
+            o.urb_size = std::strtoul(v, nullptr, 0);
+        else
+            return false;
+    }
+    return !o.out.empty() && o.urbs > 0 && o.urb_size > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (!parse_options(argc, argv, o))
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [--device /dev/bus/usb/BBB/DDD | --id vid:pid] [--loopback path]\n"
+                     "       [--seconds s] [--bytes n] [--urbs n] [--urb-size n] out|-\n";
+        return 1;
+    }
+
+    std::unique_ptr<gpx2::ByteSource> src;
+    std::string name;
+    if (!o.loopback.empty())
+    {
+        auto f = std::make_unique<gpx2::FdReader>();
+        if (!f->open(o.loopback))
+        {
+            std::cerr << f->error() << "\n";
+            return 2;
+        }
+        name = o.loopback;
+        src = std::move(f);
+    }
+    else
+    {
+        name = o.device.empty() ? gpx2::find_usb_device(o.vid, o.pid) : o.device;
+        if (name.empty())
+        {
+            char id[16];
+            std::snprintf(id, sizeof id, "%04x:%04x", o.vid, o.pid);
+            std::cerr << "no usb device " << id << "\n";
+            return 2;
+        }
+        auto u = std::make_unique<gpx2::UsbfsReader>();
+        if (!u->open(name, GPX2_USB_ITF_BULK, GPX2_USB_EP_BULK_IN, o.urbs, o.urb_size))
+        {
+            std::cerr << u->error() << "\n";
+            return 2;
+        }
+        src = std::move(u);
+    }
+
+    std::FILE *out = o.out == "-" ? stdout : std::fopen(o.out.c_str(), "wb");
+    if (!out)
+    {
+        std::cerr << "cannot create " << o.out << ": " << std::strerror(errno) << "\n";
+        return 2;
+    }
+    std::signal(SIGINT, on_sigint);
+
+    std::vector<uint8_t> buf(std::max<size_t>(o.urb_size, 1 << 16));
+    uint64_t bytes = 0, reads = 0;
+    auto t0 = Clock::now();
+    auto deadline = o.seconds > 0 ? t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.seconds))
+                                  : Clock::time_point::max();
+    bool failed = false;
+    while (!interrupted && Clock::now() < deadline && (o.max_bytes == 0 || bytes < o.max_bytes))
+    {
+        long n = src->read(buf.data(), buf.size(), 100);
+        if (n < 0)
+        {
+            failed = !src->error().empty();
+            break;
+        }
+        if (n == 0)
+            continue;
+        if (std::fwrite(buf.data(), 1, (size_t)n, out) != (size_t)n)
+        {
+            std::cerr << "write " << o.out << ": " << std::strerror(errno) << "\n";
+            return 2;
+        }
+        bytes += (uint64_t)n;
+        reads++;
+    }
+    double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    if (out != stdout)
+        std::fclose(out);
+    else
+        std::fflush(out);
+    if (failed)
+        std::cerr << name << ": " << src->error() << "\n";
+    std::cerr << name << ": " << bytes << " bytes in " << s << " s, " << (s > 0 ? bytes / s * 1e-6 : 0.0)
+              << " MB/s, " << reads << " reads of " << (reads ? bytes / reads : 0) << " bytes\n";
+    return failed ? 2 : 0;
+}
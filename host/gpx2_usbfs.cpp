@@ -0,0 +1,273 @@
+#include "gpx2_usbfs.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace gpx2 {
+
+namespace {
+
+bool read_sysfs(const std::string &path, unsigned long &value, int base)
+{
+    std::ifstream f(path);
+    std::string s;
+    if (!(f >> s))
+        return false;
+    char *end;
+    value = std::strtoul(s.c_str(), &end, base);
+    return *end == '\0';
+}
+
+} // namespace
+
+std::string find_usb_device(uint16_t vid, uint16_t pid)
+{
+    const std::string root = "/sys/bus/usb/devices/";
+    DIR *dir = opendir(root.c_str());
+    if (!dir)
+        return "";
+    std::string found;
+    while (dirent *d = readdir(dir))
+    {
+        // devices only, interfaces (1-1:1.0) have no idVendor
+        std::string base = root + d->d_name + "/";
+        unsigned long v, p, bus, dev;
+        if (read_sysfs(base + "idVendor", v, 16) && read_sysfs(base + "idProduct", p, 16) && v == vid &&
+            p == pid && read_sysfs(base + "busnum", bus, 10) && read_sysfs(base + "devnum", dev, 10))
+        {
+            char path[32];
+            std::snprintf(path, sizeof path, "/dev/bus/usb/%03lu/%03lu", bus, dev);
+            found = path;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+UsbfsReader::~UsbfsReader()
+{
+    close();
+}
+
+bool UsbfsReader::open(const std::string &path, unsigned interface, uint8_t endpoint, unsigned urbs,
+                       size_t urb_size)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    interface_ = interface;
+    endpoint_ = endpoint;
+    // a vendor interface normally has no kernel driver, unbind one if it does
+    usbdevfs_ioctl cmd{(int)interface, USBDEVFS_DISCONNECT, nullptr};
+    ioctl(fd_, USBDEVFS_IOCTL, &cmd);
+    if (ioctl(fd_, USBDEVFS_CLAIMINTERFACE, &interface) < 0)
+    {
+        error_ = "claim interface " + std::to_string(interface) + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    claimed_ = true;
+    urbs_.assign(urbs ? urbs : 1, usbdevfs_urb{});
+    buffers_.assign(urbs_.size(), std::vector<uint8_t>(urb_size));
+    for (size_t i = 0; i < urbs_.size(); i++)
+    {
+        if (!submit(i))
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool UsbfsReader::submit(size_t i)
+{
+    usbdevfs_urb &u = urbs_[i];
+    std::memset(&u, 0, sizeof u);
+    u.type = USBDEVFS_URB_TYPE_BULK;
+    u.endpoint = endpoint_;
+    u.buffer = buffers_[i].data();
+    u.buffer_length = (int)buffers_[i].size();
+    u.usercontext = reinterpret_cast<void *>(i);
+    if (ioctl(fd_, USBDEVFS_SUBMITURB, &u) < 0)
+    {
+        error_ = std::string("submit urb: ") + std::strerror(errno);
+        return false;
+    }
+    queued_++;
+    return true;
+}
+
+void UsbfsReader::close()
+{
+    if (fd_ < 0)
+        return;
+    // cancel what is queued and reap it before the buffers go away
+    for (auto &u : urbs_)
+        ioctl(fd_, USBDEVFS_DISCARDURB, &u);
+    while (queued_ > 0)
+    {
+        usbdevfs_urb *u = nullptr;
+        if (ioctl(fd_, USBDEVFS_REAPURB, &u) < 0)
+            break;
+        queued_--;
+    }
+    if (claimed_)
+        ioctl(fd_, USBDEVFS_RELEASEINTERFACE, &interface_);
+    claimed_ = false;
+    queued_ = 0;
+    ::close(fd_);
+    fd_ = -1;
+}
+
+long UsbfsReader::read(uint8_t *dst, size_t cap, int timeout_ms)
+{
+    if (fd_ < 0 || queued_ == 0)
+    {
+        if (error_.empty())
+            error_ = "not open";
+        return -1;
+    }
+    if (cap < buffers_[0].size())
+    {
+        error_ = "read buffer smaller than a transfer";
+        return -1;
+    }
+    // usbfs reports reapable urbs as writable
+    pollfd pfd{fd_, POLLOUT, 0};
+    int r = poll(&pfd, 1, timeout_ms);
+    if (r < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+        error_ = std::string("poll: ") + std::strerror(errno);
+        return -1;
+    }
+    if (r == 0)
+        return 0;
+    usbdevfs_urb *u = nullptr;
+    if (ioctl(fd_, USBDEVFS_REAPURBNDELAY, &u) < 0)
+    {
+        if (errno == EAGAIN)
+            return 0;
+        error_ = errno == ENODEV ? "device disconnected" : std::string("reap urb: ") + std::strerror(errno);
+        return -1;
+    }
+    queued_--;
+    size_t i = reinterpret_cast<size_t>(u->usercontext);
+    long n = 0;
+    if (u->status == -EPIPE)
+    {
+        unsigned ep = endpoint_;
+        ioctl(fd_, USBDEVFS_CLEAR_HALT, &ep);
+    }
+    else if (u->status == -ENODEV || u->status == -ESHUTDOWN)
+    {
+        error_ = "device disconnected";
+        return -1;
+    }
+    else if (u->status != 0)
+    {
+        error_ = std::string("bulk transfer: ") + std::strerror(-u->status);
+        return -1;
+    }
+    else
+    {
+        n = u->actual_length;
+        std::memcpy(dst, buffers_[i].data(), (size_t)n);
+        transfers_++;
+    }
+    if (!submit(i))
+        return -1;
+    return n;
+}
+
+FdReader::~FdReader()
+{
+    close();
+}
+
+bool FdReader::open(const std::string &path)
+{
+    close();
+    if (path == "-")
+    {
+        fd_ = STDIN_FILENO;
+        return true;
+    }
+    int fd = ::open(path.c_str(), O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    attach(fd);
+    termios tio;
+    if (isatty(fd_) && tcgetattr(fd_, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd_, TCSANOW, &tio);
+    }
+    return true;
+}
+
+void FdReader::attach(int fd)
+{
+    close();
+    fd_ = fd;
+    own_ = true;
+}
+
+void FdReader::close()
+{
+    if (fd_ >= 0 && own_)
+        ::close(fd_);
+    fd_ = -1;
+    own_ = false;
+}
+
+long FdReader::read(uint8_t *dst, size_t cap, int timeout_ms)
+{
+    pollfd pfd{fd_, POLLIN, 0};
+    int r = poll(&pfd, 1, timeout_ms);
+    if (r < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+        error_ = std::string("poll: ") + std::strerror(errno);
+        return -1;
+    }
+    if (r == 0)
+        return 0;
+    ssize_t n = ::read(fd_, dst, cap);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if (n <= 0)
+    {
+        // EIO: the other side of a pty closed
+        if (n < 0 && errno != EIO)
+            error_ = std::string("read: ") + std::strerror(errno);
+        return -1;
+    }
+    return (long)n;
+}
+
+} // namespace gpx2
@@ -0,0 +1,92 @@
+#ifndef GPX2_USBFS_H
+#define GPX2_USBFS_H
+
+// event data from the firmware's bulk endpoint (gpx2_usb.h) without libusb,
+// straight through linux usbfs (/dev/bus/usb/BBB/DDD, needs write access to
+// the node, e.g. a udev rule for the VID/PID)
+//
+// UsbfsReader claims the vendor interface and keeps a ring of bulk IN URBs
+// queued, so the device always has a transfer to send into while the last
+// one is being copied out. FdReader reads a file, fifo, pipe or tty with the
+// same interface: the stand-in for the endpoint on the host (designlab_sim's
+// GPX2_SIM_BULK) and the CDC console side of gpx2_usb_bench.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <linux/usbdevice_fs.h>
+
+namespace gpx2 {
+
+class ByteSource
+{
+public:
+    virtual ~ByteSource() = default;
+    // up to cap bytes; 0 when nothing came within timeout_ms, -1 at end of
+    // input (error() empty) or on an error
+    virtual long read(uint8_t *dst, size_t cap, int timeout_ms) = 0;
+    const std::string &error() const { return error_; }
+
+protected:
+    std::string error_;
+};
+
+// /dev/bus/usb path of the first device with vid:pid in /sys/bus/usb/devices,
+// empty when there is none
+std::string find_usb_device(uint16_t vid, uint16_t pid);
+
+class UsbfsReader : public ByteSource
+{
+public:
+    UsbfsReader() = default;
+    UsbfsReader(const UsbfsReader &) = delete;
+    UsbfsReader &operator=(const UsbfsReader &) = delete;
+    ~UsbfsReader() override;
+
+    // urbs transfers of urb_size bytes in flight
+    bool open(const std::string &path, unsigned interface, uint8_t endpoint, unsigned urbs = 8,
+              size_t urb_size = 16384);
+    void close();
+    long read(uint8_t *dst, size_t cap, int timeout_ms) override;
+
+    uint64_t transfers() const { return transfers_; }
+
+private:
+    bool submit(size_t i);
+
+    int fd_ = -1;
+    unsigned interface_ = 0;
+    uint8_t endpoint_ = 0;
+    bool claimed_ = false;
+    std::vector<usbdevfs_urb> urbs_;
+    std::vector<std::vector<uint8_t>> buffers_;
+    size_t queued_ = 0;
+    uint64_t transfers_ = 0;
+};
+
+class FdReader : public ByteSource
+{
+public:
+    FdReader() = default;
+    FdReader(const FdReader &) = delete;
+    FdReader &operator=(const FdReader &) = delete;
+    ~FdReader() override;
+
+    // "-" is stdin; a tty is put into raw mode
+    bool open(const std::string &path);
+    // takes over fd
+    void attach(int fd);
+    void close();
+    long read(uint8_t *dst, size_t cap, int timeout_ms) override;
+    int fd() const { return fd_; }
+
+private:
+    int fd_ = -1;
+    bool own_ = false;
+};
+
+} // namespace gpx2
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+// TinyUSB device config of the composite device (gpx2_usb.h). The build links
+// tinyusb_device itself, so the SDK's stdio_usb config and descriptors step
+// aside and these are used instead; stdio_usb still runs the CDC console and
+// tud_task() from its background irq (CMakeLists.txt).
+
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 1
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+
+// the event data interface is an application driver (gpx2_hal_pico.c) that
+// hands whole HAL_BULK_BUFFER buffers to the endpoint, not the vendor class
+// with its packet sized fifo
+#define CFG_TUD_VENDOR 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MSC 0
+#define CFG_TUD_MIDI 0
+
+#endif
@@ -0,0 +1,102 @@
+// descriptors of the composite device: CDC console + vendor bulk IN for
+// event data, layout in gpx2_usb.h
+#include "tusb.h"
+#include "pico/unique_id.h"
+#include "gpx2_usb.h"
+
+#include <string.h>
+
+enum
+{
+    STR_LANGID = 0,
+    STR_MANUFACTURER,
+    STR_PRODUCT,
+    STR_SERIAL,
+    STR_CDC,
+    STR_BULK,
+};
+
+static const tusb_desc_device_t device_desc = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // interface association descriptors around the CDC pair
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = GPX2_USB_VID,
+    .idProduct = GPX2_USB_PID,
+    .bcdDevice = GPX2_USB_BCD_DEVICE,
+    .iManufacturer = STR_MANUFACTURER,
+    .iProduct = STR_PRODUCT,
+    .iSerialNumber = STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+// vendor interface with a single bulk IN endpoint
+#define GPX2_BULK_DESC_LEN (9 + 7)
+#define GPX2_BULK_DESCRIPTOR(itf, stridx, epin, epsize)                                 \
+    9, TUSB_DESC_INTERFACE, itf, 0, 1, TUSB_CLASS_VENDOR_SPECIFIC, 0x00, 0x00, stridx, \
+        7, TUSB_DESC_ENDPOINT, epin, TUSB_XFER_BULK, U16_TO_U8S_LE(epsize), 0
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + GPX2_BULK_DESC_LEN)
+
+static const uint8_t config_desc[] = {
+    TUD_CONFIG_DESCRIPTOR(1, GPX2_USB_ITF_COUNT, 0, CONFIG_TOTAL_LEN, 0, 250),
+    TUD_CDC_DESCRIPTOR(GPX2_USB_ITF_CDC, STR_CDC, GPX2_USB_EP_CDC_NOTIF, 8, GPX2_USB_EP_CDC_OUT,
+                       GPX2_USB_EP_CDC_IN, 64),
+    GPX2_BULK_DESCRIPTOR(GPX2_USB_ITF_BULK, STR_BULK, GPX2_USB_EP_BULK_IN, GPX2_USB_BULK_PACKET),
+};
+
+static const char *const strings[] = {
+    [STR_MANUFACTURER] = "Raspberry Pi",
+    [STR_PRODUCT] = "designlab GPX2",
+    [STR_SERIAL] = NULL, // unique board id
+    [STR_CDC] = "designlab console",
+    [STR_BULK] = "designlab event data",
+};
+
+const uint8_t *tud_descriptor_device_cb(void)
+{
+    return (const uint8_t *)&device_desc;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index)
+{
+    (void)index;
+    return config_desc;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+    (void)langid;
+    static uint16_t desc[32];
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *s;
+    size_t n;
+
+    if (index == STR_LANGID)
+    {
+        desc[1] = 0x0409; // english
+        n = 1;
+    }
+    else
+    {
+        if (index >= sizeof(strings) / sizeof(strings[0]))
+            return NULL;
+        s = strings[index];
+        if (index == STR_SERIAL)
+        {
+            pico_get_unique_board_id_string(serial, sizeof serial);
+            s = serial;
+        }
+        n = strlen(s);
+        if (n > 31)
+            n = 31;
+        for (size_t i = 0; i < n; i++)
+            desc[1 + i] = (uint8_t)s[i];
+    }
+    desc[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * n + 2));
+    return desc;
+}